@@ -440,6 +440,55 @@ int mio_cmd_kvs_del_pairs(struct mio_kvs_id *kid,
 	return rc;
 }
 
+/*
+ * Keys in [start_kno, start_kno + nr_pairs). Keys are compared as
+ * strings, so all key numbers should have the same number of digits.
+ */
+static int kvs_range(struct mio_kvs_id *kid, int start_kno, int nr_pairs,
+		     uint64_t *count)
+{
+	int rc;
+	char start[KVS_MAX_KEY_LEN];
+	char end[KVS_MAX_KEY_LEN];
+	struct kvs_id_uint128 id128;
+	struct mio_op op;
+
+	kvs_id_to_uint128(&id128, kid);
+	sprintf(start, "%"PRIx64":%"PRIx64":%d",
+		id128.k_hi, id128.k_lo, start_kno);
+	sprintf(end, "%"PRIx64":%"PRIx64":%d",
+		id128.k_hi, id128.k_lo, start_kno + nr_pairs);
+
+	mio_op_init(&op);
+	if (count == NULL)
+		rc = mio_kvs_del_range(kid, start, strlen(start) + 1,
+				       end, strlen(end) + 1, &op);
+	else
+		rc = mio_kvs_count_range(kid, start, strlen(start) + 1,
+					 end, strlen(end) + 1, count, &op);
+	if (rc != 0)
+		return rc;
+
+	rc = mio_cmd_wait_on_op(&op);
+	if (rc < 0)
+		fprintf(stderr, "Failed in %s kv pairs in range!\n",
+			count == NULL? "deleting" : "counting");
+	mio_op_fini(&op);
+	return rc;
+}
+
+int mio_cmd_kvs_del_range(struct mio_kvs_id *kid,
+			  int start_kno, int nr_pairs)
+{
+	return kvs_range(kid, start_kno, nr_pairs, NULL);
+}
+
+int mio_cmd_kvs_count_range(struct mio_kvs_id *kid,
+			    int start_kno, int nr_pairs, uint64_t *count)
+{
+	return kvs_range(kid, start_kno, nr_pairs, count);
+}
+
 int mio_cmd_kvs_args_init(int argc, char **argv,
 			  struct mio_cmd_kvs_params *params,
 			  void (*usage)(FILE *, char *))
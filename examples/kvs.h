@@ -48,6 +48,10 @@ int mio_cmd_kvs_list_pairs(struct mio_kvs_id *kid,
 			   int start_kno, int nr_pairs, FILE *log);
 int mio_cmd_kvs_del_pairs(struct mio_kvs_id *kid,
 			  int start_kno, int nr_pairs, FILE *log);
+int mio_cmd_kvs_del_range(struct mio_kvs_id *kid,
+			  int start_kno, int nr_pairs);
+int mio_cmd_kvs_count_range(struct mio_kvs_id *kid,
+			    int start_kno, int nr_pairs, uint64_t *count);
 
 #endif /* __KVS_H__ */
 
@@ -194,6 +194,114 @@ comp_obj_list_extents(struct mio_obj *obj, int nr_layers, int nr_exts)
 	return rc;
 }
 
+static int comp_obj_layer_exts_update(struct mio_obj *obj,
+				      struct mio_obj_id *layer_id,
+				      int nr_exts, struct mio_obj_ext *exts,
+				      bool add)
+{
+	int rc;
+	struct mio_op op;
+
+	mio_op_init(&op);
+	rc = (add? mio_composite_obj_add_extents(obj, layer_id,
+						 nr_exts, exts, &op) :
+		   mio_composite_obj_del_extents(obj, layer_id,
+						 nr_exts, exts, &op))? :
+	     mio_cmd_wait_on_op(&op);
+	mio_op_fini(&op);
+	return rc;
+}
+
+/* Checks that a layer has exactly the extents expected. */
+static int comp_obj_layer_exts_check(struct mio_obj *obj,
+				     struct mio_obj_id *layer_id,
+				     int nr_exp, struct mio_obj_ext *exp)
+{
+	int i;
+	int rc;
+	int nr_ret_exts = 0;
+	struct mio_obj_ext exts[8];
+	struct mio_op op;
+
+	mio_op_init(&op);
+	rc = mio_composite_obj_get_extents(obj, layer_id, 0, 8, exts,
+					   &nr_ret_exts, &op)? :
+	     mio_cmd_wait_on_op(&op);
+	mio_op_fini(&op);
+	if (rc < 0)
+		return rc;
+
+	if (nr_ret_exts != nr_exp)
+		return -EPROTO;
+	for (i = 0; i < nr_exp; i++)
+		if (exts[i].moe_off != exp[i].moe_off ||
+		    exts[i].moe_size != exp[i].moe_size)
+			return -EPROTO;
+	return 0;
+}
+
+/**
+ * Exercises how extent records are planned on the first layer, which
+ * covers [0, 16M) on entry and again on return:
+ *  - deleting the middle of an extent before the layer is in the
+ *    extent map splits the record;
+ *  - adding extents overlapping one record once the layer is in the
+ *    map leaves the record as it is;
+ *  - adding the missing piece merges the records back into one.
+ */
+static int comp_obj_plan_extents(struct mio_obj *obj)
+{
+	int rc;
+	size_t len;
+	struct mio_obj_id layer_id;
+	struct mio_obj_id lookup_id;
+	struct mio_obj_ext mid[1] = {{4 << 20, 4 << 20}};
+	struct mio_obj_ext split[2] = {{0, 4 << 20}, {8 << 20, 8 << 20}};
+	struct mio_obj_ext overlap[2] = {{1 << 20, 1 << 20},
+					 {5 << 19, 1 << 20}};
+	struct mio_obj_ext whole[1] = {{0, 16 << 20}};
+
+	layer_ids_get(&obj->mo_id, 1, &layer_id);
+
+	rc = comp_obj_layer_exts_update(obj, &layer_id, 1, mid, false)? :
+	     comp_obj_layer_exts_check(obj, &layer_id, 2, split);
+	if (rc < 0)
+		return rc;
+
+	/* Looking up the start of the object loads the extent map. */
+	rc = mio_composite_obj_map_lookup(obj, 0, 1, &lookup_id, &len);
+	if (rc < 0 && rc != -ENOENT)
+		return rc;
+
+	return comp_obj_layer_exts_update(obj, &layer_id, 2, overlap, true)? :
+	       comp_obj_layer_exts_check(obj, &layer_id, 2, split)? :
+	       comp_obj_layer_exts_update(obj, &layer_id, 1, mid, true)? :
+	       comp_obj_layer_exts_check(obj, &layer_id, 1, whole);
+}
+
+/* Walk through the extents of all layers merged by priority. */
+static int comp_obj_scan_extents(struct mio_obj *obj)
+{
+	int rc;
+	struct mio_obj_ext ext;
+	struct mio_obj_id layer_id;
+	struct mio_comp_obj_ext_iter *iter;
+
+	rc = mio_composite_obj_ext_iter_init(obj, NULL, &iter);
+	if (rc < 0)
+		return rc;
+
+	while ((rc = mio_composite_obj_ext_iter_next(iter, &ext,
+						     &layer_id)) == 0) {
+		fprintf(stderr, "(%ld, %ld) from layer ",
+			ext.moe_off, ext.moe_size);
+		obj_id_printf(&layer_id);
+		fprintf(stderr, "\n");
+	}
+	mio_composite_obj_ext_iter_fini(iter);
+	return rc == -ENOENT? 0 : rc;
+}
+
 static int
 comp_obj_alloc_layers(struct mio_obj_id *oid,
 		      struct mio_comp_obj_layer **layers,
@@ -393,6 +501,19 @@ int main(int argc, char **argv)
 	if (rc < 0)
 		goto exit;
 
+	fprintf(stderr, "4.1 Scan extents of the object ...\n");
+	rc = comp_obj_scan_extents(&obj);
+	if (rc < 0)
+		goto exit;
+
+	fprintf(stderr, "4.2 Plan extent records ...");
+	rc = comp_obj_plan_extents(&obj);
+	if (rc < 0) {
+		fprintf(stderr, "failed!\n");
+		goto exit;
+	} else
+		fprintf(stderr, "success!\n");
+
 	fprintf(stderr, "5. Del extents of layers ...");
 	rc = comp_obj_del_extents(&obj, 1, 1);
 	if (rc < 0) {
@@ -88,12 +88,6 @@ hsm_make_oid(struct mio_obj_id *oid, int idx)
 	mio_cmd_obj_id_clone(&hsm_params.cop_oid, oid, idx, 0);
 }
 
-static void
-hsm_make_tmp_oid(struct mio_obj_id *oid)
-{
-	mio_cmd_obj_id_clone(&hsm_params.cop_oid, oid, 0, 0x1000);
-}
-
 static int hsm_create_objs()
 {
 	int i;
@@ -247,8 +241,8 @@ hsm_obj_if_move(struct mio_obj_id *oid, uint64_t hotness)
 static int hsm_move_one(struct mio_obj_id *oid)
 {
 	int rc;
-	struct mio_obj_id tmp_oid;
 	struct mio_cmd_obj_hint chint;
+	struct mio_pool_id pool_id;
 
 	/*
 	 * 0. Get the hotness of the object. Then use it to check which
@@ -266,27 +260,14 @@ static int hsm_move_one(struct mio_obj_id *oid)
 		return 0;
 	}
 
-	/* 1. Create a tmp object and copy data to it. */
-	hsm_make_tmp_oid(&tmp_oid);
-	rc = mio_cmd_obj_copy(oid, NULL, &tmp_oid,
-			      hsm_params.cop_block_size, NULL);
-	if (rc < 0)
-		return rc;
-
-	/* 2. Delete the original object. */
-	rc = mio_cmd_obj_unlink(oid);
+	/*
+	 * 1. Migrate the object to the new pool. The object keeps its id
+	 * and data is moved in the background.
+	 */
+	pool_id = mio_obj_hotness_to_pool_id(chint.co_hvalue);
+	rc = mio_obj_migrate(oid, &pool_id);
 	if (rc < 0)
-		return rc;
-
-	/* 3. Create a new object with the same `to` id but in different pool. */
-	rc = mio_cmd_obj_copy(&tmp_oid, NULL, oid,
-			      hsm_params.cop_block_size, &chint);
-	if (rc < 0) {
-		fprintf(stderr, "Failed to move object back to new pool!");
-		return rc;
-	}
-
-	rc = mio_cmd_obj_unlink(&tmp_oid);
+		fprintf(stderr, "Failed to migrate object to new pool!\n");
 	return rc;
 }
 
@@ -0,0 +1,227 @@
+/* -*- C -*- */
+/*
+ * Copyright: (c) 2020 - 2021 Seagate Technology LLC and/or its its Affiliates,
+ * All Rights Reserved
+ *
+ * This software is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "obj.h"
+#include "helpers.h"
+
+enum {
+	/* Below and above MOTR_INLINE_DATA_THRESHOLD. */
+	INLINE_SMALL_SIZE = 1024,
+	INLINE_LARGE_SIZE = 64 * 1024,
+};
+
+static void inline_usage(FILE *file, char *prog_name)
+{
+	fprintf(file, "Usage: %s [OPTION]...\n"
+"Check objects keeping their data inline: creating them, writing, reading\n"
+"and growing them past MOTR_INLINE_DATA_THRESHOLD, which has to be set in\n"
+"the configuration. Objects OID and OID+1 are used.\n"
+"\n"
+"Mandatory arguments to long options are mandatory for short options too.\n"
+"  -o, --object         OID       ID of the first Motr object\n"
+"  -y, --mio_conf_file            MIO YAML configuration file\n"
+"  -h, --help                     shows this help text and exit\n"
+, prog_name);
+}
+
+/*
+ * Create an object by mio_obj_create() alone, without opening it first
+ * as obj_create() does, so that the existence check is MIO's own.
+ */
+static int inline_obj_create(struct mio_obj_id *oid, struct mio_obj *obj)
+{
+	int rc;
+	struct mio_op op;
+
+	memset(obj, 0, sizeof *obj);
+	mio_op_init(&op);
+	rc = mio_obj_create(oid, NULL, NULL, obj, &op)? :
+	     mio_cmd_wait_on_op(&op);
+	mio_op_fini(&op);
+	return rc;
+}
+
+static int inline_obj_create_excl(struct mio_obj_id *oid)
+{
+	int rc;
+	struct mio_obj obj;
+
+	rc = inline_obj_create(oid, &obj);
+	if (rc == 0) {
+		obj_close(&obj);
+		fprintf(stderr, "Object created over an existing one!\n");
+		return -EINVAL;
+	}
+	return rc == -EEXIST? 0 : rc;
+}
+
+static int inline_obj_io(struct mio_obj *obj, bool is_write,
+			 char *buf, uint64_t off, size_t len)
+{
+	struct mio_iovec iov = {
+		.miov_base = buf,
+		.miov_off = off,
+		.miov_len = len,
+	};
+
+	return is_write? obj_write(obj, 1, &iov) : obj_read(obj, 1, &iov);
+}
+
+static int inline_obj_cmp(struct mio_obj *obj, char *data, size_t len)
+{
+	int rc;
+	char *buf;
+
+	buf = malloc(len);
+	if (buf == NULL)
+		return -ENOMEM;
+
+	rc = inline_obj_io(obj, false, buf, 0, len);
+	if (rc == 0 && memcmp(buf, data, len) != 0) {
+		fprintf(stderr, "Data read isn't the data written!\n");
+		rc = -EIO;
+	}
+	free(buf);
+	return rc;
+}
+
+/*
+ * An object created as a store entity, by mio_objs_create(), has no
+ * attribute record yet: creating it again must fail all the same.
+ */
+static int inline_entity_check(struct mio_obj_id *oid, char *data)
+{
+	int rc;
+	int32_t rcs[1];
+	struct mio_obj objs[1];
+	struct mio_op op;
+
+	memset(objs, 0, sizeof objs);
+	mio_op_init(&op);
+	rc = mio_objs_create(1, oid, NULL, NULL, objs, rcs, &op)? :
+	     mio_cmd_wait_on_op(&op)? : rcs[0];
+	mio_op_fini(&op);
+	if (rc < 0)
+		return rc;
+
+	rc = inline_obj_create_excl(oid)? :
+	     inline_obj_io(objs, true, data, 0, INLINE_SMALL_SIZE)? :
+	     inline_obj_cmp(objs, data, INLINE_SMALL_SIZE);
+	obj_close(objs);
+	obj_rm(oid);
+	return rc;
+}
+
+/*
+ * An object written below the threshold keeps its data inline, growing
+ * it past the threshold moves the data to a store entity.
+ */
+static int inline_promote_check(struct mio_obj_id *oid, char *data)
+{
+	int rc;
+	struct mio_obj obj;
+
+	rc = inline_obj_create(oid, &obj);
+	if (rc < 0)
+		return rc;
+
+	rc = inline_obj_create_excl(oid)? :
+	     inline_obj_io(&obj, true, data, 0, INLINE_SMALL_SIZE)? :
+	     inline_obj_cmp(&obj, data, INLINE_SMALL_SIZE);
+	obj_close(&obj);
+	if (rc < 0)
+		goto exit;
+
+	/* Reopened, the data is read from the attribute record. */
+	rc = obj_open(oid, &obj);
+	if (rc < 0)
+		goto exit;
+	rc = inline_obj_cmp(&obj, data, INLINE_SMALL_SIZE)? :
+	     inline_obj_io(&obj, true, data + INLINE_SMALL_SIZE,
+			   INLINE_SMALL_SIZE,
+			   INLINE_LARGE_SIZE - INLINE_SMALL_SIZE)? :
+	     inline_obj_cmp(&obj, data, INLINE_LARGE_SIZE);
+	obj_close(&obj);
+	if (rc < 0)
+		goto exit;
+
+	rc = obj_open(oid, &obj);
+	if (rc < 0)
+		goto exit;
+	rc = inline_obj_cmp(&obj, data, INLINE_LARGE_SIZE);
+	obj_close(&obj);
+
+exit:
+	if (rc == 0)
+		return obj_rm(oid);
+	obj_rm(oid);
+	return rc;
+}
+
+static int obj_inline_check(struct mio_obj_id *oid)
+{
+	int i;
+	int rc;
+	char *data;
+	struct mio_obj_id oids[2];
+
+	data = malloc(INLINE_LARGE_SIZE);
+	if (data == NULL)
+		return -ENOMEM;
+	for (i = 0; i < INLINE_LARGE_SIZE; i++)
+		data[i] = mio_cmd_random(256);
+
+	for (i = 0; i < 2; i++)
+		mio_cmd_obj_id_clone(oid, oids + i, 0, i);
+	rc = inline_entity_check(oids + 0, data)? :
+	     inline_promote_check(oids + 1, data);
+
+	free(data);
+	return rc;
+}
+
+int main(int argc, char **argv)
+{
+	int rc;
+	struct mio_cmd_obj_params inline_params;
+
+	mio_cmd_obj_args_init(argc, argv, &inline_params, &inline_usage);
+
+	rc = mio_init(inline_params.cop_conf_fname);
+	if (rc < 0) {
+		mio_cmd_error("Initialising MIO failed", rc);
+		exit(EXIT_FAILURE);
+	}
+
+	rc = obj_inline_check(&inline_params.cop_oid);
+	if (rc < 0)
+		mio_cmd_error("Checking inline objects failed", rc);
+
+	mio_fini();
+	mio_cmd_obj_args_fini(&inline_params);
+	return rc;
+}
+
+/*
+ *  Local variables:
+ *  c-indentation-style: "K&R"
+ *  c-basic-offset: 8
+ *  tab-width: 8
+ *  fill-column: 80
+ *  scroll-step: 1
+ *  End:
+ */
+/*
+ * vim: tabstop=8 shiftwidth=8 noexpandtab textwidth=80 nowrap
+ */
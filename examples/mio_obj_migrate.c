@@ -0,0 +1,146 @@
+/* -*- C -*- */
+/*
+ * Copyright: (c) 2020 - 2021 Seagate Technology LLC and/or its its Affiliates,
+ * All Rights Reserved
+ *
+ * This software is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "obj.h"
+#include "helpers.h"
+
+enum {
+	/* In seconds. */
+	MIGRATE_WAIT_MAX = 300,
+};
+
+static void migrate_usage(FILE *file, char *prog_name)
+{
+	fprintf(file, "Usage: %s [OPTION]...\n"
+"Migrate an object to another pool and wait until its data has moved.\n"
+"\n"
+"Mandatory arguments to long options are mandatory for short options too.\n"
+"  -o, --object         OID       ID of the Motr object\n"
+"  -p, --pool           PID       ID of the target pool\n"
+"  -y, --mio_conf_file            MIO YAML configuration file\n"
+"  -h, --help                     shows this help text and exit\n"
+, prog_name);
+}
+
+/*
+ * A migration is over once the composite object serving the migrated
+ * object is left with its top and move layers only.
+ */
+static int migrate_wait(struct mio_obj *cobj)
+{
+	int i;
+	int rc;
+	int nr_layers = 0;
+	struct mio_comp_obj_layout layout;
+	struct mio_op op;
+
+	for (i = 0; i < MIGRATE_WAIT_MAX; i++) {
+		memset(&layout, 0, sizeof layout);
+		mio_op_init(&op);
+		rc = mio_composite_obj_list_layers_revalidate(cobj, &layout,
+							      &op)? :
+		     mio_cmd_wait_on_op(&op);
+		mio_op_fini(&op);
+		if (rc < 0)
+			return rc;
+		nr_layers = layout.mlo_nr_layers;
+		free(layout.mlo_layers);
+		if (nr_layers <= 2)
+			return 0;
+		sleep(1);
+	}
+
+	fprintf(stderr, "Migration not done after %d seconds, %d layers!\n",
+		MIGRATE_WAIT_MAX, nr_layers);
+	return -ETIMEDOUT;
+}
+
+static int obj_migrate(struct mio_obj_id *oid, struct mio_pool_id *pool_id)
+{
+	int rc;
+	struct mio_obj obj;
+	struct mio_obj cobj;
+	struct mio_pool_id obj_pool_id;
+
+	rc = mio_obj_migrate(oid, pool_id);
+	if (rc < 0)
+		return rc;
+
+	memset(&obj, 0, sizeof obj);
+	rc = mio_cmd_obj_open(oid, &obj);
+	if (rc < 0)
+		return rc;
+
+	rc = mio_obj_pool_id(&obj, &obj_pool_id);
+	if (rc < 0)
+		goto exit;
+	if (!mio_obj_pool_id_cmp(&obj_pool_id, pool_id) ||
+	    !obj.mo_attrs.moa_redirected) {
+		fprintf(stderr, "Object isn't in the target pool!\n");
+		rc = -EINVAL;
+		goto exit;
+	}
+
+	memset(&cobj, 0, sizeof cobj);
+	rc = mio_cmd_obj_open(&obj.mo_attrs.moa_redirect, &cobj);
+	if (rc < 0)
+		goto exit;
+	rc = migrate_wait(&cobj);
+	mio_cmd_obj_close(&cobj);
+
+exit:
+	mio_cmd_obj_close(&obj);
+	return rc;
+}
+
+int main(int argc, char **argv)
+{
+	int rc;
+	struct mio_cmd_obj_params migrate_params;
+
+	mio_cmd_obj_args_init(argc, argv, &migrate_params, &migrate_usage);
+	if (migrate_params.cop_pool_id.mpi_hi == 0 &&
+	    migrate_params.cop_pool_id.mpi_lo == 0) {
+		migrate_usage(stderr, argv[0]);
+		exit(EXIT_FAILURE);
+	}
+
+	rc = mio_init(migrate_params.cop_conf_fname);
+	if (rc < 0) {
+		mio_cmd_error("Initialising MIO failed", rc);
+		exit(EXIT_FAILURE);
+	}
+
+	rc = obj_migrate(&migrate_params.cop_oid, &migrate_params.cop_pool_id);
+	if (rc < 0)
+		mio_cmd_error("Migrating the object failed", rc);
+
+	mio_fini();
+	mio_cmd_obj_args_fini(&migrate_params);
+	return rc;
+}
+
+/*
+ *  Local variables:
+ *  c-indentation-style: "K&R"
+ *  c-basic-offset: 8
+ *  tab-width: 8
+ *  fill-column: 80
+ *  scroll-step: 1
+ *  End:
+ */
+/*
+ * vim: tabstop=8 shiftwidth=8 noexpandtab textwidth=80 nowrap
+ */
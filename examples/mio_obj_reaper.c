@@ -0,0 +1,169 @@
+/* -*- C -*- */
+/*
+ * Copyright: (c) 2020 - 2021 Seagate Technology LLC and/or its its Affiliates,
+ * All Rights Reserved
+ *
+ * This software is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "obj.h"
+#include "helpers.h"
+
+enum {
+	/* In seconds. */
+	REAPER_LIFETIME_SHORT = 5,
+	REAPER_LIFETIME_LONG = 3600,
+	REAPER_WAIT_MAX = 120,
+};
+
+static void reaper_usage(FILE *file, char *prog_name)
+{
+	fprintf(file, "Usage: %s [OPTION]...\n"
+"Check that expired objects, and only them, are deleted by the reaper.\n"
+"MIO_OBJ_REAPER has to be set in the configuration. Objects OID to OID+2\n"
+"are used.\n"
+"\n"
+"Mandatory arguments to long options are mandatory for short options too.\n"
+"  -o, --object         OID       ID of the first Motr object\n"
+"  -y, --mio_conf_file            MIO YAML configuration file\n"
+"  -h, --help                     shows this help text and exit\n"
+, prog_name);
+}
+
+static int reaper_obj_create(struct mio_obj_id *oid, uint64_t lifetime)
+{
+	int rc;
+	struct mio_obj obj;
+	struct mio_cmd_obj_hint chint = {
+		.co_hkey = MIO_HINT_OBJ_LIFETIME,
+		.co_hvalue = lifetime,
+	};
+
+	memset(&obj, 0, sizeof obj);
+	rc = obj_create(NULL, oid, &obj, &chint);
+	if (rc < 0)
+		return rc;
+	obj_close(&obj);
+	return 0;
+}
+
+static int reaper_obj_lifetime_set(struct mio_obj_id *oid, uint64_t lifetime)
+{
+	int rc;
+	struct mio_obj obj;
+	struct mio_hints hints;
+
+	memset(&obj, 0, sizeof obj);
+	rc = obj_open(oid, &obj);
+	if (rc < 0)
+		return rc;
+
+	mio_hints_init(&hints);
+	rc = mio_hint_add(&hints, MIO_HINT_OBJ_LIFETIME, lifetime)? :
+	     mio_obj_hints_set(&obj, &hints);
+	mio_hints_fini(&hints);
+	obj_close(&obj);
+	return rc;
+}
+
+static int reaper_obj_exists(struct mio_obj_id *oid)
+{
+	int rc;
+	struct mio_obj obj;
+
+	memset(&obj, 0, sizeof obj);
+	rc = obj_open(oid, &obj);
+	if (rc == 0)
+		obj_close(&obj);
+	return rc;
+}
+
+/*
+ * Object 0 expires soon. Object 1 expires much later. Object 2 was to
+ * expire soon, but its lifetime has been extended, so its first record
+ * in the expiry index is stale. Only object 0 is to be deleted.
+ */
+static int obj_reaper_check(struct mio_obj_id *oid)
+{
+	int i;
+	int rc;
+	uint64_t now = time(NULL);
+	struct mio_obj_id oids[3];
+
+	for (i = 0; i < 3; i++)
+		mio_cmd_obj_id_clone(oid, oids + i, 0, i);
+
+	rc = reaper_obj_create(oids + 0, now + REAPER_LIFETIME_SHORT)? :
+	     reaper_obj_create(oids + 1, now + REAPER_LIFETIME_LONG)? :
+	     reaper_obj_create(oids + 2, now + REAPER_LIFETIME_SHORT)? :
+	     reaper_obj_lifetime_set(oids + 2, now + REAPER_LIFETIME_LONG);
+	if (rc < 0)
+		goto exit;
+
+	for (i = 0; i < REAPER_WAIT_MAX; i++) {
+		rc = reaper_obj_exists(oids + 0);
+		if (rc != 0)
+			break;
+		sleep(1);
+	}
+	if (rc == 0) {
+		fprintf(stderr, "Expired object not deleted after %d seconds!\n",
+			REAPER_WAIT_MAX);
+		rc = -ETIMEDOUT;
+		goto exit;
+	} else if (rc != -ENOENT)
+		goto exit;
+
+	rc = reaper_obj_exists(oids + 1)? :
+	     reaper_obj_exists(oids + 2);
+	if (rc == -ENOENT)
+		fprintf(stderr, "Object not expired deleted!\n");
+
+exit:
+	for (i = 0; i < 3; i++)
+		obj_rm(oids + i);
+	return rc;
+}
+
+int main(int argc, char **argv)
+{
+	int rc;
+	struct mio_cmd_obj_params reaper_params;
+
+	mio_cmd_obj_args_init(argc, argv, &reaper_params, &reaper_usage);
+
+	rc = mio_init(reaper_params.cop_conf_fname);
+	if (rc < 0) {
+		mio_cmd_error("Initialising MIO failed", rc);
+		exit(EXIT_FAILURE);
+	}
+
+	rc = obj_reaper_check(&reaper_params.cop_oid);
+	if (rc < 0)
+		mio_cmd_error("Checking the object reaper failed", rc);
+
+	mio_fini();
+	mio_cmd_obj_args_fini(&reaper_params);
+	return rc;
+}
+
+/*
+ *  Local variables:
+ *  c-indentation-style: "K&R"
+ *  c-basic-offset: 8
+ *  tab-width: 8
+ *  fill-column: 80
+ *  scroll-step: 1
+ *  End:
+ */
+/*
+ * vim: tabstop=8 shiftwidth=8 noexpandtab textwidth=80 nowrap
+ */
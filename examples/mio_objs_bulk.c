@@ -0,0 +1,236 @@
+/* -*- C -*- */
+/*
+ * Copyright: (c) 2020 - 2021 Seagate Technology LLC and/or its its Affiliates,
+ * All Rights Reserved
+ *
+ * This software is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "obj.h"
+#include "helpers.h"
+
+static void bulk_usage(FILE *file, char *prog_name)
+{
+	fprintf(file, "Usage: %s [OPTION]...\n"
+"Check creating, opening and deleting objects in bulk, the result of each\n"
+"object included. Objects OID to OID+N-1 are created, OID+N never is and\n"
+"an id reserved by the object store is passed along as a bad one.\n"
+"\n"
+"Mandatory arguments to long options are mandatory for short options too.\n"
+"  -o, --object         OID       ID of the first Motr object\n"
+"  -n, --nr_objs        INT       number of objects\n"
+"  -y, --mio_conf_file            MIO YAML configuration file\n"
+"  -h, --help                     shows this help text and exit\n"
+, prog_name);
+}
+
+/* Checks the result of each object against the one expected. */
+static int bulk_rcs_check(const char *what, int nr, struct mio_obj_id *oids,
+			  int32_t *rcs, int32_t *expected)
+{
+	int i;
+	int rc = 0;
+
+	for (i = 0; i < nr; i++) {
+		if (rcs[i] == expected[i])
+			continue;
+		fprintf(stderr, "%s: object ", what);
+		obj_id_printf(oids + i);
+		fprintf(stderr, " returned %d instead of %d!\n",
+			rcs[i], expected[i]);
+		rc = -EINVAL;
+	}
+	return rc;
+}
+
+static void bulk_objs_close(int nr, struct mio_obj *objs, int32_t *rcs)
+{
+	int i;
+
+	for (i = 0; i < nr; i++)
+		if (rcs[i] == 0)
+			mio_obj_close(objs + i);
+}
+
+static int bulk_create(int nr, struct mio_obj_id *oids, int32_t *expected)
+{
+	int rc;
+	int32_t *rcs;
+	struct mio_obj *objs;
+	struct mio_op op;
+
+	rcs = calloc(nr, sizeof *rcs);
+	objs = calloc(nr, sizeof *objs);
+	if (rcs == NULL || objs == NULL) {
+		rc = -ENOMEM;
+		goto exit;
+	}
+
+	mio_op_init(&op);
+	rc = mio_objs_create(nr, oids, NULL, NULL, objs, rcs, &op)? :
+	     mio_cmd_wait_on_op(&op);
+	mio_op_fini(&op);
+	if (rc < 0)
+		goto exit;
+	bulk_objs_close(nr, objs, rcs);
+	rc = bulk_rcs_check("Creating", nr, oids, rcs, expected);
+
+exit:
+	free(rcs);
+	free(objs);
+	return rc;
+}
+
+static int bulk_open(int nr, struct mio_obj_id *oids, int32_t *expected)
+{
+	int rc;
+	int32_t *rcs;
+	struct mio_obj *objs;
+	struct mio_op op;
+
+	rcs = calloc(nr, sizeof *rcs);
+	objs = calloc(nr, sizeof *objs);
+	if (rcs == NULL || objs == NULL) {
+		rc = -ENOMEM;
+		goto exit;
+	}
+
+	mio_op_init(&op);
+	rc = mio_objs_open(nr, oids, objs, rcs, &op)? :
+	     mio_cmd_wait_on_op(&op);
+	mio_op_fini(&op);
+	if (rc < 0)
+		goto exit;
+	bulk_objs_close(nr, objs, rcs);
+	rc = bulk_rcs_check("Opening", nr, oids, rcs, expected);
+
+exit:
+	free(rcs);
+	free(objs);
+	return rc;
+}
+
+static int bulk_delete(int nr, struct mio_obj_id *oids, int32_t *expected)
+{
+	int rc;
+	int32_t *rcs;
+	struct mio_op op;
+
+	rcs = calloc(nr, sizeof *rcs);
+	if (rcs == NULL)
+		return -ENOMEM;
+
+	mio_op_init(&op);
+	rc = mio_objs_delete(nr, oids, rcs, &op)? :
+	     mio_cmd_wait_on_op(&op);
+	mio_op_fini(&op);
+	if (rc == 0)
+		rc = bulk_rcs_check("Deleting", nr, oids, rcs, expected);
+	free(rcs);
+	return rc;
+}
+
+/*
+ * oids[0] to oids[nr - 1] are the objects, oids[nr] is a bad id and
+ * oids[nr + 1] is never created. Object 0 exists before the bulk
+ * creation, which fails for it alone.
+ */
+static int objs_bulk_check(struct mio_obj_id *oid, int nr)
+{
+	int i;
+	int rc;
+	int32_t *expected;
+	struct mio_obj obj;
+	struct mio_obj_id *oids;
+	struct mio_obj_id zero;
+
+	oids = calloc(nr + 2, sizeof *oids);
+	expected = calloc(nr + 2, sizeof *expected);
+	if (oids == NULL || expected == NULL) {
+		rc = -ENOMEM;
+		goto exit;
+	}
+	for (i = 0; i < nr; i++)
+		mio_cmd_obj_id_clone(oid, oids + i, 0, i);
+	memset(&zero, 0, sizeof zero);
+	mio_cmd_obj_id_clone(&zero, oids + nr, 0, 1);
+	mio_cmd_obj_id_clone(oid, oids + nr + 1, 0, nr);
+
+	memset(&obj, 0, sizeof obj);
+	rc = obj_create(NULL, oids, &obj, NULL);
+	if (rc < 0)
+		goto exit;
+	obj_close(&obj);
+
+	expected[0] = -EEXIST;
+	expected[nr] = -EINVAL;
+	rc = bulk_create(nr + 1, oids, expected);
+	if (rc < 0)
+		goto cleanup;
+
+	expected[0] = 0;
+	expected[nr + 1] = -ENOENT;
+	rc = bulk_open(nr + 2, oids, expected)? :
+	     bulk_delete(nr + 2, oids, expected);
+	if (rc < 0)
+		goto cleanup;
+
+	/* All gone. */
+	for (i = 0; i < nr; i++)
+		expected[i] = -ENOENT;
+	rc = bulk_open(nr + 2, oids, expected)? :
+	     bulk_delete(nr + 2, oids, expected);
+
+cleanup:
+	for (i = 0; rc < 0 && i < nr; i++)
+		obj_rm(oids + i);
+exit:
+	free(oids);
+	free(expected);
+	return rc;
+}
+
+int main(int argc, char **argv)
+{
+	int rc;
+	struct mio_cmd_obj_params bulk_params;
+
+	mio_cmd_obj_args_init(argc, argv, &bulk_params, &bulk_usage);
+	if (bulk_params.cop_nr_objs < 1) {
+		bulk_usage(stderr, argv[0]);
+		exit(EXIT_FAILURE);
+	}
+
+	rc = mio_init(bulk_params.cop_conf_fname);
+	if (rc < 0) {
+		mio_cmd_error("Initialising MIO failed", rc);
+		exit(EXIT_FAILURE);
+	}
+
+	rc = objs_bulk_check(&bulk_params.cop_oid, bulk_params.cop_nr_objs);
+	if (rc < 0)
+		mio_cmd_error("Checking bulk object operations failed", rc);
+
+	mio_fini();
+	mio_cmd_obj_args_fini(&bulk_params);
+	return rc;
+}
+
+/*
+ *  Local variables:
+ *  c-indentation-style: "K&R"
+ *  c-basic-offset: 8
+ *  tab-width: 8
+ *  fill-column: 80
+ *  scroll-step: 1
+ *  End:
+ */
+/*
+ * vim: tabstop=8 shiftwidth=8 noexpandtab textwidth=80 nowrap
+ */
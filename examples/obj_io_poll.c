@@ -233,27 +233,24 @@ int mio_cmd_obj_read(struct mio_obj_id *oid, char *dest,
  * if the `to` object doesn't exist. This function also shows how to use
  * MIO's hint such as MIO_HINT_OBJ_OBJ_WHERE or MIO_HINT_OBJ_HOT_INDEX
  * to create an object in a specified pool.
+ *
+ * Data is copied by mio_obj_copy() inside MIO, a block per chunk with
+ * several chunks in flight.
  */
 int mio_cmd_obj_copy(struct mio_obj_id *from_oid,
 		     struct mio_pool_id *to_pool, struct mio_obj_id *to_oid,
 		     uint64_t block_size, struct mio_cmd_obj_hint *chint)
 {
 	int rc = 0;
-	uint64_t bcount;
-	uint64_t last_index;
-	uint64_t max_index;
-	uint64_t block_count;
-	struct mio_iovec *data;
 	struct mio_obj from_obj;
 	struct mio_obj to_obj;
+	struct mio_obj_copy_opts opts;
 
 	/* Open `from` object. */
 	memset(&from_obj, 0, sizeof from_obj);
 	rc = obj_open(from_oid, &from_obj);
 	if (rc < 0)
 		goto obj_close;
-	max_index = from_obj.mo_attrs.moa_size;
-	block_count = (from_obj.mo_attrs.moa_size - 1) / block_size + 1;
 
 	/* Create the `to` object if it doesn't exist. */
 	memset(&to_obj, 0, sizeof to_obj);
@@ -261,34 +258,11 @@ int mio_cmd_obj_copy(struct mio_obj_id *from_oid,
 	if (rc < 0)
 		goto obj_close;
 
-	last_index = 0;
-	while (block_count > 0) {
-		bcount = (block_count > MIO_CMD_MAX_BLOCK_COUNT_PER_OP)?
-			  MIO_CMD_MAX_BLOCK_COUNT_PER_OP : block_count;
-		rc = obj_alloc_iovecs(&data, bcount, block_size,
-				      last_index, max_index);
-		if (rc != 0)
-			break;
-
-		/* Read data from source file. */
-		rc = obj_read(&from_obj, bcount, data);
-		if (rc != 0) {
-			fprintf(stderr, "Failed in reading from object!\n");
-			obj_cleanup_iovecs(data);
-			break;
-		}
-
-		/* Copy data to the object*/
-		rc = obj_write(&to_obj, bcount, data);
-		if (rc != 0) {
-			fprintf(stderr, "Writing to object failed!\n");
-			obj_cleanup_iovecs(data);
-			break;
-		}
-		obj_cleanup_iovecs(data);
-		block_count -= bcount;
-		last_index += bcount * block_size;
-	}
+	memset(&opts, 0, sizeof opts);
+	opts.mco_chunk_size = block_size;
+	rc = mio_obj_copy(&from_obj, &to_obj, NULL, &opts);
+	if (rc < 0)
+		fprintf(stderr, "Copying object failed!\n");
 
 	mio_obj_close(&to_obj);
 
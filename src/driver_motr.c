@@ -29,6 +29,8 @@ struct mio_motr_config *mio_drv_motr_conf;
 
 struct m0_uint128 mio_motr_obj_md_kvs_id;
 struct m0_fid mio_motr_obj_md_kvs_fid = M0_FID_TINIT('x', 0, 0x10);
+struct m0_fid mio_motr_sys_hints_kvs_fid = M0_FID_TINIT('x', 0, 0x11);
+struct m0_fid mio_motr_obj_expiry_kvs_fid = M0_FID_TINIT('x', 0, 0x12);
 
 /**
  * Some helper functions.
@@ -85,20 +87,33 @@ static int motr_op_exec_sync(struct m0_op *cop)
 	return rc;
 }
 
-static int motr_create_obj_attrs_kvs()
+static void motr_kvs_id_set(const struct m0_fid *fid, struct mio_kvs_id *kid)
+{
+	uint64_t hi;
+	uint64_t lo;
+
+	/* Reverse of the mapping done for application's key-value sets. */
+	hi = mio_byteorder_cpu_to_be64(fid->f_container & ~(0xffULL << 56));
+	lo = mio_byteorder_cpu_to_be64(fid->f_key);
+	mio_mem_copy(kid->mki_bytes, &hi, sizeof hi);
+	mio_mem_copy(kid->mki_bytes + 8, &lo, sizeof lo);
+}
+
+static int motr_create_obj_attrs_kvs(const struct m0_fid *fid,
+				     struct mio_kvs *kvs)
 {
         int rc;
 	struct m0_op *cops[1] = {NULL};
+	struct m0_uint128 id;
 	struct m0_idx *idx;
 
 	idx = mio_mem_alloc(sizeof *idx);
 	if (idx == NULL)
 		return -ENOMEM;
 
-	mio_motr_obj_md_kvs_id.u_hi = mio_motr_obj_md_kvs_fid.f_container;
-	mio_motr_obj_md_kvs_id.u_lo = mio_motr_obj_md_kvs_fid.f_key;
-	m0_idx_init(idx, &mio_motr_container.co_realm,
-			   &mio_motr_obj_md_kvs_id);
+	id.u_hi = fid->f_container;
+	id.u_lo = fid->f_key;
+	m0_idx_init(idx, &mio_motr_container.co_realm, &id);
 
 	/* Check if object's attrs key-value store exists. */
         m0_idx_op(idx, M0_IC_LOOKUP,
@@ -122,15 +137,77 @@ static int motr_create_obj_attrs_kvs()
 	rc = motr_op_exec_sync(cops[0]);
 
 exit:
-	if (rc == 0)
-		mio_obj_attrs_kvs.mk_drv_kvs = idx;
-	else {
+	if (rc == 0) {
+		kvs->mk_drv_kvs = idx;
+		motr_kvs_id_set(fid, &kvs->mk_id);
+	} else {
 		m0_idx_fini(idx);
 		mio_mem_free(idx);
 	}
 	return rc;
 }
 
+static void motr_obj_attrs_kvs_fini(struct mio_kvs *kvs)
+{
+	if (kvs->mk_drv_kvs == NULL)
+		return;
+	m0_idx_fini((struct m0_idx *)kvs->mk_drv_kvs);
+	mio_mem_free(kvs->mk_drv_kvs);
+	kvs->mk_drv_kvs = NULL;
+}
+
+static void motr_obj_attrs_kvs_shards_fini()
+{
+	int i;
+
+	for (i = 0; i < mio_obj_attrs_kvs_nr_shards; i++)
+		motr_obj_attrs_kvs_fini(mio_obj_attrs_kvs_shards + i);
+	mio_mem_free(mio_obj_attrs_kvs_shards);
+	mio_obj_attrs_kvs_shards = NULL;
+	mio_obj_attrs_kvs_nr_shards = 0;
+}
+
+/**
+ * The legacy attribute index is always created (or looked up) as
+ * objects created before sharding was configured keep their attributes
+ * there. Shard i uses fid ('x', MIO_MOTR_OBJ_ATTRS_SHARD_CONTAINER, i).
+ */
+static int motr_create_obj_attrs_kvs_all()
+{
+	int i;
+	int rc;
+	int nr_shards = mio_drv_motr_conf->mc_obj_attrs_nr_shards;
+	struct m0_fid fid;
+
+	mio_motr_obj_md_kvs_id.u_hi = mio_motr_obj_md_kvs_fid.f_container;
+	mio_motr_obj_md_kvs_id.u_lo = mio_motr_obj_md_kvs_fid.f_key;
+	rc = motr_create_obj_attrs_kvs(&mio_motr_obj_md_kvs_fid,
+				       &mio_obj_attrs_kvs);
+	if (rc < 0 || nr_shards == 0)
+		return rc;
+
+	mio_obj_attrs_kvs_shards =
+		mio_mem_alloc(nr_shards * sizeof(struct mio_kvs));
+	if (mio_obj_attrs_kvs_shards == NULL) {
+		rc = -ENOMEM;
+		goto error;
+	}
+	for (i = 0; i < nr_shards; i++) {
+		fid = M0_FID_TINIT('x', MIO_MOTR_OBJ_ATTRS_SHARD_CONTAINER, i);
+		rc = motr_create_obj_attrs_kvs(&fid,
+					       mio_obj_attrs_kvs_shards + i);
+		if (rc < 0)
+			goto error;
+		mio_obj_attrs_kvs_nr_shards++;
+	}
+	return 0;
+
+error:
+	motr_obj_attrs_kvs_shards_fini();
+	motr_obj_attrs_kvs_fini(&mio_obj_attrs_kvs);
+	return rc;
+}
+
 /**
  * Initialise and finalise motr instance.
  */
@@ -179,11 +256,34 @@ int mio_motr_init(struct mio *mio_inst)
 	}
 
 	/* Create object attrs kvs if it doesn't exist. */
- 	rc = motr_create_obj_attrs_kvs();
+ 	rc = motr_create_obj_attrs_kvs_all();
 	if (rc != 0) {
 		mio_log(MIO_ERROR, "Failed to create attrs key-value set!\n");
 		goto error;
 	}
+
+	/* And the system hint kvs. */
+	rc = motr_create_obj_attrs_kvs(&mio_motr_sys_hints_kvs_fid,
+				       &mio_sys_hints_kvs);
+	if (rc != 0) {
+		mio_log(MIO_ERROR,
+			"Failed to create system hint key-value set!\n");
+		motr_obj_attrs_kvs_shards_fini();
+		motr_obj_attrs_kvs_fini(&mio_obj_attrs_kvs);
+		goto error;
+	}
+
+	/* And the object expiry index. */
+	rc = motr_create_obj_attrs_kvs(&mio_motr_obj_expiry_kvs_fid,
+				       &mio_obj_expiry_kvs);
+	if (rc != 0) {
+		mio_log(MIO_ERROR,
+			"Failed to create object expiry key-value set!\n");
+		motr_obj_attrs_kvs_fini(&mio_sys_hints_kvs);
+		motr_obj_attrs_kvs_shards_fini();
+		motr_obj_attrs_kvs_fini(&mio_obj_attrs_kvs);
+		goto error;
+	}
 	return 0;
 
 error:
@@ -193,8 +293,10 @@ error:
 
 static void mio_motr_fini()
 {
-	m0_idx_fini(
-		(struct m0_idx *)mio_obj_attrs_kvs.mk_drv_kvs);
+	motr_obj_attrs_kvs_fini(&mio_obj_expiry_kvs);
+	motr_obj_attrs_kvs_fini(&mio_sys_hints_kvs);
+	motr_obj_attrs_kvs_shards_fini();
+	motr_obj_attrs_kvs_fini(&mio_obj_attrs_kvs);
 	m0_client_fini(mio_motr_instance, true);
 	mio_motr_instance = NULL;
 }
@@ -291,6 +393,41 @@ static struct mio_driver_sys_ops mio_motr_sys_ops = {
         .mdo_thread_fini = mio_motr_thread_fini
 };
 
+static void motr_drv_op_fini(struct mio_driver_op *dop)
+{
+	int i;
+	struct m0_op *cop;
+
+	/* Nothing was launched for an op added as done. */
+	if (dop->mdo_op == NULL)
+		return;
+
+	if (dop->mdo_ops == NULL) {
+		m0_op_fini((struct m0_op *)dop->mdo_op);
+		m0_op_free((struct m0_op *)dop->mdo_op);
+		return;
+	}
+
+	for (i = 0; i < dop->mdo_nr_ops; i++) {
+		cop = (struct m0_op *)dop->mdo_ops[i];
+		m0_op_fini(cop);
+		m0_op_free(cop);
+	}
+	mio_mem_free(dop->mdo_ops);
+}
+
+/**
+ * Finalises and frees a driver op taken off its chain. The Motr ops of
+ * the driver op must be done and none of their callbacks running.
+ */
+void mio__motr_drv_op_free(struct mio_driver_op *dop)
+{
+	motr_drv_op_fini(dop);
+	if (dop->mdo_op_fini)
+		dop->mdo_op_fini(dop);
+	mio_mem_free(dop);
+}
+
 static void mio_motr_op_fini(struct mio_op *mop)
 {
 	struct mio_driver_op *dop;
@@ -299,15 +436,37 @@ static void mio_motr_op_fini(struct mio_op *mop)
 	while(dop != NULL) {
 		mop->mop_drv_op_chain.mdoc_head = dop->mdo_next;
 		dop->mdo_next = NULL;
+		mio__motr_drv_op_free(dop);
+		dop = mop->mop_drv_op_chain.mdoc_head;
+	}
+}
 
-		m0_op_fini((struct m0_op *)dop->mdo_op);
-		m0_op_free((struct m0_op *)dop->mdo_op);
-		if (dop->mdo_op_fini)
-			dop->mdo_op_fini(dop);
-		mio_mem_free(dop);
+/*
+ * A group of ops is completed when all ops in the group have reached
+ * STABLE or FAILED state. Checking the result of each op is left to
+ * the group's post-processing function.
+ */
+static int
+motr_op_group_wait(struct mio_op *mop, uint64_t timeout, int *retstate)
+{
+	int i;
+	int rc = 0;
+	struct mio_driver_op *dop = mop->mop_drv_op_chain.mdoc_head;
 
-		dop = mop->mop_drv_op_chain.mdoc_head;
+	for (i = 0; i < dop->mdo_nr_ops; i++) {
+		rc = m0_op_wait((struct m0_op *)dop->mdo_ops[i],
+				M0_BITS(M0_OS_STABLE, M0_OS_FAILED), timeout);
+		if (rc < 0)
+			break;
 	}
+
+	if (rc == 0)
+		*retstate = MIO_OP_COMPLETED;
+	else if (rc == -ETIMEDOUT)
+		*retstate = MIO_OP_ONFLY;
+	else
+		*retstate = MIO_OP_FAILED;
+	return rc;
 }
 
 static int
@@ -316,6 +475,13 @@ mio_motr_op_wait(struct mio_op *mop, uint64_t timeout, int *retstate)
 	int rc;
 	struct m0_op *cop;
 
+	if (mop->mop_drv_op_chain.mdoc_head->mdo_ops != NULL)
+		return motr_op_group_wait(mop, timeout, retstate);
+	if (mop->mop_drv_op_chain.mdoc_head->mdo_op == NULL) {
+		*retstate = MIO_OP_COMPLETED;
+		return 0;
+	}
+
 	cop = MIO_MOTR_OP(mop);
 	rc = m0_op_wait(cop, M0_BITS(M0_OS_STABLE, M0_OS_FAILED), timeout);
 	/*
@@ -350,7 +516,7 @@ mio_motr_op_wait(struct mio_op *mop, uint64_t timeout, int *retstate)
  */
 static void motr_op_cb_complete(struct m0_op *cop)
 {
-	int rc;
+	int rc = 0;
 	struct mio_op *mop;
 
 	mop = (struct mio_op *)cop->op_datum;
@@ -362,7 +528,29 @@ static void motr_op_cb_complete(struct m0_op *cop)
 		return;
 
 app_cb:
-	mio_driver_op_invoke_real_cb(mop, 0);
+	mio_driver_op_invoke_real_cb(mop, rc < 0? rc : 0);
+}
+
+/*
+ * Both STABLE and FAILED ops of a group end up here, only the last
+ * finished op moves the MIO op forward.
+ */
+static void motr_op_group_cb(struct m0_op *cop)
+{
+	int rc;
+	struct mio_op *mop;
+	struct mio_driver_op *dop;
+
+	mop = (struct mio_op *)cop->op_datum;
+	dop = mop->mop_drv_op_chain.mdoc_head;
+	if (__atomic_add_fetch(&dop->mdo_nr_done, 1, __ATOMIC_ACQ_REL) !=
+	    dop->mdo_nr_ops)
+		return;
+
+	rc = dop->mdo_post_proc(mop);
+	if (rc == MIO_DRV_OP_NEXT)
+		return;
+	mio_driver_op_invoke_real_cb(mop, rc < 0? rc : 0);
 }
 
 static void motr_op_cb_failed(struct m0_op *cop)
@@ -374,14 +562,34 @@ static void motr_op_cb_failed(struct m0_op *cop)
 }
 
 static struct m0_op_ops motr_op_cbs;
+static struct m0_op_ops motr_op_group_cbs;
 static int
 mio_motr_op_set_cbs(struct mio_op *mop)
 
 {
+	int i;
 	struct m0_op *cop;
+	struct mio_driver_op *dop;
 
 	assert(mop != NULL);
 
+	dop = mop->mop_drv_op_chain.mdoc_head;
+	if (dop->mdo_op == NULL) {
+		mio_driver_op_invoke_real_cb(mop, 0);
+		return 0;
+	}
+	if (dop->mdo_ops != NULL) {
+		motr_op_group_cbs.oop_executed = NULL;
+		motr_op_group_cbs.oop_stable = motr_op_group_cb;
+		motr_op_group_cbs.oop_failed = motr_op_group_cb;
+		for (i = 0; i < dop->mdo_nr_ops; i++) {
+			cop = (struct m0_op *)dop->mdo_ops[i];
+			cop->op_datum = (void *)mop;
+			m0_op_setup(cop, &motr_op_group_cbs, 0);
+		}
+		return 0;
+	}
+
 	motr_op_cbs.oop_executed = NULL;
 	motr_op_cbs.oop_stable = motr_op_cb_complete;
 	motr_op_cbs.oop_failed = motr_op_cb_failed;
@@ -461,8 +669,106 @@ mio_motr_pool_get(const struct mio_pool_id *pool_id, struct mio_pool *pool)
        return 0;
 }
 
+/*
+ * Motr clients can't query the free space of a pool. The capacity of a
+ * pool is taken from the configuration (MOTR_POOL_CAPACITY) and the
+ * space used is an estimate for this process only: what it has added to
+ * objects in the pool since it started, less what it has released by
+ * deleting objects or freeing layer data. Data written or removed by
+ * other processes is not accounted for, and releasing data written
+ * before the process started only brings the estimate down to 0.
+ */
+static uint64_t motr_pools_used[MIO_MOTR_MAX_POOL_CNT];
+
+static int motr_pool_idx(const struct mio_pool_id *pool_id)
+{
+	int i;
+	struct mio_pool_id *id;
+
+	for (i = 0; i < mio_pools.mps_nr_pools; i++) {
+		id = &mio_pools.mps_pools[i].mp_id;
+		if (id->mpi_hi == pool_id->mpi_hi &&
+		    id->mpi_lo == pool_id->mpi_lo)
+			return i;
+	}
+	return -ENOENT;
+}
+
+void mio__motr_pool_used_add(const struct mio_pool_id *pool_id,
+			     uint64_t nr_bytes)
+{
+	int idx;
+
+	idx = motr_pool_idx(pool_id);
+	if (idx >= 0)
+		__atomic_add_fetch(motr_pools_used + idx, nr_bytes,
+				   __ATOMIC_RELAXED);
+}
+
+void mio__motr_pool_used_sub(const struct mio_pool_id *pool_id,
+			     uint64_t nr_bytes)
+{
+	int idx;
+	uint64_t used;
+	uint64_t *ptr;
+
+	idx = motr_pool_idx(pool_id);
+	if (idx < 0)
+		return;
+	ptr = motr_pools_used + idx;
+	used = __atomic_load_n(ptr, __ATOMIC_RELAXED);
+	while (!__atomic_compare_exchange_n(ptr, &used,
+					    used > nr_bytes? used - nr_bytes : 0,
+					    false, __ATOMIC_RELAXED,
+					    __ATOMIC_RELAXED))
+		;
+}
+
+static int mio_motr_pool_freespace(const struct mio_pool_id *pool_id,
+				   size_t *capacity, size_t *freespace)
+{
+	int idx;
+	uint64_t used;
+
+	idx = motr_pool_idx(pool_id);
+	if (idx < 0)
+		return -EINVAL;
+	if (mio_pools.mps_pools[idx].mp_capacity == 0)
+		return -EOPNOTSUPP;
+
+	used = __atomic_load_n(motr_pools_used + idx, __ATOMIC_RELAXED);
+	*capacity = mio_pools.mps_pools[idx].mp_capacity;
+	*freespace = used < *capacity? *capacity - used : 0;
+	return 0;
+}
+
+/*
+ * Motr switches a pool to a new pool version when its devices fail or
+ * are repaired. The version is identified by the pool version's fid.
+ */
+static int mio_motr_pool_version(const struct mio_pool_id *pool_id,
+				 struct mio_pool_id *version)
+{
+	int rc;
+	struct m0_fid pool_fid;
+	struct m0_reqh *reqh = &mio_motr_instance->m0c_reqh;
+	struct m0_pool_version *pver;
+
+	if (pool_id == NULL || version == NULL)
+		return -EINVAL;
+
+	mio__motr_pool_id_to_fid(pool_id, &pool_fid);
+	rc = m0_pool_version_get(reqh->rh_pools, &pool_fid, &pver);
+	if (rc != 0)
+		return rc;
+	mio__motr_fid_to_pool_id(&pver->pv_id, version);
+	return 0;
+}
+
 static struct mio_pool_ops mio_motr_pool_ops = {
-       .mpo_get    = mio_motr_pool_get
+       .mpo_get       = mio_motr_pool_get,
+       .mpo_freespace = mio_motr_pool_freespace,
+       .mpo_version   = mio_motr_pool_version
 };
 
 void mio_motr_driver_register()
@@ -46,8 +46,15 @@ extern struct m0_client *mio_motr_instance;
 extern struct m0_container mio_motr_container;
 extern struct mio_motr_config *mio_drv_motr_conf;
 
+enum {
+	/* Container of the fids of object attribute index shards. */
+	MIO_MOTR_OBJ_ATTRS_SHARD_CONTAINER = 0x10,
+};
+
 extern struct m0_uint128 mio_motr_obj_md_kvs_id;
 extern struct m0_fid mio_motr_obj_md_kvs_fid;
+extern struct m0_fid mio_motr_sys_hints_kvs_fid;
+extern struct m0_fid mio_motr_obj_expiry_kvs_fid;
 
 extern struct mio_obj_ops mio_motr_obj_ops;
 extern struct mio_kvs_ops mio_motr_kvs_ops;
@@ -66,6 +73,27 @@ void mio__motr_pool_id_to_fid(const struct mio_pool_id *pool_id,
 			      struct m0_fid *fid);
 void mio__motr_fid_to_pool_id(const struct m0_fid *fid,
 			      struct mio_pool_id *pool_id);
+int mio__motr_obj_max_size_per_op(struct mio_obj *obj,
+				  uint64_t *max_size_per_op);
+typedef int (*mio__motr_obj_write_done)(struct mio_op *op,
+					struct mio_obj *obj, int iovcnt,
+					const struct mio_iovec *iov);
+int mio__motr_obj_writev(struct mio_obj *obj,
+			 const struct mio_iovec *iov, int iovcnt,
+			 mio__motr_obj_write_done write_done,
+			 struct mio_op *op);
+typedef int (*mio__motr_obj_promote_done)(struct mio_op *op,
+					  struct mio_obj *obj, void *data);
+int mio__motr_obj_inline_promote(struct mio_obj *obj,
+				 mio__motr_obj_promote_done done,
+				 void *done_data, struct mio_op *op);
+int mio__motr_obj_attrs_put(struct mio_obj *obj, struct mio_op *op);
+void mio__motr_pool_used_add(const struct mio_pool_id *pool_id,
+			     uint64_t nr_bytes);
+void mio__motr_pool_used_sub(const struct mio_pool_id *pool_id,
+			     uint64_t nr_bytes);
+void mio__motr_obj_pool_used_sub(struct mio_obj *obj, uint64_t nr_bytes);
+void mio__motr_drv_op_free(struct mio_driver_op *dop);
 #endif
 
 /*
@@ -30,6 +30,92 @@
 #include "mio_internal.h"
 #include "driver_motr.h"
 
+/*
+ * The composite layout of an opened object is cached in the object's
+ * Motr handle (m0_obj::ob_layout). mio_obj::mo_comp_layout_cached tells
+ * whether the cached layout is what Motr has: it is set once the layout
+ * has been fetched or written successfully, and cleared before the
+ * layout is changed, so a failed or interrupted update makes the next
+ * layer operation fetch the layout again. Listing layers is served from
+ * the cache, adding or deleting layers updates the cached layout in
+ * place and writes it back in one round trip.
+ */
+
+struct motr_comp_obj_layers_args {
+	/* For listing layers. */
+	struct mio_comp_obj_layout *cla_ret_layout;
+
+	/* For adding or deleting layers. */
+	bool cla_add;
+	int cla_nr_layers;
+	struct mio_comp_obj_layer *cla_layers;
+	int cla_nr_layer_objs;
+	struct m0_obj *cla_layer_objs;
+};
+
+static void motr_comp_obj_layers_args_free(struct motr_comp_obj_layers_args *args)
+{
+	int i;
+
+	for (i = 0; i < args->cla_nr_layer_objs; i++)
+		m0_obj_fini(args->cla_layer_objs + i);
+	mio_mem_free(args->cla_layer_objs);
+	mio_mem_free(args);
+}
+
+static int motr_comp_obj_layers_op_fini(struct mio_driver_op *dop)
+{
+	motr_comp_obj_layers_args_free(
+		(struct motr_comp_obj_layers_args *)dop->mdo_op_args);
+	return 0;
+}
+
+/*
+ * Readers tell a composite object by the flag in its attributes, so the
+ * flag is stored as soon as the layout is, not when the object is
+ * closed. The object is still marked updated, closing it stores the
+ * flag again should this PUT fail.
+ */
+static int motr_comp_obj_layout_set_pp(struct mio_op *op)
+{
+	int rc;
+	struct mio_obj *obj = op->mop_who.obj;
+
+	obj->mo_comp_layout_cached = true;
+	if (obj->mo_attrs.moa_composite)
+		return MIO_DRV_OP_FINAL;
+
+	obj->mo_attrs.moa_composite = true;
+	obj->mo_attrs_updated = true;
+	rc = mio__motr_obj_attrs_put(obj, op);
+	return rc < 0? rc : MIO_DRV_OP_NEXT;
+}
+
+/* Writes the cached layout back to Motr. */
+static int motr_comp_obj_layout_set(struct mio_obj *obj,
+				    mio_driver_op_fini op_fini, void *op_args,
+				    struct mio_op *op)
+{
+	int rc;
+	struct m0_obj *cobj;
+	struct m0_op *cops[1] = {NULL};
+
+	cobj = (struct m0_obj *)obj->mo_drv_obj;
+	obj->mo_comp_layout_cached = false;
+	m0_client_layout_op(cobj, M0_EO_LAYOUT_SET,
+			    cobj->ob_layout, &cops[0]);
+
+	rc = mio_driver_op_add(op, motr_comp_obj_layout_set_pp, NULL,
+			       op_fini, cops[0], op_args);
+	if (rc < 0) {
+		m0_op_fini(cops[0]);
+		m0_op_free(cops[0]);
+		return rc;
+	}
+	m0_op_launch(cops, ARRAY_SIZE(cops));
+	return 0;
+}
+
 /*
  * Creating a composite object includes 2 steps:
  * (1) Create a `normal` object.
@@ -45,12 +131,9 @@
  * created one (not yet written any data).
  */
 
-static int
-mio_motr_comp_obj_create(struct mio_obj *obj, struct mio_op *op)
+static int motr_comp_obj_layout_create(struct mio_obj *obj, struct mio_op *op)
 {
-	int rc;
 	struct m0_obj *cobj;
-	struct m0_op *cops[1] = {NULL};
         struct m0_client_layout *layout;
 
         layout = m0_client_layout_alloc(M0_LT_COMPOSITE);
@@ -59,226 +142,178 @@ mio_motr_comp_obj_create(struct mio_obj *obj, struct mio_op *op)
 
 	cobj = (struct m0_obj *)obj->mo_drv_obj;
         /*
-	 * A bug in motr doesn't set the object's layout pointer.
+	 * A bug in motr doesn't set the object's layout pointer. The
+	 * new layout is cached in the object from now on.
 	 */
-	if (cobj->ob_layout == NULL)
-		cobj->ob_layout = layout;
-	m0_client_layout_op(cobj, M0_EO_LAYOUT_SET,
-			    layout, &cops[0]);
+	if (cobj->ob_layout != NULL)
+		m0_client_layout_free(cobj->ob_layout);
+	cobj->ob_layout = layout;
 
-	rc = mio_driver_op_add(op, NULL, NULL, NULL, cops[0], NULL);
-	if (rc < 0)
-		goto error;
-	m0_op_launch(cops, ARRAY_SIZE(cops));
-	return 0;
+	return motr_comp_obj_layout_set(obj, NULL, NULL, op);
+}
 
-error:
-	m0_op_fini(cops[0]);
-	m0_op_free(cops[0]);
-	m0_client_layout_free(layout);
-	return rc;
+static int motr_comp_obj_create_promoted(struct mio_op *op,
+					 struct mio_obj *obj, void *data)
+{
+	int rc;
+
+	rc = motr_comp_obj_layout_create(obj, op);
+	return rc < 0? rc : MIO_DRV_OP_NEXT;
 }
 
-struct motr_comp_obj_add_layer_pp_args {
-	int alpa_nr_layers_to_add;
-	struct m0_obj *alpa_layer_objs;
-	struct m0_client_layout *alpa_layout;
-};
+static int
+mio_motr_comp_obj_create(struct mio_obj *obj, struct mio_op *op)
+{
+	/* The layout is set on the object's entity. */
+	if (obj->mo_attrs.moa_inline != NULL)
+		return mio__motr_obj_inline_promote(
+			obj, motr_comp_obj_create_promoted, NULL, op);
+	return motr_comp_obj_layout_create(obj, op);
+}
 
-static int motr_comp_obj_add_layers_pp(struct mio_op *op)
+/* Fetches the layout from Motr into the cache. */
+static int
+motr_comp_obj_layout_get(struct mio_obj *obj,
+			 struct motr_comp_obj_layers_args *args,
+			 mio_driver_op_postprocess pp, struct mio_op *op)
 {
-	int i;
-	struct motr_comp_obj_add_layer_pp_args *pp_args;
+	int rc;
+	struct m0_client_layout *clayout = NULL;
+	struct m0_obj *cobj;
+	struct m0_op *cops[1] = {NULL};
 
-	pp_args = (struct motr_comp_obj_add_layer_pp_args *)
-		  op->mop_drv_op_chain.mdoc_head->mdo_post_proc_data;
-	for (i = 0; i < pp_args->alpa_nr_layers_to_add; i++)
-		m0_obj_fini(pp_args->alpa_layer_objs + i);
-	mio_mem_free(pp_args->alpa_layer_objs);
-	mio_mem_free(pp_args);
+	cobj = (struct m0_obj *)obj->mo_drv_obj;
+	obj->mo_comp_layout_cached = false;
+	/* The layout may have been changed. */
+	if (cobj->ob_layout != NULL)
+		m0_client_layout_free(cobj->ob_layout);
+	clayout = m0_client_layout_alloc(M0_LT_COMPOSITE);
+	cobj->ob_layout = clayout;
+	if (clayout == NULL)
+		return -ENOMEM;
 
-	return MIO_DRV_OP_FINAL;
+        m0_client_layout_op(cobj, M0_EO_LAYOUT_GET, clayout, &cops[0]);
+
+	rc = mio_driver_op_add(op, pp, args,
+			       motr_comp_obj_layers_op_fini, cops[0], args);
+	if (rc < 0) {
+		m0_op_fini(cops[0]);
+		m0_op_free(cops[0]);
+		return rc;
+	}
+	m0_op_launch(cops, ARRAY_SIZE(cops));
+	return 0;
 }
 
+/**
+ * Adds layers to or deletes layers from the cached layout and writes
+ * it back. `args` is owned by the SET op if `owner` is set, otherwise
+ * by the preceding GET op.
+ */
 static int
-mio_motr_comp_obj_add_layers(struct mio_obj *obj, int nr_layers,
-			       struct mio_comp_obj_layer *layers,
-			       struct mio_op *op)
+motr_comp_obj_layers_update(struct mio_obj *obj,
+			    struct motr_comp_obj_layers_args *args,
+			    bool owner, struct mio_op *op)
 {
-	int rc = 0;
 	int i;
 	int j;
+	int rc = 0;
 	struct m0_uint128 id128;
-	struct m0_obj *layer_objs;
 	struct m0_obj *cobj;
-	struct m0_op *cops[1] = {NULL};
-        struct m0_client_layout *layout = NULL;
-	struct motr_comp_obj_add_layer_pp_args *pp_args;
-
-	pp_args = mio_mem_alloc(sizeof(*pp_args));
-	layer_objs = mio_mem_alloc(nr_layers * sizeof(*layer_objs));
-	if (pp_args == NULL || layer_objs == NULL) {
-		rc = -ENOMEM;
-		goto error;
-	}
+	struct m0_obj *layer_objs;
+        struct m0_client_layout *clayout;
 
 	cobj = (struct m0_obj *)obj->mo_drv_obj;
-	/* The layout may have been changed. */
-	if (cobj->ob_layout != NULL)
-		m0_client_layout_free(cobj->ob_layout);
-	layout = m0_client_layout_alloc(M0_LT_COMPOSITE);
-	if (layout == NULL) {
-		rc = -ENOMEM;
-		goto error;
+	clayout = cobj->ob_layout;
+	obj->mo_comp_layout_cached = false;
+
+	if (!args->cla_add) {
+		for (i = 0; i < args->cla_nr_layers; i++) {
+			mio__obj_id_to_uint128(&args->cla_layers[i].mcol_oid,
+					       &id128);
+			m0_composite_layer_del(clayout, id128);
+		}
+		goto set;
 	}
-	cobj->ob_layout = layout;
 
-        for (i = 0; i < nr_layers; i++) {
-		mio__obj_id_to_uint128(&layers[i].mcol_oid, &id128);
+	layer_objs = mio_mem_alloc(args->cla_nr_layers * sizeof *layer_objs);
+	if (layer_objs == NULL)
+		return -ENOMEM;
+	args->cla_layer_objs = layer_objs;
+        for (i = 0; i < args->cla_nr_layers; i++) {
+		mio__obj_id_to_uint128(&args->cla_layers[i].mcol_oid, &id128);
 		m0_obj_init(layer_objs + i,
 				   &mio_motr_container.co_realm, &id128,
 				   mio_drv_motr_conf->mc_default_layout_id);
+		args->cla_nr_layer_objs++;
+		/* Re-adding a layer changes its priority. */
+		m0_composite_layer_del(clayout, id128);
                 rc = m0_composite_layer_add(
-			layout, layer_objs + i, layers[i].mcol_priority);
+			clayout, layer_objs + i,
+			args->cla_layers[i].mcol_priority);
                 if (rc < 0)
                         break;
         }
         if (rc != 0) {
                 for (j = 0; j < i; j++)
                         m0_composite_layer_del(
-				layout, layer_objs[j].ob_entity.en_id);
-		goto error;
+				clayout, layer_objs[j].ob_entity.en_id);
+		return rc;
         }
 
-        m0_client_layout_op(cobj, M0_EO_LAYOUT_SET,
-			    layout, &cops[0]);
-
-	pp_args->alpa_nr_layers_to_add = nr_layers;
-	pp_args->alpa_layer_objs = layer_objs;
-	pp_args->alpa_layout = layout;
-	rc = mio_driver_op_add(op, motr_comp_obj_add_layers_pp,
-			       pp_args, NULL, cops[0], NULL);
-	if (rc < 0)
-		goto error;
+set:
+	return motr_comp_obj_layout_set(
+		obj, owner? motr_comp_obj_layers_op_fini : NULL,
+		owner? args : NULL, op);
+}
 
-	m0_op_launch(cops, ARRAY_SIZE(cops));
-	return 0;
+static int motr_comp_obj_layers_update_pp(struct mio_op *op)
+{
+	int rc;
+	struct mio_obj *obj = op->mop_who.obj;
+	struct motr_comp_obj_layers_args *args;
 
-error:
-	if (layout)
-		m0_client_layout_free(layout);
-	mio_mem_free(layer_objs);
-	mio_mem_free(pp_args);
-	return rc;
+	args = (struct motr_comp_obj_layers_args *)
+	       op->mop_drv_op_chain.mdoc_head->mdo_post_proc_data;
+	rc = motr_comp_obj_layers_update(obj, args, false, op);
+	return rc < 0? rc : MIO_DRV_OP_NEXT;
 }
 
-struct motr_comp_obj_get_layers_args {
-	/* Returned object layout. */
-	struct m0_client_layout *gla_clayout;
-	/*
-	 * Customized data for layer query. For layer listing, it is
-	 * set to the pointer of MIO layout data structure from
-	 * applications. But for layer deleting, it is set to
-	 * the pointer of an array of layers to be deleted.
-	 */
-	void *gla_data;
-};
-
 static int
-motr_comp_obj_get_layers(struct mio_obj *obj,
-			   void *query_data, mio_driver_op_postprocess pp,
-			   struct mio_op *op)
+motr_comp_obj_layers_add_del(struct mio_obj *obj, bool add,
+			     int nr_layers, struct mio_comp_obj_layer *layers,
+			     struct mio_op *op)
 {
 	int rc;
-	struct motr_comp_obj_get_layers_args *args;
-	struct m0_client_layout *clayout = NULL;
-	struct m0_obj *cobj;
-	struct m0_op *cops[1] = {NULL};
+	struct motr_comp_obj_layers_args *args;
+
+	if (nr_layers <= 0 || layers == NULL)
+		return -EINVAL;
 
 	args = mio_mem_alloc(sizeof *args);
 	if (args == NULL)
 		return -ENOMEM;
-
-	cobj = (struct m0_obj *)obj->mo_drv_obj;
-	/* The layout may have been changed. */
-	if (cobj->ob_layout != NULL)
-		m0_client_layout_free(cobj->ob_layout);
-	clayout = m0_client_layout_alloc(M0_LT_COMPOSITE);
-	if (clayout == NULL) {
-		rc = -ENOMEM;
-		goto error;
-	}
-	cobj->ob_layout = clayout;
-
-        m0_client_layout_op(cobj, M0_EO_LAYOUT_GET, clayout, &cops[0]);
-
-	args->gla_data = query_data;
-	args->gla_clayout = clayout;
-	rc = mio_driver_op_add(op, pp, args, NULL, cops[0], NULL);
+	args->cla_add = add;
+	args->cla_nr_layers = nr_layers;
+	args->cla_layers = layers;
+
+	if (obj->mo_comp_layout_cached)
+		rc = motr_comp_obj_layers_update(obj, args, true, op);
+	else
+		rc = motr_comp_obj_layout_get(obj, args,
+					      motr_comp_obj_layers_update_pp,
+					      op);
 	if (rc < 0)
-		goto error;
-	m0_op_launch(cops, ARRAY_SIZE(cops));
-	return 0;
-
-error:
-	m0_op_fini(cops[0]);
-	m0_op_free(cops[0]);
-	m0_client_layout_free(clayout);
+		motr_comp_obj_layers_args_free(args);
 	return rc;
 }
 
-struct motr_comp_obj_del_layers_args {
-	int dla_nr_layers_to_del;
-	struct mio_comp_obj_layer *dla_layers_to_del;
-};
-
 static int
-motr_comp_obj_del_layers_pp(struct mio_op *op)
+mio_motr_comp_obj_add_layers(struct mio_obj *obj, int nr_layers,
+			       struct mio_comp_obj_layer *layers,
+			       struct mio_op *op)
 {
-	int rc = 0;
-	int i;
-	struct mio_obj *obj;
-	struct m0_uint128 id128;
-	struct m0_obj *cobj;
-	struct m0_op *cops[1] = {NULL};
-        struct m0_client_layout *clayout;
-	int nr_layers_to_del;
-	struct mio_comp_obj_layer *layers_to_del;
-	struct motr_comp_obj_get_layers_args *args;
-	struct motr_comp_obj_del_layers_args *del_layers_args;
-
-	obj = op->mop_who.obj;
-	assert(obj != NULL);
-
-	args = (struct motr_comp_obj_get_layers_args *)
-	       op->mop_drv_op_chain.mdoc_head->mdo_post_proc_data;
-	assert(args != NULL);
-	del_layers_args =
-		(struct motr_comp_obj_del_layers_args*) args->gla_data;
-	nr_layers_to_del = del_layers_args->dla_nr_layers_to_del;
-	layers_to_del = del_layers_args->dla_layers_to_del;
-	clayout = (struct m0_client_layout *)args->gla_clayout;
-
-	/* Here to remove the layers required. */
-        for (i = 0; i < nr_layers_to_del; i++) {
-		mio__obj_id_to_uint128(&layers_to_del[i].mcol_oid, &id128);
-		m0_composite_layer_del(clayout, id128);
-        }
-
-	/* Create and launch LAYOUT op. */
-	cobj = (struct m0_obj *)obj->mo_drv_obj;
-        m0_client_layout_op(cobj, M0_EO_LAYOUT_SET, clayout, &cops[0]);
-
-	rc = mio_driver_op_add(op, NULL, NULL, NULL, cops[0], NULL);
-	if (rc < 0)
-		goto exit;
-	m0_op_launch(cops, ARRAY_SIZE(cops));
-	rc = MIO_DRV_OP_NEXT;
-
-exit:
-	mio_mem_free(del_layers_args);
-	mio_mem_free(args);
-	return rc;
+	return motr_comp_obj_layers_add_del(obj, true, nr_layers, layers, op);
 }
 
 static int
@@ -287,23 +322,8 @@ mio_motr_comp_obj_del_layers(struct mio_obj *obj,
 			       struct mio_comp_obj_layer *layers_to_del,
 			       struct mio_op *op)
 {
-	struct motr_comp_obj_del_layers_args *args;
-
-	/*
-	 * Deleting layers of a composite object is done in 2 steps:
-	 * (1) retrieve the composite object's layout (how many layers).
-	 * (2) delete layers from the layout and launch an operation to
-	 *     update the layout in Motr service side.
-	 */
-
-	args = mio_mem_alloc(sizeof *args);
-	if (args == NULL)
-		return -ENOMEM;
-	args->dla_nr_layers_to_del = nr_layers_to_del;
-	args->dla_layers_to_del = layers_to_del;
-
-	return motr_comp_obj_get_layers(obj, args,
-			motr_comp_obj_del_layers_pp, op);
+	return motr_comp_obj_layers_add_del(obj, false, nr_layers_to_del,
+					    layers_to_del, op);
 }
 
 /**
@@ -314,34 +334,14 @@ mio_motr_comp_obj_del_layers(struct mio_obj *obj,
  * Temporary solution: MIO hacks it by iterating the layer list by explictly
  * manipulating the list as m0_tl_* APIs are exposed in 'libmotr'.
  */
-#define comp_obj_get_layout_n_args(op, cop, clayout, mlayout, args)  \
-	do { \
-		cop = (struct m0_op *) \
-		op->mop_drv_op_chain.mdoc_head->mdo_op; \
-		assert(cop != NULL); \
-		if (cop->op_sm.sm_state != M0_OS_STABLE) \
-			return -EIO; \
-			\
-		args = (struct motr_comp_obj_get_layers_args *) \
-		       op->mop_drv_op_chain.mdoc_head->mdo_post_proc_data; \
-		mlayout = (struct mio_comp_obj_layout *)args->gla_data; \
-		clayout = (struct m0_client_layout *)args->gla_clayout; \
-	} while (0)
-
-
 #ifdef __MIO_MOTR_COMP_OBJ_LAYER_GET_SUPP__
-static int motr_comp_obj_list_layers_pp(struct mio_op *op)
+static int motr_comp_obj_layout_copy(struct m0_client_layout *clayout,
+				     struct mio_comp_obj_layout *mlayout)
 {
 	int i;
 	int rc = 0;
 	uint64_t nr_layers = 0;
 	struct m0_uint128 *layer_ids;
-	struct m0_op *cop;
-	struct m0_client_layout *clayout;
-	struct mio_comp_obj_layout *mlayout;
-	struct motr_comp_obj_get_layers_args *args;
-
-	comp_obj_get_layout_n_args(op, cop, clayout, mlayout, args);
 
 	/* Retrieve layers. */
 	rc = m0_composite_layer_get(clayout, &nr_layers, &layer_ids);
@@ -371,21 +371,16 @@ exit:
 /*
  * Uggly hacking :).
  */
-static int motr_comp_obj_list_layers_pp(struct mio_op *op)
+static int motr_comp_obj_layout_copy(struct m0_client_layout *clayout,
+				     struct mio_comp_obj_layout *mlayout)
 {
 	int i;
-	int rc = 0;
 	uint64_t nr_layers = 0;
-	struct m0_op *cop;
-	struct m0_client_layout *clayout;
-	struct mio_comp_obj_layout *mlayout;
 	struct m0_client_composite_layout *comp_layout;
 	struct m0_composite_layer *comp_layer;
 	struct m0_list_link *lnk;
 	struct m0_tlink *tlnk;
-	struct motr_comp_obj_get_layers_args *args;
 
-	comp_obj_get_layout_n_args(op, cop, clayout, mlayout, args);
 	comp_layout = container_of(clayout, struct m0_client_composite_layout,
 				   ccl_layout);
 
@@ -393,10 +388,8 @@ static int motr_comp_obj_list_layers_pp(struct mio_op *op)
 	mlayout->mlo_nr_layers = nr_layers;
 	mlayout->mlo_layers =
 		mio_mem_alloc(nr_layers * sizeof(struct mio_comp_obj_layer));
-	if (mlayout->mlo_layers == NULL) {
-		rc = -ENOMEM;
-		goto exit;
-	}
+	if (mlayout->mlo_layers == NULL)
+		return -ENOMEM;
 
 	lnk = comp_layout->ccl_layers.t_head.l_head;
 	for (i = 0; i < nr_layers; i++) {
@@ -409,29 +402,54 @@ static int motr_comp_obj_list_layers_pp(struct mio_op *op)
 					  ccr_tlink);
 		mio__uint128_to_obj_id(&comp_layer->ccr_subobj,
 				       &(mlayout->mlo_layers[i]).mcol_oid);
+		mlayout->mlo_layers[i].mcol_priority = comp_layer->ccr_priority;
 
 		lnk = lnk->ll_next;
 	}
-	assert(rc == 0);
-	return MIO_DRV_OP_FINAL;
-
-exit:
-	/*
-	 * No need to call m0_client_layout_free(clayout) as
-	 * m0_obj_fini() will release layout data structure
-	 * which is triggerred by mio_obj_close().
-	 */
-	return rc;
+	return 0;
 }
 #endif
 
+static int motr_comp_obj_list_layers_pp(struct mio_op *op)
+{
+	int rc;
+	struct mio_obj *obj = op->mop_who.obj;
+	struct m0_obj *cobj;
+	struct motr_comp_obj_layers_args *args;
+
+	args = (struct motr_comp_obj_layers_args *)
+	       op->mop_drv_op_chain.mdoc_head->mdo_post_proc_data;
+	cobj = (struct m0_obj *)obj->mo_drv_obj;
+	obj->mo_comp_layout_cached = true;
+	rc = motr_comp_obj_layout_copy(cobj->ob_layout, args->cla_ret_layout);
+	return rc < 0? rc : MIO_DRV_OP_FINAL;
+}
+
 static int
 mio_motr_comp_obj_list_layers(struct mio_obj *obj,
 				struct mio_comp_obj_layout *ret_layout,
 				struct mio_op *op)
 {
-	return motr_comp_obj_get_layers(obj, ret_layout,
-			motr_comp_obj_list_layers_pp, op);
+	int rc;
+	struct m0_obj *cobj;
+	struct motr_comp_obj_layers_args *args;
+
+	/* Served from the cache, nothing to launch. */
+	if (obj->mo_comp_layout_cached) {
+		cobj = (struct m0_obj *)obj->mo_drv_obj;
+		rc = motr_comp_obj_layout_copy(cobj->ob_layout, ret_layout);
+		return rc < 0? rc : mio_driver_op_add_done(op);
+	}
+
+	args = mio_mem_alloc(sizeof *args);
+	if (args == NULL)
+		return -ENOMEM;
+	args->cla_ret_layout = ret_layout;
+	rc = motr_comp_obj_layout_get(obj, args,
+				      motr_comp_obj_list_layers_pp, op);
+	if (rc < 0)
+		mio_mem_free(args);
+	return rc;
 }
 
 struct motr_comp_obj_exts_pp_args {
@@ -441,14 +459,34 @@ struct motr_comp_obj_exts_pp_args {
 	int *epa_rcs;
 	int *epa_nr_ret_exts;
 	struct mio_obj_ext *epa_ret_exts;
+	/* The layer and number of extents in question. */
+	struct mio_obj_id epa_layer_id;
+	int epa_nr_exts;
 };
 
+static void
+motr_comp_obj_exts_op_args_fini(struct motr_comp_obj_exts_pp_args *args)
+{
+	mio_mem_free(args->epa_idx);
+        m0_bufvec_free(args->epa_keys);
+        m0_bufvec_free(args->epa_vals);
+        m0_free0(&args->epa_rcs);
+	args->epa_idx = NULL;
+	args->epa_keys = NULL;
+	args->epa_vals = NULL;
+}
+
+/**
+ * Creates an op on a layer's extent index for the extents given and
+ * keeps what the op needs in `args`, which is released by
+ * motr_comp_obj_exts_op_args_fini().
+ */
 static int
-motr_comp_obj_extent_query(struct mio_obj_id *layer_id,
-			     int nr_exts, struct mio_obj_ext *exts,
-			     int *nr_ret_exts, int opcode, struct mio_op *op,
-			     mio_driver_op_postprocess pp,
-			     struct motr_comp_obj_exts_pp_args *pp_args)
+motr_comp_obj_exts_op_init(struct mio_obj_id *layer_id,
+			   int nr_exts, struct mio_obj_ext *exts,
+			   int opcode, uint32_t flags,
+			   struct motr_comp_obj_exts_pp_args *args,
+			   struct m0_op **cop)
 {
 	int i;
         int rc = 0;
@@ -457,7 +495,6 @@ motr_comp_obj_extent_query(struct mio_obj_id *layer_id,
         struct m0_bufvec *vals = NULL;
         int *rcs = NULL;
 	struct m0_uint128 layer_id128;
-        struct m0_op *cops[1] = {NULL};
         struct m0_idx *idx;
         struct m0_composite_layer_idx_key key;
         struct m0_composite_layer_idx_val val;
@@ -506,27 +543,19 @@ motr_comp_obj_extent_query(struct mio_obj_id *layer_id,
 
         mio_memset(idx, 0, sizeof *idx);
         m0_composite_layer_idx(layer_id128, true, idx);
-        m0_idx_op(idx, opcode, keys, vals, rcs, 0, &cops[0]);
-
-	assert(pp_args != NULL);
-	pp_args->epa_idx = idx;
-	pp_args->epa_keys = keys;
-	pp_args->epa_vals = vals;
-	pp_args->epa_rcs = rcs;
-	pp_args->epa_ret_exts = exts;
-	pp_args->epa_nr_ret_exts = nr_ret_exts;
-	rc = mio_driver_op_add(op, pp, pp_args, NULL, cops[0], NULL);
-	if (rc < 0)
+        rc = m0_idx_op(idx, opcode, keys, vals, rcs, flags, cop);
+	if (rc != 0)
 		goto err_exit;
 
-        m0_op_launch(cops, 1);
+	args->epa_idx = idx;
+	args->epa_keys = keys;
+	args->epa_vals = vals;
+	args->epa_rcs = rcs;
+	args->epa_layer_id = *layer_id;
+	args->epa_nr_exts = nr_exts;
 	return 0;
 
 err_exit:
-	if (cops[0] != NULL) {
-		m0_op_fini(cops[0]);
-		m0_op_free(cops[0]);
-	}
         m0_bufvec_free(keys);
         m0_bufvec_free(vals);
         m0_free0(&rcs);
@@ -534,74 +563,455 @@ err_exit:
         return rc;
 }
 
-static int motr_comp_obj_exts_release_pp(struct mio_op *op)
-{
-	struct motr_comp_obj_exts_pp_args *pp_args;
-
-	pp_args = (struct motr_comp_obj_exts_pp_args *)
-		  op->mop_drv_op_chain.mdoc_head->mdo_post_proc_data;
-	mio_mem_free(pp_args->epa_idx);
-        m0_bufvec_free(pp_args->epa_keys);
-        m0_bufvec_free(pp_args->epa_vals);
-        m0_free0(&pp_args->epa_rcs);
+static int
+motr_comp_obj_extent_query(struct mio_obj_id *layer_id,
+			     int nr_exts, struct mio_obj_ext *exts,
+			     int *nr_ret_exts, int opcode, struct mio_op *op,
+			     mio_driver_op_postprocess pp,
+			     struct motr_comp_obj_exts_pp_args *pp_args)
+{
+        int rc;
+        struct m0_op *cops[1] = {NULL};
+
+	assert(pp_args != NULL);
+	rc = motr_comp_obj_exts_op_init(layer_id, nr_exts, exts, opcode, 0,
+					pp_args, &cops[0]);
+	if (rc < 0)
+		return rc;
+	pp_args->epa_ret_exts = exts;
+	pp_args->epa_nr_ret_exts = nr_ret_exts;
+
+	rc = mio_driver_op_add(op, pp, pp_args, NULL, cops[0], NULL);
+	if (rc < 0) {
+		m0_op_fini(cops[0]);
+		m0_op_free(cops[0]);
+		motr_comp_obj_exts_op_args_fini(pp_args);
+		return rc;
+	}
+
+        m0_op_launch(cops, 1);
+	return 0;
+}
+
+static int motr_comp_obj_exts_release_pp(struct mio_op *op)
+{
+	struct motr_comp_obj_exts_pp_args *pp_args;
+
+	pp_args = (struct motr_comp_obj_exts_pp_args *)
+		  op->mop_drv_op_chain.mdoc_head->mdo_post_proc_data;
+	motr_comp_obj_exts_op_args_fini(pp_args);
 	mio_mem_free(pp_args);
 
 	return MIO_DRV_OP_FINAL;
 }
 
+/**
+ * Copies extents returned by a NEXT op into `exts`. NEXT returns fewer
+ * records than asked for when the end of the layer's extents is
+ * reached: stop at the first failed record or the first one which
+ * doesn't belong to the layer. Returns the number of extents copied.
+ */
+static int motr_comp_obj_exts_next_copy(struct motr_comp_obj_exts_pp_args *args,
+					struct mio_obj_ext *exts)
+{
+	int i;
+	int nr_exts;
+        struct m0_bufvec *keys;
+        struct m0_bufvec *vals;
+	struct m0_composite_layer_idx_key ekey;
+	struct m0_composite_layer_idx_val eval;
+	struct m0_uint128 layer_id128;
+
+	keys  = args->epa_keys;
+	vals  = args->epa_vals;
+	mio__obj_id_to_uint128(&args->epa_layer_id, &layer_id128);
+	nr_exts = keys->ov_vec.v_nr;
+	for (i = 0; i < nr_exts; i++) {
+		if (args->epa_rcs[i] != 0 || keys->ov_buf[i] == NULL)
+			break;
+		m0_composite_layer_idx_key_from_buf(
+			&ekey, keys->ov_buf[i]);
+		if (ekey.cek_layer_id.u_hi != layer_id128.u_hi ||
+		    ekey.cek_layer_id.u_lo != layer_id128.u_lo)
+			break;
+		exts[i].moe_off = ekey.cek_off;
+		if (vals->ov_buf[i] == NULL)
+			continue;
+		m0_composite_layer_idx_val_from_buf(
+			&eval, vals->ov_buf[i]);
+		exts[i].moe_size = eval.cev_len;
+	}
+	return i;
+}
+
+/*
+ * Extent records are coalesced when they are written, see
+ * mio_comp_obj_map_exts_plan(). Adding or deleting extents, as well as
+ * compacting a layer's extent index, ends up putting a set of records
+ * (overwriting existing ones at the same offsets) and deleting another
+ * set. Both are launched together as a group, a reader may briefly see
+ * overlapping records, which cover the same data.
+ */
+enum {
+	MOTR_COMP_OBJ_EXTS_ADD = 0,
+	MOTR_COMP_OBJ_EXTS_DEL,
+	MOTR_COMP_OBJ_EXTS_COMPACT,
+};
+
+enum {
+	MOTR_COMP_OBJ_SCAN_BATCH = 256,
+};
+
+struct motr_comp_obj_exts_update_args {
+	int eua_opcode;
+	struct mio_obj_id eua_layer_id;
+
+	/*
+	 * Extents added or deleted by the application, or written through
+	 * tiering in which case they are owned by the args.
+	 */
+	int eua_nr_exts;
+	struct mio_obj_ext *eua_exts;
+	bool eua_exts_owned;
+
+	int eua_nr_put;
+	struct mio_obj_ext *eua_put;
+	int eua_nr_del;
+	struct mio_obj_ext *eua_del;
+
+	int eua_nr_cops;
+	struct m0_op *eua_cops[2];
+	struct motr_comp_obj_exts_pp_args eua_op_args[2];
+
+	/* Scanning the extent index for compaction or deletion. */
+	int eua_nr_recs;
+	int eua_max_nr_recs;
+	struct mio_obj_ext *eua_recs;
+	struct mio_obj_ext *eua_batch;
+	struct motr_comp_obj_exts_pp_args eua_next_args;
+};
+
+static void
+motr_comp_obj_exts_update_args_free(struct motr_comp_obj_exts_update_args *args)
+{
+	int i;
+
+	for (i = 0; i < args->eua_nr_cops; i++)
+		motr_comp_obj_exts_op_args_fini(args->eua_op_args + i);
+	motr_comp_obj_exts_op_args_fini(&args->eua_next_args);
+	if (args->eua_exts_owned)
+		mio_mem_free(args->eua_exts);
+	mio_mem_free(args->eua_put);
+	mio_mem_free(args->eua_del);
+	mio_mem_free(args->eua_recs);
+	mio_mem_free(args->eua_batch);
+	mio_mem_free(args);
+}
+
+static int motr_comp_obj_exts_update_op_fini(struct mio_driver_op *dop)
+{
+	motr_comp_obj_exts_update_args_free(
+		(struct motr_comp_obj_exts_update_args *)dop->mdo_op_args);
+	return 0;
+}
+
+/**
+ * Reflect the extent update in the object's extent map. If any record
+ * failed, what is in the extent index is unknown and the layer will be
+ * reloaded by the next lookup. Deleting a record which has been merged
+ * into another one already is not an error.
+ */
+static int motr_comp_obj_exts_update_pp(struct mio_op *op)
+{
+	int i;
+	int j;
+	int rc = 0;
+	struct motr_comp_obj_exts_pp_args *op_args;
+	struct motr_comp_obj_exts_update_args *args;
+
+	args = (struct motr_comp_obj_exts_update_args *)
+	       op->mop_drv_op_chain.mdoc_head->mdo_post_proc_data;
+	for (i = 0; i < args->eua_nr_cops && rc == 0; i++) {
+		op_args = args->eua_op_args + i;
+		rc = m0_rc(args->eua_cops[i]);
+		for (j = 0; j < op_args->epa_nr_exts && rc == 0; j++)
+			/* Only DEL ops go without values. */
+			if (op_args->epa_rcs[j] != 0 &&
+			    (op_args->epa_rcs[j] != -ENOENT ||
+			     op_args->epa_vals != NULL))
+				rc = op_args->epa_rcs[j];
+	}
+
+	/* Compaction doesn't change what the layer covers. */
+	if (args->eua_opcode == MOTR_COMP_OBJ_EXTS_COMPACT)
+		return rc < 0? rc : MIO_DRV_OP_FINAL;
+
+	if (rc == 0)
+		mio_comp_obj_map_exts_update(
+			op->mop_who.obj, &args->eua_layer_id,
+			args->eua_nr_exts, args->eua_exts,
+			args->eua_opcode == MOTR_COMP_OBJ_EXTS_ADD);
+	else
+		mio_comp_obj_map_layer_invalidate(op->mop_who.obj,
+						  &args->eua_layer_id);
+	return rc < 0? rc : MIO_DRV_OP_FINAL;
+}
+
+/**
+ * Launches the PUT and DEL ops planned in `args`. Once this function
+ * succeeds, `args` is owned by the driver op.
+ */
 static int
-mio_motr_comp_obj_add_extents(struct mio_obj *obj,
-				struct mio_obj_id *layer_id,
-				int nr_exts, struct mio_obj_ext *exts,
-				struct mio_op *op)
+motr_comp_obj_exts_update_launch(struct motr_comp_obj_exts_update_args *args,
+				 struct mio_op *op)
+{
+	int i;
+	int rc = 0;
+	struct m0_op **cops = args->eua_cops;
+	mio_driver_op_fini op_fini;
+
+	/* Once the layer is scanned, args are owned by the first NEXT op. */
+	op_fini = args->eua_batch != NULL? NULL :
+		  motr_comp_obj_exts_update_op_fini;
+
+	if (args->eua_nr_put != 0) {
+		rc = motr_comp_obj_exts_op_init(
+			&args->eua_layer_id, args->eua_nr_put, args->eua_put,
+			M0_IC_PUT, M0_OIF_OVERWRITE,
+			args->eua_op_args + args->eua_nr_cops,
+			cops + args->eua_nr_cops);
+		if (rc < 0)
+			goto error;
+		args->eua_nr_cops++;
+	}
+	if (args->eua_nr_del != 0) {
+		rc = motr_comp_obj_exts_op_init(
+			&args->eua_layer_id, args->eua_nr_del, args->eua_del,
+			M0_IC_DEL, 0,
+			args->eua_op_args + args->eua_nr_cops,
+			cops + args->eua_nr_cops);
+		if (rc < 0)
+			goto error;
+		args->eua_nr_cops++;
+	}
+
+	/* Nothing to change in the extent index. */
+	if (args->eua_nr_cops == 0) {
+		rc = mio_driver_op_add_done(op);
+		if (rc < 0)
+			return rc;
+		if (op_fini != NULL)
+			motr_comp_obj_exts_update_args_free(args);
+		return 0;
+	}
+
+	rc = mio_driver_op_group_add(op, motr_comp_obj_exts_update_pp, args,
+				     op_fini,
+				     args->eua_nr_cops, (void **)cops, args);
+	if (rc < 0)
+		goto error;
+	m0_op_launch(cops, args->eua_nr_cops);
+	return 0;
+
+error:
+	for (i = 0; i < args->eua_nr_cops; i++) {
+		m0_op_fini(cops[i]);
+		m0_op_free(cops[i]);
+		motr_comp_obj_exts_op_args_fini(args->eua_op_args + i);
+	}
+	args->eua_nr_cops = 0;
+	return rc;
+}
+
+static int motr_comp_obj_exts_scan(struct motr_comp_obj_exts_update_args *args,
+				   off_t off, struct mio_op *op);
+
+/**
+ * Collects the records returned by a NEXT op. Once all records of the
+ * layer are collected, the records planned for compaction or deletion
+ * are written.
+ */
+static int motr_comp_obj_exts_scan_pp(struct mio_op *op)
 {
 	int rc;
-	struct motr_comp_obj_exts_pp_args *pp_args;
+	int nr;
+	int max_nr;
+	struct mio_obj_ext *recs;
+	struct motr_comp_obj_exts_update_args *args;
 
-	pp_args = mio_mem_alloc(sizeof *pp_args);
-	if (pp_args == NULL)
+	args = (struct motr_comp_obj_exts_update_args *)
+	       op->mop_drv_op_chain.mdoc_head->mdo_post_proc_data;
+	nr = motr_comp_obj_exts_next_copy(&args->eua_next_args,
+					  args->eua_batch);
+	motr_comp_obj_exts_op_args_fini(&args->eua_next_args);
+
+	if (args->eua_nr_recs + nr > args->eua_max_nr_recs) {
+		max_nr = args->eua_max_nr_recs * 2 ?:
+			 MOTR_COMP_OBJ_SCAN_BATCH;
+		recs = mio_mem_alloc(max_nr * sizeof *recs);
+		if (recs == NULL)
+			return -ENOMEM;
+		if (args->eua_nr_recs != 0)
+			mio_mem_copy(recs, args->eua_recs,
+				     args->eua_nr_recs * sizeof *recs);
+		mio_mem_free(args->eua_recs);
+		args->eua_recs = recs;
+		args->eua_max_nr_recs = max_nr;
+	}
+	if (nr != 0)
+		mio_mem_copy(args->eua_recs + args->eua_nr_recs,
+			     args->eua_batch, nr * sizeof *recs);
+	args->eua_nr_recs += nr;
+
+	if (nr == MOTR_COMP_OBJ_SCAN_BATCH)
+		rc = motr_comp_obj_exts_scan(args,
+			args->eua_batch[nr - 1].moe_off + 1, op);
+	else if (args->eua_opcode == MOTR_COMP_OBJ_EXTS_COMPACT)
+		rc = mio_comp_obj_exts_compact_plan(
+			args->eua_nr_recs, args->eua_recs,
+			&args->eua_nr_put, &args->eua_put,
+			&args->eua_nr_del, &args->eua_del)? :
+		     motr_comp_obj_exts_update_launch(args, op);
+	else
+		rc = mio_comp_obj_exts_del_plan(
+			args->eua_nr_exts, args->eua_exts,
+			args->eua_nr_recs, args->eua_recs,
+			&args->eua_nr_put, &args->eua_put,
+			&args->eua_nr_del, &args->eua_del)? :
+		     motr_comp_obj_exts_update_launch(args, op);
+	return rc < 0? rc : MIO_DRV_OP_NEXT;
+}
+
+static int motr_comp_obj_exts_scan(struct motr_comp_obj_exts_update_args *args,
+				   off_t off, struct mio_op *op)
+{
+	int rc;
+	struct m0_op *cops[1] = {NULL};
+
+	mio_memset(args->eua_batch, 0,
+		   MOTR_COMP_OBJ_SCAN_BATCH * sizeof(struct mio_obj_ext));
+	args->eua_batch[0].moe_off = off;
+	rc = motr_comp_obj_exts_op_init(&args->eua_layer_id,
+					MOTR_COMP_OBJ_SCAN_BATCH,
+					args->eua_batch, M0_IC_NEXT, 0,
+					&args->eua_next_args, &cops[0]);
+	if (rc < 0)
+		return rc;
+
+	/* The first NEXT op owns `args` until the op is finalised. */
+	rc = mio_driver_op_add(op, motr_comp_obj_exts_scan_pp, args,
+			       off == 0? motr_comp_obj_exts_update_op_fini :
+					 NULL,
+			       cops[0], args);
+	if (rc < 0) {
+		m0_op_fini(cops[0]);
+		m0_op_free(cops[0]);
+		motr_comp_obj_exts_op_args_fini(&args->eua_next_args);
+		return rc;
+	}
+	m0_op_launch(cops, 1);
+	return 0;
+}
+
+/* Scans all records of the layer, the scan owns `args` on success. */
+static int
+motr_comp_obj_exts_scan_start(struct motr_comp_obj_exts_update_args *args,
+			      struct mio_op *op)
+{
+	args->eua_batch = mio_mem_alloc(MOTR_COMP_OBJ_SCAN_BATCH *
+					sizeof(struct mio_obj_ext));
+	if (args->eua_batch == NULL)
 		return -ENOMEM;
+	return motr_comp_obj_exts_scan(args, 0, op);
+}
 
-	rc = motr_comp_obj_extent_query(
-		layer_id, nr_exts, exts, NULL, M0_IC_PUT, op,
-		motr_comp_obj_exts_release_pp, pp_args);
+static int
+motr_comp_obj_exts_update(struct mio_obj *obj, struct mio_obj_id *layer_id,
+			  int nr_exts, struct mio_obj_ext *exts,
+			  int opcode, bool own_exts, struct mio_op *op)
+{
+	int rc;
+	struct motr_comp_obj_exts_update_args *args;
+
+	if (layer_id == NULL || nr_exts < 0 || (nr_exts > 0 && exts == NULL))
+		return -EINVAL;
+
+	args = mio_mem_alloc(sizeof *args);
+	if (args == NULL) {
+		if (own_exts)
+			mio_mem_free(exts);
+		return -ENOMEM;
+	}
+	args->eua_opcode = opcode;
+	args->eua_layer_id = *layer_id;
+	args->eua_nr_exts = nr_exts;
+	args->eua_exts = exts;
+	args->eua_exts_owned = own_exts;
+
+	/*
+	 * Deleting extents of a layer not loaded in the map plans from
+	 * the layer's records, which are scanned first.
+	 */
+	rc = mio_comp_obj_map_exts_plan(obj, layer_id, nr_exts, exts,
+					opcode == MOTR_COMP_OBJ_EXTS_ADD,
+					&args->eua_nr_put, &args->eua_put,
+					&args->eua_nr_del, &args->eua_del);
+	if (rc == -ENODATA)
+		rc = motr_comp_obj_exts_scan_start(args, op);
+	else if (rc == 0)
+		rc = motr_comp_obj_exts_update_launch(args, op);
 	if (rc < 0)
-		mio_mem_free(pp_args);
+		motr_comp_obj_exts_update_args_free(args);
 	return rc;
 }
 
+static int
+mio_motr_comp_obj_add_extents(struct mio_obj *obj,
+				struct mio_obj_id *layer_id,
+				int nr_exts, struct mio_obj_ext *exts,
+				struct mio_op *op)
+{
+	return motr_comp_obj_exts_update(obj, layer_id, nr_exts, exts,
+					 MOTR_COMP_OBJ_EXTS_ADD, false, op);
+}
+
 static int
 mio_motr_comp_obj_del_extents(struct mio_obj *obj,
 				struct mio_obj_id *layer_id,
 				int nr_exts, struct mio_obj_ext *exts,
 				struct mio_op *op)
+{
+	return motr_comp_obj_exts_update(obj, layer_id, nr_exts, exts,
+					 MOTR_COMP_OBJ_EXTS_DEL, false, op);
+}
+
+static int
+mio_motr_comp_obj_compact_extents(struct mio_obj *obj,
+				  struct mio_obj_id *layer_id,
+				  struct mio_op *op)
 {
 	int rc;
-	struct motr_comp_obj_exts_pp_args *pp_args;
+	struct motr_comp_obj_exts_update_args *args;
 
-	pp_args = mio_mem_alloc(sizeof *pp_args);
-	if (pp_args == NULL)
+	if (layer_id == NULL)
+		return -EINVAL;
+
+	args = mio_mem_alloc(sizeof *args);
+	if (args == NULL)
 		return -ENOMEM;
+	args->eua_opcode = MOTR_COMP_OBJ_EXTS_COMPACT;
+	args->eua_layer_id = *layer_id;
 
-	rc = motr_comp_obj_extent_query(
-		layer_id, nr_exts, exts, NULL, M0_IC_DEL, op,
-		motr_comp_obj_exts_release_pp, pp_args);
+	rc = motr_comp_obj_exts_scan_start(args, op);
 	if (rc < 0)
-		mio_mem_free(pp_args);
+		motr_comp_obj_exts_update_args_free(args);
 	return rc;
 }
 
 static int motr_comp_obj_exts_get_pp(struct mio_op *op)
 {
-	int i;
-	int nr_exts;
-        struct m0_bufvec *keys;
-        struct m0_bufvec *vals;
 	struct m0_op *cop;
-	struct m0_composite_layer_idx_key ekey;
-	struct m0_composite_layer_idx_val eval;
 	struct motr_comp_obj_exts_pp_args *pp_args;
-	struct mio_obj_ext *ret_exts;
 
 	cop = (struct m0_op *)
 	      op->mop_drv_op_chain.mdoc_head->mdo_op;
@@ -612,23 +1022,10 @@ static int motr_comp_obj_exts_get_pp(struct mio_op *op)
 	/* Copy returned values. */
 	pp_args = (struct motr_comp_obj_exts_pp_args *)
 		  op->mop_drv_op_chain.mdoc_head->mdo_post_proc_data;
-	ret_exts = pp_args->epa_ret_exts;
-	assert(ret_exts != NULL);
-	keys  = pp_args->epa_keys;
-	vals  = pp_args->epa_vals;
-	nr_exts = keys->ov_vec.v_nr;
-	for (i = 0; i < nr_exts; i++) {
-		m0_composite_layer_idx_key_from_buf(
-			&ekey, keys->ov_buf[i]);
-		ret_exts[i].moe_off = ekey.cek_off;
-		if (vals->ov_buf[i] == NULL)
-			continue;
-		m0_composite_layer_idx_val_from_buf(
-			&eval, vals->ov_buf[i]);
-		ret_exts[i].moe_size = eval.cev_len;
-	}
+	assert(pp_args->epa_ret_exts != NULL);
 	assert(pp_args->epa_nr_ret_exts != NULL);
-	*pp_args->epa_nr_ret_exts = nr_exts;
+	*pp_args->epa_nr_ret_exts =
+		motr_comp_obj_exts_next_copy(pp_args, pp_args->epa_ret_exts);
 
 	/* Free all allocated resources for the extent query. */
         return motr_comp_obj_exts_release_pp(op);
@@ -662,6 +1059,500 @@ mio_motr_comp_obj_get_extents(struct mio_obj *obj,
 	return 0;
 }
 
+static bool mio_motr_comp_obj_is_composite(struct mio_obj *obj)
+{
+	struct m0_obj *cobj;
+
+	cobj = (struct m0_obj *)obj->mo_drv_obj;
+	if (cobj == NULL)
+		return false;
+	if (cobj->ob_layout != NULL)
+		return cobj->ob_layout->ml_type == M0_LT_COMPOSITE;
+	/*
+	 * The layout isn't fetched by open. Objects made composite carry
+	 * a flag in their attributes, stored along with the layout.
+	 */
+	return obj->mo_attrs.moa_composite;
+}
+
+/*
+ * Reading layers of a composite object. MIO resolves the requested
+ * ranges into segments each served by one layer (see
+ * mio_comp_obj_readv()). A segment is cut into pieces no bigger than
+ * what a Motr op can carry, the pieces of a layer are packed into as
+ * few ops as possible and the ops of all layers are launched as one
+ * group, so layers are read concurrently.
+ *
+ * Motr reads whole pages. A piece which doesn't cover whole pages of
+ * the requested range is read into a bounce buffer and the requested
+ * part is copied into the application's buffer once the group is done.
+ */
+struct motr_comp_obj_read_piece {
+	struct mio_obj *crp_obj;
+	uint64_t crp_max_size;
+	int crp_op_idx;
+
+	uint64_t crp_off;
+	uint64_t crp_len;
+	char *crp_buf;
+
+	/* For a bounce buffer, the part to copy and where it goes. */
+	bool crp_bounce;
+	uint64_t crp_copy_off;
+	uint64_t crp_copy_len;
+	char *crp_copy_dst;
+};
+
+struct motr_comp_obj_read_args {
+	int cra_nr_pieces;
+	struct motr_comp_obj_read_piece *cra_pieces;
+
+	int cra_nr_cops;
+	struct m0_op **cra_cops;
+	struct m0_indexvec *cra_exts;
+	struct m0_bufvec *cra_data;
+	struct m0_bufvec *cra_attrs;
+};
+
+static void motr_comp_obj_read_args_free(struct motr_comp_obj_read_args *args)
+{
+	int i;
+
+	for (i = 0; i < args->cra_nr_pieces; i++)
+		if (args->cra_pieces[i].crp_bounce)
+			mio_mem_free(args->cra_pieces[i].crp_buf);
+	mio_mem_free(args->cra_pieces);
+
+	for (i = 0; i < args->cra_nr_cops; i++) {
+		m0_indexvec_free(args->cra_exts + i);
+		/* Data buffers belong to the pieces. */
+		mio_mem_free(args->cra_data[i].ov_buf);
+		mio_mem_free(args->cra_data[i].ov_vec.v_count);
+		m0_bufvec_free(args->cra_attrs + i);
+	}
+	mio_mem_free(args->cra_cops);
+	mio_mem_free(args->cra_exts);
+	mio_mem_free(args->cra_data);
+	mio_mem_free(args->cra_attrs);
+	mio_mem_free(args);
+}
+
+static int motr_comp_obj_read_op_fini(struct mio_driver_op *dop)
+{
+	motr_comp_obj_read_args_free(
+		(struct motr_comp_obj_read_args *)dop->mdo_op_args);
+	return 0;
+}
+
+static int motr_comp_obj_read_pp(struct mio_op *op)
+{
+	int i;
+	int rc;
+	struct motr_comp_obj_read_args *args;
+	struct motr_comp_obj_read_piece *piece;
+
+	args = (struct motr_comp_obj_read_args *)
+	       op->mop_drv_op_chain.mdoc_head->mdo_post_proc_data;
+	for (i = 0; i < args->cra_nr_cops; i++) {
+		rc = m0_rc(args->cra_cops[i]);
+		if (rc < 0)
+			return rc;
+	}
+
+	for (i = 0; i < args->cra_nr_pieces; i++) {
+		piece = args->cra_pieces + i;
+		if (piece->crp_bounce)
+			mio_mem_copy(piece->crp_copy_dst,
+				     piece->crp_buf + piece->crp_copy_off,
+				     piece->crp_copy_len);
+	}
+	return MIO_DRV_OP_FINAL;
+}
+
+/* Cuts segments into pieces, returns the number of pieces or -errno. */
+static int motr_comp_obj_read_pieces_build(int nr_segs,
+					   struct mio_comp_obj_seg *segs,
+					   struct motr_comp_obj_read_args *args)
+{
+	int i;
+	int rc;
+	int nr = 0;
+	int pass;
+	uint64_t pagesize;
+	uint64_t max_size;
+	uint64_t off;
+	uint64_t end;
+	uint64_t aligned_off;
+	uint64_t aligned_end;
+	uint64_t piece_off;
+	uint64_t piece_end;
+	struct m0_obj *cobj;
+	struct mio_comp_obj_seg *seg;
+	struct motr_comp_obj_read_piece *piece;
+
+	/* The first pass counts the pieces, the second one fills them. */
+	for (pass = 0; pass < 2; pass++) {
+		if (pass == 1) {
+			args->cra_pieces = mio_mem_alloc(nr * sizeof *piece);
+			if (args->cra_pieces == NULL)
+				return -ENOMEM;
+		}
+
+		nr = 0;
+		for (i = 0; i < nr_segs; i++) {
+			seg = segs + i;
+			cobj = (struct m0_obj *)seg->mcs_obj->mo_drv_obj;
+			pagesize = 1 << cobj->ob_attr.oa_bshift;
+			rc = mio__motr_obj_max_size_per_op(seg->mcs_obj,
+							   &max_size);
+			if (rc < 0)
+				return rc;
+			max_size = max_size / pagesize * pagesize;
+			if (max_size == 0)
+				max_size = pagesize;
+
+			off = seg->mcs_off;
+			end = off + seg->mcs_len;
+			aligned_off = off / pagesize * pagesize;
+			aligned_end = (end + pagesize - 1) / pagesize *
+				      pagesize;
+			for (piece_off = aligned_off; piece_off < aligned_end;
+			     piece_off = piece_end, nr++) {
+				piece_end = piece_off + max_size;
+				if (piece_end > aligned_end)
+					piece_end = aligned_end;
+				if (pass == 0)
+					continue;
+
+				piece = args->cra_pieces + nr;
+				piece->crp_obj = seg->mcs_obj;
+				piece->crp_max_size = max_size;
+				piece->crp_op_idx = -1;
+				piece->crp_off = piece_off;
+				piece->crp_len = piece_end - piece_off;
+				args->cra_nr_pieces = nr + 1;
+				if (piece_off >= off && piece_end <= end) {
+					piece->crp_buf = seg->mcs_buf +
+							 (piece_off - off);
+					continue;
+				}
+
+				piece->crp_buf = mio_mem_alloc(piece->crp_len);
+				if (piece->crp_buf == NULL)
+					return -ENOMEM;
+				piece->crp_bounce = true;
+				piece->crp_copy_off = piece_off < off?
+						      off - piece_off : 0;
+				piece->crp_copy_len =
+					(piece_end < end? piece_end : end) -
+					(piece_off + piece->crp_copy_off);
+				piece->crp_copy_dst = seg->mcs_buf +
+					(piece_off + piece->crp_copy_off - off);
+			}
+		}
+	}
+	return nr;
+}
+
+/*
+ * Packs pieces into ops. An op reads from one layer, its pieces must be
+ * in increasing and non-overlapping order and it can't carry more than
+ * the layer's limit. Returns the number of ops.
+ */
+static int motr_comp_obj_read_pieces_pack(struct motr_comp_obj_read_args *args)
+{
+	int i;
+	int j;
+	int nr_cops = 0;
+	uint64_t size;
+	uint64_t end;
+	struct motr_comp_obj_read_piece *first;
+	struct motr_comp_obj_read_piece *piece;
+
+	for (i = 0; i < args->cra_nr_pieces; i++) {
+		first = args->cra_pieces + i;
+		if (first->crp_op_idx >= 0)
+			continue;
+
+		first->crp_op_idx = nr_cops;
+		size = first->crp_len;
+		end = first->crp_off + first->crp_len;
+		for (j = i + 1; j < args->cra_nr_pieces; j++) {
+			piece = args->cra_pieces + j;
+			if (piece->crp_op_idx >= 0 ||
+			    piece->crp_obj != first->crp_obj ||
+			    piece->crp_off < end ||
+			    size + piece->crp_len > first->crp_max_size)
+				continue;
+			piece->crp_op_idx = nr_cops;
+			size += piece->crp_len;
+			end = piece->crp_off + piece->crp_len;
+		}
+		nr_cops++;
+	}
+	return nr_cops;
+}
+
+static int motr_comp_obj_read_ops_build(struct motr_comp_obj_read_args *args)
+{
+	int i;
+	int k;
+	int rc = 0;
+	int *nr_vecs;
+	struct m0_obj *cobj;
+	struct m0_indexvec *ext;
+	struct m0_bufvec *data;
+	struct m0_bufvec *attr;
+	struct motr_comp_obj_read_piece *piece;
+
+	args->cra_cops = mio_mem_alloc(args->cra_nr_cops * sizeof(void *));
+	args->cra_exts = mio_mem_alloc(args->cra_nr_cops * sizeof *ext);
+	args->cra_data = mio_mem_alloc(args->cra_nr_cops * sizeof *data);
+	args->cra_attrs = mio_mem_alloc(args->cra_nr_cops * sizeof *attr);
+	nr_vecs = mio_mem_alloc(args->cra_nr_cops * sizeof(int));
+	if (args->cra_cops == NULL || args->cra_exts == NULL ||
+	    args->cra_data == NULL || args->cra_attrs == NULL ||
+	    nr_vecs == NULL) {
+		/* Nothing to free per op yet. */
+		args->cra_nr_cops = 0;
+		mio_mem_free(nr_vecs);
+		return -ENOMEM;
+	}
+
+	for (i = 0; i < args->cra_nr_pieces; i++)
+		nr_vecs[args->cra_pieces[i].crp_op_idx]++;
+	for (k = 0; k < args->cra_nr_cops; k++) {
+		rc = m0_bufvec_empty_alloc(args->cra_data + k, nr_vecs[k])? :
+		     m0_bufvec_alloc(args->cra_attrs + k, nr_vecs[k], 1)? :
+		     m0_indexvec_alloc(args->cra_exts + k, nr_vecs[k]);
+		if (rc < 0)
+			goto exit;
+		nr_vecs[k] = 0;
+	}
+
+	for (i = 0; i < args->cra_nr_pieces; i++) {
+		piece = args->cra_pieces + i;
+		k = piece->crp_op_idx;
+		ext = args->cra_exts + k;
+		data = args->cra_data + k;
+		attr = args->cra_attrs + k;
+
+		data->ov_vec.v_count[nr_vecs[k]] = piece->crp_len;
+		data->ov_buf[nr_vecs[k]] = piece->crp_buf;
+		ext->iv_index[nr_vecs[k]] = piece->crp_off;
+		ext->iv_vec.v_count[nr_vecs[k]] = piece->crp_len;
+		/* we don't want any attributes */
+		attr->ov_vec.v_count[nr_vecs[k]] = 0;
+		nr_vecs[k]++;
+	}
+
+	for (i = 0; i < args->cra_nr_pieces; i++) {
+		piece = args->cra_pieces + i;
+		k = piece->crp_op_idx;
+		if (args->cra_cops[k] != NULL)
+			continue;
+		cobj = (struct m0_obj *)piece->crp_obj->mo_drv_obj;
+		rc = m0_obj_op(cobj, M0_OC_READ, args->cra_exts + k,
+			       args->cra_data + k, args->cra_attrs + k,
+			       0, 0, &args->cra_cops[k]);
+		if (rc != 0)
+			goto exit;
+	}
+
+exit:
+	mio_mem_free(nr_vecs);
+	return rc;
+}
+
+static int
+mio_motr_comp_obj_readv_layers(struct mio_obj *obj,
+			       int nr_segs, struct mio_comp_obj_seg *segs,
+			       struct mio_op *op)
+{
+	int i;
+	int rc;
+	struct motr_comp_obj_read_args *args;
+
+	if (nr_segs <= 0 || segs == NULL)
+		return -EINVAL;
+
+	args = mio_mem_alloc(sizeof *args);
+	if (args == NULL)
+		return -ENOMEM;
+	rc = motr_comp_obj_read_pieces_build(nr_segs, segs, args);
+	if (rc < 0)
+		goto error;
+	args->cra_nr_cops = motr_comp_obj_read_pieces_pack(args);
+	rc = motr_comp_obj_read_ops_build(args);
+	if (rc < 0)
+		goto error;
+
+	rc = mio_driver_op_group_add(op, motr_comp_obj_read_pp, args,
+				     motr_comp_obj_read_op_fini,
+				     args->cra_nr_cops,
+				     (void **)args->cra_cops, args);
+	if (rc < 0)
+		goto error;
+	m0_op_launch(args->cra_cops, args->cra_nr_cops);
+	return 0;
+
+error:
+	for (i = 0; args->cra_cops != NULL && i < args->cra_nr_cops; i++) {
+		if (args->cra_cops[i] == NULL)
+			continue;
+		m0_op_fini(args->cra_cops[i]);
+		m0_op_free(args->cra_cops[i]);
+	}
+	motr_comp_obj_read_args_free(args);
+	return rc;
+}
+
+/**
+ * Tiering writes into a layer object. Once the data is there, the
+ * extents written are added to the layer, so that reads find them. The
+ * composite object's size is updated in memory and is stored when the
+ * object is closed.
+ */
+static int motr_comp_obj_write_done(struct mio_op *op, struct mio_obj *lobj,
+				    int iovcnt, const struct mio_iovec *iov)
+{
+	int i;
+	int rc;
+	int nr_exts = 0;
+	uint64_t eow;
+	struct mio_obj *obj = op->mop_who.obj;
+	struct mio_obj_ext *exts;
+
+	exts = mio_mem_alloc(iovcnt * sizeof *exts);
+	if (exts == NULL)
+		return -ENOMEM;
+	for (i = 0; i < iovcnt; i++) {
+		if (iov[i].miov_len == 0)
+			continue;
+		exts[nr_exts].moe_off = iov[i].miov_off;
+		exts[nr_exts].moe_size = iov[i].miov_len;
+		nr_exts++;
+
+		eow = iov[i].miov_off + iov[i].miov_len;
+		if (eow > obj->mo_attrs.moa_size)
+			obj->mo_attrs.moa_size = eow;
+	}
+	obj->mo_attrs_updated = true;
+
+	rc = motr_comp_obj_exts_update(obj, &lobj->mo_id, nr_exts, exts,
+				       MOTR_COMP_OBJ_EXTS_ADD, true, op);
+	return rc < 0? rc : MIO_DRV_OP_NEXT;
+}
+
+static int
+mio_motr_comp_obj_writev_layer(struct mio_obj *obj, struct mio_obj *layer_obj,
+			       const struct mio_iovec *iov, int iovcnt,
+			       struct mio_op *op)
+{
+	if (iov == NULL || iovcnt <= 0)
+		return -EINVAL;
+	return mio__motr_obj_writev(layer_obj, iov, iovcnt,
+				    motr_comp_obj_write_done, op);
+}
+
+static int motr_comp_obj_free_op_fini(struct mio_driver_op *dop)
+{
+	struct m0_indexvec *ext = (struct m0_indexvec *)dop->mdo_op_args;
+
+	m0_indexvec_free(ext);
+	mio_mem_free(ext);
+	return 0;
+}
+
+/* The space of the pages freed is released from the layer's pool. */
+static int motr_comp_obj_free_pp(struct mio_op *op)
+{
+	uint32_t i;
+	uint64_t nr_bytes = 0;
+	struct mio_driver_op *dop = op->mop_drv_op_chain.mdoc_head;
+	struct m0_indexvec *ext = (struct m0_indexvec *)dop->mdo_op_args;
+
+	if (m0_rc(MIO_MOTR_OP(op)) != 0)
+		return MIO_DRV_OP_FINAL;
+	for (i = 0; i < ext->iv_vec.v_nr; i++)
+		nr_bytes += ext->iv_vec.v_count[i];
+	mio__motr_obj_pool_used_sub(
+		(struct mio_obj *)dop->mdo_post_proc_data, nr_bytes);
+	return MIO_DRV_OP_FINAL;
+}
+
+/**
+ * Frees the layer object's data in the given extents. Only whole pages
+ * are freed, the partial pages at both ends of an extent are left as
+ * they are, they are not covered by the layer's extents any more.
+ */
+static int
+mio_motr_comp_obj_free_layer_data(struct mio_obj *obj,
+				  struct mio_obj *layer_obj,
+				  int nr_exts, struct mio_obj_ext *exts,
+				  struct mio_op *op)
+{
+	int i;
+	int rc;
+	int nr_vecs = 0;
+	uint64_t pagesize;
+	uint64_t start;
+	uint64_t end;
+	struct m0_obj *cobj;
+	struct m0_op *cops[1] = {NULL};
+	struct m0_indexvec *ext;
+
+	if (nr_exts <= 0 || exts == NULL)
+		return -EINVAL;
+
+	cobj = (struct m0_obj *)layer_obj->mo_drv_obj;
+	pagesize = 1 << cobj->ob_attr.oa_bshift;
+	ext = mio_mem_alloc(sizeof *ext);
+	if (ext == NULL)
+		return -ENOMEM;
+	rc = m0_indexvec_alloc(ext, nr_exts);
+	if (rc != 0) {
+		mio_mem_free(ext);
+		return rc;
+	}
+	for (i = 0; i < nr_exts; i++) {
+		start = (exts[i].moe_off + pagesize - 1) / pagesize * pagesize;
+		end = (exts[i].moe_off + exts[i].moe_size) / pagesize *
+		      pagesize;
+		if (end <= start)
+			continue;
+		ext->iv_index[nr_vecs] = start;
+		ext->iv_vec.v_count[nr_vecs] = end - start;
+		nr_vecs++;
+	}
+	ext->iv_vec.v_nr = nr_vecs;
+
+	/* Nothing but partial pages. */
+	if (nr_vecs == 0) {
+		rc = mio_driver_op_add_done(op);
+		goto exit;
+	}
+
+	rc = m0_obj_op(cobj, M0_OC_FREE, ext, NULL, NULL, 0, 0, &cops[0]);
+	if (rc != 0)
+		goto exit;
+	rc = mio_driver_op_add(op, motr_comp_obj_free_pp, layer_obj,
+			       motr_comp_obj_free_op_fini, cops[0], ext);
+	if (rc < 0)
+		goto exit;
+	m0_op_launch(cops, 1);
+	return 0;
+
+exit:
+	if (cops[0] != NULL) {
+		m0_op_fini(cops[0]);
+		m0_op_free(cops[0]);
+	}
+	m0_indexvec_free(ext);
+	mio_mem_free(ext);
+	return rc;
+}
+
 struct mio_comp_obj_ops mio_motr_comp_obj_ops = {
         .mcoo_create      = mio_motr_comp_obj_create,
         .mcoo_add_layers  = mio_motr_comp_obj_add_layers,
@@ -669,7 +1560,12 @@ struct mio_comp_obj_ops mio_motr_comp_obj_ops = {
         .mcoo_list_layers = mio_motr_comp_obj_list_layers,
         .mcoo_add_extents = mio_motr_comp_obj_add_extents,
         .mcoo_del_extents = mio_motr_comp_obj_del_extents,
-        .mcoo_get_extents = mio_motr_comp_obj_get_extents
+        .mcoo_get_extents = mio_motr_comp_obj_get_extents,
+        .mcoo_compact_extents = mio_motr_comp_obj_compact_extents,
+        .mcoo_is_composite = mio_motr_comp_obj_is_composite,
+        .mcoo_readv_layers = mio_motr_comp_obj_readv_layers,
+        .mcoo_writev_layer = mio_motr_comp_obj_writev_layer,
+        .mcoo_free_layer_data = mio_motr_comp_obj_free_layer_data
 };
 
 /*
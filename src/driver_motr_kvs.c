@@ -145,8 +145,38 @@ struct motr_kvs_get_args {
 	struct m0_bufvec *kga_rvs; /* Returned values from motr GET op. */
 	struct mio_kv_pair *kga_orig_pairs; /* Original pointer from app. */
 	struct m0_idx *kga_idx; /* The motr index for the GET op. */
+
+	/*
+	 * If set, values are placed into the buffers pointed by
+	 * kga_orig_pairs[i].mkp_val (capacity in mkp_vlen) instead
+	 * of being handed back to the application.
+	 */
+	bool kga_into;
+	int32_t *kga_rcs;
 };
 
+/*
+ * Place the value returned by Motr into the buffer provided by the
+ * application. The buffer Motr allocated for the value is released
+ * here so that the application never sees it.
+ */
+static void motr_kvs_get_val_copy(struct mio_kv_pair *kvp,
+				  void *val, size_t vlen, int32_t *rc)
+{
+	size_t cap = kvp->mkp_vlen;
+
+	if (*rc == 0 && val != NULL) {
+		if (vlen > cap) {
+			mio_mem_copy(kvp->mkp_val, val, cap);
+			*rc = -ENOBUFS;
+		} else
+			mio_mem_copy(kvp->mkp_val, val, vlen);
+		kvp->mkp_vlen = vlen;
+	} else
+		kvp->mkp_vlen = 0;
+	m0_free(val);
+}
+
 static int motr_kvs_get_pp(struct mio_op *op)
 {
 	int i;
@@ -167,21 +197,29 @@ static int motr_kvs_get_pp(struct mio_op *op)
 	rvs  = args->kga_rvs;
 	nr_kvps = rvs->ov_vec.v_nr;
 	for (i = 0; i < nr_kvps; i++) {
+		if (args->kga_into) {
+			motr_kvs_get_val_copy(kvps + i, rvs->ov_buf[i],
+					      rvs->ov_vec.v_count[i],
+					      args->kga_rcs + i);
+			continue;
+		}
 		kvps[i].mkp_val = rvs->ov_buf[i];
 		kvps[i].mkp_vlen = rvs->ov_vec.v_count[i];
 	}
+	if (args->kga_into)
+		mio__motr_bufvec_free(rvs);
 
 	motr_kvs_idx_fini_free(args->kga_idx);
 	mio_mem_free(args);
 	return MIO_DRV_OP_FINAL;
 }
 
-static int mio_motr_kvs_get(struct mio_kvs_id *kid,
-			    int nr_kvps, struct mio_kv_pair *kvps,
-			    int32_t *rcs, struct mio_op *op)
+static int motr_kvs_get(struct mio_kvs_id *kid,
+			int nr_kvps, struct mio_kv_pair *kvps,
+			int32_t *rcs, bool into, struct mio_op *op)
 {
 	int rc;
-	struct motr_kvs_get_args *args;
+	struct motr_kvs_get_args *args = NULL;
 	struct m0_idx *idx;
 	struct m0_bufvec *keys = NULL;
 	struct m0_bufvec *vals = NULL;
@@ -204,6 +242,8 @@ static int mio_motr_kvs_get(struct mio_kvs_id *kid,
 	args->kga_rvs = vals;
 	args->kga_orig_pairs = kvps;
 	args->kga_idx = idx;
+	args->kga_into = into;
+	args->kga_rcs = rcs;
 
 	rc = motr_kvs_query(idx, M0_IC_GET,
 			      nr_kvps, kvps, rcs, keys, vals, 0,
@@ -222,6 +262,20 @@ error:
 	return rc;
 }
 
+static int mio_motr_kvs_get(struct mio_kvs_id *kid,
+			    int nr_kvps, struct mio_kv_pair *kvps,
+			    int32_t *rcs, struct mio_op *op)
+{
+	return motr_kvs_get(kid, nr_kvps, kvps, rcs, false, op);
+}
+
+static int mio_motr_kvs_get_into(struct mio_kvs_id *kid,
+				 int nr_kvps, struct mio_kv_pair *kvps,
+				 int32_t *rcs, struct mio_op *op)
+{
+	return motr_kvs_get(kid, nr_kvps, kvps, rcs, true, op);
+}
+
 struct motr_kvs_next_args {
 	struct m0_bufvec *kna_rks; /* Returned keys from motr NEXT op. */
 	struct m0_bufvec *kna_rvs; /* Returned values from motr NEXT op. */
@@ -374,6 +428,431 @@ static int mio_motr_kvs_del(struct mio_kvs_id *kid,
 			      motr_kvs_generic_pp, idx, op);
 }
 
+/*
+ * Range operations: delete or count all pairs whose keys fall into
+ * [start, end). Keys are scanned with NEXT queries of
+ * MOTR_KVS_RANGE_BATCH * MOTR_KVS_RANGE_NR_DELS keys. The keys in range
+ * returned by a NEXT query are deleted by up to MOTR_KVS_RANGE_NR_DELS
+ * DEL queries which are launched together with the NEXT query for the
+ * next page. So at most one NEXT and MOTR_KVS_RANGE_NR_DELS DEL
+ * queries are on fly at any time.
+ *
+ * Each round adds a driver op for its queries. The driver op of the
+ * previous round is released by the post-processing of the next one,
+ * not at mio_op_fini(), so that memory doesn't grow with the number of
+ * keys in range. The driver op of the round being post-processed can't
+ * be released yet, this may run in the callback of one of its queries.
+ */
+enum {
+	MOTR_KVS_RANGE_BATCH = 256,
+	MOTR_KVS_RANGE_NR_DELS = 4,
+	MOTR_KVS_RANGE_NR_OPS = MOTR_KVS_RANGE_NR_DELS + 1
+};
+
+struct motr_kvs_range_page {
+	struct m0_bufvec *krp_keys;
+	struct m0_bufvec *krp_vals;
+	int32_t *krp_rcs;
+};
+
+struct motr_kvs_range_args {
+	struct m0_idx *kra_idx;
+	bool kra_is_del;
+	void *kra_end;
+	size_t kra_end_len;
+	uint64_t *kra_count;
+	uint64_t kra_nr_found;
+
+	/* Index of the NEXT query in the group on fly, -1 if none. */
+	int kra_next_idx;
+	/* Page returned by (or to be returned by) the NEXT query on fly. */
+	struct motr_kvs_range_page kra_page;
+	/* Page whose keys are being deleted by the DEL queries on fly. */
+	struct motr_kvs_range_page kra_del_page;
+
+	int kra_nr_dels;
+	struct m0_bufvec *kra_del_keys[MOTR_KVS_RANGE_NR_DELS];
+	int32_t *kra_del_rcs[MOTR_KVS_RANGE_NR_DELS];
+};
+
+static int motr_kvs_key_cmp(void *k1, size_t len1, void *k2, size_t len2)
+{
+	int rc;
+
+	rc = memcmp(k1, k2, len1 < len2? len1 : len2);
+	if (rc != 0)
+		return rc;
+	return len1 < len2? -1 : (len1 > len2? 1 : 0);
+}
+
+static void motr_kvs_range_page_fini(struct motr_kvs_range_page *page)
+{
+	int i;
+
+	if (page->krp_keys != NULL) {
+		for (i = 0; i < page->krp_keys->ov_vec.v_nr; i++)
+			m0_free(page->krp_keys->ov_buf[i]);
+		mio__motr_bufvec_free(page->krp_keys);
+	}
+	if (page->krp_vals != NULL) {
+		for (i = 0; i < page->krp_vals->ov_vec.v_nr; i++)
+			m0_free(page->krp_vals->ov_buf[i]);
+		mio__motr_bufvec_free(page->krp_vals);
+	}
+	mio_mem_free(page->krp_rcs);
+	mio_memset(page, 0, sizeof *page);
+}
+
+static void motr_kvs_range_dels_fini(struct motr_kvs_range_args *args)
+{
+	int i;
+
+	/* Keys in DEL queries point to the buffers of kra_del_page. */
+	for (i = 0; i < args->kra_nr_dels; i++) {
+		mio__motr_bufvec_free(args->kra_del_keys[i]);
+		mio_mem_free(args->kra_del_rcs[i]);
+	}
+	args->kra_nr_dels = 0;
+	motr_kvs_range_page_fini(&args->kra_del_page);
+}
+
+static void motr_kvs_range_args_fini(struct motr_kvs_range_args *args)
+{
+	motr_kvs_range_dels_fini(args);
+	motr_kvs_range_page_fini(&args->kra_page);
+	if (args->kra_idx != NULL)
+		motr_kvs_idx_fini_free(args->kra_idx);
+	m0_free(args->kra_end);
+	mio_mem_free(args);
+}
+
+static int
+motr_kvs_range_next_init(struct motr_kvs_range_args *args,
+			 void *start, size_t start_len, bool exclude_start,
+			 struct m0_op **cop)
+{
+	int rc;
+	int nr = MOTR_KVS_RANGE_BATCH * MOTR_KVS_RANGE_NR_DELS;
+	struct motr_kvs_range_page *page = &args->kra_page;
+
+	page->krp_keys = mio__motr_bufvec_alloc(nr);
+	page->krp_vals = mio__motr_bufvec_alloc(nr);
+	page->krp_rcs = mio_mem_alloc(nr * sizeof(int32_t));
+	if (page->krp_keys == NULL || page->krp_vals == NULL ||
+	    page->krp_rcs == NULL) {
+		rc = -ENOMEM;
+		goto error;
+	}
+
+	/*
+	 * The start key is copied as Motr may replace the first key
+	 * buffer with the returned one.
+	 */
+	if (start != NULL) {
+		page->krp_keys->ov_buf[0] = m0_alloc(start_len);
+		if (page->krp_keys->ov_buf[0] == NULL) {
+			rc = -ENOMEM;
+			goto error;
+		}
+		memcpy(page->krp_keys->ov_buf[0], start, start_len);
+		page->krp_keys->ov_vec.v_count[0] = start_len;
+	}
+
+	rc = m0_idx_op(args->kra_idx, M0_IC_NEXT,
+		       page->krp_keys, page->krp_vals, page->krp_rcs,
+		       exclude_start? M0_OIF_EXCLUDE_START_KEY : 0, cop);
+	if (rc < 0)
+		goto error;
+	return 0;
+
+error:
+	motr_kvs_range_page_fini(page);
+	return rc;
+}
+
+static int
+motr_kvs_range_dels_init(struct motr_kvs_range_args *args,
+			 int nr_keys, struct m0_op **cops)
+{
+	int i;
+	int j;
+	int rc = 0;
+	int nr;
+	int batch;
+	struct m0_bufvec *keys;
+	struct m0_bufvec *page_keys = args->kra_del_page.krp_keys;
+
+	batch = (nr_keys + MOTR_KVS_RANGE_NR_DELS - 1) /
+		MOTR_KVS_RANGE_NR_DELS;
+	for (i = 0; i * batch < nr_keys; i++) {
+		nr = nr_keys - i * batch < batch? nr_keys - i * batch : batch;
+		keys = mio__motr_bufvec_alloc(nr);
+		args->kra_del_rcs[i] = mio_mem_alloc(nr * sizeof(int32_t));
+		if (keys == NULL || args->kra_del_rcs[i] == NULL) {
+			mio__motr_bufvec_free(keys);
+			mio_mem_free(args->kra_del_rcs[i]);
+			rc = -ENOMEM;
+			break;
+		}
+		for (j = 0; j < nr; j++) {
+			keys->ov_buf[j] = page_keys->ov_buf[i * batch + j];
+			keys->ov_vec.v_count[j] =
+				page_keys->ov_vec.v_count[i * batch + j];
+		}
+
+		cops[i] = NULL;
+		rc = m0_idx_op(args->kra_idx, M0_IC_DEL, keys, NULL,
+			       args->kra_del_rcs[i], 0, cops + i);
+		if (rc < 0) {
+			mio__motr_bufvec_free(keys);
+			mio_mem_free(args->kra_del_rcs[i]);
+			break;
+		}
+		args->kra_del_keys[i] = keys;
+		args->kra_nr_dels++;
+	}
+
+	if (rc < 0) {
+		for (i = 0; i < args->kra_nr_dels; i++) {
+			m0_op_fini(cops[i]);
+			m0_op_free(cops[i]);
+		}
+	}
+	return rc;
+}
+
+/*
+ * Check the DEL queries of the previous round and release the page of
+ * keys they deleted.
+ */
+static int motr_kvs_range_dels_check(struct motr_kvs_range_args *args,
+				     struct m0_op **cops, struct mio_op *op)
+{
+	int i;
+	int j;
+	int rc = 0;
+	struct m0_op *cop;
+
+	for (i = 0; i < args->kra_nr_dels; i++) {
+		cop = cops[i];
+		if (cop->op_sm.sm_state != M0_OS_STABLE || m0_rc(cop) < 0) {
+			rc = m0_rc(cop)? : -EIO;
+			break;
+		}
+		for (j = 0; j < args->kra_del_keys[i]->ov_vec.v_nr; j++) {
+			/* The pair may have been deleted by others. */
+			if (args->kra_del_rcs[i][j] == 0)
+				op->mop_progress++;
+			else if (args->kra_del_rcs[i][j] != -ENOENT) {
+				rc = args->kra_del_rcs[i][j];
+				break;
+			}
+		}
+		if (rc < 0)
+			break;
+	}
+
+	motr_kvs_range_dels_fini(args);
+	return rc;
+}
+
+/*
+ * Returns the number of keys in range from the page returned by the
+ * last NEXT query and if the end of the range has been reached.
+ */
+static int motr_kvs_range_page_scan(struct motr_kvs_range_args *args,
+				    bool *end_of_range)
+{
+	int i;
+	struct motr_kvs_range_page *page = &args->kra_page;
+	struct m0_bufvec *keys = page->krp_keys;
+
+	*end_of_range = false;
+	for (i = 0; i < keys->ov_vec.v_nr; i++) {
+		if (page->krp_rcs[i] != 0 || keys->ov_buf[i] == NULL)
+			break;
+		if (args->kra_end != NULL &&
+		    motr_kvs_key_cmp(keys->ov_buf[i], keys->ov_vec.v_count[i],
+				     args->kra_end, args->kra_end_len) >= 0)
+			break;
+	}
+	if (i < keys->ov_vec.v_nr)
+		*end_of_range = true;
+	return i;
+}
+
+static int motr_kvs_range_pp(struct mio_op *op);
+
+/*
+ * Release the driver ops of the previous rounds. Their queries are done
+ * and their post-processing has returned: it launched the queries of
+ * the current round, which have completed since.
+ */
+static void motr_kvs_range_rounds_fini(struct mio_driver_op *dop)
+{
+	struct mio_driver_op *prev;
+
+	while ((prev = dop->mdo_next) != NULL &&
+	       prev->mdo_post_proc == motr_kvs_range_pp) {
+		dop->mdo_next = prev->mdo_next;
+		prev->mdo_next = NULL;
+		mio__motr_drv_op_free(prev);
+	}
+}
+
+static int motr_kvs_range_pp(struct mio_op *op)
+{
+	int rc;
+	int nr_ops = 0;
+	int nr_in_range = 0;
+	bool end_of_range = true;
+	void *last_key;
+	size_t last_klen;
+	struct m0_op *cops[MOTR_KVS_RANGE_NR_OPS] = {NULL};
+	struct m0_op **done_cops;
+	struct m0_op *next_cop;
+	struct motr_kvs_range_args *args;
+	struct mio_driver_op *dop;
+
+	dop = op->mop_drv_op_chain.mdoc_head;
+	args = (struct motr_kvs_range_args *)dop->mdo_post_proc_data;
+	done_cops = (struct m0_op **)dop->mdo_ops;
+	motr_kvs_range_rounds_fini(dop);
+
+	/* DEL queries, if any, are at the front of the group. */
+	rc = motr_kvs_range_dels_check(args, done_cops, op);
+	if (rc < 0)
+		goto error;
+
+	if (args->kra_next_idx >= 0) {
+		next_cop = done_cops[args->kra_next_idx];
+		if (next_cop->op_sm.sm_state != M0_OS_STABLE ||
+		    m0_rc(next_cop) < 0) {
+			rc = m0_rc(next_cop)? : -EIO;
+			goto error;
+		}
+		nr_in_range = motr_kvs_range_page_scan(args, &end_of_range);
+		args->kra_nr_found += nr_in_range;
+		if (!args->kra_is_del)
+			op->mop_progress += nr_in_range;
+	}
+	if (args->kra_count != NULL)
+		*args->kra_count = args->kra_nr_found;
+
+	/* The page whose keys are to delete. */
+	args->kra_del_page = args->kra_page;
+	mio_memset(&args->kra_page, 0, sizeof args->kra_page);
+
+	if (args->kra_is_del && nr_in_range > 0) {
+		rc = motr_kvs_range_dels_init(args, nr_in_range, cops);
+		if (rc < 0)
+			goto error;
+		nr_ops = args->kra_nr_dels;
+	}
+
+	args->kra_next_idx = -1;
+	if (!end_of_range) {
+		last_key =
+		    args->kra_del_page.krp_keys->ov_buf[nr_in_range - 1];
+		last_klen =
+		    args->kra_del_page.krp_keys->ov_vec.v_count[nr_in_range - 1];
+		rc = motr_kvs_range_next_init(args, last_key, last_klen,
+					      true, cops + nr_ops);
+		if (rc < 0)
+			goto error_fini_ops;
+		args->kra_next_idx = nr_ops;
+		nr_ops++;
+	}
+
+	if (nr_ops == 0) {
+		motr_kvs_range_args_fini(args);
+		return MIO_DRV_OP_FINAL;
+	}
+
+	rc = mio_driver_op_group_add(op, motr_kvs_range_pp, args, NULL,
+				     nr_ops, (void **)cops, NULL);
+	if (rc < 0)
+		goto error_fini_ops;
+	m0_op_launch(cops, nr_ops);
+	return MIO_DRV_OP_NEXT;
+
+error_fini_ops:
+	while (nr_ops-- > 0) {
+		m0_op_fini(cops[nr_ops]);
+		m0_op_free(cops[nr_ops]);
+	}
+error:
+	motr_kvs_range_args_fini(args);
+	return rc;
+}
+
+static int motr_kvs_range(struct mio_kvs_id *kid,
+			  void *start, size_t start_len,
+			  void *end, size_t end_len,
+			  bool is_del, uint64_t *count, struct mio_op *op)
+{
+	int rc;
+	struct m0_op *cops[1] = {NULL};
+	struct motr_kvs_range_args *args;
+
+	args = mio_mem_alloc(sizeof *args);
+	if (args == NULL)
+		return -ENOMEM;
+	args->kra_is_del = is_del;
+	args->kra_count = count;
+	args->kra_next_idx = 0;
+
+	rc = motr_kvs_idx_alloc_init(kid, &args->kra_idx);
+	if (rc < 0)
+		goto error;
+
+	if (end != NULL) {
+		args->kra_end = m0_alloc(end_len);
+		if (args->kra_end == NULL) {
+			rc = -ENOMEM;
+			goto error;
+		}
+		memcpy(args->kra_end, end, end_len);
+		args->kra_end_len = end_len;
+	}
+
+	rc = motr_kvs_range_next_init(args, start, start_len, false, cops);
+	if (rc < 0)
+		goto error;
+
+	rc = mio_driver_op_group_add(op, motr_kvs_range_pp, args, NULL,
+				     1, (void **)cops, NULL);
+	if (rc < 0) {
+		m0_op_fini(cops[0]);
+		m0_op_free(cops[0]);
+		goto error;
+	}
+	m0_op_launch(cops, 1);
+	return 0;
+
+error:
+	motr_kvs_range_args_fini(args);
+	return rc;
+}
+
+static int mio_motr_kvs_del_range(struct mio_kvs_id *kid,
+				  void *start, size_t start_len,
+				  void *end, size_t end_len,
+				  struct mio_op *op)
+{
+	return motr_kvs_range(kid, start, start_len, end, end_len,
+			      true, NULL, op);
+}
+
+static int mio_motr_kvs_count_range(struct mio_kvs_id *kid,
+				    void *start, size_t start_len,
+				    void *end, size_t end_len,
+				    uint64_t *count, struct mio_op *op)
+{
+	return motr_kvs_range(kid, start, start_len, end, end_len,
+			      false, count, op);
+}
+
 static int mio_motr_kvs_create_set(struct mio_kvs_id *kid,
 				   struct mio_op *op)
 {
@@ -442,9 +921,12 @@ error:
 
 struct mio_kvs_ops mio_motr_kvs_ops = {
         .mko_get        = mio_motr_kvs_get,
+        .mko_get_into   = mio_motr_kvs_get_into,
         .mko_next       = mio_motr_kvs_next,
         .mko_put        = mio_motr_kvs_put,
         .mko_del        = mio_motr_kvs_del,
+        .mko_del_range  = mio_motr_kvs_del_range,
+        .mko_count_range = mio_motr_kvs_count_range,
         .mko_create_set = mio_motr_kvs_create_set,
         .mko_del_set    = mio_motr_kvs_del_set
 };
@@ -10,6 +10,7 @@
 
 #include <errno.h>
 #include <assert.h>
+#include <string.h>
 
 #include "logger.h"
 #include "utils.h"
@@ -18,15 +19,127 @@
 #include "mio_telemetry.h"
 #include "driver_motr.h"
 
+struct motr_obj_attrs_pp_args {
+	int32_t *aca_rc;
+	struct m0_bufvec *aca_key;
+	struct m0_bufvec *aca_val;
+	/* Where the returned attributes are copied to. */
+	struct mio_obj *aca_to;
+	/* The attribute index (shard) the query was sent to. */
+	struct mio_kvs *aca_kvs;
+};
+
 /**
  * pp is short for Post-Process to avoid confusion of cb (callback).
  */
 static int motr_obj_attrs_query_free_pp(struct mio_op *op);
 static int motr_obj_attrs_get_pp(struct mio_op *op);
+static int motr_obj_attrs_del_pp(struct mio_op *op);
+static int motr_obj_attrs_put_pp(struct mio_op *op);
+static int motr_obj_attrs_cache_load(struct mio_obj *obj);
 static int motr_obj_attrs_query(int opcode, struct mio_obj *obj,
 				  mio_driver_op_postprocess op_pp,
 				  struct mio_op *op);
+static int motr_obj_attrs_kvs_query(int opcode, struct mio_obj *obj,
+				    struct mio_kvs *kvs,
+				    mio_driver_op_postprocess op_pp,
+				    struct mio_op *op);
 static int motr_obj_attrs_update_sync(struct mio_obj *obj);
+static int motr_obj_access_pattern(struct mio_obj *obj);
+static void motr_obj_rcache_free(struct mio_obj *obj);
+static void motr_obj_rcache_invalidate(struct mio_obj *obj,
+				       const struct mio_iovec *iov,
+				       int iovcnt);
+static int
+mio_motr_obj_pool_id(const struct mio_obj *obj, struct mio_pool_id *pool_id);
+static void motr_obj_attrs_pp_args_free(struct motr_obj_attrs_pp_args *args);
+static int motr_obj_attrs_kvs_op(int opcode, uint32_t flags,
+				 struct mio_obj *obj, struct mio_kvs *kvs,
+				 struct m0_op **cop,
+				 struct motr_obj_attrs_pp_args **out);
+static int motr_obj_attrs_kvs_launch(int opcode, uint32_t flags,
+				     struct mio_obj *obj, struct mio_kvs *kvs,
+				     mio_driver_op_postprocess op_pp,
+				     struct mio_op *op);
+static int motr_obj_attrs_wire2mem(struct mio_obj *obj,
+				   int attr_size, void *attr_buf);
+
+/**
+ * Inline data.
+ *
+ * With MOTR_INLINE_DATA_THRESHOLD set, an object created by
+ * mio_obj_create() starts without a Motr object: its data is kept in
+ * its attribute record (field MOTR_OBJ_ATTR_INLINE), so creating it
+ * takes a single attribute PUT, opening it fetches the data with the
+ * attributes, a read is served from memory and a write within the
+ * threshold stores the record again. A write taking the object past the
+ * threshold promotes it: the Motr object is created in the pool given
+ * at creation, the inline data is written to it and the write goes on
+ * as usual. Objects created by mio_objs_create() are never inline.
+ *
+ * An object is only created inline if it has neither a Motr object
+ * nor a record. A record holding inline data wins over any Motr object,
+ * which may be left behind by a promotion that didn't complete.
+ * Promoting is a chain of driver ops of the op needing it. An inline
+ * object is promoted before it becomes a layer of a composite object
+ * (moo_promote), a layout can only refer to Motr objects.
+ */
+struct motr_obj_inline {
+	/* The size of the buffer, writes beyond it promote the object. */
+	uint64_t moi_cap;
+	char *moi_data;
+
+	/* The pool to create the Motr object in when promoted. */
+	bool moi_has_pool;
+	struct m0_fid moi_pool;
+};
+
+static bool motr_obj_inline_enabled()
+{
+	return mio_drv_motr_conf->mc_inline_data_threshold > 0;
+}
+
+static void motr_obj_inline_free(struct mio_obj *obj)
+{
+	struct motr_obj_inline *in = obj->mo_attrs.moa_inline;
+
+	if (in == NULL)
+		return;
+	mio_mem_free(in->moi_data);
+	mio_mem_free(in);
+	obj->mo_attrs.moa_inline = NULL;
+}
+
+/* Makes `obj` inline with `len` bytes of `data` (which may be NULL). */
+static int motr_obj_inline_data_set(struct mio_obj *obj,
+				    void *data, uint64_t len)
+{
+	uint64_t cap;
+	char *buf;
+	struct motr_obj_inline *in = obj->mo_attrs.moa_inline;
+
+	if (in == NULL) {
+		in = mio_mem_alloc(sizeof *in);
+		if (in == NULL)
+			return -ENOMEM;
+		obj->mo_attrs.moa_inline = in;
+	}
+
+	cap = mio_drv_motr_conf->mc_inline_data_threshold;
+	if (cap < len)
+		cap = len;
+	buf = mio_mem_alloc(cap?: 1);
+	if (buf == NULL)
+		return -ENOMEM;
+	if (len != 0)
+		mio_mem_copy(buf, data, len);
+
+	mio_mem_free(in->moi_data);
+	in->moi_data = buf;
+	in->moi_cap = cap;
+	obj->mo_attrs.moa_size = len;
+	return 0;
+}
 
 void mio__uint128_to_obj_id(struct m0_uint128 *uint128,
 			    struct mio_obj_id *oid)
@@ -62,6 +175,10 @@ static int motr_obj_open_pp(struct mio_op *op)
 	if (rc < 0)
 		return rc;
 
+	/* Skip the round trip to attribute index if it has been cached. */
+	if (!obj->mo_attrs_revalidate && motr_obj_attrs_cache_load(obj) == 0)
+		return MIO_DRV_OP_FINAL;
+
 	/* Launch a new op to get object attributes. */
 	rc = motr_obj_attrs_query(M0_IC_GET, obj,
 			          motr_obj_attrs_get_pp, op);
@@ -71,12 +188,65 @@ static int motr_obj_open_pp(struct mio_op *op)
 		return MIO_DRV_OP_NEXT;
 }
 
+/*
+ * An object whose entity doesn't exist may be inline, whose record may
+ * still be in the legacy index.
+ */
+static int motr_obj_open_legacy_pp(struct mio_op *op)
+{
+	struct mio_obj *obj = op->mop_who.obj;
+
+	motr_obj_attrs_get_pp(op);
+	return obj->mo_attrs.moa_inline != NULL? MIO_DRV_OP_FINAL : -ENOENT;
+}
+
+static int motr_obj_open_group_pp(struct mio_op *op)
+{
+	int rc;
+	bool found;
+	struct mio_driver_op *dop = op->mop_drv_op_chain.mdoc_head;
+	struct motr_obj_attrs_pp_args *args = dop->mdo_post_proc_data;
+	struct mio_obj *obj = args->aca_to;
+	struct m0_bufvec *val = args->aca_val;
+
+	rc = m0_rc((struct m0_op *)dop->mdo_ops[0]);
+	found = m0_rc((struct m0_op *)dop->mdo_ops[1]) == 0 &&
+		*args->aca_rc == 0 &&
+		val->ov_vec.v_count[0] != 0;
+	if (found) {
+		motr_obj_attrs_wire2mem(obj, val->ov_vec.v_count[0],
+					val->ov_buf[0]);
+		mio_obj_attrs_cache_put(&obj->mo_id, val->ov_buf[0],
+					val->ov_vec.v_count[0]);
+	}
+	motr_obj_attrs_pp_args_free(args);
+
+	if (obj->mo_attrs.moa_inline != NULL)
+		return MIO_DRV_OP_FINAL;
+	if (rc < 0 && rc != -ENOENT)
+		return rc;
+	if (found || obj->mo_md_kvs == &mio_obj_attrs_kvs)
+		return rc < 0? rc : MIO_DRV_OP_FINAL;
+
+	rc = motr_obj_attrs_kvs_query(M0_IC_GET, obj, &mio_obj_attrs_kvs,
+				      rc == 0? motr_obj_attrs_get_pp :
+					       motr_obj_open_legacy_pp, op);
+	return rc < 0? rc : MIO_DRV_OP_NEXT;
+}
+
+/**
+ * Unless the attributes are cached, the object's entity and attributes
+ * are fetched together: the object may be inline and have no entity.
+ */
 static int mio_motr_obj_open(struct mio_obj *obj, struct mio_op *op)
 {
+	int i;
 	int rc;
+	bool cached;
 	struct m0_uint128 id128;
 	struct m0_obj *cobj;
-	struct m0_op *cops[1] = {NULL};
+	struct m0_op *cops[2] = {NULL, NULL};
+	struct motr_obj_attrs_pp_args *args = NULL;
 
 	cobj = mio_mem_alloc(sizeof *cobj);
 	if (cobj == NULL)
@@ -85,25 +255,48 @@ static int mio_motr_obj_open(struct mio_obj *obj, struct mio_op *op)
 	mio__obj_id_to_uint128(&obj->mo_id, &id128);
 	m0_obj_init(cobj, &mio_motr_container.co_realm, &id128,
 			   mio_drv_motr_conf->mc_default_layout_id);
+	obj->mo_drv_obj = (void *)cobj;
+
+	cached = !obj->mo_attrs_revalidate &&
+		 motr_obj_attrs_cache_load(obj) == 0;
+	if (cached && obj->mo_attrs.moa_inline != NULL)
+		return mio_driver_op_add_done(op);
+
 	rc = m0_entity_open(&cobj->ob_entity, &cops[0]);
 	if (rc != 0)
 		goto error;
 
-	obj->mo_drv_obj = (void *)cobj;
-	rc = mio_driver_op_add(op, motr_obj_open_pp, NULL, NULL,
-			       cops[0], NULL);
+	if (cached) {
+		rc = mio_driver_op_add(op, motr_obj_open_pp, NULL, NULL,
+				       cops[0], NULL);
+		if (rc < 0)
+			goto error;
+		m0_op_launch(cops, 1);
+		return 0;
+	}
+
+	rc = motr_obj_attrs_kvs_op(M0_IC_GET, 0, obj, obj->mo_md_kvs,
+				   &cops[1], &args)? :
+	     mio_driver_op_group_add(op, motr_obj_open_group_pp, args, NULL,
+				     ARRAY_SIZE(cops), (void **)cops, NULL);
 	if (rc < 0)
 		goto error;
-	m0_op_launch(cops, 1);
+	m0_op_launch(cops, ARRAY_SIZE(cops));
 	return 0;
 
 error:
-	if (cops[0] != NULL) {
-		m0_op_fini(cops[0]);
-		m0_op_free(cops[0]);
+	for (i = 0; i < ARRAY_SIZE(cops); i++) {
+		if (cops[i] == NULL)
+			continue;
+		m0_op_fini(cops[i]);
+		m0_op_free(cops[i]);
 	}
+	if (args != NULL)
+		motr_obj_attrs_pp_args_free(args);
+	motr_obj_inline_free(obj);
 	m0_obj_fini(cobj);
 	mio_mem_free(cobj);
+	obj->mo_drv_obj = NULL;
 	return rc;
 }
 
@@ -124,6 +317,8 @@ static int mio_motr_obj_close(struct mio_obj *obj)
 	rc = motr_obj_attrs_update_sync(obj);
 
 obj_fini:
+	motr_obj_rcache_free(obj);
+	motr_obj_inline_free(obj);
 	/* Finalise motr's object. */
 	m0_obj_fini((struct m0_obj *)obj->mo_drv_obj);
 	return rc;
@@ -143,6 +338,148 @@ mio__motr_fid_to_pool_id(const struct m0_fid *fid, struct mio_pool_id *pool_id)
 	pool_id->mpi_lo = fid->f_key;
 }
 
+enum {
+	/* Range of unit sizes Motr has layout ids for. */
+	MOTR_OBJ_MIN_UNIT_SIZE = 4096,
+	MOTR_OBJ_MAX_UNIT_SIZE = 32 * 1024 * 1024,
+};
+
+/**
+ * Chooses the layout of a new object. With the MIO_HINT_OBJ_IO_SIZE
+ * hint, the unit size is the largest power of 2 such that an IO of the
+ * expected size covers whole parity groups (N data units) of the pool,
+ * so large streams do full-stripe writes and small objects aren't
+ * spread over units far bigger than their IO, which costs
+ * read-modify-write. Otherwise the configured default layout is used.
+ */
+static uint64_t motr_obj_layout_id(struct mio_obj *obj, struct m0_fid *pfid)
+{
+	int rc;
+	uint64_t io_size;
+	uint64_t unit_size;
+	uint64_t lid;
+	struct m0_reqh *reqh = &mio_motr_instance->m0c_reqh;
+	struct m0_pool_version *pver;
+
+	if (mio_hint_map_get(&obj->mo_hints.mh_map,
+			     MIO_HINT_OBJ_IO_SIZE, &io_size) < 0 ||
+	    io_size == 0)
+		return mio_drv_motr_conf->mc_default_layout_id;
+
+	rc = m0_pool_version_get(reqh->rh_pools, pfid, &pver);
+	if (rc != 0)
+		return mio_drv_motr_conf->mc_default_layout_id;
+
+	io_size /= pver->pv_attr.pa_N?: 1;
+	for (unit_size = MOTR_OBJ_MIN_UNIT_SIZE;
+	     unit_size < MOTR_OBJ_MAX_UNIT_SIZE && unit_size * 2 <= io_size;
+	     unit_size *= 2)
+		;
+	lid = m0_obj_unit_size_to_layout_id(unit_size);
+	return lid != 0? lid : mio_drv_motr_conf->mc_default_layout_id;
+}
+
+static int motr_obj_inline_create_pp(struct mio_op *op)
+{
+	int rc;
+	struct motr_obj_attrs_pp_args *args;
+
+	args = (struct motr_obj_attrs_pp_args *)
+	       op->mop_drv_op_chain.mdoc_head->mdo_post_proc_data;
+	rc = *args->aca_rc;
+	if (rc == 0)
+		return motr_obj_attrs_put_pp(op);
+
+	motr_obj_inline_free(args->aca_to);
+	motr_obj_attrs_pp_args_free(args);
+	return rc;
+}
+
+/*
+ * The record is stored without M0_OIF_OVERWRITE so that creating an
+ * object whose record is in its shard fails with -EEXIST, as creating
+ * its entity would. The object's entity and its record in the legacy
+ * index are checked first, the inline record would hide them.
+ */
+static int motr_obj_inline_create_check_pp(struct mio_op *op)
+{
+	int rc;
+	bool found = false;
+	struct mio_driver_op *dop = op->mop_drv_op_chain.mdoc_head;
+	struct motr_obj_attrs_pp_args *args = dop->mdo_post_proc_data;
+	struct mio_obj *obj = op->mop_who.obj;
+
+	rc = m0_rc((struct m0_op *)dop->mdo_ops[0]);
+	if (args != NULL) {
+		found = m0_rc((struct m0_op *)dop->mdo_ops[1]) == 0 &&
+			*args->aca_rc == 0;
+		motr_obj_attrs_pp_args_free(args);
+	}
+	if (rc == 0 || found)
+		rc = -EEXIST;
+	else if (rc == -ENOENT)
+		rc = motr_obj_attrs_kvs_launch(M0_IC_PUT, 0, obj,
+					       obj->mo_md_kvs,
+					       motr_obj_inline_create_pp, op);
+	if (rc < 0) {
+		motr_obj_inline_free(obj);
+		return rc;
+	}
+	return MIO_DRV_OP_NEXT;
+}
+
+static int motr_obj_inline_create(struct mio_obj *obj, struct m0_fid *pfid,
+				  struct mio_op *op)
+{
+	int i;
+	int rc;
+	int nr_ops = 1;
+	struct m0_obj *cobj = (struct m0_obj *)obj->mo_drv_obj;
+	struct m0_op *cops[2] = {NULL, NULL};
+	struct motr_obj_inline *in;
+	struct motr_obj_attrs_pp_args *args = NULL;
+
+	rc = motr_obj_inline_data_set(obj, NULL, 0);
+	if (rc < 0)
+		goto error;
+	in = obj->mo_attrs.moa_inline;
+	if (pfid != NULL) {
+		in->moi_has_pool = true;
+		in->moi_pool = *pfid;
+	}
+
+	rc = m0_entity_open(&cobj->ob_entity, &cops[0]);
+	if (rc != 0)
+		goto error;
+	if (obj->mo_md_kvs != &mio_obj_attrs_kvs) {
+		rc = motr_obj_attrs_kvs_op(M0_IC_GET, 0, obj,
+					   &mio_obj_attrs_kvs, &cops[1],
+					   &args);
+		if (rc < 0)
+			goto error;
+		nr_ops++;
+	}
+	/* As a group so that a failed OPEN is seen by the pp. */
+	rc = mio_driver_op_group_add(op, motr_obj_inline_create_check_pp,
+				     args, NULL, nr_ops, (void **)cops, NULL);
+	if (rc < 0)
+		goto error;
+	m0_op_launch(cops, nr_ops);
+	return 0;
+
+error:
+	for (i = 0; i < ARRAY_SIZE(cops); i++) {
+		if (cops[i] == NULL)
+			continue;
+		m0_op_fini(cops[i]);
+		m0_op_free(cops[i]);
+	}
+	if (args != NULL)
+		motr_obj_attrs_pp_args_free(args);
+	motr_obj_inline_free(obj);
+	return rc;
+}
+
 static int mio_motr_obj_create(const struct mio_pool_id *pool_id,
 			       struct mio_obj *obj, struct mio_op *op)
 {
@@ -164,12 +501,19 @@ static int mio_motr_obj_create(const struct mio_pool_id *pool_id,
 
 	mio__obj_id_to_uint128(&obj->mo_id, &id128);
 	m0_obj_init(cobj, &mio_motr_container.co_realm, &id128,
-			   mio_drv_motr_conf->mc_default_layout_id);
+			   motr_obj_layout_id(obj, ptr_pfid));
+	obj->mo_drv_obj = (void *)cobj;
+	if (motr_obj_inline_enabled()) {
+		rc = motr_obj_inline_create(obj, ptr_pfid, op);
+		if (rc < 0)
+			goto error;
+		return 0;
+	}
+
 	rc = m0_entity_create(ptr_pfid, &cobj->ob_entity, &cops[0]);
 	if (rc < 0)
 		goto error;
 
-	obj->mo_drv_obj = (void *)cobj;
 	rc = mio_driver_op_add(op, NULL, NULL, NULL, cops[0], NULL);
 	if (rc < 0)
 		goto error;
@@ -192,13 +536,25 @@ static int motr_obj_delete_pp(struct mio_op *op)
 	struct mio_obj *mobj = op->mop_who.obj;
 	struct m0_obj *cobj = (struct m0_obj *)mobj->mo_drv_obj;
 
-	/* Launch a new op to delete this object's attributes. */
+	if (m0_rc(MIO_MOTR_OP(op)) == 0)
+		mio__motr_obj_pool_used_sub(mobj, mobj->mo_attrs.moa_size);
+	/* The composite object serving a migrated object goes with it. */
+	if (m0_rc(MIO_MOTR_OP(op)) == 0 && mobj->mo_attrs.moa_redirected)
+		mio_obj_redirect_deleted(&mobj->mo_id,
+					 &mobj->mo_attrs.moa_redirect);
+
+	/*
+	 * Launch a new op to delete this object's attributes. mobj is
+	 * released by motr_obj_attrs_del_pp() once the attributes have
+	 * been removed from both the shard and the legacy index.
+	 */
 	rc = motr_obj_attrs_query(M0_IC_DEL, mobj,
-				    motr_obj_attrs_query_free_pp, op);
+				    motr_obj_attrs_del_pp, op);
 
 	/* The opened object is not needed any more. */
 	mio_mem_free(cobj);
-	mio_mem_free(mobj);
+	if (rc < 0)
+		mio_mem_free(mobj);
 
 	if (rc < 0)
 		return rc;
@@ -206,6 +562,75 @@ static int motr_obj_delete_pp(struct mio_op *op)
 		return MIO_DRV_OP_NEXT;
 }
 
+/*
+ * The last step of deleting an object: its record in the expiry index
+ * goes if it has a lifetime, see mio_obj_reaper.c. Releases `obj`.
+ */
+static int motr_obj_delete_expiry(struct mio_obj *obj, struct mio_op *op)
+{
+	int rc;
+	uint64_t lifetime;
+
+	rc = mio_hint_map_get(&obj->mo_hints.mh_map, MIO_HINT_OBJ_LIFETIME,
+			      &lifetime);
+	if (rc == 0)
+		rc = mio_obj_expiry_del_launch(1, &obj->mo_id, &lifetime, op);
+	mio_mem_free(obj);
+	if (rc == -ENOENT)
+		return MIO_DRV_OP_FINAL;
+	return rc < 0? rc : MIO_DRV_OP_NEXT;
+}
+
+/*
+ * An object without entity may be inline, deleting its attribute
+ * record deletes it.
+ */
+static int motr_obj_inline_delete_pp(struct mio_op *op)
+{
+	int rc;
+	struct mio_obj *obj;
+	struct mio_kvs *kvs;
+	struct motr_obj_attrs_pp_args *args;
+
+	args = (struct motr_obj_attrs_pp_args *)
+	       op->mop_drv_op_chain.mdoc_head->mdo_post_proc_data;
+	obj = args->aca_to;
+	kvs = args->aca_kvs;
+	rc = m0_rc(MIO_MOTR_OP(op))? : *args->aca_rc;
+	motr_obj_attrs_pp_args_free(args);
+	if (rc == 0)
+		return motr_obj_delete_expiry(obj, op);
+	if (rc != -ENOENT || kvs == &mio_obj_attrs_kvs) {
+		mio_mem_free(obj);
+		return rc;
+	}
+
+	rc = motr_obj_attrs_kvs_query(M0_IC_DEL, obj, &mio_obj_attrs_kvs,
+				      motr_obj_inline_delete_pp, op);
+	if (rc < 0) {
+		mio_mem_free(obj);
+		return rc;
+	}
+	return MIO_DRV_OP_NEXT;
+}
+
+/* Keeps the redirect of a migrated object from its attributes. */
+static void motr_obj_delete_attrs_get(struct mio_op *op)
+{
+	struct mio_driver_op *dop = op->mop_drv_op_chain.mdoc_head;
+	struct motr_obj_attrs_pp_args *args = dop->mdo_post_proc_data;
+	struct mio_obj *mobj = args->aca_to;
+	struct m0_bufvec *val = args->aca_val;
+
+	if (m0_rc((struct m0_op *)dop->mdo_ops[1]) == 0 &&
+	    *args->aca_rc == 0 && val->ov_vec.v_count[0] != 0 &&
+	    motr_obj_attrs_wire2mem(mobj, val->ov_vec.v_count[0],
+				    val->ov_buf[0]) < 0)
+		mobj->mo_attrs.moa_redirected = false;
+	motr_obj_inline_free(mobj);
+	motr_obj_attrs_pp_args_free(args);
+}
+
 static int
 motr_obj_delete_open_pp(struct mio_op *op)
 {
@@ -214,7 +639,24 @@ motr_obj_delete_open_pp(struct mio_op *op)
 	struct m0_obj *cobj;
 	struct mio_obj *mobj = op->mop_who.obj;
 
+	motr_obj_delete_attrs_get(op);
 	cobj = (struct m0_obj *)mobj->mo_drv_obj;
+	rc = m0_rc(MIO_MOTR_OP(op));
+	if (rc == -ENOENT) {
+		m0_obj_fini(cobj);
+		mio_mem_free(cobj);
+		mobj->mo_drv_obj = NULL;
+		rc = motr_obj_attrs_query(M0_IC_DEL, mobj,
+					  motr_obj_inline_delete_pp, op);
+		if (rc < 0) {
+			mio_mem_free(mobj);
+			return rc;
+		}
+		return MIO_DRV_OP_NEXT;
+	}
+	if (rc < 0)
+		goto error;
+
 	rc = m0_entity_delete(&cobj->ob_entity, &cops[0]);
 	if (rc != 0) {
 		mio_log(MIO_ERROR, "Creating DELETE op failed!\n");
@@ -241,18 +683,23 @@ error:
 
 /**
  * Deleting an object takes the following steps:
- * (1) Open the object to fetch required Motr-wise object attributes.
+ * (1) Open the object to fetch required Motr-wise object attributes,
+ *     its MIO attributes are fetched along to find a redirect.
  * (2) Create and launch DELETE op to remove the object data.
  * (3) Create and launch an KVS DEL op to remove this object MIO attributes.
+ * (4) If the object has a lifetime, remove its expiry record.
+ * An inline object has no entity to open, only steps (3) and (4) are taken.
  */
 static int
 mio_motr_obj_delete(const struct mio_obj_id *oid, struct mio_op *op)
 {
+	int i;
 	int rc = 0;
 	struct m0_uint128 id128;
 	struct m0_obj *cobj;
-	struct m0_op *cops[1] = {NULL};
+	struct m0_op *cops[2] = {NULL, NULL};
 	struct mio_obj *mobj;
+	struct motr_obj_attrs_pp_args *args = NULL;
 
 	/* Create a mio obj handler for callback. */
 	mobj = mio_mem_alloc(sizeof *mobj);
@@ -267,7 +714,7 @@ mio_motr_obj_delete(const struct mio_obj_id *oid, struct mio_op *op)
 		return -ENOMEM;
 	}
 	mobj->mo_drv_obj = (void *)cobj;
-	mobj->mo_md_kvs = &mio_obj_attrs_kvs;
+	mobj->mo_md_kvs = mio_obj_attrs_kvs_select(oid);
 
 	mio__obj_id_to_uint128(&mobj->mo_id, &id128);
 	m0_obj_init(cobj, &mio_motr_container.co_realm, &id128,
@@ -279,18 +726,25 @@ mio_motr_obj_delete(const struct mio_obj_id *oid, struct mio_op *op)
 		goto error;
 	}
 
-	rc = mio_driver_op_add(op, motr_obj_delete_open_pp,
-			       NULL, NULL, cops[0], NULL);
+	/* As a group so that a failed OPEN is seen by the pp. */
+	rc = motr_obj_attrs_kvs_op(M0_IC_GET, 0, mobj, mobj->mo_md_kvs,
+				   &cops[1], &args)? :
+	     mio_driver_op_group_add(op, motr_obj_delete_open_pp, args, NULL,
+				     ARRAY_SIZE(cops), (void **)cops, NULL);
 	if (rc < 0)
 		goto error;
 	m0_op_launch(cops, ARRAY_SIZE(cops));
 	return 0;
 
 error:
-	if (cops[0] != NULL) {
-		m0_op_fini(cops[0]);
-		m0_op_free(cops[0]);
+	for (i = 0; i < ARRAY_SIZE(cops); i++) {
+		if (cops[i] == NULL)
+			continue;
+		m0_op_fini(cops[i]);
+		m0_op_free(cops[i]);
 	}
+	if (args != NULL)
+		motr_obj_attrs_pp_args_free(args);
 	m0_obj_fini(cobj);
 	mio_mem_free(cobj);
 	mio_mem_free(mobj);
@@ -306,6 +760,14 @@ struct motr_obj_rw_args {
 	bool rwa_is_write;
 	uint64_t rwa_max_eow;
 
+	/*
+	 * Called once all data is written instead of updating the size of
+	 * the op's object, see mio__motr_obj_writev().
+	 */
+	mio__motr_obj_write_done rwa_write_done;
+	/* Called once all data is read, see motr_obj_readv(). */
+	mio__motr_obj_write_done rwa_read_done;
+
 	/* Original read/write IO vectors. */
 	int rwa_orig_iovcnt;
 	const struct mio_iovec *rwa_orig_iovs;
@@ -353,8 +815,8 @@ static int motr_obj_io_pagesize(struct mio_obj *obj)
 	return 1<<cobj->ob_attr.oa_bshift;
 }
 
-static int
-motr_obj_max_size_per_op(struct mio_obj *obj, uint64_t *max_size_per_op)
+int
+mio__motr_obj_max_size_per_op(struct mio_obj *obj, uint64_t *max_size_per_op)
 {
         struct m0_obj *cobj;
         struct m0_pool_version *pver;
@@ -389,7 +851,7 @@ motr_obj_rw_args_estimate_iovcnts(struct mio_obj *obj, int iovcnt,
 	int aligned_cnt = 0;
 	uint64_t max_size_per_op;
 
-	rc = motr_obj_max_size_per_op(obj, &max_size_per_op);
+	rc = mio__motr_obj_max_size_per_op(obj, &max_size_per_op);
 	if (rc < 0)
 		return rc;
 
@@ -657,7 +1119,7 @@ motr_obj_iovec_clone(struct motr_obj_rw_args *args, uint64_t off,
 	int pagesize;
 	uint64_t max_size_per_op;
 
-	rc = motr_obj_max_size_per_op(args->rwa_obj, &max_size_per_op);
+	rc = mio__motr_obj_max_size_per_op(args->rwa_obj, &max_size_per_op);
 	if (rc < 0)
 		return rc;
 
@@ -1103,7 +1565,7 @@ motr_obj_rw_aligned(struct mio_obj *obj, struct mio_iovec *iovs,
 	uint64_t max_size_per_op;
 	struct mio_iovec *st_iov;
 
-	rc = motr_obj_max_size_per_op(obj, &max_size_per_op);
+	rc = mio__motr_obj_max_size_per_op(obj, &max_size_per_op);
 	if (rc < 0)
 		return rc;
 
@@ -1124,31 +1586,75 @@ motr_obj_rw_aligned(struct mio_obj *obj, struct mio_iovec *iovs,
 				    op_pp, op_pp_args, op);
 }
 
+/* Accounts the space taken by a write beyond the end of the object. */
+static void motr_obj_pool_used_add(struct mio_obj *obj, uint64_t nr_bytes)
+{
+	struct mio_pool_id pool_id;
+
+	if (mio_motr_obj_pool_id(obj, &pool_id) == 0)
+		mio__motr_pool_used_add(&pool_id, nr_bytes);
+}
+
+/* Accounts the space released by deleting or freeing the object's data. */
+void mio__motr_obj_pool_used_sub(struct mio_obj *obj, uint64_t nr_bytes)
+{
+	struct mio_pool_id pool_id;
+
+	if (mio_motr_obj_pool_id(obj, &pool_id) == 0)
+		mio__motr_pool_used_sub(&pool_id, nr_bytes);
+}
+
 static int motr_obj_write_pp(struct mio_op *op)
 {
 	int rc;
+	uint64_t max_eow;
 	struct motr_obj_rw_args *args;
 	struct mio_obj *obj = op->mop_who.obj;
+	struct mio_obj *wobj;
+	const struct mio_iovec *iovs;
+	int iovcnt;
+	mio__motr_obj_write_done write_done;
 
 	args = (struct motr_obj_rw_args *)
 		  op->mop_drv_op_chain.mdoc_head->mdo_post_proc_data;
 
 	/* Check if all IO vectors done. */
 	if (args->rwa_aligned_progress != args->rwa_aligned_iovcnt) {
-		rc = motr_obj_rw_aligned(obj, args->rwa_aligned_iovs,
+		rc = motr_obj_rw_aligned(args->rwa_obj, args->rwa_aligned_iovs,
 					   args->rwa_aligned_iovcnt,
 					   &args->rwa_aligned_progress,
 					   M0_OC_WRITE,
 					   motr_obj_write_pp, args, op);
 	} else {
+		max_eow = args->rwa_max_eow;
+		wobj = args->rwa_obj;
+		iovs = args->rwa_orig_iovs;
+		iovcnt = args->rwa_orig_iovcnt;
+		write_done = args->rwa_write_done;
 		motr_obj_rw_args_free(args);
 
+		if (write_done != NULL) {
+			if (max_eow > wobj->mo_attrs.moa_size) {
+				motr_obj_pool_used_add(wobj, max_eow -
+						wobj->mo_attrs.moa_size);
+				wobj->mo_attrs.moa_size = max_eow;
+				wobj->mo_attrs_updated = true;
+			}
+			return write_done(op, wobj, iovcnt, iovs);
+		}
+
 		/* Launch a new op to update object size. */
-		if (args->rwa_max_eow <= obj->mo_attrs.moa_size)
+		if (max_eow <= obj->mo_attrs.moa_size)
+			return MIO_DRV_OP_FINAL;
+		motr_obj_pool_used_add(obj, max_eow - obj->mo_attrs.moa_size);
+		obj->mo_attrs.moa_size = max_eow;
+		/* Write-once objects store their size when closed. */
+		if (motr_obj_access_pattern(obj) == MIO_OBJ_ACCESS_WRITE_ONCE) {
+			obj->mo_attrs_updated = true;
 			return MIO_DRV_OP_FINAL;
-		obj->mo_attrs.moa_size = args->rwa_max_eow;
+		}
 		rc = motr_obj_attrs_query(M0_IC_PUT, obj,
-					    motr_obj_attrs_query_free_pp, op);
+					    motr_obj_attrs_put_pp, op);
 	}
 	if (rc < 0)
 		return rc;
@@ -1160,20 +1666,19 @@ static int motr_obj_read_before_write_pp(struct mio_op *op)
 {
 	int rc;
 	struct motr_obj_rw_args *args;
-	struct mio_obj *obj = op->mop_who.obj;
 
 	args = (struct motr_obj_rw_args *)
 		  op->mop_drv_op_chain.mdoc_head->mdo_post_proc_data;
 
 	if (args->rwa_rbw_progress == args->rwa_rbw_iovcnt) {
 		motr_obj_data_copy(args);
-		rc = motr_obj_rw_aligned(obj, args->rwa_aligned_iovs,
+		rc = motr_obj_rw_aligned(args->rwa_obj, args->rwa_aligned_iovs,
 					   args->rwa_aligned_iovcnt,
 					   &args->rwa_aligned_progress,
 					   M0_OC_WRITE,
 				  	   motr_obj_write_pp, args, op);
 	} else
-		rc = motr_obj_rw_aligned(obj, args->rwa_rbw_iovs,
+		rc = motr_obj_rw_aligned(args->rwa_obj, args->rwa_rbw_iovs,
 					   args->rwa_rbw_iovcnt,
 					   &args->rwa_rbw_progress,
 					   M0_OC_WRITE,
@@ -1269,45 +1774,360 @@ motr_obj_read_before_write(struct mio_obj *obj,
 				     motr_obj_read_before_write_pp, args, op);
 }
 
-/**
- * Motr sets a limit on how many data units an op can Read/write
- * due to the implementation at the service size, the value is queried
- * using motr_obj_max_size_per_op(). For an IO which is bigger than the
- * limit, it is divided into multiple parts, each part is less or equal to
- * the limit in size and is done in one op.
- *
- * Note that currently the ops for all parts are launched and served
- * sequentially (not in parallel). When each op is completed, post processing
- * functions (motr_obj_write/read_pp()) are triggered to check if all parts
- * are done, if not, launch a new op.
- */
-static int mio_motr_obj_writev(struct mio_obj *obj,
-				 const struct mio_iovec *iov,
-				 int iovcnt, struct mio_op *op)
+static bool motr_obj_inline_fits(struct mio_obj *obj,
+				 const struct mio_iovec *iov, int iovcnt)
+{
+	int i;
+	struct motr_obj_inline *in = obj->mo_attrs.moa_inline;
+
+	for (i = 0; i < iovcnt; i++)
+		if (iov[i].miov_off > in->moi_cap ||
+		    iov[i].miov_len > in->moi_cap - iov[i].miov_off)
+			return false;
+	return true;
+}
+
+static int motr_obj_inline_readv(struct mio_obj *obj,
+				 const struct mio_iovec *iov, int iovcnt,
+				 struct mio_op *op)
+{
+	int i;
+	uint64_t nr;
+	uint64_t size = obj->mo_attrs.moa_size;
+	struct motr_obj_inline *in = obj->mo_attrs.moa_inline;
+
+	for (i = 0; i < iovcnt; i++) {
+		nr = 0;
+		if (iov[i].miov_off < size)
+			nr = size - iov[i].miov_off;
+		if (nr > iov[i].miov_len)
+			nr = iov[i].miov_len;
+		if (nr != 0)
+			mio_mem_copy(iov[i].miov_base,
+				     in->moi_data + iov[i].miov_off, nr);
+		/* Reading beyond the end of an object returns zeros. */
+		mio_memset(iov[i].miov_base + nr, 0, iov[i].miov_len - nr);
+	}
+	return mio_driver_op_add_done(op);
+}
+
+static int motr_obj_inline_writev(struct mio_obj *obj,
+				  const struct mio_iovec *iov, int iovcnt,
+				  struct mio_op *op)
 {
+	int i;
 	int rc;
-	struct motr_obj_rw_args *args;
+	uint64_t end;
+	struct motr_obj_inline *in = obj->mo_attrs.moa_inline;
 
-	args = motr_obj_rw_args_alloc(obj, iovcnt, iov);
-	if (args == NULL)
-		return -ENOMEM;
-	args->rwa_is_write = true;
+	for (i = 0; i < iovcnt; i++) {
+		mio_mem_copy(in->moi_data + iov[i].miov_off,
+			     iov[i].miov_base, iov[i].miov_len);
+		end = iov[i].miov_off + iov[i].miov_len;
+		if (end > obj->mo_attrs.moa_size)
+			obj->mo_attrs.moa_size = end;
+	}
 
-	/* 1. Sort IO vectors. */
-	rc = motr_obj_iovec_sort(args);
-	if (rc < 0)
-		goto error;
+	/* Write-once objects store their data when closed. */
+	if (motr_obj_access_pattern(obj) == MIO_OBJ_ACCESS_WRITE_ONCE) {
+		obj->mo_attrs_updated = true;
+		return mio_driver_op_add_done(op);
+	}
+	rc = motr_obj_attrs_query(M0_IC_PUT, obj, motr_obj_attrs_put_pp, op);
+	return rc < 0? rc : 0;
+}
 
-	/* 2. Align byte ranges of the sorted IO vector. */
-	rc = motr_obj_iovec_adjust(args);
-	if (rc < 0)
-		goto error;
+/**
+ * Promotion of an inline object, see "Inline data" at the top of this
+ * file. The object's entity is created (or opened if a promotion which
+ * didn't complete left it behind), the inline data is written to it and
+ * the attributes are stored, dropping the inline data from the record.
+ * Each step is a driver op of the op needing the promotion, which goes
+ * on with `opa_done` once it is done.
+ */
+struct motr_obj_promote_args {
+	struct mio_obj *opa_obj;
+	/* Detached from the object while its data is being written. */
+	struct motr_obj_inline *opa_in;
+	struct mio_iovec opa_iov;
+	struct motr_obj_attrs_pp_args *opa_attrs_args;
+	bool opa_opened;
+
+	mio__motr_obj_promote_done opa_done;
+	void *opa_done_data;
+};
 
-	/*
-	 * 3. If offset and end of an IO vector are not aligned with page size,
-	 * read back the first or last block (of page size) to avoid data
-	 * overwriting. If the offset or end are aligned with page size, no
-	 * blocks are required to read before write, IO operation can be
+static int motr_obj_promote_entity_pp(struct mio_op *op);
+
+/*
+ * Released with the op. If writing the data failed, the inline data is
+ * given back to the object, which is still open as the op is issued
+ * against it.
+ */
+static int motr_obj_promote_fini(struct mio_driver_op *dop)
+{
+	struct motr_obj_promote_args *args = dop->mdo_op_args;
+	struct motr_obj_inline *in = args->opa_in;
+	struct mio_obj *obj = args->opa_obj;
+
+	if (in != NULL && obj->mo_attrs.moa_inline == NULL)
+		obj->mo_attrs.moa_inline = in;
+	else if (in != NULL) {
+		mio_mem_free(in->moi_data);
+		mio_mem_free(in);
+	}
+	if (args->opa_attrs_args != NULL)
+		motr_obj_attrs_pp_args_free(args->opa_attrs_args);
+	mio_mem_free(args->opa_done_data);
+	mio_mem_free(args);
+	return 0;
+}
+
+static int motr_obj_promote_entity_launch(struct motr_obj_promote_args *args,
+					  struct mio_op *op)
+{
+	int rc;
+	struct m0_uint128 id128;
+	struct m0_fid *pfid = NULL;
+	struct mio_obj *obj = args->opa_obj;
+	struct m0_obj *cobj = (struct m0_obj *)obj->mo_drv_obj;
+	struct m0_op *cops[1] = {NULL};
+	struct motr_obj_inline *in = obj->mo_attrs.moa_inline;
+
+	if (in->moi_has_pool)
+		pfid = &in->moi_pool;
+	mio__obj_id_to_uint128(&obj->mo_id, &id128);
+	m0_obj_fini(cobj);
+	mio_memset(cobj, 0, sizeof *cobj);
+	m0_obj_init(cobj, &mio_motr_container.co_realm, &id128,
+		    motr_obj_layout_id(obj, pfid));
+	rc = args->opa_opened?
+	     m0_entity_open(&cobj->ob_entity, &cops[0]) :
+	     m0_entity_create(pfid, &cobj->ob_entity, &cops[0]);
+	if (rc != 0)
+		goto error;
+
+	rc = mio_driver_op_add(op, motr_obj_promote_entity_pp, args, NULL,
+			       cops[0], NULL);
+	if (rc < 0)
+		goto error;
+	m0_op_launch(cops, 1);
+	return 0;
+
+error:
+	if (cops[0] != NULL) {
+		m0_op_fini(cops[0]);
+		m0_op_free(cops[0]);
+	}
+	return rc;
+}
+
+static int motr_obj_promote_attrs_pp(struct mio_op *op)
+{
+	struct m0_bufvec *val;
+	struct mio_obj *obj;
+	struct motr_obj_attrs_pp_args *attrs_args;
+	struct motr_obj_promote_args *args;
+
+	args = (struct motr_obj_promote_args *)
+	       op->mop_drv_op_chain.mdoc_head->mdo_post_proc_data;
+	attrs_args = args->opa_attrs_args;
+	obj = args->opa_obj;
+	val = attrs_args->aca_val;
+	if (m0_rc(MIO_MOTR_OP(op)) == 0 && *attrs_args->aca_rc == 0)
+		mio_obj_attrs_cache_put(&obj->mo_id, val->ov_buf[0],
+					val->ov_vec.v_count[0]);
+	else {
+		/* Otherwise closing the object retries. */
+		mio_obj_attrs_cache_invalidate(&obj->mo_id);
+		obj->mo_attrs_updated = true;
+	}
+	motr_obj_attrs_pp_args_free(attrs_args);
+	args->opa_attrs_args = NULL;
+	return args->opa_done(op, obj, args->opa_done_data);
+}
+
+static int motr_obj_promote_write_done(struct mio_op *op, struct mio_obj *obj,
+				       int iovcnt, const struct mio_iovec *iov)
+{
+	int rc;
+	struct m0_op *cops[1] = {NULL};
+	struct motr_obj_promote_args *args;
+
+	args = container_of(iov, struct motr_obj_promote_args, opa_iov);
+	motr_obj_pool_used_add(obj, obj->mo_attrs.moa_size);
+	mio_mem_free(args->opa_in->moi_data);
+	mio_mem_free(args->opa_in);
+	args->opa_in = NULL;
+
+	rc = motr_obj_attrs_kvs_op(M0_IC_PUT, M0_OIF_OVERWRITE, obj,
+				   obj->mo_md_kvs, &cops[0],
+				   &args->opa_attrs_args);
+	if (rc < 0)
+		return rc;
+	rc = mio_driver_op_add(op, motr_obj_promote_attrs_pp, args, NULL,
+			       cops[0], NULL);
+	if (rc < 0) {
+		m0_op_fini(cops[0]);
+		m0_op_free(cops[0]);
+		return rc;
+	}
+	m0_op_launch(cops, 1);
+	return MIO_DRV_OP_NEXT;
+}
+
+static int motr_obj_promote_entity_pp(struct mio_op *op)
+{
+	int rc;
+	struct mio_obj *obj;
+	struct motr_obj_promote_args *args;
+
+	args = (struct motr_obj_promote_args *)
+	       op->mop_drv_op_chain.mdoc_head->mdo_post_proc_data;
+	obj = args->opa_obj;
+	rc = m0_rc(MIO_MOTR_OP(op));
+	/* Left behind by a promotion which didn't complete. */
+	if (rc == -EEXIST && !args->opa_opened) {
+		args->opa_opened = true;
+		rc = motr_obj_promote_entity_launch(args, op);
+		return rc < 0? rc : MIO_DRV_OP_NEXT;
+	}
+	if (rc < 0)
+		return rc;
+
+	/* The data now goes to the entity. */
+	args->opa_in = obj->mo_attrs.moa_inline;
+	obj->mo_attrs.moa_inline = NULL;
+	if (obj->mo_attrs.moa_size == 0)
+		return motr_obj_promote_write_done(op, obj, 1, &args->opa_iov);
+
+	motr_obj_iovec_set(&args->opa_iov, 0, obj->mo_attrs.moa_size,
+			   args->opa_in->moi_data);
+	rc = mio__motr_obj_writev(obj, &args->opa_iov, 1,
+				  motr_obj_promote_write_done, op);
+	return rc < 0? rc : MIO_DRV_OP_NEXT;
+}
+
+/**
+ * Promotes an inline object on behalf of `op`, then calls `done` to go
+ * on with the op. `done_data` is released with the op.
+ */
+int mio__motr_obj_inline_promote(struct mio_obj *obj,
+				 mio__motr_obj_promote_done done,
+				 void *done_data, struct mio_op *op)
+{
+	int rc;
+	struct motr_obj_promote_args *args;
+
+	assert(obj->mo_attrs.moa_inline != NULL);
+	args = mio_mem_alloc(sizeof *args);
+	if (args == NULL) {
+		mio_mem_free(done_data);
+		return -ENOMEM;
+	}
+	args->opa_obj = obj;
+	args->opa_done = done;
+	args->opa_done_data = done_data;
+
+	rc = mio_driver_op_add_fini(op, motr_obj_promote_fini, args);
+	if (rc < 0) {
+		mio_mem_free(done_data);
+		mio_mem_free(args);
+		return rc;
+	}
+	return motr_obj_promote_entity_launch(args, op);
+}
+
+/* A write which doesn't fit in the inline data goes on once promoted. */
+struct motr_obj_promote_write {
+	const struct mio_iovec *opw_iov;
+	int opw_iovcnt;
+	mio__motr_obj_write_done opw_write_done;
+};
+
+static int motr_obj_promote_writev_done(struct mio_op *op,
+					struct mio_obj *obj, void *data)
+{
+	int rc;
+	struct motr_obj_promote_write *pw = data;
+
+	rc = mio__motr_obj_writev(obj, pw->opw_iov, pw->opw_iovcnt,
+				  pw->opw_write_done, op);
+	return rc < 0? rc : MIO_DRV_OP_NEXT;
+}
+
+static int motr_obj_promote_writev(struct mio_obj *obj,
+				   const struct mio_iovec *iov, int iovcnt,
+				   mio__motr_obj_write_done write_done,
+				   struct mio_op *op)
+{
+	struct motr_obj_promote_write *pw;
+
+	pw = mio_mem_alloc(sizeof *pw);
+	if (pw == NULL)
+		return -ENOMEM;
+	pw->opw_iov = iov;
+	pw->opw_iovcnt = iovcnt;
+	pw->opw_write_done = write_done;
+	return mio__motr_obj_inline_promote(obj, motr_obj_promote_writev_done,
+					    pw, op);
+}
+
+/**
+ * Motr sets a limit on how many data units an op can Read/write
+ * due to the implementation at the service size, the value is queried
+ * using mio__motr_obj_max_size_per_op(). For an IO which is bigger than
+ * the limit, it is divided into multiple parts, each part is less or equal
+ * to the limit in size and is done in one op.
+ *
+ * Note that currently the ops for all parts are launched and served
+ * sequentially (not in parallel). When each op is completed, post processing
+ * functions (motr_obj_write/read_pp()) are triggered to check if all parts
+ * are done, if not, launch a new op.
+ *
+ * mio__motr_obj_writev() writes to `obj` on behalf of an op which may be
+ * issued against another object, a composite object writing into one of
+ * its layers for example. Once all data is written, `write_done` is called
+ * to move the op forward and only the in-memory size of `obj` is updated.
+ */
+int mio__motr_obj_writev(struct mio_obj *obj,
+			 const struct mio_iovec *iov, int iovcnt,
+			 mio__motr_obj_write_done write_done,
+			 struct mio_op *op)
+{
+	int rc;
+	struct motr_obj_rw_args *args;
+
+	if (obj->mo_attrs.moa_inline != NULL) {
+		if (write_done == NULL &&
+		    motr_obj_inline_fits(obj, iov, iovcnt))
+			return motr_obj_inline_writev(obj, iov, iovcnt, op);
+		return motr_obj_promote_writev(obj, iov, iovcnt,
+					       write_done, op);
+	}
+
+	motr_obj_rcache_invalidate(obj, iov, iovcnt);
+	args = motr_obj_rw_args_alloc(obj, iovcnt, iov);
+	if (args == NULL)
+		return -ENOMEM;
+	args->rwa_is_write = true;
+	args->rwa_write_done = write_done;
+
+	/* 1. Sort IO vectors. */
+	rc = motr_obj_iovec_sort(args);
+	if (rc < 0)
+		goto error;
+
+	/* 2. Align byte ranges of the sorted IO vector. */
+	rc = motr_obj_iovec_adjust(args);
+	if (rc < 0)
+		goto error;
+
+	/*
+	 * 3. If offset and end of an IO vector are not aligned with page size,
+	 * read back the first or last block (of page size) to avoid data
+	 * overwriting. If the offset or end are aligned with page size, no
+	 * blocks are required to read before write, IO operation can be
 	 * issued immediately to Motr.
 	 */
 	if (args->rwa_rbw_iovcnt != 0)
@@ -1330,10 +2150,21 @@ error:
 	return rc;
 }
 
+static int mio_motr_obj_writev(struct mio_obj *obj,
+				 const struct mio_iovec *iov,
+				 int iovcnt, struct mio_op *op)
+{
+	return mio__motr_obj_writev(obj, iov, iovcnt, NULL, op);
+}
+
 static int motr_obj_read_pp(struct mio_op *op)
 {
 	int rc = 0;
+	int iovcnt;
+	const struct mio_iovec *iovs;
+	struct mio_obj *robj;
 	struct motr_obj_rw_args *args;
+	mio__motr_obj_write_done read_done;
 
 	args = (struct motr_obj_rw_args *)
 		  op->mop_drv_op_chain.mdoc_head->mdo_post_proc_data;
@@ -1341,7 +2172,13 @@ static int motr_obj_read_pp(struct mio_op *op)
 	if (args->rwa_aligned_iovcnt == args->rwa_aligned_progress) {
 		/* Copy data into application's memory if needed. */
 		motr_obj_data_copy(args);
+		robj = args->rwa_obj;
+		iovs = args->rwa_orig_iovs;
+		iovcnt = args->rwa_orig_iovcnt;
+		read_done = args->rwa_read_done;
 		motr_obj_rw_args_free(args);
+		if (read_done != NULL)
+			return read_done(op, robj, iovcnt, iovs);
 		return MIO_DRV_OP_FINAL;
 	} else {
 		rc = motr_obj_rw_aligned(args->rwa_obj,
@@ -1358,9 +2195,14 @@ static int motr_obj_read_pp(struct mio_op *op)
 		return MIO_DRV_OP_NEXT;
 }
 
-static int mio_motr_obj_readv(struct mio_obj *obj,
-				 const struct mio_iovec *iov,
-				 int iovcnt, struct mio_op *op)
+/*
+ * `read_done`, if set, is called once all data is read to move the op
+ * forward, see mio__motr_obj_writev().
+ */
+static int motr_obj_readv(struct mio_obj *obj,
+			  const struct mio_iovec *iov, int iovcnt,
+			  mio__motr_obj_write_done read_done,
+			  struct mio_op *op)
 {
 	int rc;
 	struct motr_obj_rw_args *args;
@@ -1369,6 +2211,7 @@ static int mio_motr_obj_readv(struct mio_obj *obj,
 	if (args == NULL)
 		return -ENOMEM;
 	args->rwa_is_write = false;
+	args->rwa_read_done = read_done;
 
 	/* 1. Sort IO vectors. */
 	motr_obj_iovec_sort(args);
@@ -1396,12 +2239,368 @@ error:
 	return rc;
 }
 
+/**
+ * Read cache for objects with the MIO_OBJ_ACCESS_SEQUENTIAL or
+ * MIO_OBJ_ACCESS_READ_MOSTLY access pattern hint.
+ *
+ * The cache holds a few windows of the object's data. A read which
+ * falls entirely in valid windows is served from memory and completes
+ * at once. A single-vector read which misses is turned into a read of
+ * a whole window which is then copied out: for sequential access the
+ * window extends the read up to the smaller of the biggest single Motr
+ * op and MOTR_OBJ_RCACHE_MAX_WINDOW_SIZE, and within the object size,
+ * which reads ahead of the application; for read-mostly access the window
+ * just covers the (page aligned) read and up to
+ * MOTR_OBJ_RCACHE_NR_WINDOWS ranges are kept. Other reads bypass the
+ * cache.
+ *
+ * Writes through this client drop the windows they overlap. A window
+ * filled while a write was issued is discarded.
+ */
+enum {
+	MOTR_OBJ_RCACHE_NR_WINDOWS = 4,
+	MOTR_OBJ_RCACHE_MAX_WINDOW_SIZE = 32 * 1024 * 1024,
+};
+
+struct motr_obj_rcache_window {
+	uint64_t rw_off;
+	/* 0 if the window holds no valid data. */
+	uint64_t rw_len;
+	bool rw_filling;
+	uint64_t rw_buf_size;
+	char *rw_buf;
+};
+
+struct motr_obj_rcache {
+	pthread_mutex_t rc_lock;
+	/* Bumped by every invalidation. */
+	uint64_t rc_gen;
+	/* The next window to replace. */
+	int rc_next;
+	struct motr_obj_rcache_window rc_windows[MOTR_OBJ_RCACHE_NR_WINDOWS];
+};
+
+struct motr_obj_rcache_fill {
+	/* The window read from Motr. */
+	struct mio_iovec rf_win_iov;
+	/* The application's read. */
+	struct mio_iovec rf_iov;
+	struct motr_obj_rcache *rf_cache;
+	int rf_win;
+	uint64_t rf_gen;
+	bool rf_done;
+};
+
+static int motr_obj_access_pattern(struct mio_obj *obj)
+{
+	uint64_t pattern;
+
+	if (mio_hint_map_get(&obj->mo_hints.mh_map,
+			     MIO_HINT_OBJ_ACCESS_PATTERN, &pattern) < 0)
+		return MIO_HINT_VALUE_NULL;
+	return (int)pattern;
+}
+
+/*
+ * The cache is allocated by the first read needing it. Concurrent first
+ * reads race to install theirs, the losers free their own and use the
+ * winner's.
+ */
+static struct motr_obj_rcache *motr_obj_rcache_get(struct mio_obj *obj)
+{
+	void *installed;
+	struct motr_obj_rcache *cache;
+
+	installed = __atomic_load_n(&obj->mo_drv_obj_cache, __ATOMIC_ACQUIRE);
+	if (installed != NULL)
+		return installed;
+
+	cache = mio_mem_alloc(sizeof *cache);
+	if (cache == NULL)
+		return NULL;
+	pthread_mutex_init(&cache->rc_lock, NULL);
+	if (__atomic_compare_exchange_n(&obj->mo_drv_obj_cache, &installed,
+					cache, false, __ATOMIC_ACQ_REL,
+					__ATOMIC_ACQUIRE))
+		return cache;
+
+	pthread_mutex_destroy(&cache->rc_lock);
+	mio_mem_free(cache);
+	return installed;
+}
+
+static void motr_obj_rcache_free(struct mio_obj *obj)
+{
+	int i;
+	struct motr_obj_rcache *cache = obj->mo_drv_obj_cache;
+
+	if (cache == NULL)
+		return;
+	for (i = 0; i < MOTR_OBJ_RCACHE_NR_WINDOWS; i++)
+		mio_mem_free(cache->rc_windows[i].rw_buf);
+	pthread_mutex_destroy(&cache->rc_lock);
+	mio_mem_free(cache);
+	obj->mo_drv_obj_cache = NULL;
+}
+
+static void motr_obj_rcache_invalidate(struct mio_obj *obj,
+				       const struct mio_iovec *iov,
+				       int iovcnt)
+{
+	int i;
+	int j;
+	struct motr_obj_rcache *cache;
+	struct motr_obj_rcache_window *win;
+
+	cache = __atomic_load_n(&obj->mo_drv_obj_cache, __ATOMIC_ACQUIRE);
+	if (cache == NULL)
+		return;
+
+	pthread_mutex_lock(&cache->rc_lock);
+	cache->rc_gen++;
+	for (i = 0; i < MOTR_OBJ_RCACHE_NR_WINDOWS; i++) {
+		win = cache->rc_windows + i;
+		for (j = 0; j < iovcnt && win->rw_len != 0; j++)
+			if (iov[j].miov_off < win->rw_off + win->rw_len &&
+			    win->rw_off < iov[j].miov_off + iov[j].miov_len)
+				win->rw_len = 0;
+	}
+	pthread_mutex_unlock(&cache->rc_lock);
+}
+
+/* Must be called with the cache lock held. */
+static struct motr_obj_rcache_window *
+motr_obj_rcache_lookup(struct motr_obj_rcache *cache,
+		       const struct mio_iovec *iov)
+{
+	int i;
+	struct motr_obj_rcache_window *win;
+
+	for (i = 0; i < MOTR_OBJ_RCACHE_NR_WINDOWS; i++) {
+		win = cache->rc_windows + i;
+		if (win->rw_len != 0 && !win->rw_filling &&
+		    iov->miov_off >= win->rw_off &&
+		    iov->miov_off + iov->miov_len <= win->rw_off + win->rw_len)
+			return win;
+	}
+	return NULL;
+}
+
+/* Serves the read from the cache if all vectors hit. */
+static bool motr_obj_rcache_hit(struct motr_obj_rcache *cache,
+				const struct mio_iovec *iov, int iovcnt)
+{
+	int i;
+	bool hit = true;
+	struct motr_obj_rcache_window *win;
+
+	pthread_mutex_lock(&cache->rc_lock);
+	for (i = 0; i < iovcnt && hit; i++)
+		hit = motr_obj_rcache_lookup(cache, iov + i) != NULL;
+	for (i = 0; i < iovcnt && hit; i++) {
+		win = motr_obj_rcache_lookup(cache, iov + i);
+		mio_mem_copy(iov[i].miov_base,
+			     win->rw_buf + (iov[i].miov_off - win->rw_off),
+			     iov[i].miov_len);
+	}
+	pthread_mutex_unlock(&cache->rc_lock);
+	return hit;
+}
+
+static int motr_obj_rcache_fill_done(struct mio_op *op, struct mio_obj *obj,
+				     int iovcnt, const struct mio_iovec *iov)
+{
+	struct motr_obj_rcache_fill *fill;
+	struct motr_obj_rcache_window *win;
+
+	fill = container_of(iov, struct motr_obj_rcache_fill, rf_win_iov);
+	win = fill->rf_cache->rc_windows + fill->rf_win;
+	mio_mem_copy(fill->rf_iov.miov_base,
+		     win->rw_buf + (fill->rf_iov.miov_off - win->rw_off),
+		     fill->rf_iov.miov_len);
+
+	pthread_mutex_lock(&fill->rf_cache->rc_lock);
+	if (fill->rf_gen == fill->rf_cache->rc_gen)
+		win->rw_len = fill->rf_win_iov.miov_len;
+	win->rw_filling = false;
+	fill->rf_done = true;
+	pthread_mutex_unlock(&fill->rf_cache->rc_lock);
+	return MIO_DRV_OP_FINAL;
+}
+
+/* Releases the window of a fill which didn't complete. */
+static int motr_obj_rcache_fill_fini(struct mio_driver_op *dop)
+{
+	struct motr_obj_rcache_fill *fill;
+
+	fill = (struct motr_obj_rcache_fill *)dop->mdo_op_args;
+	if (!fill->rf_done) {
+		pthread_mutex_lock(&fill->rf_cache->rc_lock);
+		fill->rf_cache->rc_windows[fill->rf_win].rw_filling = false;
+		pthread_mutex_unlock(&fill->rf_cache->rc_lock);
+	}
+	mio_mem_free(fill);
+	return 0;
+}
+
+/*
+ * Works out the window to read for `iov`. Returns -ENOENT if the read
+ * should bypass the cache.
+ */
+static int motr_obj_rcache_window_size(struct mio_obj *obj, int pattern,
+				       const struct mio_iovec *iov,
+				       uint64_t *off, uint64_t *len)
+{
+	int rc;
+	uint64_t pagesize;
+	uint64_t max_len;
+	uint64_t end;
+	uint64_t req_end;
+	uint64_t size_end;
+
+	/* Let the plain read path deal with objects it can't size. */
+	rc = mio__motr_obj_max_size_per_op(obj, &max_len);
+	if (rc < 0)
+		return -ENOENT;
+	if (max_len > MOTR_OBJ_RCACHE_MAX_WINDOW_SIZE)
+		max_len = MOTR_OBJ_RCACHE_MAX_WINDOW_SIZE;
+
+	pagesize = motr_obj_io_pagesize(obj);
+	*off = iov->miov_off / pagesize * pagesize;
+	req_end = iov->miov_off + iov->miov_len;
+	req_end = (req_end + pagesize - 1) / pagesize * pagesize;
+	if (req_end - *off > max_len ||
+	    iov->miov_off >= obj->mo_attrs.moa_size)
+		return -ENOENT;
+
+	end = req_end;
+	if (pattern == MIO_OBJ_ACCESS_SEQUENTIAL) {
+		size_end = (obj->mo_attrs.moa_size + pagesize - 1) /
+			   pagesize * pagesize;
+		end = *off + max_len / pagesize * pagesize;
+		if (end > size_end)
+			end = size_end;
+		if (end < req_end)
+			end = req_end;
+	}
+	*len = end - *off;
+	return 0;
+}
+
+/* Reads the window covering `iov` into the cache, then copies it out. */
+static int motr_obj_rcache_fill(struct mio_obj *obj,
+				struct motr_obj_rcache *cache, int pattern,
+				const struct mio_iovec *iov, struct mio_op *op)
+{
+	int i;
+	int rc;
+	int nr_windows;
+	uint64_t off;
+	uint64_t len;
+	char *buf;
+	struct motr_obj_rcache_fill *fill;
+	struct motr_obj_rcache_window *win = NULL;
+
+	rc = motr_obj_rcache_window_size(obj, pattern, iov, &off, &len);
+	if (rc < 0)
+		return rc;
+
+	fill = mio_mem_alloc(sizeof *fill);
+	if (fill == NULL)
+		return -ENOMEM;
+
+	nr_windows = pattern == MIO_OBJ_ACCESS_SEQUENTIAL?
+		     1 : MOTR_OBJ_RCACHE_NR_WINDOWS;
+	pthread_mutex_lock(&cache->rc_lock);
+	for (i = 0; i < nr_windows && win == NULL; i++) {
+		fill->rf_win = (cache->rc_next + i) % nr_windows;
+		if (!cache->rc_windows[fill->rf_win].rw_filling)
+			win = cache->rc_windows + fill->rf_win;
+	}
+	if (win == NULL) {
+		pthread_mutex_unlock(&cache->rc_lock);
+		mio_mem_free(fill);
+		return -ENOENT;
+	}
+	if (win->rw_buf_size < len) {
+		mio_mem_free(win->rw_buf);
+		win->rw_buf_size = 0;
+		win->rw_buf = mio_mem_alloc(len);
+		if (win->rw_buf != NULL)
+			win->rw_buf_size = len;
+	}
+	win->rw_len = 0;
+	buf = win->rw_buf;
+	if (buf != NULL) {
+		win->rw_off = off;
+		win->rw_filling = true;
+		cache->rc_next = (fill->rf_win + 1) % nr_windows;
+	}
+	fill->rf_gen = cache->rc_gen;
+	pthread_mutex_unlock(&cache->rc_lock);
+	if (buf == NULL) {
+		mio_mem_free(fill);
+		return -ENOMEM;
+	}
+
+	fill->rf_cache = cache;
+	fill->rf_iov = *iov;
+	motr_obj_iovec_set(&fill->rf_win_iov, off, len, buf);
+	rc = mio_driver_op_add_fini(op, motr_obj_rcache_fill_fini, fill);
+	if (rc < 0) {
+		pthread_mutex_lock(&cache->rc_lock);
+		win->rw_filling = false;
+		pthread_mutex_unlock(&cache->rc_lock);
+		mio_mem_free(fill);
+		return rc;
+	}
+	return motr_obj_readv(obj, &fill->rf_win_iov, 1,
+			      motr_obj_rcache_fill_done, op);
+}
+
+static int mio_motr_obj_readv(struct mio_obj *obj,
+				 const struct mio_iovec *iov,
+				 int iovcnt, struct mio_op *op)
+{
+	int rc;
+	int pattern;
+	struct motr_obj_rcache *cache;
+
+	if (obj->mo_attrs.moa_inline != NULL)
+		return motr_obj_inline_readv(obj, iov, iovcnt, op);
+
+	pattern = motr_obj_access_pattern(obj);
+	if (pattern != MIO_OBJ_ACCESS_SEQUENTIAL &&
+	    pattern != MIO_OBJ_ACCESS_READ_MOSTLY)
+		return motr_obj_readv(obj, iov, iovcnt, NULL, op);
+
+	cache = motr_obj_rcache_get(obj);
+	if (cache == NULL)
+		return motr_obj_readv(obj, iov, iovcnt, NULL, op);
+	if (motr_obj_rcache_hit(cache, iov, iovcnt))
+		return mio_driver_op_add_done(op);
+	if (iovcnt == 1) {
+		rc = motr_obj_rcache_fill(obj, cache, pattern, iov, op);
+		if (rc != -ENOENT)
+			return rc;
+	}
+	return motr_obj_readv(obj, iov, iovcnt, NULL, op);
+}
+
 static int mio_motr_obj_sync(struct mio_obj *obj, struct mio_op *op)
 {
 	int rc;
 	struct m0_obj *cobj;
 	struct m0_op  *sync_op = {NULL};
 
+	/* Inline data is stored with the attributes. */
+	if (obj->mo_attrs.moa_inline != NULL) {
+		if (!obj->mo_attrs_updated)
+			return mio_driver_op_add_done(op);
+		return motr_obj_attrs_query(M0_IC_PUT, obj,
+					    motr_obj_attrs_put_pp, op);
+	}
+
 	rc = m0_sync_op_init(&sync_op);
 	if (rc < 0)
 		return rc;
@@ -1431,268 +2630,1456 @@ error:
  * Depending on workload and performance of Motr index, MIO may support
  * multiple indics.
  *
- * Format of object attributes that are stored in attribute index are
- * defined as below:
+ * Object attributes are stored in the attribute index as a record
+ * starting with a header, MOTR_OBJ_ATTRS_MAGIC followed by a version
+ * byte, and then a list of fields up to the end of the record. Each
+ * field starts with a varint tag, its number shifted left by one with
+ * the lowest bit giving how the value is encoded:
+ *   - MOTR_OBJ_ATTR_VARINT: a varint.
+ *   - MOTR_OBJ_ATTR_BYTES: a varint length and as many bytes.
+ * Integer fields which are 0 are left out, a hint is a field of its own
+ * holding two varints (key and value). An inline object has no size
+ * field, the length of its data (MOTR_OBJ_ATTR_INLINE) is its size.
+ * Fields of unknown numbers are skipped, so new attributes can be added
+ * without changing the version and records stay readable by older
+ * clients. All integers are encoded independently of the host's byte
+ * order.
+ *
+ * Records written before the header was introduced are still decoded.
+ * Their layout is:
  *
  * struct motr_obj_attrs_onwire {
  *	struct mio_obj_attrs coa_attrs;
  *      int coa_nr_hints;
  *      int coa_hint_keys[];   // array of hint's keys
  *      uint64_t coa_hint_values[]; // array of hint's values
+ *      struct motr_obj_attrs_ext coa_exts[]; // optional extensions
  * };
  *
+ * where the extension area holds optional attributes as type-length-value
+ * records up to the end of the record. Such records are upgraded to the
+ * current format when the object's attributes are next stored.
+ *
  * Note: MIO assumes application takes care of concurrent accesses to
  * an object and its attributes.
  */
 
-struct motr_obj_attrs_pp_args {
-	int32_t *aca_rc;
-	struct m0_bufvec *aca_key;
-	struct m0_bufvec *aca_val;
-	/* Where the returned attributes are copied to. */
-	struct mio_obj *aca_to;
+enum motr_obj_attrs_ext_type {
+	/* The composite object of a migrated object, see mio_obj_migrate(). */
+	MOTR_OBJ_ATTRS_EXT_REDIRECT = 1,
+	/* Time-decayed access heat, struct mio_obj_heat. */
+	MOTR_OBJ_ATTRS_EXT_HEAT = 2,
 };
 
-static int motr_obj_attr_nonhint_size(struct mio_obj *obj)
-{
-	int size;
+struct motr_obj_attrs_ext {
+	uint16_t oae_type;
+	uint16_t oae_len;
+	char oae_value[];
+};
 
-	size = sizeof obj->mo_attrs.moa_size;
+enum {
+	MOTR_OBJ_ATTRS_MAGIC_LEN = 4,
+	MOTR_OBJ_ATTRS_VERSION = 1,
+	MOTR_OBJ_ATTRS_HDR_LEN = MOTR_OBJ_ATTRS_MAGIC_LEN + 1,
+};
+static const char MOTR_OBJ_ATTRS_MAGIC[MOTR_OBJ_ATTRS_MAGIC_LEN] = "MIOA";
+
+enum motr_obj_attr_encoding {
+	MOTR_OBJ_ATTR_VARINT = 0,
+	MOTR_OBJ_ATTR_BYTES = 1,
+};
+
+enum motr_obj_attr_field {
+	MOTR_OBJ_ATTR_SIZE = 1,
+	MOTR_OBJ_ATTR_RCOUNT,
+	MOTR_OBJ_ATTR_RBYTES,
+	MOTR_OBJ_ATTR_RTIME,
+	MOTR_OBJ_ATTR_WCOUNT,
+	MOTR_OBJ_ATTR_WBYTES,
+	MOTR_OBJ_ATTR_WTIME,
+	/* Bytes: varint key, varint value. */
+	MOTR_OBJ_ATTR_HINT,
+	/* Bytes: the composite object's id, see mio_obj_migrate(). */
+	MOTR_OBJ_ATTR_REDIRECT,
+	/* Bytes: varint score, varint time, struct mio_obj_heat. */
+	MOTR_OBJ_ATTR_HEAT,
+	/* Bytes: the data of an inline object, replacing the size. */
+	MOTR_OBJ_ATTR_INLINE,
+	/* Bytes: varint container, varint key of an inline object's pool. */
+	MOTR_OBJ_ATTR_INLINE_POOL,
+	/* Varint: 1 if the object has a composite layout. */
+	MOTR_OBJ_ATTR_COMPOSITE,
+};
+
+static int motr_obj_attr_nonhint_size(struct mio_obj *obj)
+{
+	int size;
+
+	size = sizeof obj->mo_attrs.moa_size;
 	size += sizeof obj->mo_attrs.moa_stats;
 	return size;
 }
 
-static int
-motr_obj_attrs_mem2wire(struct mio_obj *obj,
-			  uint64_t *attr_size, void **attr_buf)
+/* The integer attribute stored as field `field`, NULL if there is none. */
+static uint64_t *motr_obj_attr_u64(struct mio_obj *obj, int field)
+{
+	struct mio_obj_stats *stats = &obj->mo_attrs.moa_stats;
+
+	switch (field) {
+	case MOTR_OBJ_ATTR_SIZE:
+		return &obj->mo_attrs.moa_size;
+	case MOTR_OBJ_ATTR_RCOUNT:
+		return &stats->mos_rcount;
+	case MOTR_OBJ_ATTR_RBYTES:
+		return &stats->mos_rbytes;
+	case MOTR_OBJ_ATTR_RTIME:
+		return &stats->mos_rtime;
+	case MOTR_OBJ_ATTR_WCOUNT:
+		return &stats->mos_wcount;
+	case MOTR_OBJ_ATTR_WBYTES:
+		return &stats->mos_wbytes;
+	case MOTR_OBJ_ATTR_WTIME:
+		return &stats->mos_wtime;
+	default:
+		return NULL;
+	}
+}
+
+static char *motr_obj_attr_tag_put(char *ptr, int field, int encoding)
+{
+	return ptr + mio_varint_encode((uint64_t)field << 1 | encoding, ptr);
+}
+
+static char *
+motr_obj_attr_bytes_put(char *ptr, int field, void *value, int len)
+{
+	ptr = motr_obj_attr_tag_put(ptr, field, MOTR_OBJ_ATTR_BYTES);
+	ptr += mio_varint_encode(len, ptr);
+	if (len != 0)
+		mio_mem_copy(ptr, value, len);
+	return ptr + len;
+}
+
+static char *
+motr_obj_attr_pair_put(char *ptr, int field, uint64_t v1, uint64_t v2)
+{
+	int len;
+	char pair[2 * MIO_VARINT_MAX_LEN];
+
+	len = mio_varint_encode(v1, pair);
+	len += mio_varint_encode(v2, pair + len);
+	return motr_obj_attr_bytes_put(ptr, field, pair, len);
+}
+
+static int
+motr_obj_attrs_mem2wire(struct mio_obj *obj,
+			  uint64_t *attr_size, void **attr_buf)
+{
+	int key;
+	int field;
+	uint64_t *value;
+	uint64_t max_size;
+	char *buf;
+	char *ptr;
+	struct mio_hint_map *map = &obj->mo_attrs.moa_phints.mh_map;
+	struct mio_obj_heat *heat = &obj->mo_attrs.moa_heat;
+	struct motr_obj_inline *in = obj->mo_attrs.moa_inline;
+
+	/* Tags and lengths take one byte each. */
+	max_size = MOTR_OBJ_ATTRS_HDR_LEN;
+	max_size += MOTR_OBJ_ATTR_WTIME * (1 + MIO_VARINT_MAX_LEN);
+	max_size += map->mhm_nr_set * (2 + 2 * MIO_VARINT_MAX_LEN);
+	max_size += 2 + MIO_OBJ_ID_LEN;
+	max_size += 2 + 2 * MIO_VARINT_MAX_LEN;
+	max_size += 2;
+	if (in != NULL) {
+		max_size += 1 + MIO_VARINT_MAX_LEN + obj->mo_attrs.moa_size;
+		max_size += 2 + 2 * MIO_VARINT_MAX_LEN;
+	}
+
+	buf = mio_mem_alloc(max_size);
+	if (buf == NULL)
+		return -ENOMEM;
+
+	ptr = buf;
+	mio_mem_copy(ptr, (void *)MOTR_OBJ_ATTRS_MAGIC,
+		     MOTR_OBJ_ATTRS_MAGIC_LEN);
+	ptr += MOTR_OBJ_ATTRS_MAGIC_LEN;
+	*ptr++ = MOTR_OBJ_ATTRS_VERSION;
+
+	for (field = MOTR_OBJ_ATTR_SIZE; field <= MOTR_OBJ_ATTR_WTIME;
+	     field++) {
+		value = motr_obj_attr_u64(obj, field);
+		if (*value == 0 ||
+		    (field == MOTR_OBJ_ATTR_SIZE && in != NULL))
+			continue;
+		ptr = motr_obj_attr_tag_put(ptr, field, MOTR_OBJ_ATTR_VARINT);
+		ptr += mio_varint_encode(*value, ptr);
+	}
+
+	for (key = mio_hint_map_next(map, MIO_HINT_INVALID);
+	     key != MIO_HINT_INVALID; key = mio_hint_map_next(map, key))
+		ptr = motr_obj_attr_pair_put(ptr, MOTR_OBJ_ATTR_HINT,
+					     key, map->mhm_values[key]);
+
+	if (obj->mo_attrs.moa_redirected)
+		ptr = motr_obj_attr_bytes_put(ptr, MOTR_OBJ_ATTR_REDIRECT,
+				obj->mo_attrs.moa_redirect.moi_bytes,
+				MIO_OBJ_ID_LEN);
+
+	if (heat->moh_time != 0)
+		ptr = motr_obj_attr_pair_put(ptr, MOTR_OBJ_ATTR_HEAT,
+					     heat->moh_score, heat->moh_time);
+
+	if (obj->mo_attrs.moa_composite) {
+		ptr = motr_obj_attr_tag_put(ptr, MOTR_OBJ_ATTR_COMPOSITE,
+					    MOTR_OBJ_ATTR_VARINT);
+		ptr += mio_varint_encode(1, ptr);
+	}
+
+	if (in != NULL) {
+		ptr = motr_obj_attr_bytes_put(ptr, MOTR_OBJ_ATTR_INLINE,
+					      in->moi_data,
+					      obj->mo_attrs.moa_size);
+		if (in->moi_has_pool)
+			ptr = motr_obj_attr_pair_put(ptr,
+					MOTR_OBJ_ATTR_INLINE_POOL,
+					in->moi_pool.f_container,
+					in->moi_pool.f_key);
+	}
+
+	*attr_size = ptr - buf;
+	*attr_buf = buf;
+	return 0;
+}
+
+static int
+motr_obj_attrs_exts_wire2mem(struct mio_obj *obj, int exts_size, char *ptr)
+{
+	struct motr_obj_attrs_ext ext;
+
+	obj->mo_attrs.moa_redirected = false;
+	obj->mo_attrs.moa_composite = false;
+	mio_memset(&obj->mo_attrs.moa_heat, 0, sizeof obj->mo_attrs.moa_heat);
+	while (exts_size > 0) {
+		if (exts_size < sizeof ext)
+			return -EIO;
+		mio_mem_copy(&ext, ptr, sizeof ext);
+		ptr += sizeof ext;
+		exts_size -= sizeof ext;
+		if (exts_size < ext.oae_len)
+			return -EIO;
+
+		switch (ext.oae_type) {
+		case MOTR_OBJ_ATTRS_EXT_REDIRECT:
+			if (ext.oae_len != MIO_OBJ_ID_LEN)
+				return -EIO;
+			mio_mem_copy(obj->mo_attrs.moa_redirect.moi_bytes,
+				     ptr, MIO_OBJ_ID_LEN);
+			obj->mo_attrs.moa_redirected = true;
+			break;
+		case MOTR_OBJ_ATTRS_EXT_HEAT:
+			if (ext.oae_len != sizeof obj->mo_attrs.moa_heat)
+				return -EIO;
+			mio_mem_copy(&obj->mo_attrs.moa_heat, ptr,
+				     sizeof obj->mo_attrs.moa_heat);
+			break;
+		default:
+			break;
+		}
+		ptr += ext.oae_len;
+		exts_size -= ext.oae_len;
+	}
+	return 0;
+}
+
+static int
+motr_obj_attrs_legacy_wire2mem(struct mio_obj *obj,
+			       int attr_size, void *attr_buf)
+{
+	int i;
+	int rc;
+	int key;
+	int nonhint_size;
+	int size;
+	int nr_hints;
+	char *ptr;
+	char *vptr;
+	uint64_t value;
+	struct mio_hint_map *map = &obj->mo_hints.mh_map;
+
+	/* Nothing is copied from a record too short to hold it. */
+	nonhint_size = motr_obj_attr_nonhint_size(obj);
+	size = nonhint_size + sizeof(int);
+	if (attr_size < size)
+		return -EINVAL;
+
+	ptr = attr_buf;
+	mio_mem_copy(&nr_hints, ptr + nonhint_size, sizeof(int));
+	if (nr_hints < 0 || nr_hints > MIO_OBJ_HINT_NUM)
+		return -EIO;
+	size += nr_hints * (sizeof(int) + sizeof(uint64_t));
+	if (attr_size < size)
+		return -EINVAL;
+
+	mio_mem_copy(&obj->mo_attrs, ptr, nonhint_size);
+	ptr += nonhint_size + sizeof(int);
+
+	vptr = ptr + nr_hints * sizeof(int);
+	for (i = 0; i < nr_hints; i++) {
+		mio_mem_copy(&key, ptr, sizeof(int));
+		ptr += sizeof(int);
+		mio_mem_copy(&value, vptr, sizeof(uint64_t));
+		vptr += sizeof(uint64_t);
+		rc = mio_hint_map_set(map, key, value);
+		if (rc < 0)
+			return -EIO;
+	}
+	ptr = vptr;
+
+	return motr_obj_attrs_exts_wire2mem(obj, attr_size - size, ptr);
+}
+
+static int motr_obj_attr_pair_get(char *ptr, uint64_t len,
+				  uint64_t *v1, uint64_t *v2)
+{
+	int n1;
+	int n2;
+
+	n1 = mio_varint_decode(ptr, len, v1);
+	if (n1 < 0)
+		return n1;
+	n2 = mio_varint_decode(ptr + n1, len - n1, v2);
+	if (n2 < 0)
+		return n2;
+	return (uint64_t)(n1 + n2) == len? 0 : -EIO;
+}
+
+static int motr_obj_attr_bytes_decode(struct mio_obj *obj, int field,
+				      char *ptr, uint64_t len)
+{
+	int rc = 0;
+	uint64_t v1;
+	uint64_t v2;
+	struct motr_obj_inline *in;
+
+	switch (field) {
+	case MOTR_OBJ_ATTR_HINT:
+		rc = motr_obj_attr_pair_get(ptr, len, &v1, &v2);
+		if (rc == 0 && v1 >= MIO_OBJ_HINT_NUM)
+			rc = -EIO;
+		rc = rc? : mio_hint_map_set(&obj->mo_hints.mh_map, v1, v2);
+		break;
+	case MOTR_OBJ_ATTR_REDIRECT:
+		if (len != MIO_OBJ_ID_LEN)
+			return -EIO;
+		mio_mem_copy(obj->mo_attrs.moa_redirect.moi_bytes,
+			     ptr, MIO_OBJ_ID_LEN);
+		obj->mo_attrs.moa_redirected = true;
+		break;
+	case MOTR_OBJ_ATTR_HEAT:
+		rc = motr_obj_attr_pair_get(ptr, len, &v1, &v2);
+		obj->mo_attrs.moa_heat.moh_score = v1;
+		obj->mo_attrs.moa_heat.moh_time = v2;
+		break;
+	case MOTR_OBJ_ATTR_INLINE:
+		rc = motr_obj_inline_data_set(obj, ptr, len);
+		if (rc < 0)
+			return rc;
+		break;
+	case MOTR_OBJ_ATTR_INLINE_POOL:
+		/* Follows MOTR_OBJ_ATTR_INLINE. */
+		in = obj->mo_attrs.moa_inline;
+		rc = motr_obj_attr_pair_get(ptr, len, &v1, &v2);
+		if (rc < 0 || in == NULL)
+			break;
+		in->moi_has_pool = true;
+		in->moi_pool.f_container = v1;
+		in->moi_pool.f_key = v2;
+		break;
+	default:
+		break;
+	}
+	return rc < 0? -EIO : 0;
+}
+
+static int
+motr_obj_attrs_v1_wire2mem(struct mio_obj *obj, int attr_size, char *buf)
+{
+	int n;
+	int rc;
+	uint64_t tag;
+	uint64_t value;
+	uint64_t *attr;
+	char *ptr = buf + MOTR_OBJ_ATTRS_HDR_LEN;
+	char *end = buf + attr_size;
+
+	obj->mo_attrs.moa_size = 0;
+	mio_memset(&obj->mo_attrs.moa_stats, 0,
+		   sizeof obj->mo_attrs.moa_stats);
+	obj->mo_attrs.moa_redirected = false;
+	obj->mo_attrs.moa_composite = false;
+	mio_memset(&obj->mo_attrs.moa_heat, 0, sizeof obj->mo_attrs.moa_heat);
+
+	while (ptr < end) {
+		n = mio_varint_decode(ptr, end - ptr, &tag);
+		if (n < 0)
+			return -EIO;
+		ptr += n;
+		n = mio_varint_decode(ptr, end - ptr, &value);
+		if (n < 0)
+			return -EIO;
+		ptr += n;
+
+		if ((tag & 1) == MOTR_OBJ_ATTR_VARINT) {
+			attr = motr_obj_attr_u64(obj, tag >> 1);
+			if (attr != NULL)
+				*attr = value;
+			else if (tag >> 1 == MOTR_OBJ_ATTR_COMPOSITE)
+				obj->mo_attrs.moa_composite = value != 0;
+			continue;
+		}
+
+		/* MOTR_OBJ_ATTR_BYTES, `value` is the length. */
+		if (value > (uint64_t)(end - ptr))
+			return -EIO;
+		rc = motr_obj_attr_bytes_decode(obj, tag >> 1, ptr, value);
+		if (rc < 0)
+			return rc;
+		ptr += value;
+	}
+	return 0;
+}
+
+static bool motr_obj_attrs_is_v1(int attr_size, char *buf)
+{
+	return attr_size >= MOTR_OBJ_ATTRS_HDR_LEN &&
+	       memcmp(buf, MOTR_OBJ_ATTRS_MAGIC,
+		      MOTR_OBJ_ATTRS_MAGIC_LEN) == 0 &&
+	       buf[MOTR_OBJ_ATTRS_MAGIC_LEN] == MOTR_OBJ_ATTRS_VERSION;
+}
+
+/**
+ * A legacy record starts with the object's size, which could happen to
+ * look like the header. Such a record is unlikely to also parse as a
+ * list of fields up to its end, and is decoded as legacy if it doesn't.
+ * It is tried as v1 on a copy of the object, so that the fields decoded
+ * before failing don't end up in the object.
+ */
+static int
+motr_obj_attrs_wire2mem(struct mio_obj *obj, int attr_size, void *attr_buf)
+{
+	int rc;
+	struct mio_obj tmp;
+
+	motr_obj_inline_free(obj);
+	if (motr_obj_attrs_is_v1(attr_size, attr_buf)) {
+		tmp = *obj;
+		rc = motr_obj_attrs_v1_wire2mem(&tmp, attr_size, attr_buf);
+		if (rc == 0) {
+			obj->mo_attrs = tmp.mo_attrs;
+			obj->mo_hints = tmp.mo_hints;
+			return 0;
+		}
+		motr_obj_inline_free(&tmp);
+		if (attr_size < motr_obj_attr_nonhint_size(obj))
+			return rc;
+	}
+	return motr_obj_attrs_legacy_wire2mem(obj, attr_size, attr_buf);
+}
+
+static void motr_obj_attrs_pp_args_free(struct motr_obj_attrs_pp_args *args)
+{
+	mio__motr_bufvec_free(args->aca_key);
+	mio__motr_bufvec_free(args->aca_val);
+	mio_mem_free(args->aca_rc);
+	mio_mem_free(args);
+}
+
+/**
+ * Creates (without launching) an op querying the object's attribute
+ * record in `kvs`.
+ */
+static int motr_obj_attrs_kvs_op(int opcode, uint32_t flags,
+				 struct mio_obj *obj, struct mio_kvs *kvs,
+				 struct m0_op **cop,
+				 struct motr_obj_attrs_pp_args **out)
+{
+	int rc;
+	int32_t *qrc = NULL; /* return value for kvs query. */
+	struct m0_uint128 *id128;
+        struct m0_bufvec *key = NULL;
+        struct m0_bufvec *val = NULL;
+	struct m0_idx *idx;
+	struct motr_obj_attrs_pp_args *args;
+
+	assert(opcode == M0_IC_GET || opcode == M0_IC_PUT ||
+	       opcode == M0_IC_DEL);
+
+	*cop = NULL;
+	id128 = mio_mem_alloc(sizeof *id128);
+	qrc = mio_mem_alloc(sizeof(int32_t));
+	args = mio_mem_alloc(sizeof *args);
+	if (id128 == NULL || qrc == NULL || args == NULL) {
+		rc = -ENOMEM;
+		goto error;
+	}
+
+	/* Allocate bufvec's for keys and values. */
+	key = mio__motr_bufvec_alloc(1);
+	if (key == NULL) {
+		rc = -ENOMEM;
+		goto error;
+	}
+
+	if (opcode != M0_IC_DEL) {
+		val = mio__motr_bufvec_alloc(1);
+		if (val == NULL) {
+			rc = -ENOMEM;
+			goto error;
+		}
+	}
+
+        /* Fill key and value. TODO: serialise key and value? */
+	mio__obj_id_to_uint128(&obj->mo_id, id128);
+	key->ov_vec.v_count[0] = sizeof *id128;
+	key->ov_buf[0] = id128;
+
+	if (opcode == M0_IC_PUT) {
+		rc = motr_obj_attrs_mem2wire(obj, &val->ov_vec.v_count[0],
+					     &val->ov_buf[0]);
+		if (rc < 0)
+			goto error;
+	}
+
+	/* Create index's op. */
+	idx = (struct m0_idx *)kvs->mk_drv_kvs;
+	rc = m0_idx_op(idx, opcode, key, val, qrc, flags, cop);
+	if (rc < 0)
+		goto error;
+
+	args->aca_val = val;
+	args->aca_key = key;
+	args->aca_rc = qrc;
+	args->aca_to = obj;
+	args->aca_kvs = kvs;
+	*out = args;
+	return 0;
+
+error:
+	mio_mem_free(id128);
+	if (opcode == M0_IC_PUT && val != NULL)
+		mio_mem_free(val->ov_buf[0]);
+	mio__motr_bufvec_free(key);
+	mio__motr_bufvec_free(val);
+	mio_mem_free(qrc);
+	mio_mem_free(args);
+	return rc;
+}
+
+static int motr_obj_attrs_kvs_launch(int opcode, uint32_t flags,
+				     struct mio_obj *obj, struct mio_kvs *kvs,
+				     mio_driver_op_postprocess op_pp,
+				     struct mio_op *op)
+{
+	int rc;
+	struct m0_op *cops[1] = {NULL};
+	struct motr_obj_attrs_pp_args *args;
+
+	rc = motr_obj_attrs_kvs_op(opcode, flags, obj, kvs, &cops[0], &args);
+	if (rc < 0)
+		return rc;
+
+	/* Set callback function and arguments. */
+	rc = mio_driver_op_add(op, op_pp, args, NULL, cops[0], NULL);
+	if (rc < 0) {
+		m0_op_fini(cops[0]);
+		m0_op_free(cops[0]);
+		motr_obj_attrs_pp_args_free(args);
+		return rc;
+	}
+
+	mio_telemetry_array_advertise_noprefix(
+		"mio-op-to-motr-kv", MIO_TM_TYPE_ARRAY_UINT64,
+		3, obj->mo_sess_seqno, op->mop_seqno, cops[0]->op_sm.sm_id);
+	m0_op_launch(cops, 1);
+	return 0;
+}
+
+static int motr_obj_attrs_kvs_query(int opcode, struct mio_obj *obj,
+				    struct mio_kvs *kvs,
+				    mio_driver_op_postprocess op_pp,
+				    struct mio_op *op)
+{
+	return motr_obj_attrs_kvs_launch(opcode, opcode == M0_IC_PUT?
+					 M0_OIF_OVERWRITE : 0,
+					 obj, kvs, op_pp, op);
+}
+
+static int motr_obj_attrs_query(int opcode, struct mio_obj *obj,
+				  mio_driver_op_postprocess op_pp,
+				  struct mio_op *op)
+{
+	return motr_obj_attrs_kvs_query(opcode, obj, obj->mo_md_kvs,
+					op_pp, op);
+}
+
+/**
+ * Update object's attrs and wait till it completes.
+ */
+static int motr_obj_attrs_update_sync(struct mio_obj *obj)
+{
+	int rc;
+	struct mio_op mop;
+	struct m0_op *cop;
+
+	mio_op_init(&mop);
+	mio_obj_op_init(&mop, obj, MIO_OBJ_ATTRS_SET);
+	rc = motr_obj_attrs_query(M0_IC_PUT, obj,
+				    motr_obj_attrs_query_free_pp, &mop);
+	if (rc < 0)
+		return rc;
+
+	cop = MIO_MOTR_OP((&mop));
+	rc = m0_op_wait(cop, M0_BITS(M0_OS_FAILED, M0_OS_STABLE),
+			M0_TIME_NEVER);
+	rc = rc? : m0_rc(cop);
+	motr_obj_attrs_put_pp(&mop);
+	m0_op_fini(cop);
+	m0_op_free(cop);
+	return rc;
+
+}
+
+static int motr_obj_attrs_cache_load(struct mio_obj *obj)
+{
+	int rc;
+	int len;
+	void *buf;
+
+	rc = mio_obj_attrs_cache_get(&obj->mo_id, &buf, &len);
+	if (rc < 0)
+		return rc;
+	rc = motr_obj_attrs_wire2mem(obj, len, buf);
+	mio_mem_free(buf);
+	return rc;
+}
+
+static int motr_obj_attrs_query_free_pp(struct mio_op *op)
+{
+	struct motr_obj_attrs_pp_args *args;
+
+	args = (struct motr_obj_attrs_pp_args *)
+	       op->mop_drv_op_chain.mdoc_head->mdo_post_proc_data;
+	motr_obj_attrs_pp_args_free(args);
+	return MIO_DRV_OP_FINAL;
+}
+
+/**
+ * With sharding enabled, an object created before the shards were
+ * configured still has its attributes in the legacy index. A miss in
+ * the shard is retried there and, on a hit, the attributes are marked
+ * dirty so that closing the object migrates them into the shard.
+ */
+static int motr_obj_attrs_get_pp(struct mio_op *op)
+{
+	int rc;
+	bool found;
+	bool from_legacy;
+	struct m0_bufvec *ret_val;
+	struct m0_op *cop = MIO_MOTR_OP(op);
+	struct mio_obj *obj;
+	struct motr_obj_attrs_pp_args *args;
+
+	assert(cop != NULL);
+	args = (struct motr_obj_attrs_pp_args *)
+	       op->mop_drv_op_chain.mdoc_head->mdo_post_proc_data;
+	obj = args->aca_to;
+	ret_val = args->aca_val;
+	found = *args->aca_rc == 0 && ret_val->ov_vec.v_count[0] != 0;
+	from_legacy = args->aca_kvs == &mio_obj_attrs_kvs;
+	if (found) {
+		motr_obj_attrs_wire2mem(obj, ret_val->ov_vec.v_count[0],
+					  ret_val->ov_buf[0]);
+		mio_obj_attrs_cache_put(&obj->mo_id, ret_val->ov_buf[0],
+					ret_val->ov_vec.v_count[0]);
+		if (from_legacy && obj->mo_md_kvs != &mio_obj_attrs_kvs)
+			obj->mo_attrs_updated = true;
+	}
+
+	motr_obj_attrs_query_free_pp(op);
+	if (found || from_legacy)
+		return MIO_DRV_OP_FINAL;
+
+	rc = motr_obj_attrs_kvs_query(M0_IC_GET, obj, &mio_obj_attrs_kvs,
+				      motr_obj_attrs_get_pp, op);
+	return rc < 0? rc : MIO_DRV_OP_NEXT;
+}
+
+/**
+ * Keep the attribute cache in sync with what this client has stored.
+ * A failed PUT leaves the stored record unknown, so drop the cached one.
+ */
+static int motr_obj_attrs_put_pp(struct mio_op *op)
+{
+	struct m0_op *cop = MIO_MOTR_OP(op);
+	struct m0_bufvec *val;
+	struct mio_obj *obj;
+	struct motr_obj_attrs_pp_args *args;
+
+	args = (struct motr_obj_attrs_pp_args *)
+	       op->mop_drv_op_chain.mdoc_head->mdo_post_proc_data;
+	obj = args->aca_to;
+	val = args->aca_val;
+	if (m0_rc(cop) == 0 && *args->aca_rc == 0)
+		mio_obj_attrs_cache_put(&obj->mo_id, val->ov_buf[0],
+					val->ov_vec.v_count[0]);
+	else
+		mio_obj_attrs_cache_invalidate(&obj->mo_id);
+
+	return motr_obj_attrs_query_free_pp(op);
+}
+
+/* Stores the object's attributes on behalf of `op`. */
+int mio__motr_obj_attrs_put(struct mio_obj *obj, struct mio_op *op)
+{
+	return motr_obj_attrs_query(M0_IC_PUT, obj, motr_obj_attrs_put_pp, op);
+}
+
+/**
+ * Attributes are removed from the object's shard first and then from
+ * the legacy index, where they may still live if the object has not
+ * been re-opened since sharding was enabled.
+ */
+static int motr_obj_attrs_del_pp(struct mio_op *op)
+{
+	int rc;
+	struct mio_obj *obj;
+	struct motr_obj_attrs_pp_args *args;
+
+	args = (struct motr_obj_attrs_pp_args *)
+	       op->mop_drv_op_chain.mdoc_head->mdo_post_proc_data;
+	obj = args->aca_to;
+	if (args->aca_kvs == &mio_obj_attrs_kvs) {
+		motr_obj_attrs_query_free_pp(op);
+		return motr_obj_delete_expiry(obj, op);
+	}
+
+	motr_obj_attrs_query_free_pp(op);
+	rc = motr_obj_attrs_kvs_query(M0_IC_DEL, obj, &mio_obj_attrs_kvs,
+				      motr_obj_attrs_del_pp, op);
+	if (rc < 0) {
+		mio_mem_free(obj);
+		return rc;
+	}
+	return MIO_DRV_OP_NEXT;
+}
+
+/**
+ * Multi-object open, create and delete.
+ *
+ * Entity ops of all objects are launched together as one group of ops.
+ * Attribute index queries that follow are merged too: keys of objects
+ * whose attributes live in the same index (shard) are sent in a single
+ * multi-key m0_idx_op, and the queries to all indices are launched as
+ * one group. Results are reported per object, a failed object doesn't
+ * fail the whole MIO op.
+ *
+ * Deletion takes the steps of deleting a single object for all objects
+ * together: they are opened and their attributes fetched as by opening
+ * them, their entities are deleted, then their attributes, and the
+ * composite objects of migrated objects and the expiry records of
+ * objects with a lifetime go last.
+ */
+enum motr_objs_stage {
+	MOTR_OBJS_ENTITY = 0,
+	MOTR_OBJS_ATTRS,
+	/* Retry attribute queries against the legacy (non-sharded) index. */
+	MOTR_OBJS_ATTRS_LEGACY,
+	MOTR_OBJS_ENTITY_DELETE,
+	MOTR_OBJS_ATTRS_DELETE,
+	MOTR_OBJS_ATTRS_DELETE_LEGACY,
+};
+
+struct motr_objs_attrs_query {
+	struct mio_kvs *oaq_kvs;
+	int oaq_nr;
+	int *oaq_idx;              /* Object index of each key. */
+	struct m0_uint128 *oaq_ids;
+	struct m0_bufvec *oaq_keys;
+	struct m0_bufvec *oaq_vals;
+	int32_t *oaq_rcs;
+	struct m0_op *oaq_op;
+};
+
+struct motr_objs_args {
+	enum mio_obj_opcode oa_opcode;
+	enum motr_objs_stage oa_stage;
+	int oa_nr;
+	struct mio_obj *oa_objs;
+	struct m0_obj **oa_cobjs;
+	struct m0_op **oa_cops;
+	int32_t *oa_rcs;
+	int32_t *oa_app_rcs;
+	/* Objects to be included in the next attribute query. */
+	bool *oa_pending;
+	/* Objects without entity, which exist only if inline. */
+	bool *oa_no_entity;
+	/* Objects to delete whose attributes have been found. */
+	bool *oa_has_attrs;
+
+	int oa_nr_queries;
+	struct motr_objs_attrs_query *oa_queries;
+};
+
+static int motr_objs_attrs_pp(struct mio_op *op);
+
+static void motr_objs_obj_failed(struct motr_objs_args *args, int i, int rc)
+{
+	args->oa_rcs[i] = rc;
+	args->oa_app_rcs[i] = rc;
+	if (args->oa_opcode != MIO_OBJ_DELETE)
+		args->oa_objs[i].mo_drv_obj = NULL;
+}
+
+static void motr_objs_queries_fini(struct motr_objs_args *args)
+{
+	int i;
+	int j;
+	struct motr_objs_attrs_query *q;
+
+	for (i = 0; i < args->oa_nr_queries; i++) {
+		q = args->oa_queries + i;
+		if (q->oaq_vals != NULL)
+			for (j = 0; j < q->oaq_nr; j++)
+				m0_free(q->oaq_vals->ov_buf[j]);
+		mio__motr_bufvec_free(q->oaq_keys);
+		mio__motr_bufvec_free(q->oaq_vals);
+		mio_mem_free(q->oaq_idx);
+		mio_mem_free(q->oaq_ids);
+		mio_mem_free(q->oaq_rcs);
+		mio_memset(q, 0, sizeof *q);
+	}
+	args->oa_nr_queries = 0;
+}
+
+/**
+ * Motr objects of successfully opened or created objects are handed
+ * over to the application's mio_obj's, the rest are released here.
+ */
+static void motr_objs_args_free(struct motr_objs_args *args)
+{
+	int i;
+	struct m0_obj *cobj;
+
+	motr_objs_queries_fini(args);
+	for (i = 0; args->oa_opcode == MIO_OBJ_DELETE &&
+		    args->oa_objs != NULL && i < args->oa_nr; i++)
+		motr_obj_inline_free(args->oa_objs + i);
+	for (i = 0; args->oa_cobjs != NULL && i < args->oa_nr; i++) {
+		cobj = args->oa_cobjs[i];
+		if (cobj == NULL)
+			continue;
+		if (args->oa_opcode != MIO_OBJ_DELETE && args->oa_rcs[i] == 0)
+			continue;
+		m0_obj_fini(cobj);
+		mio_mem_free(cobj);
+	}
+
+	if (args->oa_opcode == MIO_OBJ_DELETE)
+		mio_mem_free(args->oa_objs);
+	mio_mem_free(args->oa_cobjs);
+	mio_mem_free(args->oa_cops);
+	mio_mem_free(args->oa_rcs);
+	mio_mem_free(args->oa_pending);
+	mio_mem_free(args->oa_no_entity);
+	mio_mem_free(args->oa_has_attrs);
+	mio_mem_free(args->oa_queries);
+	mio_mem_free(args);
+}
+
+static int motr_objs_op_fini(struct mio_driver_op *dop)
+{
+	motr_objs_args_free((struct motr_objs_args *)dop->mdo_op_args);
+	return 0;
+}
+
+static struct motr_objs_args *
+motr_objs_args_alloc(enum mio_obj_opcode opcode, int nr_objs,
+		     struct mio_obj *objs, int32_t *rcs)
+{
+	int i;
+	struct motr_objs_args *args;
+
+	args = mio_mem_alloc(sizeof *args);
+	if (args == NULL)
+		return NULL;
+	args->oa_opcode = opcode;
+	args->oa_stage = MOTR_OBJS_ENTITY;
+	args->oa_nr = nr_objs;
+	args->oa_objs = objs;
+	args->oa_app_rcs = rcs;
+	args->oa_cobjs = mio_mem_alloc(nr_objs * sizeof(struct m0_obj *));
+	args->oa_cops = mio_mem_alloc(nr_objs * sizeof(struct m0_op *));
+	args->oa_rcs = mio_mem_alloc(nr_objs * sizeof(int32_t));
+	args->oa_pending = mio_mem_alloc(nr_objs * sizeof(bool));
+	args->oa_no_entity = mio_mem_alloc(nr_objs * sizeof(bool));
+	args->oa_has_attrs = mio_mem_alloc(nr_objs * sizeof(bool));
+	args->oa_queries = mio_mem_alloc((mio_obj_attrs_kvs_nr_shards + 1) *
+					 sizeof(struct motr_objs_attrs_query));
+	if (args->oa_cobjs == NULL || args->oa_cops == NULL ||
+	    args->oa_rcs == NULL || args->oa_pending == NULL ||
+	    args->oa_no_entity == NULL || args->oa_has_attrs == NULL ||
+	    args->oa_queries == NULL) {
+		if (opcode == MIO_OBJ_DELETE)
+			args->oa_objs = NULL;
+		motr_objs_args_free(args);
+		return NULL;
+	}
+
+	for (i = 0; i < nr_objs; i++)
+		rcs[i] = 0;
+	return args;
+}
+
+static bool motr_objs_attrs_is_get(struct motr_objs_args *args)
+{
+	return args->oa_stage == MOTR_OBJS_ATTRS ||
+	       args->oa_stage == MOTR_OBJS_ATTRS_LEGACY;
+}
+
+static bool motr_objs_attrs_is_legacy(struct motr_objs_args *args)
+{
+	return args->oa_stage == MOTR_OBJS_ATTRS_LEGACY ||
+	       args->oa_stage == MOTR_OBJS_ATTRS_DELETE_LEGACY;
+}
+
+/* The legacy attribute index takes the slot after all shards. */
+static int motr_objs_kvs_slot(struct mio_kvs *kvs)
+{
+	if (kvs == &mio_obj_attrs_kvs)
+		return mio_obj_attrs_kvs_nr_shards;
+	return kvs - mio_obj_attrs_kvs_shards;
+}
+
+static struct mio_kvs *
+motr_objs_attrs_kvs(struct motr_objs_args *args, int i)
+{
+	if (motr_objs_attrs_is_legacy(args))
+		return &mio_obj_attrs_kvs;
+	return args->oa_objs[i].mo_md_kvs;
+}
+
+static int motr_objs_query_alloc(struct motr_objs_attrs_query *q, int opcode)
+{
+	int nr = q->oaq_nr;
+
+	q->oaq_idx = mio_mem_alloc(nr * sizeof(int));
+	q->oaq_ids = mio_mem_alloc(nr * sizeof(struct m0_uint128));
+	q->oaq_rcs = mio_mem_alloc(nr * sizeof(int32_t));
+	q->oaq_keys = mio__motr_bufvec_alloc(nr);
+	if (opcode != M0_IC_DEL)
+		q->oaq_vals = mio__motr_bufvec_alloc(nr);
+	if (q->oaq_idx == NULL || q->oaq_ids == NULL ||
+	    q->oaq_rcs == NULL || q->oaq_keys == NULL ||
+	    (opcode != M0_IC_DEL && q->oaq_vals == NULL))
+		return -ENOMEM;
+	/* Refilled below. */
+	q->oaq_nr = 0;
+	return 0;
+}
+
+/**
+ * Launches one multi-key query per attribute index for all pending
+ * objects. Returns the number of queries launched.
+ */
+static int
+motr_objs_attrs_launch(struct motr_objs_args *args, int opcode,
+		       struct mio_op *op)
+{
+	int i;
+	int j;
+	int rc;
+	int *slot2q;
+	int nr_slots = mio_obj_attrs_kvs_nr_shards + 1;
+	int nr_cops = 0;
+	struct m0_op **cops = NULL;
+	struct motr_objs_attrs_query *q;
+
+	slot2q = mio_mem_alloc(nr_slots * sizeof(int));
+	if (slot2q == NULL)
+		return -ENOMEM;
+	for (i = 0; i < nr_slots; i++)
+		slot2q[i] = -1;
+
+	/* Group the pending objects by the index holding their attrs. */
+	for (i = 0; i < args->oa_nr; i++) {
+		if (!args->oa_pending[i])
+			continue;
+		j = motr_objs_kvs_slot(motr_objs_attrs_kvs(args, i));
+		if (slot2q[j] < 0) {
+			slot2q[j] = args->oa_nr_queries++;
+			q = args->oa_queries + slot2q[j];
+			q->oaq_kvs = motr_objs_attrs_kvs(args, i);
+		}
+		args->oa_queries[slot2q[j]].oaq_nr++;
+	}
+	if (args->oa_nr_queries == 0) {
+		mio_mem_free(slot2q);
+		return 0;
+	}
+
+	for (i = 0; i < args->oa_nr_queries; i++) {
+		rc = motr_objs_query_alloc(args->oa_queries + i, opcode);
+		if (rc < 0)
+			goto error;
+	}
+
+	for (i = 0; i < args->oa_nr; i++) {
+		if (!args->oa_pending[i])
+			continue;
+		q = args->oa_queries +
+		    slot2q[motr_objs_kvs_slot(motr_objs_attrs_kvs(args, i))];
+		j = q->oaq_nr++;
+		q->oaq_idx[j] = i;
+		mio__obj_id_to_uint128(&args->oa_objs[i].mo_id, q->oaq_ids + j);
+		q->oaq_keys->ov_vec.v_count[j] = sizeof(struct m0_uint128);
+		q->oaq_keys->ov_buf[j] = q->oaq_ids + j;
+	}
+
+	cops = mio_mem_alloc(args->oa_nr_queries * sizeof *cops);
+	if (cops == NULL) {
+		rc = -ENOMEM;
+		goto error;
+	}
+	for (i = 0; i < args->oa_nr_queries; i++) {
+		q = args->oa_queries + i;
+		rc = m0_idx_op((struct m0_idx *)q->oaq_kvs->mk_drv_kvs,
+			       opcode, q->oaq_keys, q->oaq_vals, q->oaq_rcs,
+			       0, &q->oaq_op);
+		if (rc < 0)
+			goto error;
+		cops[nr_cops++] = q->oaq_op;
+	}
+
+	rc = mio_driver_op_group_add(op, motr_objs_attrs_pp, args, NULL,
+				     nr_cops, (void **)cops, args);
+	if (rc < 0)
+		goto error;
+	m0_op_launch(cops, nr_cops);
+	mio_mem_free(cops);
+	mio_mem_free(slot2q);
+	return args->oa_nr_queries;
+
+error:
+	for (i = 0; i < nr_cops; i++) {
+		m0_op_fini(cops[i]);
+		m0_op_free(cops[i]);
+	}
+	motr_objs_queries_fini(args);
+	mio_mem_free(cops);
+	mio_mem_free(slot2q);
+	return rc;
+}
+
+static int motr_objs_entity_pp(struct mio_op *op);
+
+/**
+ * Creates and launches entity ops (depending on the opcode and stage)
+ * for objects which haven't failed yet. The first launch takes the
+ * ownership of args. Returns the number of ops launched.
+ */
+static int motr_objs_entity_launch(struct motr_objs_args *args,
+				   struct m0_fid *pfid, struct mio_op *op)
 {
 	int i;
-	int nonhint_size;
-	int hints_nr_set;
-	uint64_t size;
-	void *buf;
-	char *ptr;
-	struct mio_hint_map *map = &obj->mo_attrs.moa_phints.mh_map;
-
-	hints_nr_set = map->mhm_nr_set;
-	if (hints_nr_set > map->mhm_nr_entries)
-		hints_nr_set = map->mhm_nr_entries;
-
-	nonhint_size  = motr_obj_attr_nonhint_size(obj);
-	size = nonhint_size;
-	size += sizeof(int);
-	size += hints_nr_set * (sizeof(int) + sizeof(uint64_t));
+	int rc;
+	int nr_cops = 0;
+	bool first = args->oa_stage == MOTR_OBJS_ENTITY;
+	struct m0_uint128 id128;
+	struct m0_obj *cobj;
+	struct m0_op **cops;
 
-	buf = mio_mem_alloc(size);
-	if (buf == NULL)
+	cops = mio_mem_alloc(args->oa_nr * sizeof *cops);
+	if (cops == NULL)
 		return -ENOMEM;
 
-	ptr = buf;
-	mio_mem_copy(ptr, &obj->mo_attrs, nonhint_size);
-	ptr += nonhint_size;
+	for (i = 0; i < args->oa_nr; i++) {
+		args->oa_cops[i] = NULL;
+		if (args->oa_rcs[i] != 0 || args->oa_no_entity[i])
+			continue;
 
-	mio_mem_copy(ptr, &hints_nr_set, sizeof(int));
-	ptr += sizeof(int);
+		cobj = args->oa_cobjs[i];
+		if (cobj == NULL) {
+			mio__obj_id_to_uint128(&args->oa_objs[i].mo_id,
+					       &id128);
+			/* Ids up to M0_ID_APP are reserved by Motr. */
+			if (m0_uint128_cmp(&id128, &M0_ID_APP) <= 0) {
+				motr_objs_obj_failed(args, i, -EINVAL);
+				continue;
+			}
+			cobj = mio_mem_alloc(sizeof *cobj);
+			if (cobj == NULL) {
+				motr_objs_obj_failed(args, i, -ENOMEM);
+				continue;
+			}
+			m0_obj_init(cobj, &mio_motr_container.co_realm, &id128,
+				    args->oa_opcode == MIO_OBJ_CREATE?
+				    motr_obj_layout_id(args->oa_objs + i, pfid) :
+				    mio_drv_motr_conf->mc_default_layout_id);
+			args->oa_cobjs[i] = cobj;
+			args->oa_objs[i].mo_drv_obj = (void *)cobj;
+		}
 
-	for (i = 0; i < hints_nr_set; i++) {
-		mio_mem_copy(ptr, map->mhm_keys + i, sizeof(int));
-		ptr += sizeof(int);
+		if (args->oa_stage == MOTR_OBJS_ENTITY_DELETE)
+			rc = m0_entity_delete(&cobj->ob_entity,
+					      &args->oa_cops[i]);
+		else if (args->oa_opcode == MIO_OBJ_CREATE)
+			rc = m0_entity_create(pfid, &cobj->ob_entity,
+					      &args->oa_cops[i]);
+		else
+			rc = m0_entity_open(&cobj->ob_entity,
+					    &args->oa_cops[i]);
+		if (rc != 0) {
+			if (args->oa_cops[i] != NULL) {
+				m0_op_fini(args->oa_cops[i]);
+				m0_op_free(args->oa_cops[i]);
+				args->oa_cops[i] = NULL;
+			}
+			motr_objs_obj_failed(args, i, rc);
+			continue;
+		}
+		cops[nr_cops++] = args->oa_cops[i];
 	}
-
-	for (i = 0; i < hints_nr_set; i++) {
-		mio_mem_copy(ptr, map->mhm_values + i, sizeof(uint64_t));
-		ptr += sizeof(uint64_t);
+	if (nr_cops == 0) {
+		mio_mem_free(cops);
+		return 0;
 	}
 
-	*attr_size = size;
-	*attr_buf = buf;
-	return 0;
+	rc = mio_driver_op_group_add(op, motr_objs_entity_pp, args,
+				     first? motr_objs_op_fini : NULL,
+				     nr_cops, (void **)cops, args);
+	if (rc < 0) {
+		for (i = 0; i < nr_cops; i++) {
+			m0_op_fini(cops[i]);
+			m0_op_free(cops[i]);
+		}
+		for (i = 0; i < args->oa_nr; i++)
+			args->oa_cops[i] = NULL;
+		mio_mem_free(cops);
+		return rc;
+	}
+	m0_op_launch(cops, nr_cops);
+	mio_mem_free(cops);
+	return nr_cops;
 }
 
-static int
-motr_obj_attrs_wire2mem(struct mio_obj *obj, int attr_size, void *attr_buf)
+/*
+ * The last step of deleting objects: the composite objects serving
+ * migrated objects go with them and the expiry records of objects with
+ * a lifetime are removed, see motr_obj_delete_pp().
+ */
+static int motr_objs_delete_cleanup(struct motr_objs_args *args,
+				    struct mio_op *op)
 {
 	int i;
-	int nonhint_size;
-	int size;
-	int nr_hints;
-	char *ptr;
-	/* Note that hint map has been initialised with default number. */
-	struct mio_hint_map *map = &obj->mo_hints.mh_map;
-
-	nonhint_size = motr_obj_attr_nonhint_size(obj);
-	ptr = attr_buf;
-	mio_mem_copy(&obj->mo_attrs, ptr, nonhint_size);
-	ptr += nonhint_size;
-
-	mio_mem_copy(&nr_hints, ptr, sizeof(int));
-	ptr += sizeof(int);
-	if (nr_hints < 0 || nr_hints > MIO_OBJ_HINT_NUM)
-		return -EIO;
-	else if (nr_hints == 0)
-		return 0;
-	map->mhm_nr_set = nr_hints;
-
-	size  = nonhint_size;
-	size += sizeof(int);
-	size += nr_hints * (sizeof(int) + sizeof(uint64_t));
-	if (attr_size != size)
-		return -EIO;
+	int rc;
+	int nr = 0;
+	uint64_t *expiries;
+	struct mio_obj *obj;
+	struct mio_obj_id *oids;
 
-	for (i = 0; i < nr_hints; i++) {
-		mio_mem_copy(map->mhm_keys + i, ptr, sizeof(int));
-		ptr += sizeof(int);
+	oids = mio_mem_alloc(args->oa_nr * sizeof *oids);
+	expiries = mio_mem_alloc(args->oa_nr * sizeof *expiries);
+	if (oids == NULL || expiries == NULL) {
+		rc = -ENOMEM;
+		goto exit;
 	}
 
-	for (i = 0; i < nr_hints; i++) {
-		mio_mem_copy(map->mhm_values + i, ptr, sizeof(uint64_t));
-		ptr += sizeof(uint64_t);
+	for (i = 0; i < args->oa_nr; i++) {
+		obj = args->oa_objs + i;
+		if (args->oa_rcs[i] != 0)
+			continue;
+		if (obj->mo_attrs.moa_redirected)
+			mio_obj_redirect_deleted(&obj->mo_id,
+						 &obj->mo_attrs.moa_redirect);
+		if (mio_hint_map_get(&obj->mo_hints.mh_map,
+				     MIO_HINT_OBJ_LIFETIME, expiries + nr) == 0)
+			oids[nr++] = obj->mo_id;
 	}
+	rc = nr == 0? 0 : mio_obj_expiry_del_launch(nr, oids, expiries, op);
 
-	return 0;
+exit:
+	mio_mem_free(oids);
+	mio_mem_free(expiries);
+	if (rc < 0)
+		return rc;
+	return nr == 0? MIO_DRV_OP_FINAL : MIO_DRV_OP_NEXT;
 }
 
-static int motr_obj_attrs_query(int opcode, struct mio_obj *obj,
-				  mio_driver_op_postprocess op_pp,
-				  struct mio_op *op)
+/* Removes the attributes of the objects deleted so far. */
+static int motr_objs_attrs_delete(struct motr_objs_args *args,
+				  struct mio_op *op);
+
+/*
+ * Deletes the entities of the objects found, objects without entity
+ * only have their attributes removed.
+ */
+static int motr_objs_entity_delete(struct motr_objs_args *args,
+				   struct mio_op *op)
 {
 	int rc;
-	int32_t *qrc = NULL; /* return value for kvs query. */
-	uint32_t flags = 0;
-	struct m0_uint128 *id128;
-        struct m0_bufvec *key = NULL;
-        struct m0_bufvec *val = NULL;
-	struct m0_idx *idx;
-	struct m0_op *cops[1] = {NULL};
-	struct motr_obj_attrs_pp_args *args;
 
-	assert(opcode == M0_IC_GET || opcode == M0_IC_PUT ||
-	       opcode == M0_IC_DEL);
+	args->oa_stage = MOTR_OBJS_ENTITY_DELETE;
+	rc = motr_objs_entity_launch(args, NULL, op);
+	if (rc != 0)
+		return rc < 0? rc : MIO_DRV_OP_NEXT;
+	return motr_objs_attrs_delete(args, op);
+}
 
-	id128 = mio_mem_alloc(sizeof *id128);
-	qrc = mio_mem_alloc(sizeof(int32_t));
-	args = mio_mem_alloc(sizeof *args);
-	if (id128 == NULL || qrc == NULL || args == NULL) {
-		rc = -ENOMEM;
-		goto error;
-	}
+/*
+ * Launches the next attribute query. Once fetched, objects without
+ * entity which haven't turned out to be inline (or, being deleted, to
+ * have attributes) don't exist.
+ */
+static int motr_objs_attrs_next(struct motr_objs_args *args,
+				struct mio_op *op)
+{
+	int i;
+	int rc;
+	bool is_get = motr_objs_attrs_is_get(args);
 
-	/* Allocate bufvec's for keys and values. */
-	key = mio__motr_bufvec_alloc(1);
-	if (key == NULL) {
-		rc = -ENOMEM;
-		goto error;
-	}
+	rc = motr_objs_attrs_launch(args, is_get? M0_IC_GET : M0_IC_DEL, op);
+	if (rc != 0)
+		return rc < 0? rc : MIO_DRV_OP_NEXT;
+	if (!is_get)
+		return motr_objs_delete_cleanup(args, op);
+
+	for (i = 0; i < args->oa_nr; i++)
+		if (args->oa_no_entity[i] && !args->oa_has_attrs[i] &&
+		    args->oa_rcs[i] == 0)
+			motr_objs_obj_failed(args, i, -ENOENT);
+	if (args->oa_opcode == MIO_OBJ_DELETE)
+		return motr_objs_entity_delete(args, op);
+	return MIO_DRV_OP_FINAL;
+}
 
-	if (opcode != M0_IC_DEL) {
-		val = mio__motr_bufvec_alloc(1);
-		if (val == NULL) {
-			rc = -ENOMEM;
-			goto error;
-		}
-	}
+static int motr_objs_attrs_delete(struct motr_objs_args *args,
+				  struct mio_op *op)
+{
+	int i;
 
-        /* Fill key and value. TODO: serialise key and value? */
-	mio__obj_id_to_uint128(&obj->mo_id, id128);
-	key->ov_vec.v_count[0] = sizeof *id128;
-	key->ov_buf[0] = id128;
+	for (i = 0; i < args->oa_nr; i++)
+		args->oa_pending[i] = args->oa_rcs[i] == 0;
+	args->oa_stage = MOTR_OBJS_ATTRS_DELETE;
+	return motr_objs_attrs_next(args, op);
+}
 
-	if (opcode == M0_IC_PUT) {
-		flags = M0_OIF_OVERWRITE;
-		motr_obj_attrs_mem2wire(obj, &val->ov_vec.v_count[0],
-					  &val->ov_buf[0]);
+static int motr_objs_entity_pp(struct mio_op *op)
+{
+	int i;
+	int rc;
+	struct mio_obj *obj;
+	struct motr_objs_args *args;
+
+	args = (struct motr_objs_args *)
+	       op->mop_drv_op_chain.mdoc_head->mdo_post_proc_data;
+	for (i = 0; i < args->oa_nr; i++) {
+		if (args->oa_cops[i] == NULL)
+			continue;
+		rc = m0_rc(args->oa_cops[i]);
+		/* The object may be inline, see its attributes. */
+		if (rc == -ENOENT && args->oa_opcode != MIO_OBJ_CREATE &&
+		    args->oa_stage == MOTR_OBJS_ENTITY)
+			args->oa_no_entity[i] = true;
+		else if (rc < 0)
+			motr_objs_obj_failed(args, i, rc);
+		else if (args->oa_stage == MOTR_OBJS_ENTITY_DELETE)
+			mio__motr_obj_pool_used_sub(args->oa_objs + i,
+				args->oa_objs[i].mo_attrs.moa_size);
+		args->oa_cops[i] = NULL;
 	}
 
-	/* Create index's op. */
-	idx = (struct m0_idx *)obj->mo_md_kvs->mk_drv_kvs;
-	rc = m0_idx_op(idx, opcode, key, val, qrc, flags, &cops[0]);
-	if (rc < 0)
-		goto error;
+	if (args->oa_opcode == MIO_OBJ_CREATE)
+		return MIO_DRV_OP_FINAL;
+	if (args->oa_stage == MOTR_OBJS_ENTITY_DELETE)
+		return motr_objs_attrs_delete(args, op);
+
+	/* Fetch attributes of the remaining objects. */
+	for (i = 0; i < args->oa_nr; i++) {
+		obj = args->oa_objs + i;
+		args->oa_pending[i] = args->oa_rcs[i] == 0;
+		if (args->oa_pending[i] && args->oa_opcode == MIO_OBJ_OPEN &&
+		    motr_obj_attrs_cache_load(obj) == 0 &&
+		    (!args->oa_no_entity[i] ||
+		     obj->mo_attrs.moa_inline != NULL)) {
+			args->oa_pending[i] = false;
+			args->oa_no_entity[i] = false;
+		}
+	}
+	args->oa_stage = MOTR_OBJS_ATTRS;
+	return motr_objs_attrs_next(args, op);
+}
 
-	/* Set callback function and arguments. */
-	args->aca_val = val;
-	args->aca_key = key;
-	args->aca_rc = qrc;
-	args->aca_to = obj;
-	rc = mio_driver_op_add(op, op_pp, args, NULL, cops[0], NULL);
-	if (rc < 0)
-		goto error;
+/**
+ * As in the single object case, attributes not found in a shard are
+ * looked up in (or removed from) the legacy attribute index.
+ */
+static int motr_objs_attrs_pp(struct mio_op *op)
+{
+	int i;
+	int j;
+	int k;
+	int rc;
+	bool is_get;
+	bool legacy;
+	struct mio_obj *obj;
+	struct m0_bufvec *vals;
+	struct motr_objs_args *args;
+	struct motr_objs_attrs_query *q;
 
-	mio_telemetry_array_advertise_noprefix(
-		"mio-op-to-motr-kv", MIO_TM_TYPE_ARRAY_UINT64,
-		3, obj->mo_sess_seqno, op->mop_seqno, cops[0]->op_sm.sm_id);
-	m0_op_launch(cops, 1);
-	return 0;
+	args = (struct motr_objs_args *)
+	       op->mop_drv_op_chain.mdoc_head->mdo_post_proc_data;
+	is_get = motr_objs_attrs_is_get(args);
+	legacy = motr_objs_attrs_is_legacy(args);
+	for (i = 0; i < args->oa_nr; i++)
+		args->oa_pending[i] = false;
+
+	for (k = 0; k < args->oa_nr_queries; k++) {
+		q = args->oa_queries + k;
+		vals = q->oaq_vals;
+		rc = m0_rc(q->oaq_op);
+		for (j = 0; j < q->oaq_nr; j++) {
+			i = q->oaq_idx[j];
+			obj = args->oa_objs + i;
+			if (rc < 0) {
+				motr_objs_obj_failed(args, i, rc);
+				continue;
+			}
 
-error:
-	mio__motr_bufvec_free(key);
-	mio__motr_bufvec_free(val);
-	mio_mem_free(qrc);
-	mio_mem_free(args);
-	return rc;
+			if (is_get && q->oaq_rcs[j] == 0 &&
+			    vals->ov_vec.v_count[j] != 0 &&
+			    args->oa_opcode == MIO_OBJ_DELETE) {
+				/* Only the redirect and lifetime are used. */
+				if (motr_obj_attrs_wire2mem(obj,
+					vals->ov_vec.v_count[j],
+					vals->ov_buf[j]) < 0)
+					obj->mo_attrs.moa_redirected = false;
+				args->oa_has_attrs[i] = true;
+				continue;
+			}
+			if (is_get && q->oaq_rcs[j] == 0 &&
+			    vals->ov_vec.v_count[j] != 0) {
+				motr_obj_attrs_wire2mem(obj,
+					vals->ov_vec.v_count[j],
+					vals->ov_buf[j]);
+				mio_obj_attrs_cache_put(&obj->mo_id,
+					vals->ov_buf[j],
+					vals->ov_vec.v_count[j]);
+				if (legacy &&
+				    obj->mo_md_kvs != &mio_obj_attrs_kvs)
+					obj->mo_attrs_updated = true;
+				if (obj->mo_attrs.moa_inline != NULL)
+					args->oa_no_entity[i] = false;
+				continue;
+			}
+			if (!legacy && obj->mo_md_kvs != &mio_obj_attrs_kvs)
+				args->oa_pending[i] = true;
+		}
+	}
+	/* Nothing is pending after the legacy index. */
+	motr_objs_queries_fini(args);
+	args->oa_stage = is_get? MOTR_OBJS_ATTRS_LEGACY :
+				 MOTR_OBJS_ATTRS_DELETE_LEGACY;
+	return motr_objs_attrs_next(args, op);
 }
 
 /**
- * Update object's attrs and wait till it completes.
+ * Kicks off a bulk operation. If no entity op could be launched at all,
+ * the MIO op is not started and the first per-object error is returned.
  */
-static int motr_obj_attrs_update_sync(struct mio_obj *obj)
+static int motr_objs_start(struct motr_objs_args *args,
+			   struct m0_fid *pfid, struct mio_op *op)
 {
+	int i;
 	int rc;
-	struct mio_op mop;
-	struct m0_op *cop;
 
-	mio_op_init(&mop);
-	mio_obj_op_init(&mop, obj, MIO_OBJ_ATTRS_SET);
-	rc = motr_obj_attrs_query(M0_IC_PUT, obj,
-				    motr_obj_attrs_query_free_pp, &mop);
-	if (rc < 0)
-		return rc;
+	rc = motr_objs_entity_launch(args, pfid, op);
+	if (rc > 0)
+		return 0;
 
-	cop = MIO_MOTR_OP((&mop));
-	rc = m0_op_wait(cop, M0_BITS(M0_OS_FAILED, M0_OS_STABLE),
-			M0_TIME_NEVER);
-	rc = rc? : m0_rc(cop);
-	m0_op_fini(cop);
-	m0_op_free(cop);
+	if (rc == 0)
+		for (i = 0; i < args->oa_nr; i++)
+			if (args->oa_rcs[i] != 0) {
+				rc = args->oa_rcs[i];
+				break;
+			}
+	motr_objs_args_free(args);
 	return rc;
+}
 
+static int mio_motr_objs_open(int nr_objs, struct mio_obj *objs,
+			      int32_t *rcs, struct mio_op *op)
+{
+	struct motr_objs_args *args;
+
+	args = motr_objs_args_alloc(MIO_OBJ_OPEN, nr_objs, objs, rcs);
+	if (args == NULL)
+		return -ENOMEM;
+	return motr_objs_start(args, NULL, op);
 }
 
-static int motr_obj_attrs_query_free_pp(struct mio_op *op)
+static int mio_motr_objs_create(const struct mio_pool_id *pool_id,
+				int nr_objs, struct mio_obj *objs,
+				int32_t *rcs, struct mio_op *op)
 {
-	struct motr_obj_attrs_pp_args *args;
+	struct m0_fid pfid;
+	struct m0_fid *ptr_pfid = NULL;
+	struct motr_objs_args *args;
 
-	args = (struct motr_obj_attrs_pp_args *)
-	       op->mop_drv_op_chain.mdoc_head->mdo_post_proc_data;
-	mio__motr_bufvec_free(args->aca_key);
-	mio__motr_bufvec_free(args->aca_val);
-	mio_mem_free(args->aca_rc);
-	mio_mem_free(args);
+	if (pool_id != NULL) {
+		mio__motr_pool_id_to_fid(pool_id, &pfid);
+		ptr_pfid = &pfid;
+	}
 
-	return MIO_DRV_OP_FINAL;
+	args = motr_objs_args_alloc(MIO_OBJ_CREATE, nr_objs, objs, rcs);
+	if (args == NULL)
+		return -ENOMEM;
+	return motr_objs_start(args, ptr_pfid, op);
 }
 
-static int motr_obj_attrs_get_pp(struct mio_op *op)
+static int mio_motr_objs_delete(int nr_objs, const struct mio_obj_id *oids,
+				int32_t *rcs, struct mio_op *op)
 {
-	struct m0_bufvec *ret_val;
-	struct m0_op *cop = MIO_MOTR_OP(op);
-	struct mio_obj *obj;
-	struct motr_obj_attrs_pp_args *args;
+	int i;
+	struct mio_obj *mobjs;
+	struct motr_objs_args *args;
 
-	assert(cop != NULL);
-	args = (struct motr_obj_attrs_pp_args *)
-	       op->mop_drv_op_chain.mdoc_head->mdo_post_proc_data;
-	obj = args->aca_to;
-	ret_val = args->aca_val;
-	if (ret_val->ov_vec.v_count[0] != 0)
-		motr_obj_attrs_wire2mem(obj, ret_val->ov_vec.v_count[0],
-					  ret_val->ov_buf[0]);
+	mobjs = mio_mem_alloc(nr_objs * sizeof *mobjs);
+	if (mobjs == NULL)
+		return -ENOMEM;
+	for (i = 0; i < nr_objs; i++) {
+		mobjs[i].mo_id = oids[i];
+		mobjs[i].mo_md_kvs = mio_obj_attrs_kvs_select(oids + i);
+	}
 
-	return motr_obj_attrs_query_free_pp(op);
+	args = motr_objs_args_alloc(MIO_OBJ_DELETE, nr_objs, mobjs, rcs);
+	if (args == NULL) {
+		mio_mem_free(mobjs);
+		return -ENOMEM;
+	}
+	return motr_objs_start(args, NULL, op);
 }
 
 static int mio_motr_obj_size(struct mio_obj *obj, struct mio_op *op)
 {
+	/*
+	 * The size fetched at open (and kept by writes) is good enough.
+	 * The one of an inline object is kept with its data.
+	 */
+	if (motr_obj_access_pattern(obj) == MIO_OBJ_ACCESS_READ_MOSTLY ||
+	    obj->mo_attrs.moa_inline != NULL)
+		return mio_driver_op_add_done(op);
 	return motr_obj_attrs_query(M0_IC_GET, obj,
 				      motr_obj_attrs_get_pp, op);
 }
@@ -1702,10 +4089,19 @@ mio_motr_obj_pool_id(const struct mio_obj *obj, struct mio_pool_id *pool_id)
 {
         struct m0_obj *cobj = (struct m0_obj *)obj->mo_drv_obj;
 	struct m0_pool_version *pver;
+	struct motr_obj_inline *in = obj->mo_attrs.moa_inline;
 
         if (cobj == NULL)
                 return -EINVAL;
 
+	/* The pool an inline object will be promoted into. */
+	if (in != NULL) {
+		if (!in->moi_has_pool)
+			return -EINVAL;
+		mio__motr_fid_to_pool_id(&in->moi_pool, pool_id);
+		return 0;
+	}
+
 	pver = m0_conf_fid_is_valid(&cobj->ob_attr.oa_pver) == false? NULL:
 	       m0_pool_version_find(&mio_motr_instance->m0c_pools_common,
 				    &cobj->ob_attr.oa_pver);
@@ -1774,11 +4170,51 @@ static int mio_motr_obj_hint_load(struct mio_obj *obj)
 	return 0;
 }
 
+static int mio_motr_obj_attrs_key_decode(const void *key, size_t klen,
+					 struct mio_obj_id *oid)
+{
+	struct m0_uint128 id128;
+
+	if (klen != sizeof id128)
+		return -EINVAL;
+	mio_mem_copy(&id128, (void *)key, sizeof id128);
+	mio__uint128_to_obj_id(&id128, oid);
+	return 0;
+}
+
+static int mio_motr_obj_attrs_decode(const void *val, size_t vlen,
+				     struct mio_obj *obj)
+{
+	int rc;
+
+	rc = motr_obj_attrs_wire2mem(obj, vlen, (void *)val);
+	/* The data of an inline object isn't needed. */
+	motr_obj_inline_free(obj);
+	return rc;
+}
+
+static int motr_obj_promote_done(struct mio_op *op, struct mio_obj *obj,
+				 void *data)
+{
+	return MIO_DRV_OP_FINAL;
+}
+
+static int mio_motr_obj_promote(struct mio_obj *obj, struct mio_op *op)
+{
+	if (obj->mo_attrs.moa_inline == NULL)
+		return mio_driver_op_add_done(op);
+	return mio__motr_obj_inline_promote(obj, motr_obj_promote_done,
+					    NULL, op);
+}
+
 struct mio_obj_ops mio_motr_obj_ops = {
         .moo_open         = mio_motr_obj_open,
         .moo_close        = mio_motr_obj_close,
         .moo_create       = mio_motr_obj_create,
         .moo_delete       = mio_motr_obj_delete,
+        .moo_objs_open    = mio_motr_objs_open,
+        .moo_objs_create  = mio_motr_objs_create,
+        .moo_objs_delete  = mio_motr_objs_delete,
         .moo_writev       = mio_motr_obj_writev,
         .moo_readv        = mio_motr_obj_readv,
         .moo_sync         = mio_motr_obj_sync,
@@ -1788,6 +4224,9 @@ struct mio_obj_ops mio_motr_obj_ops = {
         .moo_unlock       = mio_motr_obj_unlock,
         .moo_hint_store   = mio_motr_obj_hint_store,
         .moo_hint_load    = mio_motr_obj_hint_load,
+        .moo_attrs_key_decode = mio_motr_obj_attrs_key_decode,
+        .moo_attrs_decode = mio_motr_obj_attrs_decode,
+        .moo_promote      = mio_motr_obj_promote,
 };
 
 /*
@@ -16,10 +16,6 @@
 #include "mio.h"
 #include "mio_internal.h"
 
-enum {
-	MIO_HINT_INVALID = -1
-};
-
 struct hint {
 	char *h_name;
 	enum mio_hint_type h_type;
@@ -37,140 +33,102 @@ static struct hint obj_hint_table[] = {
 	[MIO_HINT_OBJ_HOT_INDEX] = {
 		.h_name = "MIO_HINT_OBJ_HOT_INDEX",
 		.h_type = MIO_HINT_PERSISTENT,
+	},
+	[MIO_HINT_OBJ_IO_SIZE] = {
+		.h_name = "MIO_HINT_OBJ_IO_SIZE",
+		.h_type = MIO_HINT_SESSION,
+	},
+	[MIO_HINT_OBJ_ACCESS_PATTERN] = {
+		.h_name = "MIO_HINT_OBJ_ACCESS_PATTERN",
+		.h_type = MIO_HINT_SESSION,
+	},
+	[MIO_HINT_OBJ_AUTO_TIERING] = {
+		.h_name = "MIO_HINT_OBJ_AUTO_TIERING",
+		.h_type = MIO_HINT_PERSISTENT,
 	}
 };
 
+/* Persistent system hints are shared by all clients, see mio_sys_hints.c. */
 static struct hint sys_hint_table[] = {
 	[MIO_HINT_HOT_OBJ_THRESHOLD] = {
 		.h_name = "MIO_HINT_HOT_OBJ_THRESHOLD",
-		.h_type = MIO_HINT_SESSION,
+		.h_type = MIO_HINT_PERSISTENT,
 	},
 	[MIO_HINT_COLD_OBJ_THRESHOLD] = {
 		.h_name = "MIO_HINT_COLD_OBJ_THRESHOLD",
-		.h_type = MIO_HINT_SESSION,
+		.h_type = MIO_HINT_PERSISTENT,
+	},
+	[MIO_HINT_OBJ_HEAT_HALF_LIFE] = {
+		.h_name = "MIO_HINT_OBJ_HEAT_HALF_LIFE",
+		.h_type = MIO_HINT_PERSISTENT,
 	},
 };
 
-struct mio_hints mio_sys_hints;
-
 int mio_hint_map_init(struct mio_hint_map *map, int nr_entries)
 {
-	int i;
-
-	assert(map != NULL && nr_entries > 0);
-	map->mhm_nr_entries = nr_entries;
-
-	map->mhm_keys = mio_mem_alloc(nr_entries * sizeof(int));
-	map->mhm_values = mio_mem_alloc(nr_entries * sizeof(uint64_t));
-	if (map->mhm_keys == NULL ||
-	    map->mhm_values == NULL) {
-		mio_log(MIO_ERROR, "Can't create map !");
-		mio_hint_map_fini(map);
-		return -ENOMEM;
-	}
-
-	for (i = 0; i < nr_entries; i++) {
-		map->mhm_keys[i] = MIO_HINT_INVALID;
-		map->mhm_values[i] = 0;
-	}
-	map->mhm_nr_set = 0;
-
+	assert(map != NULL && nr_entries > 0 &&
+	       nr_entries <= MIO_OBJ_HINT_NUM);
+	mio_memset(map, 0, sizeof *map);
 	return 0;
 }
 
 void mio_hint_map_fini(struct mio_hint_map *map)
 {
-	mio_mem_free(map->mhm_keys);
-	mio_mem_free(map->mhm_values);
-	map->mhm_nr_entries = 0;
+	map->mhm_set = 0;
 	map->mhm_nr_set = 0;
 }
 
 int mio_hint_map_copy(struct mio_hint_map *to, struct mio_hint_map *from)
 {
-	int i;
-	int j;
-	int rc;
-	int hkey;
-	uint64_t hvalue;
-	int nr_new = 0;
+	int key;
 
 	assert(to != NULL && from != NULL);
 
-	if (to->mhm_nr_entries == 0 ) {
-		rc = mio_hint_map_init(to, from->mhm_nr_entries);
-		if (rc < 0) {
-			mio_log(MIO_ERROR, "Failed to initialise hint map!");
-			return rc;
-		}
-	}
-
-	/* Check if 'to' hint map has enough space for new hints. */
-	for (i = 0; i < from->mhm_nr_set; i++) {
-		hkey = from->mhm_keys[i];
-		for (j = 0; j < to->mhm_nr_set; j++)
-			if (to->mhm_keys[j] == hkey)
-				break;
-		if (j == to->mhm_nr_set)
-			nr_new++;
-	}
-	if (to->mhm_nr_set + nr_new > to->mhm_nr_entries)
-		return -E2BIG;
-
-	/* It is safe to add new hints now. */
-	for (i = 0; i < from->mhm_nr_set; i++) {
-		hkey = from->mhm_keys[i];
-		hvalue = from->mhm_values[i];
-		for (j = 0; j < to->mhm_nr_set; j++)
-			if (to->mhm_keys[j] == hkey)
-				break;
-		if (j == to->mhm_nr_set) {
-			j = to->mhm_nr_set;
-			to->mhm_nr_set++;
-		}
-
-		to->mhm_keys[j] = hkey;
-		to->mhm_values[j] = hvalue;
-	}
+	for (key = mio_hint_map_next(from, MIO_HINT_INVALID);
+	     key != MIO_HINT_INVALID; key = mio_hint_map_next(from, key))
+		mio_hint_map_set(to, key, from->mhm_values[key]);
 	return 0;
 }
 
 int mio_hint_map_set(struct mio_hint_map *map, int key, uint64_t value)
 {
-	int i;
+	if (key < 0 || key >= MIO_OBJ_HINT_NUM)
+		return -EINVAL;
 
-	for (i = 0; i < map->mhm_nr_set; i++) {
-		if (map->mhm_keys[i] == key)
-			break;
+	if (!(map->mhm_set & (1U << key))) {
+		map->mhm_set |= 1U << key;
+		map->mhm_nr_set++;
 	}
-	if (i == map->mhm_nr_set) {
-		if (map->mhm_nr_set == map->mhm_nr_entries)
-			return -EINVAL;
-		else
-			map->mhm_nr_set++;
-	}
-
-	map->mhm_keys[i] = key;
-	map->mhm_values[i] = value;
+	map->mhm_values[key] = value;
 	return 0;
 }
 
 int mio_hint_map_get(struct mio_hint_map *map, int key, uint64_t *value)
 {
-	int i;
-
 	assert(map != NULL && value != NULL);
 
-	for (i = 0; i < map->mhm_nr_set; i++) {
-		if (map->mhm_keys[i] == key)
-			break;
-	}
-	if (i == map->mhm_nr_set)
+	if (key < 0 || key >= MIO_OBJ_HINT_NUM ||
+	    !(map->mhm_set & (1U << key)))
 		return -ENOENT;
-	*value = map->mhm_values[i];
+	*value = map->mhm_values[key];
 	return 0;
 }
 
+/**
+ * Returns the smallest key set in the map which is greater than `key`,
+ * or MIO_HINT_INVALID if there is none. Iteration over the hints set
+ * starts from MIO_HINT_INVALID.
+ */
+int mio_hint_map_next(struct mio_hint_map *map, int key)
+{
+	uint32_t rest;
+
+	if (key + 1 >= MIO_OBJ_HINT_NUM)
+		return MIO_HINT_INVALID;
+	rest = map->mhm_set >> (key + 1) << (key + 1);
+	return rest == 0? MIO_HINT_INVALID : __builtin_ctz(rest);
+}
+
 #define OBJ_NKEYS (sizeof(obj_hint_table)/sizeof(struct hint))
 #define SYS_NKEYS (sizeof(sys_hint_table)/sizeof(struct hint))
 enum mio_hint_type mio_hint_type(enum mio_hint_scope scope, int key)
@@ -230,46 +188,57 @@ void mio_hints_fini(struct mio_hints *hints)
 }
 
 #define drv_obj_ops (mio_instance->m_driver->md_obj_ops)
-static int obj_hint_store(struct mio_obj *obj)
+/**
+ * Copies the object's persistent hints into its attributes, from where
+ * the driver stores them.
+ */
+int mio_obj_phints_update(struct mio_obj *obj)
 {
-	int i;
-	int rc;
-	int nr_hints;
-	int nr_phints = 0;
-	int phint_cnt = 0;
-	struct mio_hints *phints = &obj->mo_attrs.moa_phints;
+	int key;
+	struct mio_hint_map *map;
+	struct mio_hint_map *pmap;
 
 	if (obj == NULL)
 		return -EINVAL;
 
-	nr_hints = obj->mo_hints.mh_map.mhm_nr_set;
-
-	for (i = 0; i < nr_hints; i++)
-		if (mio_hint_type(MIO_HINT_SCOPE_OBJ,
-				  obj->mo_hints.mh_map.mhm_keys[i]) ==
+	map = &obj->mo_hints.mh_map;
+	pmap = &obj->mo_attrs.moa_phints.mh_map;
+	mio_hint_map_fini(pmap);
+	for (key = mio_hint_map_next(map, MIO_HINT_INVALID);
+	     key != MIO_HINT_INVALID; key = mio_hint_map_next(map, key))
+		if (mio_hint_type(MIO_HINT_SCOPE_OBJ, key) ==
 		    MIO_HINT_PERSISTENT)
-			nr_phints++;
+			mio_hint_map_set(pmap, key, map->mhm_values[key]);
+	return 0;
+}
 
-	if (phints->mh_map.mhm_nr_entries != 0)
-		mio_hint_map_fini(&phints->mh_map);
-	rc = mio_hint_map_init(&phints->mh_map, MIO_OBJ_HINT_NUM);
-	if (rc < 0)
-		return rc;
+static int obj_hint_store(struct mio_obj *obj)
+{
+	return mio_obj_phints_update(obj)? :
+	       drv_obj_ops->moo_hint_store(obj);
+}
 
-	for (i = 0; i < nr_hints; i++) {
-		if (mio_hint_type(MIO_HINT_SCOPE_OBJ,
-				  obj->mo_hints.mh_map.mhm_keys[i]) ==
-		    MIO_HINT_PERSISTENT) {
-			phints->mh_map.mhm_keys[phint_cnt] =
-				obj->mo_hints.mh_map.mhm_keys[i];
-			phints->mh_map.mhm_values[phint_cnt] =
-				obj->mo_hints.mh_map.mhm_values[i];
-			phint_cnt++;
-		}
-	}
-	phints->mh_map.mhm_nr_set = phint_cnt;
+static uint64_t obj_lifetime(struct mio_obj *obj)
+{
+	uint64_t lifetime;
 
-	return drv_obj_ops->moo_hint_store(obj);
+	if (mio_hint_lookup(&obj->mo_hints, MIO_HINT_OBJ_LIFETIME,
+			    &lifetime) < 0)
+		return MIO_HINT_VALUE_NULL;
+	return lifetime;
+}
+
+/* Moves the object's record in the expiry index if its lifetime changed. */
+static int obj_lifetime_update(struct mio_obj *obj, uint64_t old_lifetime)
+{
+	int rc;
+
+	rc = mio_obj_expiry_update(&obj->mo_id, old_lifetime,
+				   obj_lifetime(obj));
+	if (rc < 0)
+		mio_log(MIO_ERROR,
+			"Updating object expiry failed! error = %d\n", rc);
+	return rc;
 }
 
 static int obj_hint_load(struct mio_obj *obj)
@@ -279,21 +248,104 @@ static int obj_hint_load(struct mio_obj *obj)
 	return drv_obj_ops->moo_hint_load(obj);
 }
 
+enum {
+	MIO_OBJ_HEAT_SHIFT = 8,
+	/* Every MiB moved weighs as much as one more access. */
+	MIO_OBJ_HEAT_BYTES_UNIT = 1024 * 1024,
+	MIO_DEFAULT_OBJ_HEAT_HALF_LIFE = 3600,
+};
+
+/* 2^(-i/16) in 1/65536 units, for decaying by a fraction of half-life. */
+static const uint32_t obj_heat_decay_table[16] = {
+	65536, 62757, 60097, 57549, 55109, 52773, 50535, 48393,
+	46341, 44376, 42495, 40693, 38968, 37316, 35734, 34219
+};
+
+static uint64_t obj_heat_half_life()
+{
+	uint64_t half_life;
+
+	if (mio_sys_hint_get(MIO_HINT_OBJ_HEAT_HALF_LIFE, &half_life) < 0 ||
+	    half_life == 0)
+		half_life = MIO_DEFAULT_OBJ_HEAT_HALF_LIFE;
+	return half_life;
+}
+
+static uint64_t
+obj_heat_decay(uint64_t score, uint64_t age, uint64_t half_life)
+{
+	uint64_t nr_halves;
+	uint64_t frac;
+
+	nr_halves = age / half_life;
+	if (nr_halves >= 32)
+		return 0;
+	score >>= nr_halves;
+	frac = (age % half_life) * 16 / half_life;
+	return (score * obj_heat_decay_table[frac]) >> 16;
+}
+
+/**
+ * Returns the object's heat score decayed up to `now` (in seconds).
+ * Attributes stored before heat was introduced carry access counters
+ * only, such objects start from the raw count at their last access.
+ */
+static uint64_t obj_heat_score(struct mio_obj *obj, uint64_t now)
+{
+	uint64_t count;
+	uint64_t last;
+	struct mio_obj_stats *stats = &obj->mo_attrs.moa_stats;
+	struct mio_obj_heat *heat = &obj->mo_attrs.moa_heat;
+
+	if (heat->moh_time == 0) {
+		count = stats->mos_rcount + stats->mos_wcount;
+		if (count == 0)
+			return 0;
+		last = stats->mos_rtime > stats->mos_wtime?
+		       stats->mos_rtime : stats->mos_wtime;
+		heat->moh_score = count < (UINT32_MAX >> MIO_OBJ_HEAT_SHIFT)?
+				  count << MIO_OBJ_HEAT_SHIFT : UINT32_MAX;
+		heat->moh_time = mio_time_seconds(last);
+	}
+
+	if (now <= heat->moh_time)
+		return heat->moh_score;
+	return obj_heat_decay(heat->moh_score, now - heat->moh_time,
+			      obj_heat_half_life());
+}
+
+/**
+ * Accounts an access to the object, `now` is in nano-seconds. Must be
+ * called before the access statistics are updated.
+ */
+void mio_obj_heat_update(struct mio_obj *obj, uint64_t now,
+			 const struct mio_iovec *iov, int iovcnt)
+{
+	int i;
+	uint64_t score;
+	struct mio_obj_heat *heat = &obj->mo_attrs.moa_heat;
+
+	now = mio_time_seconds(now);
+	score = obj_heat_score(obj, now);
+	for (i = 0; i < iovcnt; i++)
+		score += (1 + iov[i].miov_len / MIO_OBJ_HEAT_BYTES_UNIT) <<
+			 MIO_OBJ_HEAT_SHIFT;
+	heat->moh_score = score < UINT32_MAX? score : UINT32_MAX;
+	heat->moh_time = now;
+}
+
 static int obj_hot_index_cal(struct mio_obj *obj)
 {
 	int rc;
 	uint64_t hotness;
 
 	/*
-	 * A simple algorithm which only considers the number of accesses
-	 * to an object. (Proof of Concept only)
-	 *
-	 * More sophisticated algorithm taking account of object aging
-	 * and other factors (such as data location etc.) will be
-	 * designed later.
+	 * Hotness is the object's heat, an exponentially weighted count
+	 * of accesses (large accesses weigh more) which halves every
+	 * half-life, in whole accesses.
 	 */
-	hotness = (obj->mo_attrs.moa_stats.mos_rcount +
-		   obj->mo_attrs.moa_stats.mos_wcount);
+	hotness = obj_heat_score(obj, mio_time_seconds(mio_now())) >>
+		  MIO_OBJ_HEAT_SHIFT;
 	mio_log(MIO_DEBUG, "object hotness = %lu\n", hotness);
 	rc = mio_hint_map_set(&obj->mo_hints.mh_map, MIO_HINT_OBJ_HOT_INDEX, hotness);
 	return rc;
@@ -370,12 +422,27 @@ bool mio_hint_is_set(struct mio_hints *hints, int hint_key)
 	return true;
 }
 
+/**
+ * Stores the object's attributes and persistent hints right away instead
+ * of when the object is closed.
+ */
+int mio_obj_attrs_store(struct mio_obj *obj)
+{
+	int rc;
+
+	rc = mio_obj_hint_ops_check();
+	if (rc < 0)
+		return rc;
+	return obj_hint_store(obj);
+}
+
 /**
  * MIO hint API to set and get all hints of an object.
  */
 int mio_obj_hints_set(struct mio_obj *obj, struct mio_hints *hints)
 {
 	int rc;
+	uint64_t old_lifetime;
 
 	rc = mio_obj_hint_ops_check();
 	if (rc < 0)
@@ -383,6 +450,7 @@ int mio_obj_hints_set(struct mio_obj *obj, struct mio_hints *hints)
 	if (obj == NULL || hints == NULL)
 		return -EINVAL;
 
+	old_lifetime = obj_lifetime(obj);
 	rc = mio_hint_map_copy(&obj->mo_hints.mh_map, &hints->mh_map)? :
 	     obj_hint_store(obj);
 	if (rc < 0) {
@@ -391,7 +459,7 @@ int mio_obj_hints_set(struct mio_obj *obj, struct mio_hints *hints)
 		return rc;
 	}
 
-	return 0;
+	return obj_lifetime_update(obj, old_lifetime);
 }
 
 int mio_obj_hints_get(struct mio_obj *obj, struct mio_hints *hints)
@@ -418,6 +486,7 @@ int mio_obj_hints_get(struct mio_obj *obj, struct mio_hints *hints)
 int mio_obj_hint_set(struct mio_obj *obj, int hint_key, uint64_t hint_value)
 {
 	int rc;
+	uint64_t old_lifetime;
 
 	rc = mio_obj_hint_ops_check();
 	if (rc < 0)
@@ -425,6 +494,7 @@ int mio_obj_hint_set(struct mio_obj *obj, int hint_key, uint64_t hint_value)
 	if (obj == NULL)
 		return -EINVAL;
 
+	old_lifetime = obj_lifetime(obj);
 	rc = mio_hint_add(&obj->mo_hints, hint_key, hint_value)? :
 	     obj_hint_store(obj);
 	if (rc < 0) {
@@ -433,7 +503,7 @@ int mio_obj_hint_set(struct mio_obj *obj, int hint_key, uint64_t hint_value)
 		return rc;
 	}
 
-	return 0;
+	return obj_lifetime_update(obj, old_lifetime);
 }
 
 int mio_obj_hint_get(struct mio_obj *obj, int hint_key, uint64_t *hint_value)
@@ -526,29 +596,6 @@ struct mio_pool_id mio_obj_hotness_to_pool_id(uint64_t hotness)
 	return mio_pools.mps_pools[pool_idx].mp_id;
 }
 
-/**
- * Set and get system level hints. Currently system hints are session based,
- * support for persistent system hint will added later.
- */
-int mio_sys_hint_set(int hint_key, uint64_t hint_value)
-{
-	int rc;
-
-	rc = mio_hint_add(&mio_sys_hints, hint_key, hint_value);
-	if (rc < 0) {
-		mio_log(MIO_ERROR,
-			"Set system hint failed! error = %d\n", rc);
-		return rc;
-	}
-
-	return 0;
-}
-
-int mio_sys_hint_get(int hint_key, uint64_t *hint_value)
-{
-	return mio_hint_lookup(&mio_sys_hints, hint_key, hint_value);
-}
-
 /*
  *  Local variables:
  *  c-indentation-style: "K&R"
@@ -11,6 +11,7 @@
 
 #include <errno.h>
 #include <assert.h>
+#include <time.h>
 
 #include "logger.h"
 #include "utils.h"
@@ -19,6 +20,10 @@
 #include "mio_telemetry.h"
 
 struct mio_kvs mio_obj_attrs_kvs;
+struct mio_kvs *mio_obj_attrs_kvs_shards = NULL;
+int mio_obj_attrs_kvs_nr_shards = 0;
+struct mio_kvs mio_sys_hints_kvs;
+struct mio_kvs mio_obj_expiry_kvs;
 struct mio *mio_instance = NULL;
 
 uint64_t mio_obj_session_seqno = 0;
@@ -139,7 +144,11 @@ again:
 				 */
 				if (rc == MIO_DRV_OP_NEXT)
 					pop->mp_retstate = MIO_OP_ONFLY;
-				else {
+				else if (rc < 0) {
+					mop->mop_rc = rc;
+					pop->mp_retstate = MIO_OP_FAILED;
+					op_done = true;
+				} else {
 					assert(rc == MIO_DRV_OP_FINAL);
 					op_done = true;
 				}
@@ -164,6 +173,16 @@ again:
 	return nr_done;
 }
 
+int mio_op_wait(struct mio_op *op)
+{
+	struct mio_pollop pop;
+
+	mio_memset(&pop, 0, sizeof pop);
+	pop.mp_op = op;
+	mio_op_poll(&pop, 1, MIO_TIME_NEVER);
+	return op->mop_rc;
+}
+
 void mio_op_callbacks_set(struct mio_op *op,
 			  mio_callback cb_complete,
 			  mio_callback cb_failed,
@@ -211,6 +230,17 @@ int mio_obj_op_init(struct mio_op *op, struct mio_obj *obj,
 	return 0;
 }
 
+struct mio_kvs *mio_obj_attrs_kvs_select(const struct mio_obj_id *oid)
+{
+	uint64_t hash;
+
+	if (mio_obj_attrs_kvs_nr_shards == 0)
+		return &mio_obj_attrs_kvs;
+
+	hash = mio_hash_fnv1a(oid->moi_bytes, MIO_OBJ_ID_LEN);
+	return mio_obj_attrs_kvs_shards + hash % mio_obj_attrs_kvs_nr_shards;
+}
+
 static int obj_init(struct mio_obj *obj, const struct mio_obj_id *oid)
 {
 	int rc;
@@ -224,11 +254,19 @@ static int obj_init(struct mio_obj *obj, const struct mio_obj_id *oid)
 	mio_mem_copy(obj->mo_id.moi_bytes,
 		     (void *)oid->moi_bytes, MIO_OBJ_ID_LEN);
 	obj->mo_drv_obj_ops = mio_instance->m_driver->md_obj_ops;
-	/**
- 	 * TODO: map to an attributes key-value set by a policy
- 	 * such as object ID.
- 	 */
-	obj->mo_md_kvs = &mio_obj_attrs_kvs;
+	obj->mo_md_kvs = mio_obj_attrs_kvs_select(oid);
+	obj->mo_attrs_revalidate = false;
+	obj->mo_comp_map = NULL;
+	obj->mo_comp_layout_cached = false;
+	obj->mo_comp_tier = NULL;
+	obj->mo_read_only = false;
+	obj->mo_attrs.moa_redirected = false;
+	obj->mo_attrs.moa_composite = false;
+	mio_memset(&obj->mo_attrs.moa_heat, 0, sizeof obj->mo_attrs.moa_heat);
+	obj->mo_attrs.moa_inline = NULL;
+	obj->mo_redirect_obj = NULL;
+	obj->mo_redirect_gen = 0;
+	obj->mo_drv_obj_cache = NULL;
 	mio_hint_map_init(&obj->mo_hints.mh_map, MIO_OBJ_HINT_NUM);
 
 	/* Set the session sequence number. */
@@ -252,12 +290,46 @@ int mio_obj_open(const struct mio_obj_id *oid,
 	return rc;
 }
 
+int mio_obj_open_revalidate(const struct mio_obj_id *oid,
+			    struct mio_obj *obj, struct mio_op *op)
+{
+	int rc;
+
+	rc = obj_init(obj, oid);
+	if (rc < 0)
+		return rc;
+	obj->mo_attrs_revalidate = true;
+
+	rc = mio_obj_op_init(op, obj, MIO_OBJ_OPEN)? :
+	     obj->mo_drv_obj_ops->moo_open(obj, op);
+	return rc;
+}
+
+int mio_obj_snapshot_open(const struct mio_obj_id *snap_id,
+			  struct mio_obj *snap, struct mio_op *op)
+{
+	int rc;
+
+	rc = obj_init(snap, snap_id);
+	if (rc < 0)
+		return rc;
+	snap->mo_read_only = true;
+
+	rc = mio_obj_op_init(op, snap, MIO_OBJ_OPEN)? :
+	     snap->mo_drv_obj_ops->moo_open(snap, op);
+	return rc;
+}
+
 void mio_obj_close(struct mio_obj *obj)
 {
 	if (obj == NULL)
 		return;
 
+	mio_obj_redirect_check(obj);
+	mio_obj_redirect_close(obj);
 	mio_hint_map_fini(&obj->mo_hints.mh_map);
+	mio_composite_obj_tier_disable(obj);
+	mio_comp_obj_map_fini(obj);
 	if (obj->mo_drv_obj_ops->moo_close != NULL)
 		obj->mo_drv_obj_ops->moo_close(obj);
 
@@ -331,9 +403,9 @@ static int obj_pool_select(struct mio_hints *hints, int *which)
 		return -EINVAL;
 }
 
-int mio_obj_create(const struct mio_obj_id *oid,
-                   const struct mio_pool_id *pool_id, struct mio_hints *hints,
-                   struct mio_obj *obj, struct mio_op *op)
+static const struct mio_pool_id *
+obj_create_pool_select(const struct mio_pool_id *pool_id,
+		       struct mio_hints *hints)
 {
 	int rc;
 	int selected_pool_idx = 0;
@@ -359,12 +431,94 @@ int mio_obj_create(const struct mio_obj_id *oid,
 				&mio_pools.mps_pools[selected_pool_idx].mp_id;
 		}
 
+		/* Keep new objects off pools which are (nearly) full. */
+		if (selected_pool_id != NULL) {
+			selected_pool_idx =
+				mio_pool_cache_spill(selected_pool_idx);
+			selected_pool_id =
+				&mio_pools.mps_pools[selected_pool_idx].mp_id;
+		}
 	} else
 		selected_pool_id = pool_id;
 
+	return selected_pool_id;
+}
+
+/*
+ * Passes the creation hints which shape the new object, such as its
+ * layout, on to the driver through the object's hints. The object's
+ * lifetime is kept with its attributes, stored when it is closed.
+ */
+static int obj_create_hints_set(struct mio_obj *obj, struct mio_hints *hints)
+{
+	int rc = 0;
+	uint64_t io_size;
+	uint64_t lifetime;
+
+	if (mio_hint_is_set(hints, MIO_HINT_OBJ_IO_SIZE)) {
+		mio_hint_lookup(hints, MIO_HINT_OBJ_IO_SIZE, &io_size);
+		rc = mio_hint_map_set(&obj->mo_hints.mh_map,
+				      MIO_HINT_OBJ_IO_SIZE, io_size);
+	}
+	if (rc == 0 && mio_hint_is_set(hints, MIO_HINT_OBJ_LIFETIME)) {
+		mio_hint_lookup(hints, MIO_HINT_OBJ_LIFETIME, &lifetime);
+		rc = mio_hint_map_set(&obj->mo_hints.mh_map,
+				      MIO_HINT_OBJ_LIFETIME, lifetime)? :
+		     mio_obj_phints_update(obj);
+		obj->mo_attrs_updated = true;
+	}
+	return rc;
+}
+
+/*
+ * Objects created with a lifetime are added to the expiry index first
+ * and removed from it if the creation can't be launched. The record
+ * left by a creation failing later is dropped by the reaper.
+ */
+static int objs_create_expiry_add(int nr_objs, const struct mio_obj_id *oids,
+				  struct mio_hints *hints)
+{
+	uint64_t lifetime;
+
+	if (!mio_hint_is_set(hints, MIO_HINT_OBJ_LIFETIME))
+		return 0;
+	mio_hint_lookup(hints, MIO_HINT_OBJ_LIFETIME, &lifetime);
+	return mio_obj_expiry_add(nr_objs, oids, lifetime);
+}
+
+static void objs_create_expiry_del(int nr_objs, const struct mio_obj_id *oids,
+				   struct mio_hints *hints)
+{
+	int rc;
+	uint64_t lifetime;
+
+	if (!mio_hint_is_set(hints, MIO_HINT_OBJ_LIFETIME))
+		return;
+	mio_hint_lookup(hints, MIO_HINT_OBJ_LIFETIME, &lifetime);
+	rc = mio_obj_expiry_del(nr_objs, oids, lifetime);
+	if (rc < 0)
+		mio_log(MIO_WARN,
+			"Deleting expiry records failed! error = %d\n", rc);
+}
+
+int mio_obj_create(const struct mio_obj_id *oid,
+                   const struct mio_pool_id *pool_id, struct mio_hints *hints,
+                   struct mio_obj *obj, struct mio_op *op)
+{
+	int rc;
+	const struct mio_pool_id *selected_pool_id;
+
+	selected_pool_id = obj_create_pool_select(pool_id, hints);
 	rc = obj_init(obj, oid)? :
-	     mio_obj_op_init(op, obj, MIO_OBJ_CREATE)? :
+	     obj_create_hints_set(obj, hints)? :
+	     objs_create_expiry_add(1, oid, hints);
+	if (rc < 0)
+		return rc;
+
+	rc = mio_obj_op_init(op, obj, MIO_OBJ_CREATE)? :
 	     obj->mo_drv_obj_ops->moo_create(selected_pool_id, obj, op);
+	if (rc < 0)
+		objs_create_expiry_del(1, oid, hints);
 	return rc;
 }
 
@@ -372,11 +526,115 @@ int mio_obj_delete(const struct mio_obj_id *oid, struct mio_op *op)
 {
 	int rc;
 
-	rc = mio_obj_op_init(op, NULL, MIO_OBJ_DELETE)? :
-	     mio_instance->m_driver->md_obj_ops->moo_delete(oid, op);
+	rc = mio_obj_op_init(op, NULL, MIO_OBJ_DELETE);
+	if (rc < 0)
+		return rc;
+
+	mio_obj_attrs_cache_invalidate(oid);
+	return mio_instance->m_driver->md_obj_ops->moo_delete(oid, op);
+}
+
+static int objs_check(int nr_objs, const struct mio_obj_id *oids,
+		      int32_t *rcs, struct mio_op *op)
+{
+	int rc;
+
+	if (nr_objs <= 0 || oids == NULL || rcs == NULL || op == NULL)
+		return -EINVAL;
+	rc = mio_instance_check();
+	if (rc < 0)
+		return rc;
+	return 0;
+}
+
+static int objs_init(int nr_objs, const struct mio_obj_id *oids,
+		     struct mio_obj *objs)
+{
+	int i;
+	int rc = 0;
+
+	if (objs == NULL)
+		return -EINVAL;
+	for (i = 0; i < nr_objs && rc == 0; i++)
+		rc = obj_init(objs + i, oids + i);
+	return rc;
+}
+
+int mio_objs_open(int nr_objs, const struct mio_obj_id *oids,
+		  struct mio_obj *objs, int32_t *rcs, struct mio_op *op)
+{
+	int rc;
+	struct mio_obj_ops *drv_obj_ops;
+
+	rc = objs_check(nr_objs, oids, rcs, op);
+	if (rc < 0)
+		return rc;
+	drv_obj_ops = mio_instance->m_driver->md_obj_ops;
+	if (drv_obj_ops->moo_objs_open == NULL)
+		return -EOPNOTSUPP;
+
+	rc = objs_init(nr_objs, oids, objs)? :
+	     mio_obj_op_init(op, objs, MIO_OBJ_OPEN)? :
+	     drv_obj_ops->moo_objs_open(nr_objs, objs, rcs, op);
+	return rc;
+}
+
+int mio_objs_create(int nr_objs, const struct mio_obj_id *oids,
+		    const struct mio_pool_id *pool_id,
+		    struct mio_hints *hints,
+		    struct mio_obj *objs, int32_t *rcs, struct mio_op *op)
+{
+	int i;
+	int rc;
+	const struct mio_pool_id *selected_pool_id;
+	struct mio_obj_ops *drv_obj_ops;
+
+	rc = objs_check(nr_objs, oids, rcs, op);
+	if (rc < 0)
+		return rc;
+	drv_obj_ops = mio_instance->m_driver->md_obj_ops;
+	if (drv_obj_ops->moo_objs_create == NULL)
+		return -EOPNOTSUPP;
+
+	selected_pool_id = obj_create_pool_select(pool_id, hints);
+	rc = objs_init(nr_objs, oids, objs);
+	for (i = 0; i < nr_objs && rc == 0; i++)
+		rc = obj_create_hints_set(objs + i, hints);
+	rc = rc? : objs_create_expiry_add(nr_objs, oids, hints);
+	if (rc < 0)
+		return rc;
+
+	rc = mio_obj_op_init(op, objs, MIO_OBJ_CREATE)? :
+	     drv_obj_ops->moo_objs_create(selected_pool_id, nr_objs,
+					  objs, rcs, op);
+	if (rc < 0)
+		objs_create_expiry_del(nr_objs, oids, hints);
 	return rc;
 }
 
+int mio_objs_delete(int nr_objs, const struct mio_obj_id *oids,
+		    int32_t *rcs, struct mio_op *op)
+{
+	int i;
+	int rc;
+	struct mio_obj_ops *drv_obj_ops;
+
+	rc = objs_check(nr_objs, oids, rcs, op);
+	if (rc < 0)
+		return rc;
+	drv_obj_ops = mio_instance->m_driver->md_obj_ops;
+	if (drv_obj_ops->moo_objs_delete == NULL)
+		return -EOPNOTSUPP;
+
+	rc = mio_obj_op_init(op, NULL, MIO_OBJ_DELETE);
+	if (rc < 0)
+		return rc;
+
+	for (i = 0; i < nr_objs; i++)
+		mio_obj_attrs_cache_invalidate(oids + i);
+	return drv_obj_ops->moo_objs_delete(nr_objs, oids, rcs, op);
+}
+
 static void
 obj_stats_update(struct mio_obj *obj, bool is_write,
 		 const struct mio_iovec *iov, int iovcnt)
@@ -387,6 +645,7 @@ obj_stats_update(struct mio_obj *obj, bool is_write,
 
 	stats = &obj->mo_attrs.moa_stats;
 	now = mio_now();
+	mio_obj_heat_update(obj, now, iov, iovcnt);
 	for (i = 0; i < iovcnt; i++) {
 		if (is_write) {
 			stats->mos_wcount++;
@@ -410,11 +669,24 @@ int mio_obj_writev(struct mio_obj *obj,
 
 	if (obj == NULL || op == NULL)
 		return -EINVAL;
+	if (obj->mo_read_only)
+		return -EROFS;
 	obj_stats_update(obj, true, iov, iovcnt);
 
-	rc = mio_obj_op_init(op, obj, MIO_OBJ_WRITE)? :
-	     obj->mo_drv_obj_ops->moo_writev(obj, iov, iovcnt, op);
-	return rc;
+	rc = mio_obj_op_init(op, obj, MIO_OBJ_WRITE);
+	if (rc < 0)
+		return rc;
+	/* Data of a migrated object is served by its composite object. */
+	mio_obj_redirect_check(obj);
+	if (obj->mo_attrs.moa_redirected)
+		return mio_obj_redirect_writev(obj, iov, iovcnt, op);
+	/* Writes to a tiered composite object land in its fast layer. */
+	if (obj->mo_comp_tier != NULL)
+		return mio_comp_obj_tier_writev(obj, iov, iovcnt, op);
+	/* Otherwise in the highest priority layer of a composite object. */
+	if (mio_comp_obj_is_composite(obj))
+		return mio_comp_obj_writev(obj, iov, iovcnt, op);
+	return obj->mo_drv_obj_ops->moo_writev(obj, iov, iovcnt, op);
 }
 
 int mio_obj_readv(struct mio_obj *obj,
@@ -427,9 +699,16 @@ int mio_obj_readv(struct mio_obj *obj,
 		return -EINVAL;
 	obj_stats_update(obj, false, iov, iovcnt);
 
-	rc = mio_obj_op_init(op, obj, MIO_OBJ_READ)? :
-	     obj->mo_drv_obj_ops->moo_readv(obj, iov, iovcnt, op);
-	return rc;
+	rc = mio_obj_op_init(op, obj, MIO_OBJ_READ);
+	if (rc < 0)
+		return rc;
+	mio_obj_redirect_check(obj);
+	if (obj->mo_attrs.moa_redirected)
+		return mio_obj_redirect_readv(obj, iov, iovcnt, op);
+	/* Data of a composite object is resolved across its layers. */
+	if (mio_comp_obj_is_composite(obj))
+		return mio_comp_obj_readv(obj, iov, iovcnt, op);
+	return obj->mo_drv_obj_ops->moo_readv(obj, iov, iovcnt, op);
 }
 
 int mio_obj_sync(struct mio_obj *obj, struct mio_op *op)
@@ -543,6 +822,52 @@ int mio_kvs_pair_get(struct mio_kvs_id *kid,
 	return rc;
 }
 
+int mio_kvs_pair_get_into(struct mio_kvs_id *kid,
+			  int nr_kvps, struct mio_kv_pair *kvps,
+			  int32_t *rcs, struct mio_op *op)
+{
+	int i;
+	int rc;
+
+	if (kvps == NULL || rcs == NULL)
+		return -EINVAL;
+	for (i = 0; i < nr_kvps; i++)
+		if (kvps[i].mkp_val == NULL && kvps[i].mkp_vlen != 0)
+			return -EINVAL;
+
+	rc = kvs_driver_check();
+	if (rc < 0)
+		return rc;
+	if (drv_kvs_ops->mko_get_into == NULL)
+		return -EOPNOTSUPP;
+
+	rc = kvs_op_init(op, kid, MIO_KVS_GET);
+	if (rc < 0)
+		return rc;
+	return drv_kvs_ops->mko_get_into(kid, nr_kvps, kvps, rcs, op);
+}
+
+int mio_kvs_vals_slab_set(int nr_kvps, struct mio_kv_pair *kvps,
+			  void *slab, size_t slab_len, const size_t *caps)
+{
+	int i;
+	size_t cap;
+	size_t used = 0;
+
+	if (nr_kvps <= 0 || kvps == NULL || slab == NULL)
+		return -EINVAL;
+
+	for (i = 0; i < nr_kvps; i++) {
+		cap = caps != NULL? caps[i] : slab_len / nr_kvps;
+		if (used + cap > slab_len)
+			return -ENOSPC;
+		kvps[i].mkp_val = (char *)slab + used;
+		kvps[i].mkp_vlen = cap;
+		used += cap;
+	}
+	return 0;
+}
+
 int mio_kvs_pair_next(struct mio_kvs_id *kid,
 		      int nr_kvps, struct mio_kv_pair *kvps,
 		      bool exclude_start_key, int32_t *rcs,
@@ -579,6 +904,109 @@ int mio_kvs_pair_del(struct mio_kvs_id *kid,
 	return rc;
 }
 
+int mio_kvs_del_range(struct mio_kvs_id *kid,
+		      void *start_key, size_t start_klen,
+		      void *end_key, size_t end_klen, struct mio_op *op)
+{
+	int rc;
+
+	rc = kvs_driver_check();
+	if (rc < 0)
+		return rc;
+	if (drv_kvs_ops->mko_del_range == NULL)
+		return -EOPNOTSUPP;
+
+	rc = kvs_op_init(op, kid, MIO_KVS_DEL_RANGE);
+	if (rc < 0)
+		return rc;
+	return drv_kvs_ops->mko_del_range(kid, start_key, start_klen,
+					  end_key, end_klen, op);
+}
+
+int mio_kvs_count_range(struct mio_kvs_id *kid,
+			void *start_key, size_t start_klen,
+			void *end_key, size_t end_klen,
+			uint64_t *count, struct mio_op *op)
+{
+	int rc;
+
+	if (count == NULL)
+		return -EINVAL;
+	rc = kvs_driver_check();
+	if (rc < 0)
+		return rc;
+	if (drv_kvs_ops->mko_count_range == NULL)
+		return -EOPNOTSUPP;
+
+	rc = kvs_op_init(op, kid, MIO_KVS_COUNT_RANGE);
+	if (rc < 0)
+		return rc;
+	*count = 0;
+	return drv_kvs_ops->mko_count_range(kid, start_key, start_klen,
+					    end_key, end_klen, count, op);
+}
+
+/*
+ * The smallest key larger than all keys starting with `prefix` is the
+ * prefix with trailing 0xff bytes removed and the last byte increased.
+ * If there is no such key (all bytes are 0xff), `end` is set to NULL.
+ */
+static int kvs_prefix_end(void *prefix, size_t prefix_len,
+			  void **end, size_t *end_len)
+{
+	size_t len = prefix_len;
+	uint8_t *key;
+
+	while (len > 0 && ((uint8_t *)prefix)[len - 1] == 0xff)
+		len--;
+
+	*end = NULL;
+	*end_len = 0;
+	if (len == 0)
+		return 0;
+
+	key = mio_mem_alloc(len);
+	if (key == NULL)
+		return -ENOMEM;
+	mio_mem_copy(key, prefix, len);
+	key[len - 1]++;
+	*end = key;
+	*end_len = len;
+	return 0;
+}
+
+int mio_kvs_del_prefix(struct mio_kvs_id *kid,
+		       void *prefix, size_t prefix_len, struct mio_op *op)
+{
+	int rc;
+	void *end;
+	size_t end_len;
+
+	if (prefix == NULL || prefix_len == 0)
+		return -EINVAL;
+	rc = kvs_prefix_end(prefix, prefix_len, &end, &end_len)? :
+	     mio_kvs_del_range(kid, prefix, prefix_len, end, end_len, op);
+	mio_mem_free(end);
+	return rc;
+}
+
+int mio_kvs_count_prefix(struct mio_kvs_id *kid,
+			 void *prefix, size_t prefix_len,
+			 uint64_t *count, struct mio_op *op)
+{
+	int rc;
+	void *end;
+	size_t end_len;
+
+	if (prefix == NULL || prefix_len == 0)
+		return -EINVAL;
+	rc = kvs_prefix_end(prefix, prefix_len, &end, &end_len)? :
+	     mio_kvs_count_range(kid, prefix, prefix_len,
+				 end, end_len, count, op);
+	mio_mem_free(end);
+	return rc;
+}
+
 int mio_kvs_create_set(struct mio_kvs_id *kid, struct mio_op *op)
 {
 	int rc;
@@ -632,6 +1060,7 @@ int mio_composite_obj_add_layers(struct mio_obj *obj, int nr_layers,
 
 	if (obj == NULL)
 		return -EINVAL;
+	mio_composite_obj_map_invalidate(obj);
 	rc = mio_obj_op_init(op, obj, MIO_COMP_OBJ_ADD_LAYERS)? :
 	     drv_comp_obj_ops->mcoo_add_layers(obj, nr_layers, layers, op);
 	return rc;
@@ -646,6 +1075,7 @@ int mio_composite_obj_del_layers(struct mio_obj *obj,
 
 	if (obj == NULL)
 		return -EINVAL;
+	mio_composite_obj_map_invalidate(obj);
 	rc = mio_obj_op_init(op, obj, MIO_COMP_OBJ_DEL_LAYERS)? :
 	     drv_comp_obj_ops->mcoo_del_layers(
 			obj, nr_layers_to_del, layers_to_del, op);
@@ -665,6 +1095,19 @@ int mio_composite_obj_list_layers(struct mio_obj *obj,
 	return rc;
 }
 
+int mio_composite_obj_list_layers_revalidate(
+	struct mio_obj *obj, struct mio_comp_obj_layout *ret_layout,
+	struct mio_op *op)
+{
+	if (obj == NULL)
+		return -EINVAL;
+
+	/* Layers may have changed, so may have the extent map. */
+	obj->mo_comp_layout_cached = false;
+	mio_composite_obj_map_invalidate(obj);
+	return mio_composite_obj_list_layers(obj, ret_layout, op);
+}
+
 int mio_composite_obj_add_extents(struct mio_obj *obj,
 				  struct mio_obj_id *layer_id,
 				  int nr_exts, struct mio_obj_ext *exts,
@@ -695,6 +1138,21 @@ int mio_composite_obj_del_extents(struct mio_obj *obj,
 	return rc;
 }
 
+int mio_composite_obj_compact_extents(struct mio_obj *obj,
+				      struct mio_obj_id *layer_id,
+				      struct mio_op *op)
+{
+	int rc;
+
+	if (obj == NULL || layer_id == NULL)
+		return -EINVAL;
+	if (drv_comp_obj_ops->mcoo_compact_extents == NULL)
+		return -EOPNOTSUPP;
+	rc = mio_obj_op_init(op, obj, MIO_COMP_OBJ_COMPACT_EXTENTS)? :
+	     drv_comp_obj_ops->mcoo_compact_extents(obj, layer_id, op);
+	return rc;
+}
+
 int
 mio_composite_obj_get_extents(struct mio_obj *obj,
 			      struct mio_obj_id *layer_id, off_t offset,
@@ -761,15 +1219,13 @@ int mio_pool_get(const struct mio_pool_id *pool_id, struct mio_pool **pool)
 	if (out_pool == NULL)
 		return -ENOMEM;
 	
-	/* Update pool information from driver. */
-	rc = mio_instance->m_driver->md_pool_ops->mpo_get(pool_id, found_pool);
+	/* Pool information is kept up to date by the pool state cache. */
+	rc = mio_pool_cache_get(pool_id, out_pool);
 	if (rc != 0) {
 		mio_mem_free(out_pool);
 		return rc;
 	}
 
-	/* Copy to the out_pool. */
-	mio_mem_copy(out_pool, found_pool, sizeof(*found_pool));
 	*pool = out_pool;
 	return 0;
 
@@ -804,12 +1260,9 @@ int mio_pool_get_all(struct mio_pools **pools)
 
 	for (i = 0; i < mio_pools.mps_nr_pools; i++) {
 		pool = mio_pools.mps_pools + i;
-		rc = mio_instance->m_driver->md_pool_ops->mpo_get(
-			&pool->mp_id, pool);
+		rc = mio_pool_cache_get(&pool->mp_id, out_pools->mps_pools + i);
 		if (rc < 0)
 			break;
-
-		mio_mem_copy(out_pools->mps_pools + i, pool, sizeof *pool);
 	}
 	if (rc < 0) {
 		mio_mem_free(out_pools->mps_pools);
@@ -823,10 +1276,33 @@ int mio_pool_get_all(struct mio_pools **pools)
 	return rc;
 }
 
+const struct mio_pool *mio_pool_borrow(const struct mio_pool_id *pool_id)
+{
+	if (pool_id == NULL || mio_instance_check() < 0)
+		return NULL;
+	return mio_pool_cache_borrow(pool_id);
+}
+
+int mio_pool_freespace(const struct mio_pool_id *pool_id, size_t *freespace)
+{
+	int rc;
+
+	if (pool_id == NULL || freespace == NULL)
+		return -EINVAL;
+	rc = mio_instance_check();
+	if (rc < 0)
+		return rc;
+	return mio_pool_cache_freespace(pool_id, freespace);
+}
+
 int mio_obj_pool_id(const struct mio_obj *obj, struct mio_pool_id *pool_id)
 {
 	int rc = -EINVAL;
 
+	mio_obj_redirect_check((struct mio_obj *)obj);
+	if (obj->mo_attrs.moa_redirected)
+		return mio_obj_redirect_pool_id((struct mio_obj *)obj,
+						pool_id);
 	rc = (obj->mo_drv_obj_ops->moo_pool_id == NULL)?
 	     -EOPNOTSUPP :
 	     obj->mo_drv_obj_ops->moo_pool_id(obj, pool_id);
@@ -891,16 +1367,60 @@ int mio_init(const char *yaml_conf)
 	rc = mio_telemetry_init(&telem_conf);
 	if (rc < 0) {
 		mio_log(MIO_ERROR, "Initialising MIO telemetry failed!\n");
-		goto error;
+		goto error_driver;
 	}
 
-	mio_hints_init(&mio_sys_hints);
+	rc = mio_obj_attrs_cache_init(
+		mio_instance->m_obj_attrs_cache_ttl,
+		mio_instance->m_obj_attrs_cache_size);
+	if (rc < 0) {
+		mio_log(MIO_ERROR, "Initialising attribute cache failed!\n");
+		goto error_telemetry;
+	}
+
+	rc = mio_pool_cache_init();
+	if (rc < 0) {
+		mio_log(MIO_ERROR, "Initialising pool state cache failed!\n");
+		goto error_attrs_cache;
+	}
+
+	rc = mio_sys_hints_init();
+	if (rc < 0) {
+		mio_log(MIO_ERROR, "Initialising system hints failed!\n");
+		goto error_pool_cache;
+	}
 
 	pthread_mutex_init(&mio_obj_session_seqno_lock, NULL);
 	pthread_mutex_init(&mio_op_seqno_lock, NULL);
 
+	rc = mio_obj_tiering_sys_init();
+	if (rc < 0) {
+		mio_log(MIO_ERROR, "Starting background tiering failed!\n");
+		goto error_seqno;
+	}
+
+	rc = mio_obj_reaper_sys_init();
+	if (rc < 0) {
+		mio_log(MIO_ERROR, "Starting object reaper failed!\n");
+		goto error_tiering;
+	}
+
 	return rc;
 
+error_tiering:
+	mio_obj_tiering_sys_fini();
+error_seqno:
+	pthread_mutex_destroy(&mio_obj_session_seqno_lock);
+	pthread_mutex_destroy(&mio_op_seqno_lock);
+	mio_sys_hints_fini();
+error_pool_cache:
+	mio_pool_cache_fini();
+error_attrs_cache:
+	mio_obj_attrs_cache_fini();
+error_telemetry:
+	mio_telemetry_fini();
+error_driver:
+	mio_instance->m_driver->md_sys_ops->mdo_fini();
 error:
 	mio_mem_free(mio_instance);
 	mio_instance = NULL;
@@ -913,9 +1433,18 @@ void mio_fini()
 	if (mio_instance == NULL)
 		return;
 
+	/* Background threads issue ops until they are stopped. */
+	mio_obj_reaper_sys_fini();
+	mio_obj_tiering_sys_fini();
+	mio_comp_obj_tier_sys_fini();
+	mio_obj_migrate_sys_fini();
+
 	pthread_mutex_destroy(&mio_obj_session_seqno_lock);
 	pthread_mutex_destroy(&mio_op_seqno_lock);
 
+	mio_sys_hints_fini();
+	mio_pool_cache_fini();
+	mio_obj_attrs_cache_fini();
 	mio_telemetry_fini();
 	mio_instance->m_driver->md_sys_ops->mdo_fini();
 	mio_mem_free(mio_instance);
@@ -944,6 +1473,106 @@ void mio_thread_fini(struct mio_thread *thread)
 
 	mio_instance->m_driver->md_sys_ops->mdo_thread_fini(thread);
 }
+
+static void *bg_thread_run(void *arg)
+{
+	struct mio_thread thread;
+	struct mio_bg_thread *bt = (struct mio_bg_thread *)arg;
+
+	mio_thread_init(&thread);
+	bt->bt_func();
+	mio_thread_fini(&thread);
+	return NULL;
+}
+
+int mio_bg_thread_start(struct mio_bg_thread *bt, mio_bg_thread_func func)
+{
+	int rc;
+
+	if (bt->bt_started)
+		return 0;
+
+	bt->bt_func = func;
+	bt->bt_stopping = false;
+	rc = pthread_create(&bt->bt_thread, NULL, bg_thread_run, bt);
+	if (rc != 0)
+		return -rc;
+	bt->bt_started = true;
+	return 0;
+}
+
+void mio_bg_thread_stop(struct mio_bg_thread *bt)
+{
+	pthread_mutex_lock(&bt->bt_lock);
+	if (!bt->bt_started) {
+		pthread_mutex_unlock(&bt->bt_lock);
+		return;
+	}
+	bt->bt_stopping = true;
+	pthread_cond_broadcast(&bt->bt_cond);
+	pthread_mutex_unlock(&bt->bt_lock);
+
+	pthread_join(bt->bt_thread, NULL);
+
+	pthread_mutex_lock(&bt->bt_lock);
+	bt->bt_started = false;
+	pthread_mutex_unlock(&bt->bt_lock);
+}
+
+bool mio_bg_thread_stopping(struct mio_bg_thread *bt)
+{
+	bool stopping;
+
+	pthread_mutex_lock(&bt->bt_lock);
+	stopping = bt->bt_stopping;
+	pthread_mutex_unlock(&bt->bt_lock);
+	return stopping;
+}
+
+void mio_bg_thread_wait(struct mio_bg_thread *bt, uint64_t ns)
+{
+	struct timespec ts;
+
+	if (bt->bt_stopping)
+		return;
+	clock_gettime(CLOCK_REALTIME, &ts);
+	ns += ts.tv_nsec;
+	ts.tv_sec += ns / 1000000000ULL;
+	ts.tv_nsec = ns % 1000000000ULL;
+	pthread_cond_timedwait(&bt->bt_cond, &bt->bt_lock, &ts);
+}
+
+void mio_write_guard_begin(struct mio_write_guard *wg)
+{
+	wg->wg_nr_writes++;
+	wg->wg_gen++;
+}
+
+bool mio_write_guard_end(struct mio_write_guard *wg)
+{
+	assert(wg->wg_nr_writes > 0);
+	return --wg->wg_nr_writes == 0;
+}
+
+bool mio_write_guard_busy(const struct mio_write_guard *wg)
+{
+	return wg->wg_nr_writes != 0;
+}
+
+int mio_write_guard_pass_start(const struct mio_write_guard *wg,
+			       uint64_t *gen)
+{
+	if (mio_write_guard_busy(wg))
+		return -EBUSY;
+	*gen = wg->wg_gen;
+	return 0;
+}
+
+bool mio_write_guard_changed(const struct mio_write_guard *wg, uint64_t gen)
+{
+	return wg->wg_gen != gen || mio_write_guard_busy(wg);
+}
+
 /*
  *  Local variables:
  *  c-indentation-style: "K&R"
@@ -57,6 +57,9 @@ enum mio_kvs_opcode {
 	MIO_KVS_PUT,
 	/** Delete the value, if any, for the given key. */
 	MIO_KVS_DEL,
+	/** Delete or count all pairs in a range of keys. */
+	MIO_KVS_DEL_RANGE,
+	MIO_KVS_COUNT_RANGE,
 	MIO_KVS_OP_NR
 };
 
@@ -69,6 +72,7 @@ enum mio_composite_obj_opcode {
 	MIO_COMP_OBJ_ADD_EXTENTS,
 	MIO_COMP_OBJ_DEL_EXTENTS,
 	MIO_COMP_OBJ_GET_EXTENTS,
+	MIO_COMP_OBJ_COMPACT_EXTENTS,
 	MIO_COMP_OBJ_OP_NR
 };
 
@@ -103,6 +107,13 @@ struct mio_op {
 
 	struct mio_op_app_cbs mop_app_cbs;
 
+	/*
+	 * Progress of an operation made of many steps, such as the
+	 * number of key-value pairs deleted so far by
+	 * mio_kvs_del_range().
+	 */
+	uint64_t mop_progress;
+
 	/* See mio_drv_op_chain in mio_inernal.h for explanation. */
 	struct mio_driver_op_chain mop_drv_op_chain;
 
@@ -209,17 +220,79 @@ enum mio_hint_type {
 
 /** Hints for individual object. */
 enum mio_obj_hint_key {
+	/**
+	 * When the object expires, in seconds since the Epoch. Expired
+	 * objects are deleted by the reaper if MIO_OBJ_REAPER is on.
+	 */
 	MIO_HINT_OBJ_LIFETIME,
 	MIO_HINT_OBJ_WHERE,
 	MIO_HINT_OBJ_HOT_INDEX,
+	/**
+	 * Expected size of the object's IO (or of the object itself for
+	 * small objects) in bytes. Only used when creating an object to
+	 * choose its layout: the stripe unit is sized so that an IO of
+	 * this size writes whole parity groups. Objects without it use
+	 * the configured MOTR_DEFAULT_UNIT_SIZE.
+	 */
+	MIO_HINT_OBJ_IO_SIZE,
+	/**
+	 * How the object is accessed in this session, one of
+	 * enum mio_obj_access_pattern. The driver tunes its IO to it.
+	 */
+	MIO_HINT_OBJ_ACCESS_PATTERN,
+	/**
+	 * Set to 1 to let background tiering (MIO_OBJ_TIERING) move the
+	 * object between pools by its hotness. Objects without it are
+	 * left where they are.
+	 */
+	MIO_HINT_OBJ_AUTO_TIERING,
 
 	MIO_HINT_OBJ_KEY_NUM
 };
 
+/**
+ * Values of MIO_HINT_OBJ_ACCESS_PATTERN. They apply to objects which
+ * are not composite.
+ */
+enum mio_obj_access_pattern {
+	/**
+	 * Reads move forward through the object. Each read which misses
+	 * is extended to a large read-ahead window (up to the biggest
+	 * single op Motr takes) which serves the following reads.
+	 */
+	MIO_OBJ_ACCESS_SEQUENTIAL = 1,
+	/**
+	 * No locality, nothing is read ahead or cached and each read
+	 * only fetches the pages it covers.
+	 */
+	MIO_OBJ_ACCESS_RANDOM,
+	/**
+	 * Data is written once. Writes don't store the object size in
+	 * the attribute index, it is stored once when the object is
+	 * closed (or by mio_obj_attrs_store()).
+	 */
+	MIO_OBJ_ACCESS_WRITE_ONCE,
+	/**
+	 * Data is read again and again and rarely changed. Recently
+	 * read ranges are kept in memory and mio_obj_size() answers
+	 * from the attributes fetched at open. Changes made by other
+	 * clients are not seen until the object is re-opened.
+	 */
+	MIO_OBJ_ACCESS_READ_MOSTLY,
+};
+
 /* System wide hints. */
 enum mio_sys_hint_key {
 	MIO_HINT_HOT_OBJ_THRESHOLD,
 	MIO_HINT_COLD_OBJ_THRESHOLD,
+	/**
+	 * Half-life of object heat in seconds, 1 hour by default. The
+	 * hotness (MIO_HINT_OBJ_HOT_INDEX) of an object no longer accessed
+	 * halves every half-life.
+	 */
+	MIO_HINT_OBJ_HEAT_HALF_LIFE,
+
+	MIO_HINT_SYS_KEY_NUM
 };
 
 enum mio_hint_value {
@@ -294,11 +367,37 @@ struct mio_obj_attrs {
 
 	/* Persistent hints only. */
 	struct mio_hints moa_phints;
+
+	/**
+	 * Set if the object has been migrated by mio_obj_migrate(), its
+	 * data is then served by the composite object `moa_redirect`.
+	 */
+	bool moa_redirected;
+	struct mio_obj_id moa_redirect;
+
+	/**
+	 * Set once the object is given a composite layout, so that it is
+	 * known to be composite without fetching its layout.
+	 */
+	bool moa_composite;
+
+	/* Time-decayed access heat, see MIO_HINT_OBJ_HOT_INDEX. */
+	struct mio_obj_heat moa_heat;
+
+	/**
+	 * Driver's copy of the data of a small object which is kept in
+	 * the attribute record instead of a storage object, NULL if the
+	 * object's data is stored as usual.
+	 */
+	void *moa_inline;
 };
 
 /**
  * In-memory object handler.
  */
+struct mio_comp_obj_map;
+struct mio_obj_ext;
+struct mio_comp_obj_tier;
 struct mio_obj {
 	struct mio_obj_id mo_id;
 	struct mio_obj_op *mo_op;
@@ -320,8 +419,35 @@ struct mio_obj {
 	/** Associated metadata key-vaule set. */
 	struct mio_kvs *mo_md_kvs;
 
+	/** Cached extent map if the object is a composite one. */
+	struct mio_comp_obj_map *mo_comp_map;
+
+	/**
+	 * If the driver holds an up-to-date copy of the object's
+	 * composite layout.
+	 */
+	bool mo_comp_layout_cached;
+
+	/** Tiering state if tiering is enabled on the composite object. */
+	struct mio_comp_obj_tier *mo_comp_tier;
+
+	/** If the object is a snapshot opened by mio_obj_snapshot_open(). */
+	bool mo_read_only;
+
+	/**
+	 * The opened composite object serving a migrated object's data,
+	 * opened on first use.
+	 */
+	struct mio_obj *mo_redirect_obj;
+	uint64_t mo_redirect_gen;
+
 	/** If the object's attributes have been updated. */
 	bool mo_attrs_updated;
+	/**
+	 * Bypass the attribute cache and fetch attributes from the
+	 * attribute index on open. See mio_obj_open_revalidate().
+	 */
+	bool mo_attrs_revalidate;
 	struct mio_obj_attrs mo_attrs;
 
 	/** Pointer to driver specific object structure. */
@@ -329,6 +455,12 @@ struct mio_obj {
 
 	/** Pointer to driver specific object lock. */
 	void *mo_drv_obj_lock;
+
+	/**
+	 * Driver specific cache of the object's data, see
+	 * MIO_HINT_OBJ_ACCESS_PATTERN.
+	 */
+	void *mo_drv_obj_cache;
 };
 
 extern pthread_mutex_t mio_obj_session_seqno_lock;
@@ -398,7 +530,11 @@ extern struct mio_pools mio_pools;
  * Return the available space in pool @arg pool_id.
  *
  * Returns a (reasonable approximation to) the free capacity of the given
- * pool in @param *freespace.
+ * pool in @param *freespace. The value is taken from the pool state
+ * cache and may be up to MIO_POOL_STATE_REFRESH_INTERVAL old. -EOPNOTSUPP
+ * is returned if the driver can't tell the pool's free space. The Motr
+ * driver only estimates it from what this process has written to and
+ * removed from the pool, see driver_motr.c.
  *
  */
 int mio_pool_freespace(const struct mio_pool_id *pool_id,
@@ -425,6 +561,21 @@ int mio_pool_freespace(const struct mio_pool_id *pool_id,
 int mio_pool_get(const struct mio_pool_id *pool_id, struct mio_pool **pool);
 int mio_pool_get_all(struct mio_pools **pools);
 
+/**
+ * Return the cached descriptor of a pool without copying it.
+ *
+ * Unlike mio_pool_get(), no memory is allocated and the driver is not
+ * called, which suits hot paths such as IO planning. The descriptor
+ * must not be modified. It stays valid until mio_fini() but may be
+ * superseded when the pool version changes, call mio_pool_borrow()
+ * again to see the latest one.
+ *
+ * @param pool_id The pool id.
+ * @return The pool descriptor, or NULL if the pool isn't configured
+ * or MIO isn't initialised.
+ */
+const struct mio_pool *mio_pool_borrow(const struct mio_pool_id *pool_id);
+
 /**
  * Return an object's pool id.
  *
@@ -452,6 +603,16 @@ bool mio_obj_pool_id_cmp(struct mio_pool_id *pool_id1,
 int mio_obj_open(const struct mio_obj_id *oid,
 		 struct mio_obj *obj, struct mio_op *op);
 
+/**
+ * Same as mio_obj_open() but object attributes (size, statistics and
+ * persistent hints) are always fetched from the object store instead of
+ * the attribute cache, which then is refreshed with what has been
+ * fetched. Use it when the object may have been modified by another
+ * client within the cache's freshness window (MIO_OBJ_ATTRS_CACHE_TTL).
+ */
+int mio_obj_open_revalidate(const struct mio_obj_id *oid,
+			    struct mio_obj *obj, struct mio_op *op);
+
 /**
  * Close an object handle and free resources held by the object.
  * @param obj Pointer to the object handle.
@@ -474,6 +635,8 @@ void mio_obj_close(struct mio_obj *obj);
  * {MIO_HINT_OBJ_HOT_INDEX, hotname} gives MIO information on how
  * frequent the object will be accessed and MIO then decides which
  * pool to store the object. See example in examples/mio_hsm.c.
+ * {MIO_HINT_OBJ_IO_SIZE, bytes} tells MIO the expected IO size, from
+ * which the object's layout (stripe unit size) is chosen.
  *
  * @param oid The object identifier.
  * @param pool_id The pool where the object is stored to.
@@ -498,6 +661,34 @@ int mio_obj_create(const struct mio_obj_id *oid,
  */
 int mio_obj_delete(const struct mio_obj_id *oid, struct mio_op *op);
 
+/**
+ * Multi-object versions of mio_obj_open(), mio_obj_create() and
+ * mio_obj_delete(). All objects are handled by one operation, which
+ * launches the object store's requests for all objects together
+ * instead of one by one.
+ *
+ * The result of each object is returned in rcs[i] once the operation
+ * completes, a failed object doesn't fail the operation. Only objects
+ * with rcs[i] == 0 are opened (or created) and must be closed with
+ * mio_obj_close(). The arrays `objs` and `rcs` must stay valid until
+ * the operation is finalised. If none of the objects can be handled,
+ * the operation is not started and an error is returned.
+ *
+ * @param nr_objs The number of objects.
+ * @param oids The array of object identifiers.
+ * @param[out] objs The array of pre-allocated object handles.
+ * @param[out] rcs The per-object return codes.
+ * @return 0 for success, < 0 for error.
+ */
+int mio_objs_open(int nr_objs, const struct mio_obj_id *oids,
+		  struct mio_obj *objs, int32_t *rcs, struct mio_op *op);
+int mio_objs_create(int nr_objs, const struct mio_obj_id *oids,
+		    const struct mio_pool_id *pool_id,
+		    struct mio_hints *hints,
+		    struct mio_obj *objs, int32_t *rcs, struct mio_op *op);
+int mio_objs_delete(int nr_objs, const struct mio_obj_id *oids,
+		    int32_t *rcs, struct mio_op *op);
+
 /**
  * mio_obj_writev() writes from a set of buffers specified by
  * the members of the iov: iov[0], iov[1], ..., iov[iovcnt-1]
@@ -509,6 +700,13 @@ int mio_obj_delete(const struct mio_obj_id *oid, struct mio_op *op);
  * offsets[0], offsets[1], ..., offsets[iovcnt-1] into a set
  * of buffers of iov: iov[0], iov[1], ..., iov[iovcnt-1].
  *
+ * For a composite object, mio_obj_readv() reads each byte from the
+ * highest priority layer having an extent covering it, the layers are
+ * read concurrently. Ranges no layer covers are filled with zeros.
+ * mio_obj_writev() writes into the highest priority layer and adds
+ * the extents written to the layer. Writing to a snapshot opened by
+ * mio_obj_snapshot_open() fails with -EROFS.
+ *
  * Upon successfully returning, mio_obj_writev() and mio_obj_readv()
  * return with a launched operation. op can be used to query
  * the process of the operation.
@@ -531,6 +729,72 @@ int mio_obj_readv(struct mio_obj *obj,
                   const struct mio_iovec *iov,
                   int iovcnt, struct mio_op *op);
 
+/**
+ * Progress callback of mio_obj_copy(), called each time a chunk has
+ * been written to the destination. Returning non-zero stops the copy,
+ * mio_obj_copy() then returns -ECANCELED.
+ */
+typedef int (*mio_obj_copy_progress)(struct mio_obj *src,
+				     struct mio_obj *dst,
+				     uint64_t nr_bytes_copied,
+				     uint64_t nr_bytes, void *data);
+
+struct mio_obj_copy_opts {
+	/** Size of a chunk, 1MB if 0. */
+	size_t mco_chunk_size;
+	/** Number of chunks in flight, 4 if 0. */
+	int mco_nr_chunks;
+	mio_obj_copy_progress mco_progress;
+	void *mco_progress_data;
+};
+
+/**
+ * mio_obj_copy() copies data from object `src` to object `dst` within
+ * MIO, the data doesn't go through the application. Chunks are read
+ * ahead into a ring of buffers while the chunks already read are being
+ * written, so several chunks are in flight at any time.
+ *
+ * Persistent hints of `src` are carried over to `dst`. Copying the
+ * whole object also sets the size of `dst` to that of `src`. Objects
+ * are opened (or created, in the pool of choice) by the caller. This
+ * function blocks.
+ *
+ * @param src, dst The opened source and destination objects.
+ * @param range The range to copy, the whole object if NULL. Data is
+ * copied to the same offsets of `dst`.
+ * @param opts Copy options, defaults are used if NULL.
+ * @return 0 for success, anything else for an error.
+ */
+int mio_obj_copy(struct mio_obj *src, struct mio_obj *dst,
+		 const struct mio_obj_ext *range,
+		 struct mio_obj_copy_opts *opts);
+
+/**
+ * mio_obj_migrate() moves an object to the pool `pool_id` without
+ * changing its id and without copying it out and back. The object is
+ * turned into a composite object whose lower layer is the object's old
+ * data and whose new top layer, in the target pool, takes all writes.
+ * A background thread then moves the data to a layer just below the top
+ * one, also in the target pool, and releases the old data once done.
+ * The object stays readable and writable throughout, each byte being
+ * served by whichever layer holds it, data written is never hidden by
+ * data moved, and mio_obj_pool_id() returns the target pool right away.
+ *
+ * Handles opened by other processes before the migration started must
+ * be reopened. A migration interrupted by mio_fini() resumes when the
+ * object is migrated again to the same pool. Deleting a migrated object
+ * deletes its composite object and layers in the background. This
+ * function blocks until the migration is set up, not until the data has
+ * moved.
+ *
+ * @param oid The object to migrate.
+ * @param pool_id The target pool.
+ * @return 0 for success, -EBUSY if the object is being migrated,
+ * anything else for an error.
+ */
+int mio_obj_migrate(const struct mio_obj_id *oid,
+		    const struct mio_pool_id *pool_id);
+
 /**
  * mio_obj_sync() flushes all previous writes to obj to be
  * persisted to the storage device.
@@ -589,7 +853,22 @@ struct mio_kvs {
 	struct mio_kvs_ops *mk_ops;
 };
 
+/**
+ * Object attributes are stored in the attribute key-value set
+ * `mio_obj_attrs_kvs`, or, if sharding is configured, in one of
+ * `mio_obj_attrs_kvs_nr_shards` key-value sets chosen by hash of
+ * object id. In the latter case `mio_obj_attrs_kvs` is still looked up
+ * for objects whose attributes were stored before sharding was on.
+ */
 extern struct mio_kvs mio_obj_attrs_kvs;
+extern struct mio_kvs *mio_obj_attrs_kvs_shards;
+extern int mio_obj_attrs_kvs_nr_shards;
+
+/** Persistent system hints, see mio_sys_hint_set(). */
+extern struct mio_kvs mio_sys_hints_kvs;
+
+/** Objects by expiry time (MIO_HINT_OBJ_LIFETIME), see mio_obj_reaper.c. */
+extern struct mio_kvs mio_obj_expiry_kvs;
 
 /**
  *
@@ -657,6 +936,30 @@ int mio_kvs_pair_get(struct mio_kvs_id *kvs_id,
                      int nr_kvps, struct mio_kv_pair *kvps,
                      int32_t *rcs, struct mio_op *op);
 
+/**
+ * mio_kvs_pair_get_into() is a variant of mio_kvs_pair_get() in which
+ * the memory for returned values is owned by the application:
+ * - 'kvps' key-value pairs should set mio_kv_pair::mkp_val to the
+ *   buffer the value is placed into and mio_kv_pair::mkp_vlen to the
+ *   capacity of that buffer.
+ * - After successful operation mio_kv_pair::mkp_vlen is set to the
+ *   length of the retrieved value. If a value doesn't fit, the first
+ *   mkp_vlen (capacity) bytes are copied, the corresponding element in
+ *   'rcs' is set to -ENOBUFS and mio_kv_pair::mkp_vlen is set to the
+ *   full length of the value so that the application can retry with
+ *   a larger buffer.
+ *
+ * Values can also be placed into one contiguous slab by carving it with
+ * mio_kvs_vals_slab_set(), which points the value part of each pair
+ * into the slab. `caps` gives the capacity for each pair, if it is NULL
+ * the slab is split evenly.
+ */
+int mio_kvs_pair_get_into(struct mio_kvs_id *kvs_id,
+			  int nr_kvps, struct mio_kv_pair *kvps,
+			  int32_t *rcs, struct mio_op *op);
+int mio_kvs_vals_slab_set(int nr_kvps, struct mio_kv_pair *kvps,
+			  void *slab, size_t slab_len, const size_t *caps);
+
 int mio_kvs_pair_next(struct mio_kvs_id *kvs_id,
 		      int nr_kvps, struct mio_kv_pair *kvps,
 		      bool exclude_start_key, int32_t *rcs, struct mio_op *op);
@@ -669,6 +972,39 @@ int mio_kvs_pair_del(struct mio_kvs_id *kvs_id,
                      int nr_kvps, struct mio_kv_pair *kvps,
                      int32_t *rcs, struct mio_op *op);
 
+/**
+ * mio_kvs_del_range() deletes all pairs whose keys fall into the range
+ * [start_key, end_key), while mio_kvs_count_range() counts them. Keys
+ * are compared byte by byte, a key being a prefix of another key is
+ * smaller. If `start_key` is NULL the range starts with the smallest
+ * key, if `end_key` is NULL the range runs to the last key. Both keys
+ * are copied, they can be released once the functions return.
+ *
+ * The scan for keys and the deletion of found keys are pipelined inside
+ * the driver. The number of pairs deleted or counted so far can be
+ * checked in mio_op::mop_progress while the operation is on fly.
+ *
+ * mio_kvs_del_prefix() and mio_kvs_count_prefix() work on all pairs
+ * whose keys start with `prefix`.
+ *
+ * @param kvs_id The key-value set identifier.
+ * @param count[out] The number of pairs in range.
+ * @param op[out]. The operation pointer for progress query.
+ * @return 0 for success, < 0 for error.
+ */
+int mio_kvs_del_range(struct mio_kvs_id *kvs_id,
+		      void *start_key, size_t start_klen,
+		      void *end_key, size_t end_klen, struct mio_op *op);
+int mio_kvs_count_range(struct mio_kvs_id *kvs_id,
+			void *start_key, size_t start_klen,
+			void *end_key, size_t end_klen,
+			uint64_t *count, struct mio_op *op);
+int mio_kvs_del_prefix(struct mio_kvs_id *kvs_id,
+		       void *prefix, size_t prefix_len, struct mio_op *op);
+int mio_kvs_count_prefix(struct mio_kvs_id *kvs_id,
+			 void *prefix, size_t prefix_len,
+			 uint64_t *count, struct mio_op *op);
+
 /**
  * mio_kvs_create_set() creates a key-value set,
  * while mio_kvs_del_set() deletes a key-value set.
@@ -697,6 +1033,12 @@ int mio_obj_hints_get(struct mio_obj *obj, struct mio_hints *hints);
 int mio_obj_hint_set(struct mio_obj *obj, int hint_key, uint64_t hint_value);
 int mio_obj_hint_get(struct mio_obj *obj, int hint_key, uint64_t *hint_value);
 
+/**
+ * Set and get system level hints. Persistent system hints (all of the
+ * current ones) are stored in `mio_sys_hints_kvs` and shared by all
+ * clients: a value set by one client is seen by others within
+ * MIO_SYS_HINTS_REFRESH_INTERVAL ms. Both functions are thread safe.
+ */
 int mio_sys_hint_set(int hint_key, uint64_t hint_value);
 int mio_sys_hint_get(int hint_key, uint64_t *hint_value);
 /**
@@ -752,7 +1094,8 @@ int mio_composite_obj_del(const struct mio_obj_id *oid, struct mio_op *op);
 
 /**
  * mio_composite_obj_add_layer() adds a new layer (sub-object) to a
- * composite object. mio_composite_obj_del_layer() deletes a layer
+ * composite object. Adding a layer which is in the object already
+ * changes its priority. mio_composite_obj_del_layer() deletes a layer
  * from the composite object. All extents in the layer will
  * be removed as well.
  *
@@ -774,6 +1117,11 @@ int mio_composite_obj_del_layers(struct mio_obj *obj,
  * The memory to store layers and priorities are allocated
  * inside the function.
  *
+ * The layout of an opened composite object is cached, layers are
+ * listed from the cache once the layout has been fetched. The cache
+ * doesn't see layer changes made by other clients, in which case
+ * mio_composite_obj_list_layers_revalidate() fetches the layout again.
+ *
  * @param object The object to add to.
  * @param layout[out] The returned composite layout.
  * @param op The operation will be initialised when returned.
@@ -782,10 +1130,18 @@ int mio_composite_obj_del_layers(struct mio_obj *obj,
 int mio_composite_obj_list_layers(struct mio_obj *obj,
                                   struct mio_comp_obj_layout *ret_layout,
                    		  struct mio_op *op);
+int mio_composite_obj_list_layers_revalidate(
+	struct mio_obj *obj, struct mio_comp_obj_layout *ret_layout,
+	struct mio_op *op);
 
 /**
  * Add/remove extents of the specified layer of a composite object.
  *
+ * Extents added are merged with each other and with the layer's
+ * overlapping or adjacent extents known to this client, one record
+ * covering them replaces their records in the layer's extent index.
+ * Removing an extent trims the records covering it.
+ *
  * @param object The object to add to.
  * @param layer  The sub-object of the layer.
  * @param ext The extent in question.
@@ -799,6 +1155,51 @@ int mio_composite_obj_del_extents(struct mio_obj *obj,
 				  struct mio_obj_id *layer_id,
 				  int nr_exts, struct mio_obj_ext *exts,
 				  struct mio_op *op);
+
+/**
+ * Compact the extent index of the specified layer of a composite object.
+ * All overlapping and adjacent extent records of the layer are replaced
+ * by covering ones. This scans the whole extent index of the layer and
+ * is meant to be run in the background, for example for layers written
+ * by older clients or by many clients concurrently.
+ *
+ * @param object The composite object.
+ * @param layer  The sub-object of the layer.
+ * @return 0 for success, anything else for an error.
+ */
+int mio_composite_obj_compact_extents(struct mio_obj *obj,
+				      struct mio_obj_id *layer_id,
+				      struct mio_op *op);
+
+/**
+ * Iterate over extents of a composite object without paging through
+ * the extent index by hand. With a layer given, the iterator returns
+ * the extents of that layer (overlapping and adjacent records merged).
+ * Otherwise it returns the extents of all layers merged by priority:
+ * each returned extent is served by the layer returned in `layer_id`,
+ * the highest priority layer having data there. Extents are returned
+ * in increasing offset order. The next page of extents is read ahead
+ * while the current one is being consumed.
+ *
+ * mio_composite_obj_ext_iter_next() returns -ENOENT once all extents
+ * have been returned. The iterator blocks on its queries, so it must
+ * not be used from an operation callback.
+ *
+ * @param obj The composite object.
+ * @param layer_id The layer to iterate over, or NULL for all layers.
+ * @param iter[out] The iterator, release with
+ * mio_composite_obj_ext_iter_fini().
+ * @return 0 for success, anything else for an error.
+ */
+struct mio_comp_obj_ext_iter;
+int mio_composite_obj_ext_iter_init(struct mio_obj *obj,
+				    struct mio_obj_id *layer_id,
+				    struct mio_comp_obj_ext_iter **iter);
+int mio_composite_obj_ext_iter_next(struct mio_comp_obj_ext_iter *iter,
+				    struct mio_obj_ext *ext,
+				    struct mio_obj_id *layer_id);
+void mio_composite_obj_ext_iter_fini(struct mio_comp_obj_ext_iter *iter);
+
 /**
  * Query `nr_exts` extents of the specified layer whose offsets are
  * larger than `offset`. The number of extents found is returned.
@@ -818,6 +1219,94 @@ mio_composite_obj_get_extents(struct mio_obj *obj,
 			      int nr_exts, struct mio_obj_ext *exts,
 			      int *nr_ret_exts, struct mio_op *op);
 
+/**
+ * Find out which layer serves the range [off, off + len) of an opened
+ * composite object, without querying the object store in most cases.
+ *
+ * MIO keeps an extent map for each opened composite object. It is
+ * filled lazily: the first lookup lists the object's layers and a
+ * layer's extents are fetched the first time a lookup reaches the
+ * layer. These are synchronous queries. The map is kept up to date by
+ * mio_composite_obj_add_extents() and mio_composite_obj_del_extents()
+ * issued through the same object handle, adding or deleting layers
+ * invalidates it. Extents changed by other clients are not seen until
+ * mio_composite_obj_map_invalidate() is called.
+ *
+ * @param obj The opened composite object.
+ * @param off, len The range in question.
+ * @param layer_id[out] The highest priority layer holding data at `off`.
+ * @param ret_len[out] The length of the range starting at `off` which
+ * is served by the same layer (or is a hole), it is <= `len`.
+ * @return 0 if a layer is found, -ENOENT if `off` falls into a hole,
+ * other error code for failure.
+ */
+int mio_composite_obj_map_lookup(struct mio_obj *obj, off_t off, size_t len,
+				 struct mio_obj_id *layer_id, size_t *ret_len);
+void mio_composite_obj_map_invalidate(struct mio_obj *obj);
+
+/**
+ * Tiering turns a composite object into a burst buffer. Writes to the
+ * object land in its fast layer, placed in the GOLD pool and given the
+ * highest priority, and the extents written are added to the fast
+ * layer. A background drainer copies extents of objects which haven't
+ * been written for MIO_COMP_OBJ_TIER_DRAIN_DELAY milliseconds to the
+ * slow layer, placed in the BRONZE pool, adds them to the slow layer,
+ * then removes them from the fast layer and frees their space there.
+ * Reads are served by whichever layer holds the data.
+ *
+ * mio_composite_obj_tier_enable() creates the layer objects and adds
+ * them to the composite object if needed, so an object keeps its layers
+ * across sessions while tiering has to be enabled in each session.
+ * Writes count as in flight until their op is finalised, the drainer
+ * leaves an object alone while it has writes in flight.
+ *
+ * mio_composite_obj_tier_drain() drains all extents of the fast layer
+ * right away, at the end of a checkpoint for example, and returns
+ * -EBUSY if the object is written to meanwhile.
+ * mio_composite_obj_tier_disable() stops redirecting writes and
+ * draining, data not drained yet stays in the fast layer. Closing the
+ * object disables tiering. These functions block.
+ *
+ * @param obj The opened composite object.
+ * @param fast_id, slow_id The fast and slow layers.
+ * @return 0 for success, anything else for an error.
+ */
+int mio_composite_obj_tier_enable(struct mio_obj *obj,
+				  const struct mio_obj_id *fast_id,
+				  const struct mio_obj_id *slow_id);
+int mio_composite_obj_tier_drain(struct mio_obj *obj);
+void mio_composite_obj_tier_disable(struct mio_obj *obj);
+
+/**
+ * Snapshots of composite objects. Writes to a composite object land in
+ * its highest priority layer and layers below it are never written to.
+ * mio_obj_snapshot() freezes the current layers of the object and
+ * pushes a new empty layer on top of them which takes all writes from
+ * then on, reads fall through to the frozen layers for data not written
+ * since. The snapshot is a new composite object made of the frozen
+ * layers and their extent indices, no data is copied, so taking a
+ * snapshot costs a few metadata operations whatever the object size.
+ *
+ * The object must not be written to while the snapshot is taken. The
+ * new layer is created in the object's pool. Deleting a snapshot
+ * object leaves its layers alone as they are shared with the object.
+ * Extents of frozen layers must not be deleted or tiered while
+ * snapshots refer to them. mio_obj_snapshot() blocks.
+ *
+ * mio_obj_snapshot_open() opens a snapshot read-only, writes to it
+ * fail with -EROFS. Snapshots must be opened with it.
+ *
+ * @param obj The opened composite object.
+ * @param snap_id The snapshot object to create.
+ * @param layer_id The new top layer object to create.
+ * @return 0 for success, anything else for an error.
+ */
+int mio_obj_snapshot(struct mio_obj *obj,
+		     const struct mio_obj_id *snap_id,
+		     const struct mio_obj_id *layer_id);
+int mio_obj_snapshot_open(const struct mio_obj_id *snap_id,
+			  struct mio_obj *snap, struct mio_op *op);
+
 /**
  * The structure 'mio' holds global information of underlying object store
  * and key-value set.
@@ -832,6 +1321,54 @@ struct mio {
 	enum mio_driver_id m_driver_id;
 	struct mio_driver *m_driver;
 	void *m_driver_confs;
+
+	/**
+	 * Freshness window (in milliseconds) and capacity of the object
+	 * attribute cache. A TTL of 0 (the default) disables the cache.
+	 */
+	uint64_t m_obj_attrs_cache_ttl;
+	int m_obj_attrs_cache_size;
+
+	/**
+	 * Composite object tiering (in milliseconds): how long an object
+	 * must go without writes before being drained and how often the
+	 * drainer looks for such objects. 0 selects the defaults.
+	 */
+	uint64_t m_comp_obj_tier_drain_delay;
+	uint64_t m_comp_obj_tier_drain_interval;
+
+	/**
+	 * Background tiering of objects by hotness: whether it is on, how
+	 * often (in milliseconds) objects are scanned and the budget in
+	 * bytes per second for moving data between each pair of pools.
+	 * 0 selects the defaults.
+	 */
+	bool m_obj_tiering;
+	uint64_t m_obj_tiering_scan_interval;
+	uint64_t m_obj_tiering_bandwidth;
+
+	/**
+	 * How often (in milliseconds) the pool state cache is refreshed
+	 * and how full (in percentage of capacity) a pool may get before
+	 * new objects are placed in another pool. 0 selects the defaults.
+	 */
+	uint64_t m_pool_state_refresh_interval;
+	int m_pool_high_watermark;
+
+	/**
+	 * How often (in milliseconds) persistent system hints are reloaded
+	 * from the system hint key-value set. 0 selects the default.
+	 */
+	uint64_t m_sys_hints_refresh_interval;
+
+	/**
+	 * Deletion of expired objects: whether it is on, how often (in
+	 * milliseconds) expired objects are looked for and the most objects
+	 * deleted per second. 0 selects the defaults.
+	 */
+	bool m_obj_reaper;
+	uint64_t m_obj_reaper_interval;
+	uint64_t m_obj_reaper_rate;
 };
 extern struct mio *mio_instance;
 
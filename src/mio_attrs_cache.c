@@ -0,0 +1,311 @@
+/* -*- C -*- */
+/*
+ * Copyright: (c) 2020 - 2021 Seagate Technology LLC and/or its its Affiliates,
+ * All Rights Reserved
+ *
+ * This software is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ */
+
+#include <errno.h>
+#include <assert.h>
+#include <string.h>
+#include <pthread.h>
+
+#include "logger.h"
+#include "utils.h"
+#include "mio.h"
+#include "mio_internal.h"
+
+/**
+ * Process-wide cache of object attributes.
+ *
+ * Opening an object normally takes two serial round trips, one to open
+ * the object and one to fetch its attributes from the attribute index.
+ * The cache keeps the encoded attribute record (in whatever format the
+ * driver stores in the attribute index) of recently opened objects, so
+ * that re-opening an object within the freshness window (TTL) skips the
+ * second round trip. Entries are refreshed whenever this client reads or
+ * writes the attribute record and dropped when the object is deleted.
+ *
+ * Entries are kept in a hash table for lookups and on a list in least
+ * recently used order. Once the cache is full, the least recently used
+ * entry is evicted to admit a new one.
+ *
+ * The cache does not see updates made by other clients, hence a cached
+ * record may be up to TTL old. Applications sharing objects between
+ * clients should either disable the cache (TTL = 0) or open objects with
+ * mio_obj_open_revalidate().
+ */
+
+enum {
+	MIO_ATTRS_CACHE_NR_BUCKETS = 1024,
+	MIO_ATTRS_CACHE_DEFAULT_SIZE = 4096,
+};
+
+struct attrs_cache_entry {
+	struct mio_obj_id ace_oid;
+	/* When the record was last fetched or stored, in nano-seconds. */
+	uint64_t ace_time;
+	int ace_len;
+	void *ace_buf;
+	struct attrs_cache_entry *ace_next;
+	/* Neighbours on the LRU list, ace_lru_prev is more recently used. */
+	struct attrs_cache_entry *ace_lru_prev;
+	struct attrs_cache_entry *ace_lru_next;
+};
+
+struct attrs_cache {
+	pthread_mutex_t ac_lock;
+	bool ac_enabled;
+	/* In nano-seconds, same as mio_now(). */
+	uint64_t ac_ttl;
+	int ac_max_nr_entries;
+	int ac_nr_entries;
+	struct attrs_cache_entry *ac_buckets[MIO_ATTRS_CACHE_NR_BUCKETS];
+	/* The most and the least recently used entries. */
+	struct attrs_cache_entry *ac_lru_head;
+	struct attrs_cache_entry *ac_lru_tail;
+};
+
+static struct attrs_cache mio_attrs_cache;
+
+static inline struct attrs_cache_entry **
+attrs_cache_bucket(const struct mio_obj_id *oid)
+{
+	uint64_t hash;
+
+	hash = mio_hash_fnv1a(oid->moi_bytes, MIO_OBJ_ID_LEN);
+	return &mio_attrs_cache.ac_buckets[hash % MIO_ATTRS_CACHE_NR_BUCKETS];
+}
+
+static inline bool attrs_cache_entry_is_stale(struct attrs_cache_entry *ace,
+					      uint64_t now)
+{
+	return now - ace->ace_time > mio_attrs_cache.ac_ttl;
+}
+
+static void attrs_cache_lru_unlink(struct attrs_cache_entry *ace)
+{
+	if (ace->ace_lru_prev != NULL)
+		ace->ace_lru_prev->ace_lru_next = ace->ace_lru_next;
+	else
+		mio_attrs_cache.ac_lru_head = ace->ace_lru_next;
+	if (ace->ace_lru_next != NULL)
+		ace->ace_lru_next->ace_lru_prev = ace->ace_lru_prev;
+	else
+		mio_attrs_cache.ac_lru_tail = ace->ace_lru_prev;
+	ace->ace_lru_prev = NULL;
+	ace->ace_lru_next = NULL;
+}
+
+/* Makes `ace` the most recently used entry. */
+static void attrs_cache_lru_touch(struct attrs_cache_entry *ace)
+{
+	if (mio_attrs_cache.ac_lru_head == ace)
+		return;
+	/* Only the head of the list has no predecessor. */
+	if (ace->ace_lru_prev != NULL)
+		attrs_cache_lru_unlink(ace);
+
+	ace->ace_lru_next = mio_attrs_cache.ac_lru_head;
+	if (ace->ace_lru_next != NULL)
+		ace->ace_lru_next->ace_lru_prev = ace;
+	mio_attrs_cache.ac_lru_head = ace;
+	if (mio_attrs_cache.ac_lru_tail == NULL)
+		mio_attrs_cache.ac_lru_tail = ace;
+}
+
+static void attrs_cache_entry_free(struct attrs_cache_entry *ace)
+{
+	mio_mem_free(ace->ace_buf);
+	mio_mem_free(ace);
+}
+
+/**
+ * Removes the entry pointed by *prev from its bucket. Must be called
+ * with the cache lock held.
+ */
+static void attrs_cache_entry_del(struct attrs_cache_entry **prev)
+{
+	struct attrs_cache_entry *ace = *prev;
+
+	*prev = ace->ace_next;
+	attrs_cache_lru_unlink(ace);
+	attrs_cache_entry_free(ace);
+	mio_attrs_cache.ac_nr_entries--;
+}
+
+static struct attrs_cache_entry **
+attrs_cache_find(const struct mio_obj_id *oid)
+{
+	struct attrs_cache_entry **prev;
+
+	for (prev = attrs_cache_bucket(oid); *prev != NULL;
+	     prev = &(*prev)->ace_next)
+		if (!memcmp((*prev)->ace_oid.moi_bytes, oid->moi_bytes,
+			    MIO_OBJ_ID_LEN))
+			return prev;
+	return NULL;
+}
+
+/* Evicts least recently used entries till there is room for a new one. */
+static void attrs_cache_make_room()
+{
+	struct attrs_cache_entry *lru;
+
+	while (mio_attrs_cache.ac_nr_entries >=
+	       mio_attrs_cache.ac_max_nr_entries) {
+		lru = mio_attrs_cache.ac_lru_tail;
+		assert(lru != NULL);
+		attrs_cache_entry_del(attrs_cache_find(&lru->ace_oid));
+	}
+}
+
+int mio_obj_attrs_cache_get(const struct mio_obj_id *oid,
+			    void **buf, int *len)
+{
+	int rc = 0;
+	uint64_t now;
+	void *copy;
+	struct attrs_cache_entry **prev;
+
+	if (!mio_attrs_cache.ac_enabled)
+		return -ENOENT;
+
+	now = mio_now();
+	pthread_mutex_lock(&mio_attrs_cache.ac_lock);
+	prev = attrs_cache_find(oid);
+	if (prev == NULL) {
+		rc = -ENOENT;
+		goto exit;
+	}
+	if (attrs_cache_entry_is_stale(*prev, now)) {
+		attrs_cache_entry_del(prev);
+		rc = -ENOENT;
+		goto exit;
+	}
+
+	copy = mio_mem_alloc((*prev)->ace_len);
+	if (copy == NULL) {
+		rc = -ENOMEM;
+		goto exit;
+	}
+	mio_mem_copy(copy, (*prev)->ace_buf, (*prev)->ace_len);
+	*buf = copy;
+	*len = (*prev)->ace_len;
+	attrs_cache_lru_touch(*prev);
+
+exit:
+	pthread_mutex_unlock(&mio_attrs_cache.ac_lock);
+	return rc;
+}
+
+void mio_obj_attrs_cache_put(const struct mio_obj_id *oid,
+			     const void *buf, int len)
+{
+	uint64_t now;
+	void *copy;
+	struct attrs_cache_entry *ace;
+	struct attrs_cache_entry **prev;
+	struct attrs_cache_entry **bucket;
+
+	if (!mio_attrs_cache.ac_enabled)
+		return;
+
+	copy = mio_mem_alloc(len);
+	if (copy == NULL)
+		return;
+	mio_mem_copy(copy, (void *)buf, len);
+
+	now = mio_now();
+	pthread_mutex_lock(&mio_attrs_cache.ac_lock);
+	prev = attrs_cache_find(oid);
+	if (prev != NULL) {
+		ace = *prev;
+		mio_mem_free(ace->ace_buf);
+		goto set;
+	}
+
+	attrs_cache_make_room();
+	ace = mio_mem_alloc(sizeof *ace);
+	if (ace == NULL) {
+		mio_mem_free(copy);
+		goto exit;
+	}
+	ace->ace_oid = *oid;
+	bucket = attrs_cache_bucket(oid);
+	ace->ace_next = *bucket;
+	*bucket = ace;
+	mio_attrs_cache.ac_nr_entries++;
+
+set:
+	ace->ace_buf = copy;
+	ace->ace_len = len;
+	ace->ace_time = now;
+	attrs_cache_lru_touch(ace);
+exit:
+	pthread_mutex_unlock(&mio_attrs_cache.ac_lock);
+}
+
+void mio_obj_attrs_cache_invalidate(const struct mio_obj_id *oid)
+{
+	struct attrs_cache_entry **prev;
+
+	if (!mio_attrs_cache.ac_enabled)
+		return;
+
+	pthread_mutex_lock(&mio_attrs_cache.ac_lock);
+	prev = attrs_cache_find(oid);
+	if (prev != NULL)
+		attrs_cache_entry_del(prev);
+	pthread_mutex_unlock(&mio_attrs_cache.ac_lock);
+}
+
+/**
+ * @param ttl The freshness window in milliseconds.
+ */
+int mio_obj_attrs_cache_init(uint64_t ttl, int max_nr_entries)
+{
+	mio_memset(&mio_attrs_cache, 0, sizeof mio_attrs_cache);
+	if (ttl == 0)
+		return 0;
+	if (max_nr_entries < 0)
+		return -EINVAL;
+
+	mio_attrs_cache.ac_ttl = ttl * 1000000ULL;
+	mio_attrs_cache.ac_max_nr_entries = max_nr_entries?:
+					    MIO_ATTRS_CACHE_DEFAULT_SIZE;
+	pthread_mutex_init(&mio_attrs_cache.ac_lock, NULL);
+	mio_attrs_cache.ac_enabled = true;
+	return 0;
+}
+
+void mio_obj_attrs_cache_fini()
+{
+	int i;
+
+	if (!mio_attrs_cache.ac_enabled)
+		return;
+
+	mio_attrs_cache.ac_enabled = false;
+	for (i = 0; i < MIO_ATTRS_CACHE_NR_BUCKETS; i++)
+		while (mio_attrs_cache.ac_buckets[i] != NULL)
+			attrs_cache_entry_del(mio_attrs_cache.ac_buckets + i);
+	pthread_mutex_destroy(&mio_attrs_cache.ac_lock);
+}
+
+/*
+ *  Local variables:
+ *  c-indentation-style: "K&R"
+ *  c-basic-offset: 8
+ *  tab-width: 8
+ *  fill-column: 80
+ *  scroll-step: 1
+ *  End:
+ */
+/*
+ * vim: tabstop=8 shiftwidth=8 noexpandtab textwidth=80 nowrap
+ *
+ */
@@ -0,0 +1,1356 @@
+/* -*- C -*- */
+/*
+ * Copyright: (c) 2020 - 2021 Seagate Technology LLC and/or its its Affiliates,
+ * All Rights Reserved
+ *
+ * This software is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ */
+
+#include <errno.h>
+#include <stdlib.h>
+#include <assert.h>
+#include <string.h>
+#include <pthread.h>
+
+#include "logger.h"
+#include "utils.h"
+#include "mio.h"
+#include "mio_internal.h"
+
+/**
+ * Client-side extent map of an opened composite object.
+ *
+ * For every layer, the map keeps the layer's extents sorted by offset.
+ * Overlapping and adjacent extents are coalesced, so extents of a layer
+ * never overlap and a binary search finds the one covering an offset.
+ * Layers are kept in the order returned by listing layers, that is from
+ * the highest priority to the lowest one. A byte range is served by the
+ * highest priority layer having an extent covering it.
+ *
+ * The map is filled lazily: layers are listed on the first lookup and
+ * a layer's extents are loaded from its extent index the first time a
+ * lookup reaches the layer. Once loaded, the map is kept up to date by
+ * this client's own extent updates. Changing layers invalidates the map.
+ *
+ * Reading a composite object resolves each requested range against the
+ * map into pieces served by a layer and holes. Holes are zero-filled on
+ * the spot and the pieces are handed to the driver, which reads from
+ * all layers concurrently. Layer objects are opened on first use and
+ * stay open until the composite object is closed.
+ */
+
+enum {
+	COMP_OBJ_MAP_EXTS_BATCH = 64,
+	COMP_OBJ_READ_SEGS_BATCH = 16,
+};
+
+struct comp_obj_layer_map {
+	struct mio_comp_obj_layer clm_layer;
+	bool clm_loaded;
+	int clm_nr_exts;
+	int clm_max_nr_exts;
+	struct mio_obj_ext *clm_exts;
+};
+
+struct mio_comp_obj_map {
+	pthread_mutex_t cm_lock;
+	bool cm_loaded;
+	int cm_nr_layers;
+	struct comp_obj_layer_map *cm_layers;
+
+	/*
+	 * Opened layer objects. They are not dropped when the map is
+	 * invalidated as reads in flight may still use them.
+	 */
+	int cm_nr_layer_objs;
+	struct mio_obj **cm_layer_objs;
+};
+
+static inline off_t comp_obj_ext_end(const struct mio_obj_ext *ext)
+{
+	return ext->moe_off + ext->moe_size;
+}
+
+/**
+ * Returns the index of the first extent ending after `off`, which is
+ * the one covering `off` if there is such an extent.
+ */
+static int comp_obj_layer_ext_find(struct comp_obj_layer_map *lmap, off_t off)
+{
+	int lo = 0;
+	int hi = lmap->clm_nr_exts;
+	int mid;
+
+	while (lo < hi) {
+		mid = lo + (hi - lo) / 2;
+		if (comp_obj_ext_end(lmap->clm_exts + mid) <= off)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	return lo;
+}
+
+static int comp_obj_layer_exts_reserve(struct comp_obj_layer_map *lmap,
+				       int nr_more)
+{
+	int nr;
+	struct mio_obj_ext *exts;
+
+	if (lmap->clm_nr_exts + nr_more <= lmap->clm_max_nr_exts)
+		return 0;
+
+	nr = lmap->clm_max_nr_exts * 2;
+	if (nr < lmap->clm_nr_exts + nr_more)
+		nr = lmap->clm_nr_exts + nr_more;
+	if (nr < COMP_OBJ_MAP_EXTS_BATCH)
+		nr = COMP_OBJ_MAP_EXTS_BATCH;
+	exts = mio_mem_alloc(nr * sizeof *exts);
+	if (exts == NULL)
+		return -ENOMEM;
+	if (lmap->clm_nr_exts != 0)
+		mio_mem_copy(exts, lmap->clm_exts,
+			     lmap->clm_nr_exts * sizeof *exts);
+	mio_mem_free(lmap->clm_exts);
+	lmap->clm_exts = exts;
+	lmap->clm_max_nr_exts = nr;
+	return 0;
+}
+
+/* Replaces extents [from, to) with `nr_new` extents in `new_exts`. */
+static int comp_obj_layer_exts_splice(struct comp_obj_layer_map *lmap,
+				      int from, int to, int nr_new,
+				      const struct mio_obj_ext *new_exts)
+{
+	int rc;
+	int nr_tail = lmap->clm_nr_exts - to;
+
+	rc = comp_obj_layer_exts_reserve(lmap, nr_new - (to - from));
+	if (rc < 0)
+		return rc;
+	if (nr_tail != 0)
+		memmove(lmap->clm_exts + from + nr_new, lmap->clm_exts + to,
+			nr_tail * sizeof(struct mio_obj_ext));
+	if (nr_new != 0)
+		mio_mem_copy(lmap->clm_exts + from, (void *)new_exts,
+			     nr_new * sizeof(struct mio_obj_ext));
+	lmap->clm_nr_exts = from + nr_new + nr_tail;
+	return 0;
+}
+
+static int comp_obj_layer_ext_add(struct comp_obj_layer_map *lmap,
+				  const struct mio_obj_ext *ext)
+{
+	int from;
+	int to;
+	off_t end;
+	struct mio_obj_ext merged;
+
+	if (ext->moe_size == 0)
+		return 0;
+
+	/* Merge with all extents overlapping or adjacent to the new one. */
+	merged = *ext;
+	end = comp_obj_ext_end(ext);
+	from = ext->moe_off == 0? 0 :
+	       comp_obj_layer_ext_find(lmap, ext->moe_off - 1);
+	for (to = from; to < lmap->clm_nr_exts; to++) {
+		if (lmap->clm_exts[to].moe_off > end)
+			break;
+		if (lmap->clm_exts[to].moe_off < merged.moe_off)
+			merged.moe_off = lmap->clm_exts[to].moe_off;
+		if (comp_obj_ext_end(lmap->clm_exts + to) > end)
+			end = comp_obj_ext_end(lmap->clm_exts + to);
+	}
+	merged.moe_size = end - merged.moe_off;
+	return comp_obj_layer_exts_splice(lmap, from, to, 1, &merged);
+}
+
+static int comp_obj_layer_ext_del(struct comp_obj_layer_map *lmap,
+				  const struct mio_obj_ext *ext)
+{
+	int from;
+	int to;
+	int nr_left = 0;
+	off_t end = comp_obj_ext_end(ext);
+	struct mio_obj_ext left[2];
+	struct mio_obj_ext *first;
+	struct mio_obj_ext *last;
+
+	from = comp_obj_layer_ext_find(lmap, ext->moe_off);
+	for (to = from; to < lmap->clm_nr_exts; to++)
+		if (lmap->clm_exts[to].moe_off >= end)
+			break;
+	if (from == to)
+		return 0;
+
+	/* Keep what is left of the first and last extents removed. */
+	first = lmap->clm_exts + from;
+	last = lmap->clm_exts + to - 1;
+	if (first->moe_off < ext->moe_off) {
+		left[nr_left].moe_off = first->moe_off;
+		left[nr_left].moe_size = ext->moe_off - first->moe_off;
+		nr_left++;
+	}
+	if (comp_obj_ext_end(last) > end) {
+		left[nr_left].moe_off = end;
+		left[nr_left].moe_size = comp_obj_ext_end(last) - end;
+		nr_left++;
+	}
+	return comp_obj_layer_exts_splice(lmap, from, to, nr_left, left);
+}
+
+static void comp_obj_map_layers_fini(struct mio_comp_obj_map *map)
+{
+	int i;
+
+	for (i = 0; i < map->cm_nr_layers; i++)
+		mio_mem_free(map->cm_layers[i].clm_exts);
+	mio_mem_free(map->cm_layers);
+	map->cm_layers = NULL;
+	map->cm_nr_layers = 0;
+	map->cm_loaded = false;
+}
+
+static struct comp_obj_layer_map *
+comp_obj_map_layer_find(struct mio_comp_obj_map *map,
+			const struct mio_obj_id *layer_id)
+{
+	int i;
+
+	for (i = 0; i < map->cm_nr_layers; i++)
+		if (!memcmp(map->cm_layers[i].clm_layer.mcol_oid.moi_bytes,
+			    layer_id->moi_bytes, MIO_OBJ_ID_LEN))
+			return map->cm_layers + i;
+	return NULL;
+}
+
+static int comp_obj_map_layers_load(struct mio_obj *obj,
+				    struct mio_comp_obj_map *map)
+{
+	int i;
+	int rc;
+	struct mio_op op;
+	struct mio_comp_obj_layout layout;
+
+	mio_memset(&layout, 0, sizeof layout);
+	mio_op_init(&op);
+	rc = mio_composite_obj_list_layers(obj, &layout, &op);
+	if (rc < 0)
+		return rc;
+	rc = mio_op_wait(&op);
+	mio_op_fini(&op);
+	if (rc < 0)
+		goto exit;
+
+	map->cm_layers = mio_mem_alloc(layout.mlo_nr_layers *
+				       sizeof(struct comp_obj_layer_map));
+	if (map->cm_layers == NULL && layout.mlo_nr_layers != 0) {
+		rc = -ENOMEM;
+		goto exit;
+	}
+	for (i = 0; i < layout.mlo_nr_layers; i++)
+		map->cm_layers[i].clm_layer = layout.mlo_layers[i];
+	map->cm_nr_layers = layout.mlo_nr_layers;
+	map->cm_loaded = true;
+
+exit:
+	mio_mem_free(layout.mlo_layers);
+	return rc;
+}
+
+static int comp_obj_map_layer_load(struct mio_obj *obj,
+				   struct comp_obj_layer_map *lmap)
+{
+	int i;
+	int rc;
+	int nr_exts;
+	off_t off = 0;
+	struct mio_op op;
+	struct mio_obj_ext *exts;
+
+	exts = mio_mem_alloc(COMP_OBJ_MAP_EXTS_BATCH * sizeof *exts);
+	if (exts == NULL)
+		return -ENOMEM;
+
+	lmap->clm_nr_exts = 0;
+	while (1) {
+		nr_exts = 0;
+		mio_op_init(&op);
+		rc = mio_composite_obj_get_extents(obj,
+			&lmap->clm_layer.mcol_oid, off,
+			COMP_OBJ_MAP_EXTS_BATCH, exts, &nr_exts, &op);
+		if (rc < 0)
+			break;
+		rc = mio_op_wait(&op);
+		mio_op_fini(&op);
+		if (rc < 0)
+			break;
+
+		for (i = 0; i < nr_exts && rc == 0; i++)
+			rc = comp_obj_layer_ext_add(lmap, exts + i);
+		if (rc < 0 || nr_exts < COMP_OBJ_MAP_EXTS_BATCH)
+			break;
+		off = exts[nr_exts - 1].moe_off + 1;
+	}
+
+	mio_mem_free(exts);
+	if (rc == 0)
+		lmap->clm_loaded = true;
+	return rc;
+}
+
+static struct mio_comp_obj_map *comp_obj_map_get(struct mio_obj *obj)
+{
+	struct mio_comp_obj_map *map;
+
+	if (obj->mo_comp_map != NULL)
+		return obj->mo_comp_map;
+
+	map = mio_mem_alloc(sizeof *map);
+	if (map == NULL)
+		return NULL;
+	pthread_mutex_init(&map->cm_lock, NULL);
+	obj->mo_comp_map = map;
+	return map;
+}
+
+/**
+ * Finds the layer serving the data at `off`, looking no further than
+ * `off + len`. On return *ret_len is the length of the range starting
+ * at `off` served by the layer returned in *ret_lmap, or the length of
+ * the hole if -ENOENT is returned. Must be called with the map lock held.
+ */
+static int comp_obj_map_resolve(struct mio_obj *obj,
+				struct mio_comp_obj_map *map,
+				off_t off, size_t len,
+				struct comp_obj_layer_map **ret_lmap,
+				size_t *ret_len)
+{
+	int i;
+	int j;
+	int rc;
+	off_t end;
+	struct comp_obj_layer_map *lmap;
+	struct mio_obj_ext *ext;
+
+	if (!map->cm_loaded) {
+		rc = comp_obj_map_layers_load(obj, map);
+		if (rc < 0)
+			return rc;
+	}
+
+	/*
+	 * Walk down the layers. A higher priority layer whose next
+	 * extent starts within the range limits how much of the range
+	 * a lower priority layer can serve.
+	 */
+	end = off + len;
+	for (i = 0; i < map->cm_nr_layers; i++) {
+		lmap = map->cm_layers + i;
+		if (!lmap->clm_loaded) {
+			rc = comp_obj_map_layer_load(obj, lmap);
+			if (rc < 0)
+				return rc;
+		}
+
+		j = comp_obj_layer_ext_find(lmap, off);
+		if (j == lmap->clm_nr_exts)
+			continue;
+		ext = lmap->clm_exts + j;
+		if (ext->moe_off <= off) {
+			if (comp_obj_ext_end(ext) < end)
+				end = comp_obj_ext_end(ext);
+			*ret_lmap = lmap;
+			*ret_len = end - off;
+			return 0;
+		}
+		if (ext->moe_off < end)
+			end = ext->moe_off;
+	}
+
+	/* No layer has data at `off`. */
+	*ret_len = end - off;
+	return -ENOENT;
+}
+
+int mio_composite_obj_map_lookup(struct mio_obj *obj, off_t off, size_t len,
+				 struct mio_obj_id *layer_id, size_t *ret_len)
+{
+	int rc;
+	struct mio_comp_obj_map *map;
+	struct comp_obj_layer_map *lmap;
+
+	if (obj == NULL || layer_id == NULL || ret_len == NULL || len == 0)
+		return -EINVAL;
+	map = comp_obj_map_get(obj);
+	if (map == NULL)
+		return -ENOMEM;
+
+	pthread_mutex_lock(&map->cm_lock);
+	rc = comp_obj_map_resolve(obj, map, off, len, &lmap, ret_len);
+	if (rc == 0)
+		*layer_id = lmap->clm_layer.mcol_oid;
+	pthread_mutex_unlock(&map->cm_lock);
+	return rc;
+}
+
+/**
+ * Returns the opened layer object, opening it if this is the first
+ * time the layer is read from. Must be called with the map lock held.
+ */
+static int comp_obj_map_layer_obj_get(struct mio_comp_obj_map *map,
+				      const struct mio_obj_id *layer_id,
+				      struct mio_obj **ret_obj)
+{
+	int i;
+	int rc;
+	struct mio_op op;
+	struct mio_obj *lobj;
+	struct mio_obj **lobjs;
+
+	for (i = 0; i < map->cm_nr_layer_objs; i++) {
+		lobj = map->cm_layer_objs[i];
+		if (!memcmp(lobj->mo_id.moi_bytes, layer_id->moi_bytes,
+			    MIO_OBJ_ID_LEN)) {
+			*ret_obj = lobj;
+			return 0;
+		}
+	}
+
+	lobjs = mio_mem_alloc((map->cm_nr_layer_objs + 1) * sizeof *lobjs);
+	lobj = mio_mem_alloc(sizeof *lobj);
+	if (lobjs == NULL || lobj == NULL) {
+		rc = -ENOMEM;
+		goto error;
+	}
+
+	mio_op_init(&op);
+	rc = mio_obj_open(layer_id, lobj, &op);
+	if (rc < 0)
+		goto error;
+	rc = mio_op_wait(&op);
+	mio_op_fini(&op);
+	if (rc < 0)
+		goto error;
+
+	if (map->cm_nr_layer_objs != 0)
+		mio_mem_copy(lobjs, map->cm_layer_objs,
+			     map->cm_nr_layer_objs * sizeof *lobjs);
+	lobjs[map->cm_nr_layer_objs++] = lobj;
+	mio_mem_free(map->cm_layer_objs);
+	map->cm_layer_objs = lobjs;
+	*ret_obj = lobj;
+	return 0;
+
+error:
+	mio_mem_free(lobjs);
+	mio_mem_free(lobj);
+	return rc;
+}
+
+static int comp_obj_read_seg_add(struct mio_comp_obj_seg **segs,
+				 int *nr_segs, int *max_nr_segs,
+				 struct mio_obj *lobj, off_t off,
+				 size_t len, char *buf)
+{
+	int nr;
+	struct mio_comp_obj_seg *new_segs;
+	struct mio_comp_obj_seg *seg;
+
+	/* Extend the previous piece if this one follows it. */
+	if (*nr_segs != 0) {
+		seg = *segs + *nr_segs - 1;
+		if (seg->mcs_obj == lobj &&
+		    seg->mcs_off + seg->mcs_len == off &&
+		    seg->mcs_buf + seg->mcs_len == buf) {
+			seg->mcs_len += len;
+			return 0;
+		}
+	}
+
+	if (*nr_segs == *max_nr_segs) {
+		nr = *max_nr_segs * 2?: COMP_OBJ_READ_SEGS_BATCH;
+		new_segs = mio_mem_alloc(nr * sizeof *new_segs);
+		if (new_segs == NULL)
+			return -ENOMEM;
+		if (*nr_segs != 0)
+			mio_mem_copy(new_segs, *segs,
+				     *nr_segs * sizeof *new_segs);
+		mio_mem_free(*segs);
+		*segs = new_segs;
+		*max_nr_segs = nr;
+	}
+
+	seg = *segs + *nr_segs;
+	seg->mcs_obj = lobj;
+	seg->mcs_off = off;
+	seg->mcs_len = len;
+	seg->mcs_buf = buf;
+	(*nr_segs)++;
+	return 0;
+}
+
+bool mio_comp_obj_is_composite(struct mio_obj *obj)
+{
+	struct mio_comp_obj_ops *ops;
+
+	ops = mio_instance->m_driver->md_comp_obj_ops;
+	if (ops == NULL || ops->mcoo_is_composite == NULL ||
+	    ops->mcoo_readv_layers == NULL)
+		return false;
+	return ops->mcoo_is_composite(obj);
+}
+
+/**
+ * Makes an opened object ready to be added as a layer, see the driver's
+ * moo_promote(). Waits till it completes.
+ */
+int mio_comp_obj_layer_prepare(struct mio_obj *obj)
+{
+	int rc;
+	struct mio_op op;
+
+	if (obj->mo_drv_obj_ops->moo_promote == NULL)
+		return 0;
+
+	mio_op_init(&op);
+	rc = mio_obj_op_init(&op, obj, MIO_OBJ_WRITE)? :
+	     obj->mo_drv_obj_ops->moo_promote(obj, &op)? :
+	     mio_op_wait(&op);
+	mio_op_fini(&op);
+	return rc;
+}
+
+/**
+ * Adds `nr_layers` layers above all layers of the object, `layout` being
+ * its current layers. `layer_ids[0]` becomes the top layer. Smaller
+ * number means higher priority and priorities can't go below 0: if the
+ * top layer's priority is too small, all layers are moved down in the
+ * same layout update.
+ */
+int mio_comp_obj_layers_push(struct mio_obj *obj, int nr_layers,
+			     const struct mio_obj_id *layer_ids,
+			     const struct mio_comp_obj_layout *layout)
+{
+	int i;
+	int rc;
+	int nr = 0;
+	int top;
+	int shift;
+	struct mio_op op;
+	struct mio_comp_obj_layer *layers;
+
+	layers = mio_mem_alloc((layout->mlo_nr_layers + nr_layers) *
+			       sizeof *layers);
+	if (layers == NULL)
+		return -ENOMEM;
+
+	top = layout->mlo_nr_layers == 0? nr_layers :
+	      layout->mlo_layers[0].mcol_priority;
+	shift = top >= nr_layers? 0 : nr_layers - top;
+	for (i = 0; i < nr_layers; i++) {
+		layers[nr].mcol_oid = layer_ids[i];
+		layers[nr].mcol_priority = top + shift - nr_layers + i;
+		nr++;
+	}
+	for (i = 0; shift != 0 && i < layout->mlo_nr_layers; i++) {
+		layers[nr] = layout->mlo_layers[i];
+		layers[nr].mcol_priority += shift;
+		nr++;
+	}
+
+	mio_op_init(&op);
+	rc = mio_composite_obj_add_layers(obj, nr, layers, &op)? :
+	     mio_op_wait(&op);
+	mio_op_fini(&op);
+	mio_mem_free(layers);
+	return rc;
+}
+
+int mio_comp_obj_readv(struct mio_obj *obj,
+		       const struct mio_iovec *iov, int iovcnt,
+		       struct mio_op *op)
+{
+	int i;
+	int rc = 0;
+	int nr_segs = 0;
+	int max_nr_segs = 0;
+	off_t off;
+	size_t len;
+	size_t seg_len;
+	char *buf;
+	struct mio_obj *lobj;
+	struct mio_comp_obj_seg *segs = NULL;
+	struct mio_comp_obj_map *map;
+	struct comp_obj_layer_map *lmap;
+
+	if (iov == NULL || iovcnt <= 0)
+		return -EINVAL;
+	map = comp_obj_map_get(obj);
+	if (map == NULL)
+		return -ENOMEM;
+
+	pthread_mutex_lock(&map->cm_lock);
+	for (i = 0; i < iovcnt; i++) {
+		off = iov[i].miov_off;
+		len = iov[i].miov_len;
+		buf = iov[i].miov_base;
+		while (len > 0) {
+			rc = comp_obj_map_resolve(obj, map, off, len,
+						  &lmap, &seg_len);
+			if (rc == -ENOENT) {
+				mio_memset(buf, 0, seg_len);
+				rc = 0;
+			} else if (rc == 0) {
+				rc = comp_obj_map_layer_obj_get(map,
+					&lmap->clm_layer.mcol_oid, &lobj)? :
+				     comp_obj_read_seg_add(&segs, &nr_segs,
+					&max_nr_segs, lobj, off, seg_len, buf);
+			}
+			if (rc < 0)
+				goto exit;
+			off += seg_len;
+			len -= seg_len;
+			buf += seg_len;
+		}
+	}
+	pthread_mutex_unlock(&map->cm_lock);
+
+	/* Nothing to read from the layers if the ranges are all holes. */
+	if (nr_segs == 0)
+		rc = mio_driver_op_add_done(op);
+	else
+		rc = mio_instance->m_driver->md_comp_obj_ops->mcoo_readv_layers(
+			obj, nr_segs, segs, op);
+	mio_mem_free(segs);
+	return rc;
+
+exit:
+	pthread_mutex_unlock(&map->cm_lock);
+	mio_mem_free(segs);
+	return rc;
+}
+
+/**
+ * Writes land in the highest priority layer, the first one listed, and
+ * the driver adds the extents written to the layer. Layers below it are
+ * never written to, which is what keeps snapshots frozen.
+ */
+int mio_comp_obj_writev(struct mio_obj *obj,
+			const struct mio_iovec *iov, int iovcnt,
+			struct mio_op *op)
+{
+	int rc = 0;
+	struct mio_obj *lobj;
+	struct mio_comp_obj_ops *ops;
+	struct mio_comp_obj_map *map;
+
+	ops = mio_instance->m_driver->md_comp_obj_ops;
+	if (ops->mcoo_writev_layer == NULL)
+		return obj->mo_drv_obj_ops->moo_writev(obj, iov, iovcnt, op);
+	if (iov == NULL || iovcnt <= 0)
+		return -EINVAL;
+	map = comp_obj_map_get(obj);
+	if (map == NULL)
+		return -ENOMEM;
+
+	pthread_mutex_lock(&map->cm_lock);
+	if (!map->cm_loaded)
+		rc = comp_obj_map_layers_load(obj, map);
+	if (rc == 0 && map->cm_nr_layers == 0)
+		rc = -ENOENT;
+	if (rc == 0)
+		rc = comp_obj_map_layer_obj_get(map,
+			&map->cm_layers[0].clm_layer.mcol_oid, &lobj);
+	pthread_mutex_unlock(&map->cm_lock);
+	if (rc < 0)
+		return rc;
+
+	return ops->mcoo_writev_layer(obj, lobj, iov, iovcnt, op);
+}
+
+void mio_composite_obj_map_invalidate(struct mio_obj *obj)
+{
+	struct mio_comp_obj_map *map;
+
+	if (obj == NULL || obj->mo_comp_map == NULL)
+		return;
+
+	map = obj->mo_comp_map;
+	pthread_mutex_lock(&map->cm_lock);
+	comp_obj_map_layers_fini(map);
+	pthread_mutex_unlock(&map->cm_lock);
+}
+
+void mio_comp_obj_map_exts_update(struct mio_obj *obj,
+				  const struct mio_obj_id *layer_id,
+				  int nr_exts, const struct mio_obj_ext *exts,
+				  bool add)
+{
+	int i;
+	int rc = 0;
+	struct mio_comp_obj_map *map;
+	struct comp_obj_layer_map *lmap;
+
+	if (obj == NULL || obj->mo_comp_map == NULL)
+		return;
+
+	map = obj->mo_comp_map;
+	pthread_mutex_lock(&map->cm_lock);
+	lmap = comp_obj_map_layer_find(map, layer_id);
+	if (lmap == NULL || !lmap->clm_loaded)
+		goto exit;
+
+	for (i = 0; i < nr_exts && rc == 0; i++)
+		rc = add? comp_obj_layer_ext_add(lmap, exts + i) :
+			  comp_obj_layer_ext_del(lmap, exts + i);
+	/* Reload the layer next time if the map can't be updated. */
+	if (rc < 0)
+		lmap->clm_loaded = false;
+
+exit:
+	pthread_mutex_unlock(&map->cm_lock);
+}
+
+void mio_comp_obj_map_layer_invalidate(struct mio_obj *obj,
+				       const struct mio_obj_id *layer_id)
+{
+	struct mio_comp_obj_map *map;
+	struct comp_obj_layer_map *lmap;
+
+	if (obj == NULL || obj->mo_comp_map == NULL)
+		return;
+
+	map = obj->mo_comp_map;
+	pthread_mutex_lock(&map->cm_lock);
+	lmap = comp_obj_map_layer_find(map, layer_id);
+	if (lmap != NULL)
+		lmap->clm_loaded = false;
+	pthread_mutex_unlock(&map->cm_lock);
+}
+
+static int comp_obj_ext_cmp(const void *a, const void *b)
+{
+	const struct mio_obj_ext *ext1 = a;
+	const struct mio_obj_ext *ext2 = b;
+
+	if (ext1->moe_off == ext2->moe_off)
+		return 0;
+	return ext1->moe_off < ext2->moe_off? -1 : 1;
+}
+
+/**
+ * Sorts extents and merges overlapping and adjacent ones in place.
+ * Returns the number of extents left.
+ */
+static int comp_obj_exts_coalesce(int nr_exts, struct mio_obj_ext *exts)
+{
+	int i;
+	int nr = 0;
+	struct mio_obj_ext *last;
+
+	qsort(exts, nr_exts, sizeof *exts, comp_obj_ext_cmp);
+	for (i = 0; i < nr_exts; i++) {
+		if (exts[i].moe_size == 0)
+			continue;
+		last = nr == 0? NULL : exts + nr - 1;
+		if (last != NULL && exts[i].moe_off <= comp_obj_ext_end(last)) {
+			if (comp_obj_ext_end(exts + i) > comp_obj_ext_end(last))
+				last->moe_size = comp_obj_ext_end(exts + i) -
+						 last->moe_off;
+			continue;
+		}
+		exts[nr++] = exts[i];
+	}
+	return nr;
+}
+
+/**
+ * Sorts the records to delete and drops duplicates and the ones which
+ * are going to be overwritten by a record in `put` (sorted).
+ */
+static int comp_obj_exts_del_unique(int nr_del, struct mio_obj_ext *del,
+				    int nr_put, const struct mio_obj_ext *put)
+{
+	int i;
+	int j = 0;
+	int nr = 0;
+
+	qsort(del, nr_del, sizeof *del, comp_obj_ext_cmp);
+	for (i = 0; i < nr_del; i++) {
+		if (nr != 0 && del[i].moe_off == del[nr - 1].moe_off)
+			continue;
+		while (j < nr_put && put[j].moe_off < del[i].moe_off)
+			j++;
+		if (j < nr_put && put[j].moe_off == del[i].moe_off)
+			continue;
+		del[nr++] = del[i];
+	}
+	return nr;
+}
+
+/**
+ * Works out the records to put into and delete from a layer's extent
+ * index for adding or deleting extents.
+ *
+ * Added extents are merged with each other and, if the layer is in the
+ * map, with the overlapping or adjacent extents in the map, the records
+ * of those extents are replaced by one covering record.
+ *
+ * Extent records may cover more than what was added by a single call,
+ * so deleting extents by their offsets alone could leave data behind.
+ * Deleting needs the layer's extents: they are taken from the map if
+ * the layer is loaded, otherwise -ENODATA is returned and the caller
+ * plans with mio_comp_obj_exts_del_plan() from the layer's records.
+ *
+ * Records to put are returned in *put and records to delete in *del,
+ * both sorted by offset, the caller frees them.
+ */
+int mio_comp_obj_map_exts_plan(struct mio_obj *obj,
+			       const struct mio_obj_id *layer_id,
+			       int nr_exts, const struct mio_obj_ext *exts,
+			       bool add,
+			       int *nr_put, struct mio_obj_ext **put,
+			       int *nr_del, struct mio_obj_ext **del)
+{
+	int i;
+	int j;
+	int rc = 0;
+	int nr_cached = 0;
+	int np;
+	int nd = 0;
+	int last = -1;
+	struct mio_obj_ext *p;
+	struct mio_obj_ext *d = NULL;
+	struct mio_obj_ext *c;
+	struct mio_comp_obj_map *map = obj->mo_comp_map;
+	struct comp_obj_layer_map *lmap = NULL;
+
+	if (map != NULL) {
+		pthread_mutex_lock(&map->cm_lock);
+		lmap = comp_obj_map_layer_find(map, layer_id);
+		if (lmap != NULL && !lmap->clm_loaded)
+			lmap = NULL;
+		if (lmap != NULL)
+			nr_cached = lmap->clm_nr_exts;
+	}
+
+	if (!add) {
+		rc = lmap == NULL? -ENODATA :
+		     mio_comp_obj_exts_del_plan(nr_exts, exts,
+						nr_cached, lmap->clm_exts,
+						nr_put, put, nr_del, del);
+		goto exit;
+	}
+
+	p = mio_mem_alloc((nr_exts?: 1) * sizeof *p);
+	d = mio_mem_alloc((nr_cached?: 1) * sizeof *d);
+	if (p == NULL || d == NULL) {
+		mio_mem_free(p);
+		mio_mem_free(d);
+		rc = -ENOMEM;
+		goto exit;
+	}
+	mio_mem_copy(p, (void *)exts, nr_exts * sizeof *p);
+	np = comp_obj_exts_coalesce(nr_exts, p);
+	for (i = 0; lmap != NULL && i < np; i++) {
+		j = p[i].moe_off == 0? 0 :
+		    comp_obj_layer_ext_find(lmap, p[i].moe_off - 1);
+		for (; j < nr_cached; j++) {
+			c = lmap->clm_exts + j;
+			if (c->moe_off > comp_obj_ext_end(p + i))
+				break;
+			if (comp_obj_ext_end(c) > comp_obj_ext_end(p + i))
+				p[i].moe_size = comp_obj_ext_end(c) -
+						p[i].moe_off;
+			if (c->moe_off < p[i].moe_off) {
+				p[i].moe_size += p[i].moe_off - c->moe_off;
+				p[i].moe_off = c->moe_off;
+			}
+			/*
+			 * A cached extent may overlap several put
+			 * extents, record it only once.
+			 */
+			if (j > last) {
+				d[nd++] = *c;
+				last = j;
+			}
+		}
+	}
+	/* Neighbours may have bridged some of the extents. */
+	np = comp_obj_exts_coalesce(np, p);
+
+	*nr_put = np;
+	*put = p;
+	*nr_del = comp_obj_exts_del_unique(nd, d, np, p);
+	*del = d;
+
+exit:
+	if (map != NULL)
+		pthread_mutex_unlock(&map->cm_lock);
+	return rc;
+}
+
+/**
+ * Works out the records to put into and delete from a layer's extent
+ * index for deleting extents, given the layer's extents or records
+ * `recs` sorted by offset. The records of the given extents are deleted
+ * as well as the records overlapping them, and what is left of the
+ * latter is put back. Records are returned as in
+ * mio_comp_obj_map_exts_plan().
+ */
+int mio_comp_obj_exts_del_plan(int nr_exts, const struct mio_obj_ext *exts,
+			       int nr_recs, const struct mio_obj_ext *recs,
+			       int *nr_put, struct mio_obj_ext **put,
+			       int *nr_del, struct mio_obj_ext **del)
+{
+	int i;
+	int j;
+	int k = 0;
+	int nr_req;
+	int np = 0;
+	int nd;
+	off_t cur;
+	struct mio_obj_ext *req;
+	struct mio_obj_ext *p;
+	struct mio_obj_ext *d;
+	const struct mio_obj_ext *c;
+
+	req = mio_mem_alloc((nr_exts?: 1) * sizeof *req);
+	p = mio_mem_alloc((2 * nr_recs + nr_exts?: 1) * sizeof *p);
+	d = mio_mem_alloc((nr_exts + nr_recs?: 1) * sizeof *d);
+	if (req == NULL || p == NULL || d == NULL) {
+		mio_mem_free(req);
+		mio_mem_free(p);
+		mio_mem_free(d);
+		return -ENOMEM;
+	}
+	mio_mem_copy(req, (void *)exts, nr_exts * sizeof *req);
+	nr_req = comp_obj_exts_coalesce(nr_exts, req);
+
+	mio_mem_copy(d, (void *)exts, nr_exts * sizeof *d);
+	nd = nr_exts;
+	for (j = 0; j < nr_recs; j++) {
+		c = recs + j;
+		while (k < nr_req && comp_obj_ext_end(req + k) <= c->moe_off)
+			k++;
+		if (k == nr_req || req[k].moe_off >= comp_obj_ext_end(c))
+			continue;
+
+		/* Put back the parts of `c` not deleted. */
+		cur = c->moe_off;
+		for (i = k; i < nr_req && req[i].moe_off < comp_obj_ext_end(c);
+		     i++) {
+			if (req[i].moe_off > cur) {
+				p[np].moe_off = cur;
+				p[np].moe_size = req[i].moe_off - cur;
+				np++;
+			}
+			if (comp_obj_ext_end(req + i) > cur)
+				cur = comp_obj_ext_end(req + i);
+		}
+		if (cur < comp_obj_ext_end(c)) {
+			p[np].moe_off = cur;
+			p[np].moe_size = comp_obj_ext_end(c) - cur;
+			np++;
+		}
+		d[nd++] = *c;
+	}
+	mio_mem_free(req);
+
+	*nr_put = np;
+	*put = p;
+	*nr_del = comp_obj_exts_del_unique(nd, d, np, p);
+	*del = d;
+	return 0;
+}
+
+/**
+ * Works out how to compact the records of a layer's extent index:
+ * overlapping and adjacent records are replaced by one covering record.
+ * `recs` are all records of the layer sorted by offset. Records are
+ * returned as in mio_comp_obj_map_exts_plan().
+ */
+int mio_comp_obj_exts_compact_plan(int nr_recs, const struct mio_obj_ext *recs,
+				   int *nr_put, struct mio_obj_ext **put,
+				   int *nr_del, struct mio_obj_ext **del)
+{
+	int i;
+	int j = 0;
+	int np;
+	int nr_merged;
+	struct mio_obj_ext *p;
+	struct mio_obj_ext *d;
+
+	p = mio_mem_alloc((nr_recs?: 1) * sizeof *p);
+	d = mio_mem_alloc((nr_recs?: 1) * sizeof *d);
+	if (p == NULL || d == NULL) {
+		mio_mem_free(p);
+		mio_mem_free(d);
+		return -ENOMEM;
+	}
+	mio_mem_copy(p, (void *)recs, nr_recs * sizeof *p);
+	mio_mem_copy(d, (void *)recs, nr_recs * sizeof *d);
+	nr_merged = comp_obj_exts_coalesce(nr_recs, p);
+
+	/* Records which don't start a merged extent go away. */
+	*nr_del = comp_obj_exts_del_unique(nr_recs, d, nr_merged, p);
+
+	/* A merged extent which is a record already needn't be put. */
+	for (i = 0, np = 0; i < nr_merged; i++) {
+		while (j < nr_recs && recs[j].moe_off < p[i].moe_off)
+			j++;
+		if (j < nr_recs && recs[j].moe_off == p[i].moe_off &&
+		    recs[j].moe_size == p[i].moe_size)
+			continue;
+		p[np++] = p[i];
+	}
+	*nr_put = np;
+	*put = p;
+	*del = d;
+	return 0;
+}
+
+void mio_comp_obj_map_fini(struct mio_obj *obj)
+{
+	int i;
+	struct mio_comp_obj_map *map = obj->mo_comp_map;
+
+	if (map == NULL)
+		return;
+
+	comp_obj_map_layers_fini(map);
+	for (i = 0; i < map->cm_nr_layer_objs; i++) {
+		mio_obj_close(map->cm_layer_objs[i]);
+		mio_mem_free(map->cm_layer_objs[i]);
+	}
+	mio_mem_free(map->cm_layer_objs);
+	pthread_mutex_destroy(&map->cm_lock);
+	mio_mem_free(map);
+	obj->mo_comp_map = NULL;
+}
+
+/*
+ * Extent iterator.
+ *
+ * A cursor walks the extent index of one layer page by page. As soon as
+ * a page arrives, the next one is read ahead while the current page is
+ * consumed. Records are coalesced on the way, so a cursor yields the
+ * layer's extents in order without overlaps.
+ *
+ * Iterating over all layers merges their cursors: the extent at the
+ * current position comes from the highest priority layer covering the
+ * position and ends where that layer's extent ends or a higher
+ * priority layer's next extent starts, whichever comes first.
+ */
+enum {
+	COMP_OBJ_EXT_ITER_PAGE = 128,
+};
+
+struct comp_obj_ext_cursor {
+	struct mio_obj_id ec_layer_id;
+
+	/* The page being consumed and the one being read ahead. */
+	struct mio_obj_ext *ec_pages[2];
+	int ec_nr_exts[2];
+	int ec_cur;
+	int ec_pos;
+	struct mio_op ec_op;
+	bool ec_reading;
+	/* The page read ahead is the last one. */
+	bool ec_last;
+
+	bool ec_has_peek;
+	struct mio_obj_ext ec_peek;
+	bool ec_has_head;
+	struct mio_obj_ext ec_head;
+	bool ec_done;
+};
+
+struct mio_comp_obj_ext_iter {
+	struct mio_obj *ei_obj;
+	off_t ei_pos;
+	int ei_nr_cursors;
+	struct comp_obj_ext_cursor *ei_cursors;
+};
+
+static int comp_obj_ext_cursor_read(struct mio_obj *obj,
+				    struct comp_obj_ext_cursor *c, off_t off)
+{
+	int rc;
+	int next = 1 - c->ec_cur;
+
+	c->ec_nr_exts[next] = 0;
+	mio_op_init(&c->ec_op);
+	rc = mio_composite_obj_get_extents(obj, &c->ec_layer_id, off,
+					   COMP_OBJ_EXT_ITER_PAGE,
+					   c->ec_pages[next],
+					   c->ec_nr_exts + next, &c->ec_op);
+	if (rc < 0) {
+		mio_op_fini(&c->ec_op);
+		return rc;
+	}
+	c->ec_reading = true;
+	return 0;
+}
+
+/* Waits for the page read ahead, makes it current and reads the next. */
+static int comp_obj_ext_cursor_turn(struct mio_obj *obj,
+				    struct comp_obj_ext_cursor *c)
+{
+	int rc;
+	int nr;
+	struct mio_obj_ext *last;
+
+	rc = mio_op_wait(&c->ec_op);
+	mio_op_fini(&c->ec_op);
+	c->ec_reading = false;
+	if (rc < 0)
+		return rc;
+
+	c->ec_cur = 1 - c->ec_cur;
+	c->ec_pos = 0;
+	nr = c->ec_nr_exts[c->ec_cur];
+	if (nr < COMP_OBJ_EXT_ITER_PAGE) {
+		c->ec_last = true;
+		return 0;
+	}
+
+	/* The start key of NEXT is inclusive. */
+	last = c->ec_pages[c->ec_cur] + nr - 1;
+	return comp_obj_ext_cursor_read(obj, c, last->moe_off + 1);
+}
+
+static int comp_obj_ext_cursor_raw_next(struct mio_obj *obj,
+					struct comp_obj_ext_cursor *c,
+					struct mio_obj_ext *ext)
+{
+	int rc;
+
+	while (1) {
+		if (c->ec_pos < c->ec_nr_exts[c->ec_cur]) {
+			*ext = c->ec_pages[c->ec_cur][c->ec_pos++];
+			if (ext->moe_size == 0)
+				continue;
+			return 0;
+		}
+		if (c->ec_last || !c->ec_reading)
+			return -ENOENT;
+		rc = comp_obj_ext_cursor_turn(obj, c);
+		if (rc < 0)
+			return rc;
+	}
+}
+
+/* Moves the cursor's head to the next coalesced extent. */
+static int comp_obj_ext_cursor_next(struct mio_obj *obj,
+				    struct comp_obj_ext_cursor *c)
+{
+	int rc;
+
+	c->ec_has_head = false;
+	if (!c->ec_has_peek) {
+		rc = comp_obj_ext_cursor_raw_next(obj, c, &c->ec_peek);
+		if (rc == -ENOENT)
+			c->ec_done = true;
+		if (rc < 0)
+			return rc;
+	}
+	c->ec_head = c->ec_peek;
+	c->ec_has_head = true;
+	c->ec_has_peek = false;
+
+	while (1) {
+		rc = comp_obj_ext_cursor_raw_next(obj, c, &c->ec_peek);
+		if (rc == -ENOENT)
+			return 0;
+		if (rc < 0)
+			return rc;
+		if (c->ec_peek.moe_off > comp_obj_ext_end(&c->ec_head)) {
+			c->ec_has_peek = true;
+			return 0;
+		}
+		if (comp_obj_ext_end(&c->ec_peek) >
+		    comp_obj_ext_end(&c->ec_head))
+			c->ec_head.moe_size = comp_obj_ext_end(&c->ec_peek) -
+					      c->ec_head.moe_off;
+	}
+}
+
+/* Makes the cursor's head end after `pos`, unless the cursor is done. */
+static int comp_obj_ext_cursor_seek(struct mio_obj *obj,
+				    struct comp_obj_ext_cursor *c, off_t pos)
+{
+	int rc;
+
+	while (!c->ec_done &&
+	       (!c->ec_has_head || comp_obj_ext_end(&c->ec_head) <= pos)) {
+		rc = comp_obj_ext_cursor_next(obj, c);
+		if (rc < 0 && rc != -ENOENT)
+			return rc;
+	}
+	return 0;
+}
+
+static void comp_obj_ext_cursor_fini(struct comp_obj_ext_cursor *c)
+{
+	if (c->ec_reading) {
+		mio_op_wait(&c->ec_op);
+		mio_op_fini(&c->ec_op);
+	}
+	mio_mem_free(c->ec_pages[0]);
+	mio_mem_free(c->ec_pages[1]);
+}
+
+void mio_composite_obj_ext_iter_fini(struct mio_comp_obj_ext_iter *iter)
+{
+	int i;
+
+	if (iter == NULL)
+		return;
+	for (i = 0; i < iter->ei_nr_cursors; i++)
+		comp_obj_ext_cursor_fini(iter->ei_cursors + i);
+	mio_mem_free(iter->ei_cursors);
+	mio_mem_free(iter);
+}
+
+int mio_composite_obj_ext_iter_init(struct mio_obj *obj,
+				    struct mio_obj_id *layer_id,
+				    struct mio_comp_obj_ext_iter **ret_iter)
+{
+	int i;
+	int rc = 0;
+	struct mio_op op;
+	struct mio_comp_obj_layout layout;
+	struct mio_comp_obj_ext_iter *iter;
+	struct comp_obj_ext_cursor *c;
+
+	if (obj == NULL || ret_iter == NULL)
+		return -EINVAL;
+
+	mio_memset(&layout, 0, sizeof layout);
+	if (layer_id == NULL) {
+		mio_op_init(&op);
+		rc = mio_composite_obj_list_layers(obj, &layout, &op);
+		if (rc < 0)
+			return rc;
+		rc = mio_op_wait(&op);
+		mio_op_fini(&op);
+		if (rc < 0)
+			goto exit;
+	}
+
+	iter = mio_mem_alloc(sizeof *iter);
+	if (iter == NULL) {
+		rc = -ENOMEM;
+		goto exit;
+	}
+	iter->ei_obj = obj;
+	iter->ei_nr_cursors = layer_id != NULL? 1 : layout.mlo_nr_layers;
+	iter->ei_cursors = mio_mem_alloc((iter->ei_nr_cursors?: 1) *
+					 sizeof *c);
+	if (iter->ei_cursors == NULL) {
+		mio_mem_free(iter);
+		rc = -ENOMEM;
+		goto exit;
+	}
+
+	/* Start reading the first page of every layer at once. */
+	for (i = 0; i < iter->ei_nr_cursors; i++) {
+		c = iter->ei_cursors + i;
+		c->ec_layer_id = layer_id != NULL? *layer_id :
+				 layout.mlo_layers[i].mcol_oid;
+		c->ec_pages[0] = mio_mem_alloc(COMP_OBJ_EXT_ITER_PAGE *
+					       sizeof(struct mio_obj_ext));
+		c->ec_pages[1] = mio_mem_alloc(COMP_OBJ_EXT_ITER_PAGE *
+					       sizeof(struct mio_obj_ext));
+		if (c->ec_pages[0] == NULL || c->ec_pages[1] == NULL)
+			rc = -ENOMEM;
+		else
+			rc = comp_obj_ext_cursor_read(obj, c, 0);
+		if (rc < 0) {
+			iter->ei_nr_cursors = i + 1;
+			mio_composite_obj_ext_iter_fini(iter);
+			goto exit;
+		}
+	}
+	*ret_iter = iter;
+
+exit:
+	mio_mem_free(layout.mlo_layers);
+	return rc;
+}
+
+int mio_composite_obj_ext_iter_next(struct mio_comp_obj_ext_iter *iter,
+				    struct mio_obj_ext *ext,
+				    struct mio_obj_id *layer_id)
+{
+	int i;
+	int rc;
+	int best;
+	off_t end;
+	off_t limit;
+	struct comp_obj_ext_cursor *c;
+
+	if (iter == NULL || ext == NULL)
+		return -EINVAL;
+
+	while (1) {
+		best = -1;
+		limit = -1;
+		for (i = 0; i < iter->ei_nr_cursors; i++) {
+			c = iter->ei_cursors + i;
+			rc = comp_obj_ext_cursor_seek(iter->ei_obj, c,
+						      iter->ei_pos);
+			if (rc < 0)
+				return rc;
+			if (c->ec_done)
+				continue;
+			if (c->ec_head.moe_off <= iter->ei_pos) {
+				best = i;
+				break;
+			}
+			/*
+			 * The layer has data further on, which limits
+			 * lower priority layers and skips a hole.
+			 */
+			if (limit < 0 || c->ec_head.moe_off < limit)
+				limit = c->ec_head.moe_off;
+		}
+
+		if (best < 0) {
+			if (limit < 0)
+				return -ENOENT;
+			iter->ei_pos = limit;
+			continue;
+		}
+
+		c = iter->ei_cursors + best;
+		end = comp_obj_ext_end(&c->ec_head);
+		if (limit >= 0 && limit < end)
+			end = limit;
+		ext->moe_off = iter->ei_pos;
+		ext->moe_size = end - iter->ei_pos;
+		if (layer_id != NULL)
+			*layer_id = c->ec_layer_id;
+		iter->ei_pos = end;
+		return 0;
+	}
+}
+
+/*
+ *  Local variables:
+ *  c-indentation-style: "K&R"
+ *  c-basic-offset: 8
+ *  tab-width: 8
+ *  fill-column: 80
+ *  scroll-step: 1
+ *  End:
+ */
+/*
+ * vim: tabstop=8 shiftwidth=8 noexpandtab textwidth=80 nowrap
+ *
+ */
@@ -0,0 +1,172 @@
+/* -*- C -*- */
+/*
+ * Copyright: (c) 2020 - 2021 Seagate Technology LLC and/or its its Affiliates,
+ * All Rights Reserved
+ *
+ * This software is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ */
+
+#include <errno.h>
+#include <assert.h>
+#include <string.h>
+
+#include "logger.h"
+#include "utils.h"
+#include "mio.h"
+#include "mio_internal.h"
+
+/**
+ * Copy-on-write snapshots of composite objects.
+ *
+ * The snapshot object is created first with the object's layers and
+ * priorities, then the new top layer is pushed onto the object. If
+ * anything fails before the new layer is in place the object is left
+ * as it was and the objects created so far are deleted.
+ */
+
+static void comp_obj_snap_obj_delete(const struct mio_obj_id *oid)
+{
+	struct mio_op op;
+
+	mio_op_init(&op);
+	if (mio_obj_delete(oid, &op) == 0)
+		mio_op_wait(&op);
+	mio_op_fini(&op);
+}
+
+static int comp_obj_snap_create(const struct mio_obj_id *snap_id,
+				struct mio_obj *obj,
+				struct mio_comp_obj_layout *layout)
+{
+	int rc;
+	struct mio_op op;
+	struct mio_obj *snap;
+
+	snap = mio_mem_alloc(sizeof *snap);
+	if (snap == NULL)
+		return -ENOMEM;
+
+	mio_op_init(&op);
+	rc = mio_obj_create(snap_id, NULL, NULL, snap, &op)? :
+	     mio_op_wait(&op);
+	mio_op_fini(&op);
+	if (rc < 0)
+		goto exit;
+
+	mio_op_init(&op);
+	rc = mio_composite_obj_create(snap_id, snap, &op)? :
+	     mio_op_wait(&op);
+	mio_op_fini(&op);
+	if (rc == 0 && layout->mlo_nr_layers != 0) {
+		mio_op_init(&op);
+		rc = mio_composite_obj_add_layers(snap, layout->mlo_nr_layers,
+						  layout->mlo_layers, &op)? :
+		     mio_op_wait(&op);
+		mio_op_fini(&op);
+	}
+	if (rc == 0) {
+		snap->mo_attrs.moa_size = obj->mo_attrs.moa_size;
+		snap->mo_attrs_updated = true;
+	}
+	mio_obj_close(snap);
+	if (rc < 0)
+		comp_obj_snap_obj_delete(snap_id);
+
+exit:
+	mio_mem_free(snap);
+	return rc;
+}
+
+static int comp_obj_snap_layer_push(struct mio_obj *obj,
+				    const struct mio_obj_id *layer_id,
+				    struct mio_comp_obj_layout *layout)
+{
+	int rc;
+	struct mio_op op;
+	struct mio_obj *lobj;
+	struct mio_pool_id pool_id;
+	struct mio_pool_id *pool = NULL;
+
+	lobj = mio_mem_alloc(sizeof *lobj);
+	if (lobj == NULL)
+		return -ENOMEM;
+
+	if (mio_obj_pool_id(obj, &pool_id) == 0)
+		pool = &pool_id;
+	mio_op_init(&op);
+	rc = mio_obj_create(layer_id, pool, NULL, lobj, &op)? :
+	     mio_op_wait(&op);
+	mio_op_fini(&op);
+	if (rc < 0)
+		goto exit;
+	rc = mio_comp_obj_layer_prepare(lobj);
+	mio_obj_close(lobj);
+	if (rc < 0) {
+		comp_obj_snap_obj_delete(layer_id);
+		goto exit;
+	}
+
+	rc = mio_comp_obj_layers_push(obj, 1, layer_id, layout);
+	if (rc < 0)
+		comp_obj_snap_obj_delete(layer_id);
+
+exit:
+	mio_mem_free(lobj);
+	return rc;
+}
+
+int mio_obj_snapshot(struct mio_obj *obj,
+		     const struct mio_obj_id *snap_id,
+		     const struct mio_obj_id *layer_id)
+{
+	int rc;
+	struct mio_op op;
+	struct mio_comp_obj_layout layout;
+
+	if (obj == NULL || snap_id == NULL || layer_id == NULL)
+		return -EINVAL;
+	if (obj->mo_read_only)
+		return -EROFS;
+	if (!mio_comp_obj_is_composite(obj))
+		return -EINVAL;
+	/* The drainer writes to lower layers. */
+	if (obj->mo_comp_tier != NULL)
+		return -EBUSY;
+
+	mio_memset(&layout, 0, sizeof layout);
+	mio_op_init(&op);
+	rc = mio_composite_obj_list_layers(obj, &layout, &op)? :
+	     mio_op_wait(&op);
+	mio_op_fini(&op);
+	if (rc < 0)
+		goto exit;
+
+	rc = comp_obj_snap_create(snap_id, obj, &layout);
+	if (rc < 0)
+		goto exit;
+	rc = comp_obj_snap_layer_push(obj, layer_id, &layout);
+	if (rc < 0)
+		comp_obj_snap_obj_delete(snap_id);
+
+exit:
+	if (rc < 0)
+		mio_log(MIO_ERROR, "Taking snapshot failed: %d\n", rc);
+	mio_mem_free(layout.mlo_layers);
+	return rc;
+}
+
+/*
+ *  Local variables:
+ *  c-indentation-style: "K&R"
+ *  c-basic-offset: 8
+ *  tab-width: 8
+ *  fill-column: 80
+ *  scroll-step: 1
+ *  End:
+ */
+/*
+ * vim: tabstop=8 shiftwidth=8 noexpandtab textwidth=80 nowrap
+ *
+ */
@@ -0,0 +1,615 @@
+/* -*- C -*- */
+/*
+ * Copyright: (c) 2020 - 2021 Seagate Technology LLC and/or its its Affiliates,
+ * All Rights Reserved
+ *
+ * This software is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ */
+
+#include <errno.h>
+#include <assert.h>
+#include <string.h>
+#include <pthread.h>
+
+#include "logger.h"
+#include "utils.h"
+#include "mio.h"
+#include "mio_internal.h"
+
+/**
+ * Tiering of composite objects.
+ *
+ * A tiered composite object has a fast layer in the GOLD pool with the
+ * highest priority and a slow layer in the BRONZE pool below it. Writes
+ * are redirected to the fast layer, the driver adds the extents written
+ * to the fast layer's extent index once the data is there.
+ *
+ * The drainer thread wakes up every drain interval and drains objects
+ * which haven't been written for the drain delay. Draining moves the
+ * fast layer's extents chunk by chunk: a chunk is read from the fast
+ * layer, written to the slow layer and added to its extents, then
+ * deleted from the fast layer's extents and its space freed there.
+ *
+ * Moving a chunk out of the fast layer must not race with writes to it,
+ * see struct mio_write_guard. The chunk is only deleted from the fast
+ * layer, under the tier lock, if the object hasn't been written since
+ * the pass started. Otherwise the pass stops and the object is drained
+ * again once it is cold. Writes issued while a chunk is being deleted
+ * wait for the tier lock.
+ */
+
+enum {
+	/* Data is moved from the fast layer by chunks of this size. */
+	COMP_OBJ_TIER_DRAIN_CHUNK = 4 * 1024 * 1024,
+	COMP_OBJ_TIER_EXTS_BATCH = 64,
+	/* In milliseconds. */
+	COMP_OBJ_TIER_DEFAULT_DRAIN_DELAY = 30000,
+	COMP_OBJ_TIER_DEFAULT_DRAIN_INTERVAL = 1000,
+};
+
+struct mio_comp_obj_tier {
+	struct mio_obj *ct_obj;
+	struct mio_obj *ct_fast_obj;
+	struct mio_obj *ct_slow_obj;
+
+	/* Protects the fields below, see above. */
+	pthread_mutex_t ct_lock;
+	bool ct_enabled;
+	struct mio_write_guard ct_writes;
+	/* When the last write was issued, in nano-seconds. */
+	uint64_t ct_wtime;
+	/* The write generation fully drained by the last pass. */
+	uint64_t ct_drained_wgen;
+
+	/* Held by a drain pass. */
+	pthread_mutex_t ct_drain_lock;
+
+	/* The drainer round in which the object was last looked at. */
+	uint64_t ct_round;
+	struct mio_comp_obj_tier *ct_next;
+};
+
+struct comp_obj_tier_drainer {
+	/* The thread's lock and condition protect the fields below too. */
+	struct mio_bg_thread td_thread;
+	/* In nano-seconds, same as mio_now(). */
+	uint64_t td_delay;
+	uint64_t td_interval;
+	struct mio_comp_obj_tier *td_tiers;
+	/* The object being drained by the drainer thread. */
+	struct mio_comp_obj_tier *td_current;
+};
+
+static struct comp_obj_tier_drainer tier_drainer = {
+	.td_thread = MIO_BG_THREAD_INITIALIZER,
+};
+
+#define drv_comp_obj_ops (mio_instance->m_driver->md_comp_obj_ops)
+
+static void comp_obj_tier_layer_obj_close(struct mio_obj *lobj)
+{
+	if (lobj == NULL)
+		return;
+	mio_obj_close(lobj);
+	mio_mem_free(lobj);
+}
+
+static void comp_obj_tier_free(struct mio_comp_obj_tier *tier)
+{
+	pthread_mutex_destroy(&tier->ct_lock);
+	pthread_mutex_destroy(&tier->ct_drain_lock);
+	mio_mem_free(tier);
+}
+
+/**
+ * Opens a layer object, creating it in the pool selected by `where`
+ * (MIO_POOL_GOLD or MIO_POOL_BRONZE) if it doesn't exist, and makes it
+ * ready to be a layer.
+ */
+static int comp_obj_tier_layer_obj_get(const struct mio_obj_id *layer_id,
+				       uint64_t where, struct mio_obj **ret_obj)
+{
+	int rc;
+	struct mio_op op;
+	struct mio_obj *lobj;
+	struct mio_hints hints;
+
+	lobj = mio_mem_alloc(sizeof *lobj);
+	if (lobj == NULL)
+		return -ENOMEM;
+
+	mio_op_init(&op);
+	rc = mio_obj_open(layer_id, lobj, &op)? : mio_op_wait(&op);
+	mio_op_fini(&op);
+	if (rc != -ENOENT)
+		goto exit;
+
+	rc = mio_hints_init(&hints);
+	if (rc < 0)
+		goto exit;
+	mio_op_init(&op);
+	rc = mio_hint_add(&hints, MIO_HINT_OBJ_WHERE, where)? :
+	     mio_obj_create(layer_id, NULL, &hints, lobj, &op)? :
+	     mio_op_wait(&op);
+	mio_op_fini(&op);
+	mio_hints_fini(&hints);
+
+exit:
+	if (rc == 0) {
+		rc = mio_comp_obj_layer_prepare(lobj);
+		if (rc < 0)
+			mio_obj_close(lobj);
+	}
+	if (rc < 0) {
+		mio_log(MIO_ERROR, "Opening tiering layer failed: %d\n", rc);
+		mio_mem_free(lobj);
+		return rc;
+	}
+	*ret_obj = lobj;
+	return 0;
+}
+
+/**
+ * Adds the fast and slow layers to the composite object unless it has
+ * them already. They are pushed above the object's other layers, as
+ * snapshots and migrations do, the fast layer on top. A slow layer can
+ * only go above an existing fast layer, which would hide the data not
+ * drained yet, so a fast layer without the slow one is refused.
+ */
+static int comp_obj_tier_layers_add(struct mio_obj *obj,
+				    const struct mio_obj_id *fast_id,
+				    const struct mio_obj_id *slow_id)
+{
+	int i;
+	int rc;
+	int nr_layers = 0;
+	bool has_fast = false;
+	bool has_slow = false;
+	struct mio_op op;
+	struct mio_obj_id ids[2];
+	struct mio_comp_obj_layer *layer;
+	struct mio_comp_obj_layout layout;
+
+	mio_memset(&layout, 0, sizeof layout);
+	mio_op_init(&op);
+	rc = mio_composite_obj_list_layers(obj, &layout, &op)? :
+	     mio_op_wait(&op);
+	mio_op_fini(&op);
+	if (rc < 0)
+		goto exit;
+
+	for (i = 0; i < layout.mlo_nr_layers; i++) {
+		layer = layout.mlo_layers + i;
+		if (!memcmp(layer->mcol_oid.moi_bytes, fast_id->moi_bytes,
+			    MIO_OBJ_ID_LEN))
+			has_fast = true;
+		else if (!memcmp(layer->mcol_oid.moi_bytes, slow_id->moi_bytes,
+				 MIO_OBJ_ID_LEN))
+			has_slow = true;
+	}
+
+	if (has_fast && !has_slow) {
+		rc = -EINVAL;
+		goto exit;
+	}
+	if (!has_fast)
+		ids[nr_layers++] = *fast_id;
+	if (!has_slow)
+		ids[nr_layers++] = *slow_id;
+	if (nr_layers != 0)
+		rc = mio_comp_obj_layers_push(obj, nr_layers, ids, &layout);
+
+exit:
+	mio_mem_free(layout.mlo_layers);
+	return rc;
+}
+
+static void comp_obj_tier_drainer_run();
+
+/* Must be called with the drainer lock held. */
+static int comp_obj_tier_drainer_start()
+{
+	int rc;
+	uint64_t delay;
+	uint64_t interval;
+
+	if (tier_drainer.td_thread.bt_started)
+		return 0;
+
+	delay = mio_instance->m_comp_obj_tier_drain_delay?:
+		COMP_OBJ_TIER_DEFAULT_DRAIN_DELAY;
+	interval = mio_instance->m_comp_obj_tier_drain_interval?:
+		   COMP_OBJ_TIER_DEFAULT_DRAIN_INTERVAL;
+	tier_drainer.td_delay = delay * 1000000ULL;
+	tier_drainer.td_interval = interval * 1000000ULL;
+	rc = mio_bg_thread_start(&tier_drainer.td_thread,
+				 comp_obj_tier_drainer_run);
+	if (rc < 0)
+		mio_log(MIO_ERROR, "Starting tiering drainer failed: %d\n", rc);
+	return rc;
+}
+
+int mio_composite_obj_tier_enable(struct mio_obj *obj,
+				  const struct mio_obj_id *fast_id,
+				  const struct mio_obj_id *slow_id)
+{
+	int rc;
+	struct mio_comp_obj_tier *tier;
+
+	rc = mio_instance_check();
+	if (rc < 0)
+		return rc;
+	if (obj == NULL || fast_id == NULL || slow_id == NULL ||
+	    !memcmp(fast_id->moi_bytes, slow_id->moi_bytes, MIO_OBJ_ID_LEN))
+		return -EINVAL;
+	if (obj->mo_comp_tier != NULL)
+		return -EEXIST;
+	if (!mio_comp_obj_is_composite(obj))
+		return -EINVAL;
+	if (drv_comp_obj_ops->mcoo_writev_layer == NULL ||
+	    drv_comp_obj_ops->mcoo_free_layer_data == NULL)
+		return -EOPNOTSUPP;
+
+	tier = mio_mem_alloc(sizeof *tier);
+	if (tier == NULL)
+		return -ENOMEM;
+	tier->ct_obj = obj;
+	tier->ct_enabled = true;
+	/* Whatever a previous session left in the fast layer is drained. */
+	tier->ct_drained_wgen = ~0ULL;
+	pthread_mutex_init(&tier->ct_lock, NULL);
+	pthread_mutex_init(&tier->ct_drain_lock, NULL);
+
+	rc = comp_obj_tier_layer_obj_get(fast_id, MIO_POOL_GOLD,
+					 &tier->ct_fast_obj)? :
+	     comp_obj_tier_layer_obj_get(slow_id, MIO_POOL_BRONZE,
+					 &tier->ct_slow_obj)? :
+	     comp_obj_tier_layers_add(obj, fast_id, slow_id);
+	if (rc < 0)
+		goto error;
+
+	pthread_mutex_lock(&tier_drainer.td_thread.bt_lock);
+	rc = comp_obj_tier_drainer_start();
+	if (rc == 0) {
+		tier->ct_next = tier_drainer.td_tiers;
+		tier_drainer.td_tiers = tier;
+		obj->mo_comp_tier = tier;
+	}
+	pthread_mutex_unlock(&tier_drainer.td_thread.bt_lock);
+	if (rc < 0)
+		goto error;
+	return 0;
+
+error:
+	comp_obj_tier_layer_obj_close(tier->ct_fast_obj);
+	comp_obj_tier_layer_obj_close(tier->ct_slow_obj);
+	comp_obj_tier_free(tier);
+	return rc;
+}
+
+void mio_composite_obj_tier_disable(struct mio_obj *obj)
+{
+	bool busy;
+	struct mio_comp_obj_tier *tier;
+	struct mio_comp_obj_tier **prev;
+
+	if (obj == NULL || obj->mo_comp_tier == NULL)
+		return;
+	tier = obj->mo_comp_tier;
+	obj->mo_comp_tier = NULL;
+
+	/* Wait for the drainer to be done with the object. */
+	pthread_mutex_lock(&tier_drainer.td_thread.bt_lock);
+	for (prev = &tier_drainer.td_tiers; *prev != NULL;
+	     prev = &(*prev)->ct_next)
+		if (*prev == tier) {
+			*prev = tier->ct_next;
+			break;
+		}
+	while (tier_drainer.td_current == tier)
+		pthread_cond_wait(&tier_drainer.td_thread.bt_cond,
+				  &tier_drainer.td_thread.bt_lock);
+	pthread_mutex_unlock(&tier_drainer.td_thread.bt_lock);
+
+	/* And for a drain pass issued by the application. */
+	pthread_mutex_lock(&tier->ct_drain_lock);
+	pthread_mutex_unlock(&tier->ct_drain_lock);
+
+	comp_obj_tier_layer_obj_close(tier->ct_fast_obj);
+	comp_obj_tier_layer_obj_close(tier->ct_slow_obj);
+
+	/* Ops of the last writes may not be finalised yet. */
+	pthread_mutex_lock(&tier->ct_lock);
+	tier->ct_enabled = false;
+	busy = mio_write_guard_busy(&tier->ct_writes);
+	pthread_mutex_unlock(&tier->ct_lock);
+	if (!busy)
+		comp_obj_tier_free(tier);
+}
+
+static int comp_obj_tier_write_fini(struct mio_driver_op *dop)
+{
+	bool release;
+	struct mio_comp_obj_tier *tier;
+
+	tier = (struct mio_comp_obj_tier *)dop->mdo_op_args;
+	pthread_mutex_lock(&tier->ct_lock);
+	release = mio_write_guard_end(&tier->ct_writes) && !tier->ct_enabled;
+	pthread_mutex_unlock(&tier->ct_lock);
+	if (release)
+		comp_obj_tier_free(tier);
+	return 0;
+}
+
+int mio_comp_obj_tier_writev(struct mio_obj *obj,
+			     const struct mio_iovec *iov, int iovcnt,
+			     struct mio_op *op)
+{
+	int rc;
+	struct mio_comp_obj_tier *tier = obj->mo_comp_tier;
+
+	rc = mio_driver_op_add_fini(op, comp_obj_tier_write_fini, tier);
+	if (rc < 0)
+		return rc;
+
+	pthread_mutex_lock(&tier->ct_lock);
+	mio_write_guard_begin(&tier->ct_writes);
+	tier->ct_wtime = mio_now();
+	pthread_mutex_unlock(&tier->ct_lock);
+
+	return drv_comp_obj_ops->mcoo_writev_layer(obj, tier->ct_fast_obj,
+						   iov, iovcnt, op);
+}
+
+/**
+ * Moves [off, off + len) from the fast layer to the slow layer. The
+ * chunk is left in the fast layer if the object has been written since
+ * the drain pass started, a copy in the slow layer doesn't matter as the
+ * fast layer takes precedence.
+ */
+static int comp_obj_tier_chunk_move(struct mio_comp_obj_tier *tier,
+				    uint64_t wgen, off_t off, size_t len,
+				    char *buf)
+{
+	int rc;
+	struct mio_op op;
+	struct mio_iovec iov;
+	struct mio_obj_ext ext;
+	struct mio_obj *obj = tier->ct_obj;
+
+	iov.miov_base = buf;
+	iov.miov_off = off;
+	iov.miov_len = len;
+	ext.moe_off = off;
+	ext.moe_size = len;
+
+	mio_op_init(&op);
+	rc = mio_obj_readv(tier->ct_fast_obj, &iov, 1, &op)? :
+	     mio_op_wait(&op);
+	mio_op_fini(&op);
+	if (rc < 0)
+		return rc;
+
+	mio_op_init(&op);
+	rc = mio_obj_writev(tier->ct_slow_obj, &iov, 1, &op)? :
+	     mio_op_wait(&op);
+	mio_op_fini(&op);
+	if (rc < 0)
+		return rc;
+
+	mio_op_init(&op);
+	rc = mio_composite_obj_add_extents(obj, &tier->ct_slow_obj->mo_id,
+					   1, &ext, &op)? :
+	     mio_op_wait(&op);
+	mio_op_fini(&op);
+	if (rc < 0)
+		return rc;
+
+	pthread_mutex_lock(&tier->ct_lock);
+	if (mio_write_guard_changed(&tier->ct_writes, wgen)) {
+		rc = -EBUSY;
+		goto exit;
+	}
+
+	mio_op_init(&op);
+	rc = mio_composite_obj_del_extents(obj, &tier->ct_fast_obj->mo_id,
+					   1, &ext, &op)? :
+	     mio_op_wait(&op);
+	mio_op_fini(&op);
+	if (rc < 0)
+		goto exit;
+
+	mio_op_init(&op);
+	rc = mio_obj_op_init(&op, obj, MIO_COMP_OBJ_DEL_EXTENTS)? :
+	     drv_comp_obj_ops->mcoo_free_layer_data(obj, tier->ct_fast_obj,
+						    1, &ext, &op)? :
+	     mio_op_wait(&op);
+	mio_op_fini(&op);
+
+exit:
+	pthread_mutex_unlock(&tier->ct_lock);
+	return rc;
+}
+
+/**
+ * Lists the fast layer's extents. They are collected before any of them
+ * is moved, as moving trims the extent records being iterated over.
+ */
+static int comp_obj_tier_fast_exts_get(struct mio_comp_obj_tier *tier,
+				       int *ret_nr_exts,
+				       struct mio_obj_ext **ret_exts)
+{
+	int rc;
+	int nr_exts = 0;
+	int max_nr_exts = 0;
+	struct mio_obj_ext ext;
+	struct mio_obj_ext *exts = NULL;
+	struct mio_obj_ext *new_exts;
+	struct mio_comp_obj_ext_iter *iter;
+
+	rc = mio_composite_obj_ext_iter_init(tier->ct_obj,
+					     &tier->ct_fast_obj->mo_id, &iter);
+	if (rc < 0)
+		return rc;
+
+	while ((rc = mio_composite_obj_ext_iter_next(iter, &ext, NULL)) == 0) {
+		if (nr_exts == max_nr_exts) {
+			max_nr_exts += COMP_OBJ_TIER_EXTS_BATCH;
+			new_exts = mio_mem_alloc(max_nr_exts * sizeof *exts);
+			if (new_exts == NULL) {
+				rc = -ENOMEM;
+				break;
+			}
+			if (nr_exts != 0)
+				mio_mem_copy(new_exts, exts,
+					     nr_exts * sizeof *exts);
+			mio_mem_free(exts);
+			exts = new_exts;
+		}
+		exts[nr_exts++] = ext;
+	}
+	mio_composite_obj_ext_iter_fini(iter);
+
+	if (rc != -ENOENT) {
+		mio_mem_free(exts);
+		return rc;
+	}
+	*ret_nr_exts = nr_exts;
+	*ret_exts = exts;
+	return 0;
+}
+
+static int comp_obj_tier_drain(struct mio_comp_obj_tier *tier)
+{
+	int i;
+	int rc;
+	int nr_exts = 0;
+	off_t off;
+	off_t end;
+	size_t len;
+	uint64_t wgen;
+	char *buf = NULL;
+	struct mio_obj_ext *exts = NULL;
+
+	pthread_mutex_lock(&tier->ct_drain_lock);
+
+	pthread_mutex_lock(&tier->ct_lock);
+	rc = mio_write_guard_pass_start(&tier->ct_writes, &wgen);
+	pthread_mutex_unlock(&tier->ct_lock);
+	if (rc < 0)
+		goto exit;
+
+	rc = comp_obj_tier_fast_exts_get(tier, &nr_exts, &exts);
+	if (rc < 0 || nr_exts == 0)
+		goto done;
+
+	buf = mio_mem_alloc(COMP_OBJ_TIER_DRAIN_CHUNK);
+	if (buf == NULL) {
+		rc = -ENOMEM;
+		goto exit;
+	}
+	for (i = 0; i < nr_exts && rc == 0; i++) {
+		end = exts[i].moe_off + exts[i].moe_size;
+		for (off = exts[i].moe_off; off < end && rc == 0; off += len) {
+			len = end - off;
+			if (len > COMP_OBJ_TIER_DRAIN_CHUNK)
+				len = COMP_OBJ_TIER_DRAIN_CHUNK;
+			rc = comp_obj_tier_chunk_move(tier, wgen,
+						      off, len, buf);
+		}
+	}
+
+done:
+	if (rc == 0) {
+		pthread_mutex_lock(&tier->ct_lock);
+		tier->ct_drained_wgen = wgen;
+		pthread_mutex_unlock(&tier->ct_lock);
+	}
+exit:
+	pthread_mutex_unlock(&tier->ct_drain_lock);
+	mio_mem_free(buf);
+	mio_mem_free(exts);
+	return rc;
+}
+
+int mio_composite_obj_tier_drain(struct mio_obj *obj)
+{
+	if (obj == NULL || obj->mo_comp_tier == NULL)
+		return -EINVAL;
+	return comp_obj_tier_drain(obj->mo_comp_tier);
+}
+
+/* An object is cold if it has not been written for the drain delay. */
+static bool comp_obj_tier_is_cold(struct mio_comp_obj_tier *tier,
+				  uint64_t now)
+{
+	bool cold;
+
+	pthread_mutex_lock(&tier->ct_lock);
+	cold = !mio_write_guard_busy(&tier->ct_writes) &&
+	       tier->ct_writes.wg_gen != tier->ct_drained_wgen &&
+	       now - tier->ct_wtime >= tier_drainer.td_delay;
+	pthread_mutex_unlock(&tier->ct_lock);
+	return cold;
+}
+
+/**
+ * Each round drains the cold objects once. The list may change while an
+ * object is being drained, so it is scanned from the start again after
+ * each drain, skipping objects already looked at in this round.
+ */
+static void comp_obj_tier_drainer_run()
+{
+	int rc;
+	uint64_t round = 0;
+	struct mio_comp_obj_tier *tier;
+	struct mio_bg_thread *bt = &tier_drainer.td_thread;
+
+	pthread_mutex_lock(&bt->bt_lock);
+	while (!bt->bt_stopping) {
+		mio_bg_thread_wait(bt, tier_drainer.td_interval);
+		round++;
+again:
+		for (tier = tier_drainer.td_tiers;
+		     tier != NULL && !bt->bt_stopping;
+		     tier = tier->ct_next) {
+			if (tier->ct_round == round)
+				continue;
+			tier->ct_round = round;
+			if (!comp_obj_tier_is_cold(tier, mio_now()))
+				continue;
+
+			tier_drainer.td_current = tier;
+			pthread_mutex_unlock(&bt->bt_lock);
+			rc = comp_obj_tier_drain(tier);
+			if (rc < 0 && rc != -EBUSY)
+				mio_log(MIO_WARN,
+					"Draining fast layer failed: %d\n", rc);
+			pthread_mutex_lock(&bt->bt_lock);
+			tier_drainer.td_current = NULL;
+			pthread_cond_broadcast(&bt->bt_cond);
+			goto again;
+		}
+	}
+	pthread_mutex_unlock(&bt->bt_lock);
+}
+
+void mio_comp_obj_tier_sys_fini()
+{
+	mio_bg_thread_stop(&tier_drainer.td_thread);
+}
+
+/*
+ *  Local variables:
+ *  c-indentation-style: "K&R"
+ *  c-basic-offset: 8
+ *  tab-width: 8
+ *  fill-column: 80
+ *  scroll-step: 1
+ *  End:
+ */
+/*
+ * vim: tabstop=8 shiftwidth=8 noexpandtab textwidth=80 nowrap
+ */
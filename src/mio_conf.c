@@ -52,6 +52,19 @@ enum conf_key {
 	MIO_DRIVER,
 	MIO_TELEMETRY_STORE,
 	MIO_TELEMETRY_PREFIX,
+	MIO_OBJ_ATTRS_CACHE_TTL,
+	MIO_OBJ_ATTRS_CACHE_SIZE,
+	MIO_COMP_OBJ_TIER_DRAIN_DELAY,
+	MIO_COMP_OBJ_TIER_DRAIN_INTERVAL,
+	MIO_OBJ_TIERING,
+	MIO_OBJ_TIERING_SCAN_INTERVAL,
+	MIO_OBJ_TIERING_BANDWIDTH,
+	MIO_POOL_STATE_REFRESH_INTERVAL,
+	MIO_POOL_HIGH_WATERMARK,
+	MIO_SYS_HINTS_REFRESH_INTERVAL,
+	MIO_OBJ_REAPER,
+	MIO_OBJ_REAPER_INTERVAL,
+	MIO_OBJ_REAPER_RATE,
 
 	/* Motr driver. "MOTR_CONFIG" is the key for Motr section. */
 	MOTR_CONFIG,
@@ -66,10 +79,13 @@ enum conf_key {
 	MOTR_MAX_IOSIZE_PER_DEV,
 	MOTR_DEFAULT_UNIT_SIZE,
 	MOTR_USER_GROUP,
+	MOTR_OBJ_ATTRS_NR_SHARDS,
+	MOTR_INLINE_DATA_THRESHOLD,
 	MOTR_POOLS,
 	MOTR_POOL_NAME,
 	MOTR_POOL_ID,
 	MOTR_POOL_TYPE,
+	MOTR_POOL_CAPACITY,
 	MOTR_POOL_DEFAULT,
 
 	/* Other drivers such as Ceph defined here. */
@@ -116,6 +132,58 @@ struct conf_entry conf_table[] = {
 		.name = "MIO_TELEMETRY_PREFIX",
 		.type = MIO
 	},
+	[MIO_OBJ_ATTRS_CACHE_TTL] = {
+		.name = "MIO_OBJ_ATTRS_CACHE_TTL",
+		.type = MIO
+	},
+	[MIO_OBJ_ATTRS_CACHE_SIZE] = {
+		.name = "MIO_OBJ_ATTRS_CACHE_SIZE",
+		.type = MIO
+	},
+	[MIO_COMP_OBJ_TIER_DRAIN_DELAY] = {
+		.name = "MIO_COMP_OBJ_TIER_DRAIN_DELAY",
+		.type = MIO
+	},
+	[MIO_COMP_OBJ_TIER_DRAIN_INTERVAL] = {
+		.name = "MIO_COMP_OBJ_TIER_DRAIN_INTERVAL",
+		.type = MIO
+	},
+	[MIO_OBJ_TIERING] = {
+		.name = "MIO_OBJ_TIERING",
+		.type = MIO
+	},
+	[MIO_OBJ_TIERING_SCAN_INTERVAL] = {
+		.name = "MIO_OBJ_TIERING_SCAN_INTERVAL",
+		.type = MIO
+	},
+	[MIO_OBJ_TIERING_BANDWIDTH] = {
+		.name = "MIO_OBJ_TIERING_BANDWIDTH",
+		.type = MIO
+	},
+	[MIO_POOL_STATE_REFRESH_INTERVAL] = {
+		.name = "MIO_POOL_STATE_REFRESH_INTERVAL",
+		.type = MIO
+	},
+	[MIO_POOL_HIGH_WATERMARK] = {
+		.name = "MIO_POOL_HIGH_WATERMARK",
+		.type = MIO
+	},
+	[MIO_SYS_HINTS_REFRESH_INTERVAL] = {
+		.name = "MIO_SYS_HINTS_REFRESH_INTERVAL",
+		.type = MIO
+	},
+	[MIO_OBJ_REAPER] = {
+		.name = "MIO_OBJ_REAPER",
+		.type = MIO
+	},
+	[MIO_OBJ_REAPER_INTERVAL] = {
+		.name = "MIO_OBJ_REAPER_INTERVAL",
+		.type = MIO
+	},
+	[MIO_OBJ_REAPER_RATE] = {
+		.name = "MIO_OBJ_REAPER_RATE",
+		.type = MIO
+	},
 
 	/* Motr driver. */
 	[MOTR_CONFIG] = {
@@ -166,6 +234,14 @@ struct conf_entry conf_table[] = {
 		.name = "MOTR_USER_GROUP",
 		.type = MOTR
 	},
+	[MOTR_OBJ_ATTRS_NR_SHARDS] = {
+		.name = "MOTR_OBJ_ATTRS_NR_SHARDS",
+		.type = MOTR
+	},
+	[MOTR_INLINE_DATA_THRESHOLD] = {
+		.name = "MOTR_INLINE_DATA_THRESHOLD",
+		.type = MOTR
+	},
 	[MOTR_POOL_DEFAULT] = {
 		.name = "MOTR_POOL_DEFAULT",
 		.type = MOTR
@@ -186,6 +262,10 @@ struct conf_entry conf_table[] = {
 		.name = "MOTR_POOL_TYPE",
 		.type = MOTR
 	},
+	[MOTR_POOL_CAPACITY] = {
+		.name = "MOTR_POOL_CAPACITY",
+		.type = MOTR
+	},
 };
 
 enum conf_block_sequence {
@@ -298,9 +378,11 @@ static int conf_alloc_driver(int key)
 		mio_driver_confs[MIO_MOTR] = motr_conf;
 		if (motr_conf == NULL)
 			rc = -ENOMEM;
-		else
+		else {
 			motr_conf->mc_max_iosize_per_dev =
 				MIO_MOTR_DEFAULT_IOSIZE_PER_DEV;
+			motr_conf->mc_obj_attrs_nr_shards = 0;
+		}
 		break;
 	case CEPH:
 		fprintf(stderr, "Ceph driver is not supported yet!");
@@ -471,6 +553,69 @@ static int conf_extract_value(enum conf_key key, char *value, int vlen)
 		assert(mio_instance != NULL && value != NULL);
 		rc = conf_copy_str(&mio_instance->m_log_dir, value, vlen);
 		break;
+	case MIO_OBJ_ATTRS_CACHE_TTL:
+		assert(mio_instance != NULL && value != NULL);
+		mio_instance->m_obj_attrs_cache_ttl = strtoull(value, NULL, 0);
+		break;
+	case MIO_OBJ_ATTRS_CACHE_SIZE:
+		assert(mio_instance != NULL && value != NULL);
+		mio_instance->m_obj_attrs_cache_size = atoi(value);
+		if (mio_instance->m_obj_attrs_cache_size < 0)
+			rc = -EINVAL;
+		break;
+	case MIO_COMP_OBJ_TIER_DRAIN_DELAY:
+		assert(mio_instance != NULL && value != NULL);
+		mio_instance->m_comp_obj_tier_drain_delay =
+			strtoull(value, NULL, 0);
+		break;
+	case MIO_COMP_OBJ_TIER_DRAIN_INTERVAL:
+		assert(mio_instance != NULL && value != NULL);
+		mio_instance->m_comp_obj_tier_drain_interval =
+			strtoull(value, NULL, 0);
+		break;
+	case MIO_OBJ_TIERING:
+		assert(mio_instance != NULL && value != NULL);
+		mio_instance->m_obj_tiering = atoi(value) != 0;
+		break;
+	case MIO_OBJ_TIERING_SCAN_INTERVAL:
+		assert(mio_instance != NULL && value != NULL);
+		mio_instance->m_obj_tiering_scan_interval =
+			strtoull(value, NULL, 0);
+		break;
+	case MIO_OBJ_TIERING_BANDWIDTH:
+		assert(mio_instance != NULL && value != NULL);
+		mio_instance->m_obj_tiering_bandwidth =
+			strtoull(value, NULL, 0);
+		break;
+	case MIO_POOL_STATE_REFRESH_INTERVAL:
+		assert(mio_instance != NULL && value != NULL);
+		mio_instance->m_pool_state_refresh_interval =
+			strtoull(value, NULL, 0);
+		break;
+	case MIO_POOL_HIGH_WATERMARK:
+		assert(mio_instance != NULL && value != NULL);
+		mio_instance->m_pool_high_watermark = atoi(value);
+		if (mio_instance->m_pool_high_watermark < 0 ||
+		    mio_instance->m_pool_high_watermark > 100)
+			rc = -EINVAL;
+		break;
+	case MIO_SYS_HINTS_REFRESH_INTERVAL:
+		assert(mio_instance != NULL && value != NULL);
+		mio_instance->m_sys_hints_refresh_interval =
+			strtoull(value, NULL, 0);
+		break;
+	case MIO_OBJ_REAPER:
+		assert(mio_instance != NULL && value != NULL);
+		mio_instance->m_obj_reaper = atoi(value) != 0;
+		break;
+	case MIO_OBJ_REAPER_INTERVAL:
+		assert(mio_instance != NULL && value != NULL);
+		mio_instance->m_obj_reaper_interval = strtoull(value, NULL, 0);
+		break;
+	case MIO_OBJ_REAPER_RATE:
+		assert(mio_instance != NULL && value != NULL);
+		mio_instance->m_obj_reaper_rate = strtoull(value, NULL, 0);
+		break;
 	case MOTR_INST_ADDR:
 		rc = conf_copy_str(&motr_conf->mc_motr_local_addr, value, vlen);
 		break;
@@ -506,6 +651,20 @@ static int conf_extract_value(enum conf_key key, char *value, int vlen)
 	case MOTR_USER_GROUP:
 		rc = conf_copy_str(&motr_conf->mc_motr_group, value, vlen);
 		break;
+	case MOTR_OBJ_ATTRS_NR_SHARDS:
+		motr_conf->mc_obj_attrs_nr_shards = atoi(value);
+		if (motr_conf->mc_obj_attrs_nr_shards < 0 ||
+		    motr_conf->mc_obj_attrs_nr_shards >
+		    MIO_MOTR_MAX_OBJ_ATTRS_SHARDS)
+			rc = -EINVAL;
+		break;
+	case MOTR_INLINE_DATA_THRESHOLD:
+		motr_conf->mc_inline_data_threshold = atoi(value);
+		if (motr_conf->mc_inline_data_threshold < 0 ||
+		    motr_conf->mc_inline_data_threshold >
+		    MIO_MOTR_MAX_INLINE_DATA)
+			rc = -EINVAL;
+		break;
 	case MOTR_POOL_DEFAULT:
 		slen = strnlen(value, MIO_POOL_MAX_NAME_LEN);
 		if (slen > MIO_POOL_MAX_NAME_LEN)
@@ -529,6 +688,10 @@ static int conf_extract_value(enum conf_key key, char *value, int vlen)
 		pool = mio_pools.mps_pools + mio_pools.mps_nr_pools - 1;
 		rc = conf_extract_pool_type(&pool->mp_type, value);
 		break;
+	case MOTR_POOL_CAPACITY:
+		pool = mio_pools.mps_pools + mio_pools.mps_nr_pools - 1;
+		pool->mp_capacity = strtoull(value, NULL, 0);
+		break;
 	default:
 		break;
 	}
@@ -18,16 +18,11 @@
 
 static struct mio_driver mio_drivers[MIO_DRIVER_NUM];
 
-/**
- * This function must be called in each driver specific operation
- * functions for object, key/value and others before launching
- * the operations to add driver specific operation into the chain.
- */
-int mio_driver_op_add(struct mio_op *op,
-		      mio_driver_op_postprocess post_proc,
-		      void *post_proc_data,
-		      mio_driver_op_fini op_fini,
-		      void *drv_op, void *drv_op_args)
+static struct mio_driver_op *
+driver_op_alloc_add(struct mio_op *op,
+		    mio_driver_op_postprocess post_proc,
+		    void *post_proc_data,
+		    mio_driver_op_fini op_fini, void *drv_op_args)
 {
 	struct mio_driver_op *dop;
 
@@ -35,14 +30,13 @@ int mio_driver_op_add(struct mio_op *op,
 
 	dop = (struct mio_driver_op *)mio_mem_alloc(sizeof *dop);
 	if (dop == NULL)
-		return -ENOMEM;
+		return NULL;
 
 	/*
  	 * Set driver op's action function such as post-processing
  	 * for key/value set GET query. See struct mio_driver_op
  	 * for details.
  	 */
-	dop->mdo_op = drv_op;
 	dop->mdo_op_args = drv_op_args;
 	dop->mdo_post_proc = post_proc;
 	dop->mdo_post_proc_data = post_proc_data;
@@ -51,7 +45,11 @@ int mio_driver_op_add(struct mio_op *op,
 	/* Insert into the chain. */
 	dop->mdo_next = op->mop_drv_op_chain.mdoc_head;
 	op->mop_drv_op_chain.mdoc_head = dop;
+	return dop;
+}
 
+static void driver_op_set_cbs(struct mio_op *op)
+{
 	/*
 	 * Set driver operation's callbacks which will invoke real
 	 * application set callbacks when all job of MIO op is done.
@@ -61,7 +59,99 @@ int mio_driver_op_add(struct mio_op *op,
 	    op->mop_app_cbs.moc_cb_failed != NULL) {
 		op->mop_op_ops->mopo_set_cbs(op);
 	}
+}
+
+/**
+ * This function must be called in each driver specific operation
+ * functions for object, key/value and others before launching
+ * the operations to add driver specific operation into the chain.
+ */
+int mio_driver_op_add(struct mio_op *op,
+		      mio_driver_op_postprocess post_proc,
+		      void *post_proc_data,
+		      mio_driver_op_fini op_fini,
+		      void *drv_op, void *drv_op_args)
+{
+	struct mio_driver_op *dop;
+
+	dop = driver_op_alloc_add(op, post_proc, post_proc_data,
+				  op_fini, drv_op_args);
+	if (dop == NULL)
+		return -ENOMEM;
+	dop->mdo_op = drv_op;
+	dop->mdo_nr_ops = 1;
+
+	driver_op_set_cbs(op);
+	return 0;
+}
+
+/**
+ * Adds a driver op with nothing to launch, which is completed as soon
+ * as it is added. If callbacks are set, they are invoked before this
+ * function returns.
+ */
+int mio_driver_op_add_done(struct mio_op *op)
+{
+	struct mio_driver_op *dop;
+
+	dop = driver_op_alloc_add(op, NULL, NULL, NULL, NULL);
+	if (dop == NULL)
+		return -ENOMEM;
+	dop->mdo_op = NULL;
+	dop->mdo_nr_ops = 0;
+
+	driver_op_set_cbs(op);
+	return 0;
+}
+
+/**
+ * Similar to mio_driver_op_add(), but adds a group of driver specific
+ * operations which are launched together. See mio_driver_op::mdo_ops.
+ */
+int mio_driver_op_add_fini(struct mio_op *op,
+			   mio_driver_op_fini op_fini, void *drv_op_args)
+{
+	struct mio_driver_op *dop;
+
+	assert(op_fini != NULL);
+	dop = driver_op_alloc_add(op, NULL, NULL, op_fini, drv_op_args);
+	if (dop == NULL)
+		return -ENOMEM;
+	dop->mdo_op = NULL;
+	dop->mdo_nr_ops = 0;
+	return 0;
+}
+
+int mio_driver_op_group_add(struct mio_op *op,
+			    mio_driver_op_postprocess post_proc,
+			    void *post_proc_data,
+			    mio_driver_op_fini op_fini,
+			    int nr_drv_ops, void **drv_ops,
+			    void *drv_op_args)
+{
+	struct mio_driver_op *dop;
+	void **ops;
+
+	assert(post_proc != NULL);
+	if (nr_drv_ops <= 0 || drv_ops == NULL)
+		return -EINVAL;
+
+	ops = mio_mem_alloc(nr_drv_ops * sizeof(void *));
+	if (ops == NULL)
+		return -ENOMEM;
+	mio_mem_copy(ops, drv_ops, nr_drv_ops * sizeof(void *));
+
+	dop = driver_op_alloc_add(op, post_proc, post_proc_data,
+				  op_fini, drv_op_args);
+	if (dop == NULL) {
+		mio_mem_free(ops);
+		return -ENOMEM;
+	}
+	dop->mdo_op = ops[0];
+	dop->mdo_ops = ops;
+	dop->mdo_nr_ops = nr_drv_ops;
 
+	driver_op_set_cbs(op);
 	return 0;
 }
 
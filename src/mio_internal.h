@@ -14,6 +14,8 @@
 #define __MIO_INTERNAL__
 
 #include <stdint.h>
+#include <stdbool.h>
+#include <pthread.h>
 
 #undef PACKAGE
 #undef PACKAGE_BUGREPORT
@@ -63,6 +65,19 @@ struct mio_obj_stats {
 	uint64_t mos_wtime;
 };
 
+/**
+ * Time-decayed access heat of an object. Every access adds to the score
+ * and the score halves every half-life (MIO_HINT_OBJ_HEAT_HALF_LIFE), so
+ * it tracks how often the object is accessed now rather than how often
+ * it has been accessed since it was created.
+ */
+struct mio_obj_heat {
+	/* Decayed score, fixed point with MIO_OBJ_HEAT_SHIFT fraction bits. */
+	uint32_t moh_score;
+	/* When the score was last updated, in seconds. */
+	uint32_t moh_time;
+};
+
 /**
  * MIO defines sets of operations a driver must implemnt:
  *   - mio_op_ops defines driver specific functions on operation,
@@ -92,6 +107,18 @@ struct mio_obj_ops {
 			  struct mio_obj *obj, struct mio_op *op);
 	int (*moo_delete)(const struct mio_obj_id *oid, struct mio_op *op);
 
+	/**
+	 * Multi-object versions of the above, per-object results are
+	 * returned in `rcs`. Optional.
+	 */
+	int (*moo_objs_open)(int nr_objs, struct mio_obj *objs,
+			     int32_t *rcs, struct mio_op *op);
+	int (*moo_objs_create)(const struct mio_pool_id *pool_id,
+			       int nr_objs, struct mio_obj *objs,
+			       int32_t *rcs, struct mio_op *op);
+	int (*moo_objs_delete)(int nr_objs, const struct mio_obj_id *oids,
+			       int32_t *rcs, struct mio_op *op);
+
 	int (*moo_writev)(struct mio_obj *obj,
 			  const struct mio_iovec *iov,
 			  int iovcnt, struct mio_op *op);
@@ -120,6 +147,26 @@ struct mio_obj_ops {
 	 */
 	int (*moo_hint_store)(struct mio_obj *obj);
 	int (*moo_hint_load)(struct mio_obj *obj);
+
+	/**
+	 * Decodes a key of the attribute key-value set into the id of the
+	 * object the record belongs to (optional, for scanning objects).
+	 */
+	int (*moo_attrs_key_decode)(const void *key, size_t klen,
+				    struct mio_obj_id *oid);
+	/**
+	 * Decodes a value of the attribute key-value set into the
+	 * attributes and persistent hints of `obj`, which isn't opened
+	 * (optional, for scanning objects).
+	 */
+	int (*moo_attrs_decode)(const void *val, size_t vlen,
+				struct mio_obj *obj);
+	/**
+	 * Gives an object the driver keeps without storage of its own
+	 * (inline in its attributes for example) its own storage, so
+	 * that it can become a layer of a composite object (optional).
+	 */
+	int (*moo_promote)(struct mio_obj *obj, struct mio_op *op);
 };
 
 struct mio_kvs_ops {
@@ -127,6 +174,14 @@ struct mio_kvs_ops {
 		       int nr_kvps, struct mio_kv_pair *kvps,
 		       int32_t *rcs, struct mio_op *op);
 
+	/**
+	 * The same as mko_get() except that values are placed into
+	 * the buffers provided by application (optional).
+	 */
+	int (*mko_get_into)(struct mio_kvs_id *kvs_id,
+			    int nr_kvps, struct mio_kv_pair *kvps,
+			    int32_t *rcs, struct mio_op *op);
+
 	int (*mko_next)(struct mio_kvs_id *kvs_id,
 			int nr_kvps, struct mio_kv_pair *kvps,
 			bool exclude_start_key, int32_t *rcs,
@@ -140,10 +195,35 @@ struct mio_kvs_ops {
 		       int nr_kvps, struct mio_kv_pair *kvps,
 		       int32_t *rcs, struct mio_op *op);
 
+	/**
+	 * Delete or count all pairs with keys in [start, end) (optional).
+	 * NULL start or end key means the range is unbounded at that
+	 * side. Progress is reported in mio_op::mop_progress.
+	 */
+	int (*mko_del_range)(struct mio_kvs_id *kvs_id,
+			     void *start, size_t start_len,
+			     void *end, size_t end_len, struct mio_op *op);
+	int (*mko_count_range)(struct mio_kvs_id *kvs_id,
+			       void *start, size_t start_len,
+			       void *end, size_t end_len,
+			       uint64_t *count, struct mio_op *op);
+
 	int (*mko_create_set)(struct mio_kvs_id *kvs_id, struct mio_op *op);
 	int (*mko_del_set)(struct mio_kvs_id *kvs_id, struct mio_op *op);
 };
 
+/**
+ * A piece of a composite object read served by one of its layers:
+ * [mcs_off, mcs_off + mcs_len) of the layer object mcs_obj is read
+ * into mcs_buf.
+ */
+struct mio_comp_obj_seg {
+	struct mio_obj *mcs_obj;
+	off_t mcs_off;
+	size_t mcs_len;
+	char *mcs_buf;
+};
+
 struct mio_comp_obj_ops {
 	int (*mcoo_create)(struct mio_obj *obj, struct mio_op *op);
 	int (*mcoo_del)(const struct mio_obj_id *oid, struct mio_op *op);
@@ -173,6 +253,33 @@ struct mio_comp_obj_ops {
 			        struct mio_obj_id *layer_id, off_t offset,
 				int nr_exts, struct mio_obj_ext *exts,
 				int *nr_ret_exts, struct mio_op *op);
+	int (*mcoo_compact_extents)(struct mio_obj *obj,
+				    struct mio_obj_id *layer_id,
+				    struct mio_op *op);
+
+	/*
+	 * Optional. mcoo_readv_layers() reads all segments concurrently,
+	 * the segments array may be freed once it returns.
+	 */
+	bool (*mcoo_is_composite)(struct mio_obj *obj);
+	int (*mcoo_readv_layers)(struct mio_obj *obj,
+				 int nr_segs, struct mio_comp_obj_seg *segs,
+				 struct mio_op *op);
+
+	/*
+	 * Optional, for tiering. mcoo_writev_layer() writes data into the
+	 * opened layer object `layer_obj` and, once written, adds the
+	 * written extents to the layer. mcoo_free_layer_data() releases
+	 * the space taken by the layer's data in the given extents.
+	 */
+	int (*mcoo_writev_layer)(struct mio_obj *obj,
+				 struct mio_obj *layer_obj,
+				 const struct mio_iovec *iov, int iovcnt,
+				 struct mio_op *op);
+	int (*mcoo_free_layer_data)(struct mio_obj *obj,
+				    struct mio_obj *layer_obj,
+				    int nr_exts, struct mio_obj_ext *exts,
+				    struct mio_op *op);
 };
 
 /**
@@ -181,6 +288,21 @@ struct mio_comp_obj_ops {
 struct mio_pool_ops {
 	/* Synchronous GET operation. */
 	int (*mpo_get)(const struct mio_pool_id *pool_id, struct mio_pool *pool);
+
+	/**
+	 * Capacity and free space of a pool in bytes (optional). Called
+	 * periodically by the pool state cache, see mio_pool_cache.c.
+	 */
+	int (*mpo_freespace)(const struct mio_pool_id *pool_id,
+			     size_t *capacity, size_t *freespace);
+
+	/**
+	 * A cheap query of the pool's current version (optional). The
+	 * version is identified the same way as a pool, the descriptor
+	 * returned by mpo_get() only changes when the version does.
+	 */
+	int (*mpo_version)(const struct mio_pool_id *pool_id,
+			   struct mio_pool_id *version);
 };
 
 /**
@@ -267,6 +389,26 @@ struct mio_driver {
  *    functions must check and call the post processing action if set.
  *  - So, an application can't poll an op whose callback functions have
  *    been set to avoid double entries to the post processing action.
+ *
+ * Some tasks issue a number of independent driver operations at once,
+ * for example deleting a batch of keys while scanning the next page.
+ * mio_driver_op_group_add() adds such a group of driver operations as
+ * one mio_driver_op. A group is done only when every operation in it is
+ * done, successfully or not, and the post processing function (which
+ * is mandatory for a group) is responsible for checking the result of
+ * each operation in mio_driver_op::mdo_ops. A post processing function
+ * may return an error code (< 0), in which case the MIO op fails with
+ * that error code.
+ *
+ * An op which turns out to need no driver operation at all (reading
+ * only holes of a composite object, for example) still has to go
+ * through the chain, mio_driver_op_add_done() adds an empty driver op
+ * which drivers treat as completed.
+ *
+ * mio_driver_op_add_fini() registers a function to be called when the
+ * MIO op is finalised, whether the op succeeds or fails. The empty
+ * driver op it adds is never waited on, so it must be followed by the
+ * driver ops doing the real job.
  */
 enum {
 	MIO_DRV_OP_NEXT = 0,
@@ -285,6 +427,17 @@ struct mio_driver_op {
 	/** Pointers to driver specific op. */
 	void *mdo_op;
 	void *mdo_op_args;
+
+	/**
+	 * For a group of driver ops, `mdo_ops` holds all `mdo_nr_ops` ops
+	 * and `mdo_op` points to the first one. `mdo_ops` is NULL for a
+	 * single driver op. `mdo_nr_done` is used by drivers to count
+	 * finished ops of a group when callbacks are set.
+	 */
+	int mdo_nr_ops;
+	void **mdo_ops;
+	int mdo_nr_done;
+
 	mio_driver_op_fini mdo_op_fini;
 
 	struct mio_driver_op *mdo_next;
@@ -300,8 +453,23 @@ int mio_driver_op_add(struct mio_op *op,
 		      mio_driver_op_fini op_fini,
 		      void *drv_op,void *drv_op_args);
 
+int mio_driver_op_add_done(struct mio_op *op);
+
+int mio_driver_op_add_fini(struct mio_op *op,
+			   mio_driver_op_fini op_fini, void *drv_op_args);
+
+int mio_driver_op_group_add(struct mio_op *op,
+			    mio_driver_op_postprocess post_proc,
+			    void *post_proc_data,
+			    mio_driver_op_fini op_fini,
+			    int nr_drv_ops, void **drv_ops,
+			    void *drv_op_args);
+
 void mio_driver_op_invoke_real_cb(struct mio_op *op, int rc);
 
+/* Polls an op until it is done, returns its rc. */
+int mio_op_wait(struct mio_op *op);
+
 struct mio_driver* mio_driver_get(enum mio_driver_id driver_id);
 
 /** Register a driver. */
@@ -324,6 +492,8 @@ void mio_motr_driver_register();
  */
 enum {
 	MIO_MOTR_MAX_POOL_CNT = 16,
+	MIO_MOTR_MAX_OBJ_ATTRS_SHARDS = 1024,
+	MIO_MOTR_MAX_INLINE_DATA = 64 * 1024,
 };
 
 struct mio_motr_config {
@@ -376,23 +546,38 @@ struct mio_motr_config {
 
 	/** Is ADDB on? */
 	bool mc_is_addb_on;
+
+	/**
+	 * Number of indices object attributes are spread over (by hash
+	 * of object id). 0 means only the single legacy attribute index
+	 * is used. All clients of a cluster must use the same value.
+	 */
+	int mc_obj_attrs_nr_shards;
+
+	/**
+	 * Objects created by mio_obj_create() keep their data in their
+	 * attribute record until it grows past this many bytes. 0 (the
+	 * default) disables inline data.
+	 */
+	int mc_inline_data_threshold;
+};
+
+enum {
+	MIO_OBJ_HINT_NUM = 32,
+	MIO_HINT_INVALID = -1
 };
 
 /**
  * A simple map implementation for hints in which key is of type `int`
- * and value is of type `uint64_t`. As there are usually small number
- * of hints for each object, arrays are used to store keys and values.
- * The overhead of looking up entries in arrays is low.
+ * and value is of type `uint64_t`. Hint keys are small integers, so the
+ * map is held inline: a bitmap of the keys set and an array of values
+ * indexed by key. Maps need no allocation and a zeroed map is empty.
  */
 struct mio_hint_map {
-	int mhm_nr_entries;
+	/* Bit `key` is set if hint `key` is set. */
+	uint32_t mhm_set;
 	int mhm_nr_set;
-	int *mhm_keys;
-	uint64_t *mhm_values;
-};
-
-enum {
-	MIO_OBJ_HINT_NUM = 32
+	uint64_t mhm_values[MIO_OBJ_HINT_NUM];
 };
 
 int mio_hint_map_init(struct mio_hint_map *map, int nr_entries);
@@ -400,10 +585,195 @@ void mio_hint_map_fini(struct mio_hint_map *map);
 int mio_hint_map_copy(struct mio_hint_map *, struct mio_hint_map *from);
 int mio_hint_map_set(struct mio_hint_map *map, int key, uint64_t value);
 int mio_hint_map_get(struct mio_hint_map *map, int key, uint64_t *value);
+int mio_hint_map_next(struct mio_hint_map *map, int key);
 
 bool mio_hint_is_set(struct mio_hints *hints, int hint_key);
 
 int mio_obj_hotness_to_pool_idx(uint64_t hotness);
+void mio_obj_heat_update(struct mio_obj *obj, uint64_t now,
+			 const struct mio_iovec *iov, int iovcnt);
+
+struct mio_kvs *mio_obj_attrs_kvs_select(const struct mio_obj_id *oid);
+
+/**
+ * Object attribute cache. Drivers store the encoded attribute record
+ * of an object once it has been fetched from or written to the
+ * attribute index. mio_obj_attrs_cache_get() returns a copy of a fresh
+ * record which the caller must free, or -ENOENT if there is none.
+ * A TTL of 0 disables the cache.
+ */
+int mio_obj_attrs_cache_init(uint64_t ttl, int max_nr_entries);
+void mio_obj_attrs_cache_fini();
+int mio_obj_attrs_cache_get(const struct mio_obj_id *oid,
+			    void **buf, int *len);
+void mio_obj_attrs_cache_put(const struct mio_obj_id *oid,
+			     const void *buf, int len);
+void mio_obj_attrs_cache_invalidate(const struct mio_obj_id *oid);
+
+/**
+ * Composite object extent map, see mio_composite_obj_map_lookup().
+ * Drivers call mio_comp_obj_map_exts_update() once extents have been
+ * added or deleted and mio_comp_obj_map_layer_invalidate() if the
+ * outcome of an extent update is unknown. Extent records are written
+ * as planned by mio_comp_obj_map_exts_plan(), which coalesces them.
+ */
+void mio_comp_obj_map_exts_update(struct mio_obj *obj,
+				  const struct mio_obj_id *layer_id,
+				  int nr_exts, const struct mio_obj_ext *exts,
+				  bool add);
+void mio_comp_obj_map_layer_invalidate(struct mio_obj *obj,
+				       const struct mio_obj_id *layer_id);
+void mio_comp_obj_map_fini(struct mio_obj *obj);
+int mio_comp_obj_map_exts_plan(struct mio_obj *obj,
+			       const struct mio_obj_id *layer_id,
+			       int nr_exts, const struct mio_obj_ext *exts,
+			       bool add,
+			       int *nr_put, struct mio_obj_ext **put,
+			       int *nr_del, struct mio_obj_ext **del);
+int mio_comp_obj_exts_del_plan(int nr_exts, const struct mio_obj_ext *exts,
+			       int nr_recs, const struct mio_obj_ext *recs,
+			       int *nr_put, struct mio_obj_ext **put,
+			       int *nr_del, struct mio_obj_ext **del);
+int mio_comp_obj_exts_compact_plan(int nr_recs, const struct mio_obj_ext *recs,
+				   int *nr_put, struct mio_obj_ext **put,
+				   int *nr_del, struct mio_obj_ext **del);
+bool mio_comp_obj_is_composite(struct mio_obj *obj);
+int mio_comp_obj_layers_push(struct mio_obj *obj, int nr_layers,
+			     const struct mio_obj_id *layer_ids,
+			     const struct mio_comp_obj_layout *layout);
+int mio_comp_obj_layer_prepare(struct mio_obj *obj);
+int mio_comp_obj_readv(struct mio_obj *obj,
+		       const struct mio_iovec *iov, int iovcnt,
+		       struct mio_op *op);
+int mio_comp_obj_writev(struct mio_obj *obj,
+			const struct mio_iovec *iov, int iovcnt,
+			struct mio_op *op);
+
+/**
+ * Background threads of MIO sub-systems. `bt_lock` protects the thread's
+ * state and may also protect the sub-system's own state, a thread waits
+ * on `bt_cond` with mio_bg_thread_wait() between its passes and must
+ * return once mio_bg_thread_stopping() is true. A thread started on
+ * demand is started with `bt_lock` held.
+ */
+typedef void (*mio_bg_thread_func)(void);
+struct mio_bg_thread {
+	pthread_mutex_t bt_lock;
+	pthread_cond_t bt_cond;
+	pthread_t bt_thread;
+	bool bt_started;
+	bool bt_stopping;
+	mio_bg_thread_func bt_func;
+};
+
+#define MIO_BG_THREAD_INITIALIZER {			\
+	.bt_lock = PTHREAD_MUTEX_INITIALIZER,		\
+	.bt_cond = PTHREAD_COND_INITIALIZER,		\
+}
+
+int mio_bg_thread_start(struct mio_bg_thread *bt, mio_bg_thread_func func);
+void mio_bg_thread_stop(struct mio_bg_thread *bt);
+bool mio_bg_thread_stopping(struct mio_bg_thread *bt);
+/* Waits for `ns` nano-seconds at most, must be called with `bt_lock` held. */
+void mio_bg_thread_wait(struct mio_bg_thread *bt, uint64_t ns);
+
+/**
+ * Guards data moved in the background, by tiering, against writes made
+ * meanwhile. Writes are counted from being issued until their op is
+ * finalised and each write bumps a generation number. A pass takes the
+ * generation when it starts, with no write in flight, and may only
+ * replace data if mio_write_guard_changed() is false. The owner's lock
+ * protects the guard.
+ */
+struct mio_write_guard {
+	int wg_nr_writes;
+	uint64_t wg_gen;
+};
+
+void mio_write_guard_begin(struct mio_write_guard *wg);
+/* Returns true if it was the last write in flight. */
+bool mio_write_guard_end(struct mio_write_guard *wg);
+bool mio_write_guard_busy(const struct mio_write_guard *wg);
+int mio_write_guard_pass_start(const struct mio_write_guard *wg,
+			       uint64_t *gen);
+bool mio_write_guard_changed(const struct mio_write_guard *wg, uint64_t gen);
+
+/**
+ * Tiering of composite objects, see mio_composite_obj_tier_enable().
+ * mio_comp_obj_tier_writev() redirects a write to the fast layer.
+ */
+int mio_comp_obj_tier_writev(struct mio_obj *obj,
+			     const struct mio_iovec *iov, int iovcnt,
+			     struct mio_op *op);
+void mio_comp_obj_tier_sys_fini();
+
+/**
+ * Migrated objects, see mio_obj_migrate(). IO to a migrated object is
+ * redirected to the composite object serving its data.
+ * mio_obj_redirect_check() marks a handle opened before its object was
+ * migrated by this process as redirected. mio_obj_redirect_deleted()
+ * deletes the composite object of a migrated object being deleted.
+ */
+void mio_obj_redirect_check(struct mio_obj *obj);
+int mio_obj_redirect_readv(struct mio_obj *obj,
+			   const struct mio_iovec *iov, int iovcnt,
+			   struct mio_op *op);
+int mio_obj_redirect_writev(struct mio_obj *obj,
+			    const struct mio_iovec *iov, int iovcnt,
+			    struct mio_op *op);
+int mio_obj_redirect_pool_id(struct mio_obj *obj, struct mio_pool_id *pool_id);
+void mio_obj_redirect_close(struct mio_obj *obj);
+void mio_obj_redirect_deleted(const struct mio_obj_id *oid,
+			      const struct mio_obj_id *cobj_id);
+void mio_obj_migrate_sys_fini();
+
+/**
+ * Background tiering, enabled by MIO_OBJ_TIERING in the configuration.
+ * See mio_obj_tiering.c.
+ */
+int mio_obj_tiering_sys_init();
+void mio_obj_tiering_sys_fini();
+
+/**
+ * Object expiry index and the reaper of expired objects, enabled by
+ * MIO_OBJ_REAPER in the configuration. See mio_obj_reaper.c.
+ */
+int mio_obj_expiry_add(int nr_objs, const struct mio_obj_id *oids,
+		       uint64_t expiry);
+int mio_obj_expiry_del(int nr_objs, const struct mio_obj_id *oids,
+		       uint64_t expiry);
+int mio_obj_expiry_update(const struct mio_obj_id *oid,
+			  uint64_t old_expiry, uint64_t new_expiry);
+/**
+ * Adds the deletion of the records of `nr_objs` objects, expiring at
+ * `expiries`, to `op`, for drivers to chain to the deletion of objects
+ * with a lifetime.
+ */
+int mio_obj_expiry_del_launch(int nr_objs, const struct mio_obj_id *oids,
+			      const uint64_t *expiries, struct mio_op *op);
+int mio_obj_reaper_sys_init();
+void mio_obj_reaper_sys_fini();
+
+/**
+ * Pool state cache, see mio_pool_cache.c. mio_pool_cache_spill() returns
+ * the index of the pool to place a new object in when pool `pool_idx`
+ * is chosen for it.
+ */
+int mio_pool_cache_init();
+void mio_pool_cache_fini();
+int mio_pool_cache_get(const struct mio_pool_id *pool_id,
+		       struct mio_pool *pool);
+const struct mio_pool *mio_pool_cache_borrow(const struct mio_pool_id *pool_id);
+int mio_pool_cache_freespace(const struct mio_pool_id *pool_id,
+			     size_t *freespace);
+int mio_pool_cache_spill(int pool_idx);
+
+/* Persistent system hints, see mio_sys_hints.c. */
+int mio_sys_hints_init();
+void mio_sys_hints_fini();
+
+int mio_obj_attrs_store(struct mio_obj *obj);
+int mio_obj_phints_update(struct mio_obj *obj);
 
 int mio_conf_init(const char *config_file);
 void mio_conf_fini();
@@ -0,0 +1,309 @@
+/* -*- C -*- */
+/*
+ * Copyright: (c) 2020 - 2021 Seagate Technology LLC and/or its its Affiliates,
+ * All Rights Reserved
+ *
+ * This software is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ */
+
+#include <errno.h>
+#include <assert.h>
+#include <string.h>
+
+#include "logger.h"
+#include "utils.h"
+#include "mio.h"
+#include "mio_internal.h"
+
+/**
+ * Streaming copy between objects.
+ *
+ * The range is copied by chunks through a ring of chunk buffers. Free
+ * buffers are filled by reads ahead of the writes. A buffer whose read
+ * completes is written out right away and is reused for the next read
+ * once its write completes. Ring positions from the oldest in flight
+ * are: buffers being written, buffers being read, free buffers.
+ * While there are free buffers or nothing is being written, the oldest
+ * read is waited for, otherwise the oldest write.
+ */
+
+enum {
+	OBJ_COPY_DEFAULT_CHUNK_SIZE = 1024 * 1024,
+	OBJ_COPY_DEFAULT_NR_CHUNKS = 4,
+};
+
+struct obj_copy_chunk {
+	struct mio_op occ_op;
+	struct mio_iovec occ_iov;
+	bool occ_busy;
+};
+
+struct obj_copy {
+	struct mio_obj *oc_src;
+	struct mio_obj *oc_dst;
+	struct mio_obj_copy_opts *oc_opts;
+	size_t oc_chunk_size;
+	int oc_nr_chunks;
+	struct obj_copy_chunk *oc_chunks;
+
+	/* Ring position of the oldest chunk in flight. */
+	int oc_head;
+	int oc_nr_writing;
+	int oc_nr_reading;
+
+	/* Next offset to read and end of the range. */
+	off_t oc_off;
+	off_t oc_end;
+	uint64_t oc_nr_bytes;
+	uint64_t oc_nr_copied;
+};
+
+static inline struct obj_copy_chunk *
+obj_copy_chunk_at(struct obj_copy *oc, int pos)
+{
+	return oc->oc_chunks + (oc->oc_head + pos) % oc->oc_nr_chunks;
+}
+
+static int obj_copy_read_launch(struct obj_copy *oc)
+{
+	int rc;
+	struct obj_copy_chunk *occ;
+
+	occ = obj_copy_chunk_at(oc, oc->oc_nr_writing + oc->oc_nr_reading);
+	occ->occ_iov.miov_off = oc->oc_off;
+	occ->occ_iov.miov_len = oc->oc_end - oc->oc_off;
+	if (occ->occ_iov.miov_len > oc->oc_chunk_size)
+		occ->occ_iov.miov_len = oc->oc_chunk_size;
+
+	mio_op_init(&occ->occ_op);
+	rc = mio_obj_readv(oc->oc_src, &occ->occ_iov, 1, &occ->occ_op);
+	if (rc < 0) {
+		mio_op_fini(&occ->occ_op);
+		return rc;
+	}
+	occ->occ_busy = true;
+	oc->oc_off += occ->occ_iov.miov_len;
+	oc->oc_nr_reading++;
+	return 0;
+}
+
+/* Waits for the oldest read and writes the chunk out. */
+static int obj_copy_read_complete(struct obj_copy *oc)
+{
+	int rc;
+	struct obj_copy_chunk *occ;
+
+	occ = obj_copy_chunk_at(oc, oc->oc_nr_writing);
+	rc = mio_op_wait(&occ->occ_op);
+	mio_op_fini(&occ->occ_op);
+	occ->occ_busy = false;
+	if (rc < 0)
+		return rc;
+
+	mio_op_init(&occ->occ_op);
+	rc = mio_obj_writev(oc->oc_dst, &occ->occ_iov, 1, &occ->occ_op);
+	if (rc < 0) {
+		mio_op_fini(&occ->occ_op);
+		return rc;
+	}
+	occ->occ_busy = true;
+	oc->oc_nr_reading--;
+	oc->oc_nr_writing++;
+	return 0;
+}
+
+/* Waits for the oldest write and frees its buffer. */
+static int obj_copy_write_complete(struct obj_copy *oc)
+{
+	int rc;
+	struct obj_copy_chunk *occ;
+	struct mio_obj_copy_opts *opts = oc->oc_opts;
+
+	occ = obj_copy_chunk_at(oc, 0);
+	rc = mio_op_wait(&occ->occ_op);
+	mio_op_fini(&occ->occ_op);
+	occ->occ_busy = false;
+	oc->oc_head = (oc->oc_head + 1) % oc->oc_nr_chunks;
+	oc->oc_nr_writing--;
+	if (rc < 0)
+		return rc;
+
+	oc->oc_nr_copied += occ->occ_iov.miov_len;
+	if (opts != NULL && opts->mco_progress != NULL &&
+	    opts->mco_progress(oc->oc_src, oc->oc_dst, oc->oc_nr_copied,
+			       oc->oc_nr_bytes, opts->mco_progress_data))
+		return -ECANCELED;
+	return 0;
+}
+
+/* Waits for all chunks in flight after an error, ignoring their result. */
+static void obj_copy_drain(struct obj_copy *oc)
+{
+	int i;
+	struct obj_copy_chunk *occ;
+
+	for (i = 0; i < oc->oc_nr_chunks; i++) {
+		occ = oc->oc_chunks + i;
+		if (!occ->occ_busy)
+			continue;
+		mio_op_wait(&occ->occ_op);
+		mio_op_fini(&occ->occ_op);
+		occ->occ_busy = false;
+	}
+}
+
+static int obj_copy_run(struct obj_copy *oc)
+{
+	int rc = 0;
+	int nr_free;
+
+	while (rc == 0) {
+		while (rc == 0 && oc->oc_off < oc->oc_end &&
+		       oc->oc_nr_writing + oc->oc_nr_reading < oc->oc_nr_chunks)
+			rc = obj_copy_read_launch(oc);
+		if (rc < 0)
+			break;
+
+		nr_free = oc->oc_nr_chunks - oc->oc_nr_writing -
+			  oc->oc_nr_reading;
+		if (oc->oc_nr_reading > 0 &&
+		    (nr_free > 0 || oc->oc_nr_writing == 0))
+			rc = obj_copy_read_complete(oc);
+		else if (oc->oc_nr_writing > 0)
+			rc = obj_copy_write_complete(oc);
+		else
+			break;
+	}
+
+	if (rc < 0)
+		obj_copy_drain(oc);
+	return rc;
+}
+
+/**
+ * Carries the source's persistent hints over to the destination, on top
+ * of the destination's own hints.
+ */
+static int obj_copy_hints(struct mio_obj *src, struct mio_obj *dst)
+{
+	int rc;
+	int key;
+	struct mio_hints hints;
+	struct mio_hints phints;
+
+	rc = mio_hints_init(&hints);
+	if (rc < 0)
+		return rc;
+	rc = mio_hints_init(&phints);
+	if (rc < 0) {
+		mio_hints_fini(&hints);
+		return rc;
+	}
+
+	rc = mio_obj_hints_get(src, &hints);
+	if (rc == -EOPNOTSUPP) {
+		rc = 0;
+		goto exit;
+	}
+	for (key = mio_hint_map_next(&hints.mh_map, MIO_HINT_INVALID);
+	     rc == 0 && key != MIO_HINT_INVALID;
+	     key = mio_hint_map_next(&hints.mh_map, key)) {
+		if (mio_hint_type(MIO_HINT_SCOPE_OBJ, key) ==
+		    MIO_HINT_PERSISTENT)
+			rc = mio_hint_add(&phints, key,
+					  hints.mh_map.mhm_values[key]);
+	}
+	if (rc == 0 && phints.mh_map.mhm_nr_set != 0)
+		rc = mio_obj_hints_set(dst, &phints);
+
+exit:
+	mio_hints_fini(&phints);
+	mio_hints_fini(&hints);
+	return rc;
+}
+
+int mio_obj_copy(struct mio_obj *src, struct mio_obj *dst,
+		 const struct mio_obj_ext *range,
+		 struct mio_obj_copy_opts *opts)
+{
+	int i;
+	int rc = 0;
+	uint64_t src_size;
+	struct obj_copy oc;
+
+	if (src == NULL || dst == NULL || src == dst)
+		return -EINVAL;
+	if (!memcmp(src->mo_id.moi_bytes, dst->mo_id.moi_bytes,
+		    MIO_OBJ_ID_LEN))
+		return -EINVAL;
+	if (opts != NULL && opts->mco_nr_chunks < 0)
+		return -EINVAL;
+
+	mio_memset(&oc, 0, sizeof oc);
+	oc.oc_src = src;
+	oc.oc_dst = dst;
+	oc.oc_opts = opts;
+	oc.oc_chunk_size = (opts != NULL && opts->mco_chunk_size != 0)?
+			   opts->mco_chunk_size : OBJ_COPY_DEFAULT_CHUNK_SIZE;
+	oc.oc_nr_chunks = (opts != NULL && opts->mco_nr_chunks != 0)?
+			  opts->mco_nr_chunks : OBJ_COPY_DEFAULT_NR_CHUNKS;
+
+	/* The range is cut at the source's end. */
+	src_size = src->mo_attrs.moa_size;
+	oc.oc_off = range != NULL? range->moe_off : 0;
+	oc.oc_end = range != NULL? range->moe_off + range->moe_size : src_size;
+	if (oc.oc_off < 0 || oc.oc_end < oc.oc_off)
+		return -EINVAL;
+	if (oc.oc_end > src_size)
+		oc.oc_end = src_size;
+	if (oc.oc_off > oc.oc_end)
+		oc.oc_off = oc.oc_end;
+	oc.oc_nr_bytes = oc.oc_end - oc.oc_off;
+
+	oc.oc_chunks = mio_mem_alloc(oc.oc_nr_chunks * sizeof *oc.oc_chunks);
+	if (oc.oc_chunks == NULL)
+		return -ENOMEM;
+	for (i = 0; i < oc.oc_nr_chunks; i++) {
+		oc.oc_chunks[i].occ_iov.miov_base =
+			mio_mem_alloc(oc.oc_chunk_size);
+		if (oc.oc_chunks[i].occ_iov.miov_base == NULL) {
+			rc = -ENOMEM;
+			goto exit;
+		}
+	}
+
+	rc = obj_copy_run(&oc);
+	if (rc < 0)
+		goto exit;
+
+	/* A whole object copy keeps the size, including a trailing hole. */
+	if (range == NULL && dst->mo_attrs.moa_size < src_size) {
+		dst->mo_attrs.moa_size = src_size;
+		dst->mo_attrs_updated = true;
+	}
+	rc = obj_copy_hints(src, dst);
+
+exit:
+	if (rc < 0)
+		mio_log(MIO_ERROR, "Copying object failed: %d\n", rc);
+	for (i = 0; i < oc.oc_nr_chunks; i++)
+		mio_mem_free(oc.oc_chunks[i].occ_iov.miov_base);
+	mio_mem_free(oc.oc_chunks);
+	return rc;
+}
+
+/*
+ *  Local variables:
+ *  c-indentation-style: "K&R"
+ *  c-basic-offset: 8
+ *  tab-width: 8
+ *  fill-column: 80
+ *  scroll-step: 1
+ *  End:
+ */
+/*
+ * vim: tabstop=8 shiftwidth=8 noexpandtab textwidth=80 nowrap
+ *
+ */
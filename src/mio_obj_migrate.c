@@ -0,0 +1,1066 @@
+/* -*- C -*- */
+/*
+ * Copyright: (c) 2020 - 2021 Seagate Technology LLC and/or its its Affiliates,
+ * All Rights Reserved
+ *
+ * This software is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ */
+
+#include <errno.h>
+#include <assert.h>
+#include <string.h>
+#include <pthread.h>
+
+#include "logger.h"
+#include "utils.h"
+#include "mio.h"
+#include "mio_internal.h"
+
+/**
+ * Migrating objects between pools.
+ *
+ * A Motr object can't move to another pool and its id can't change, so
+ * a migrated object becomes a redirect: its attribute record points to
+ * a composite object which serves its data from then on. The composite
+ * object is given the original object as its lower layer, with one
+ * extent covering the object, and two new empty layers in the target
+ * pool above it: the top layer, which takes all writes, and the move
+ * layer just below it. Migrating the object again pushes another two
+ * layers.
+ *
+ * The migrator thread then moves the data of the lower layers into the
+ * move layer, chunk by chunk. A chunk is read through the composite
+ * object and written to the move layer. Data written meanwhile is in
+ * the top layer, which takes precedence, so moving a chunk never hides
+ * it and writes don't wait for the migrator. Once no lower layer serves
+ * any data, the lower layers are removed from the composite object, the
+ * original object's space is freed and other layer objects deleted.
+ *
+ * Handles of the object opened in this process before it was migrated
+ * don't have the redirect in their attributes: the redirects stored are
+ * kept until the object is deleted and looked up by such handles before
+ * IO.
+ *
+ * Deleting a migrated object hands its composite object over to the
+ * migrator thread, which drops the object's migration and deletes the
+ * composite object and its layers.
+ */
+
+enum {
+	/* Data is moved by chunks of this size. */
+	OBJ_MIGRATE_CHUNK = 4 * 1024 * 1024,
+	OBJ_MIGRATE_EXTS_BATCH = 64,
+	/* In milliseconds. */
+	OBJ_MIGRATE_RETRY_INTERVAL = 1000,
+	OBJ_MIGRATE_ID_NR_TRIES = 8,
+};
+
+struct obj_migration {
+	struct mio_obj_id om_oid;
+	/* The migrator's own handle of the composite object. */
+	struct mio_obj *om_cobj;
+	/* Protected by the migrator lock. */
+	struct obj_migration *om_next;
+};
+
+struct obj_redirect_rec {
+	struct mio_obj_id orr_oid;
+	struct mio_obj_id orr_redirect;
+	/* Handles opened from this session sequence number on have it. */
+	uint64_t orr_seqno;
+	struct obj_redirect_rec *orr_next;
+};
+
+/* A migrated object deleted, whose composite object is yet to go. */
+struct obj_redirect_del {
+	struct mio_obj_id ord_oid;
+	struct mio_obj_id ord_cobj_id;
+	struct obj_redirect_del *ord_next;
+};
+
+struct obj_migrator {
+	/* The thread's lock and condition protect the fields below too. */
+	struct mio_bg_thread mg_thread;
+	struct obj_migration *mg_migrations;
+	/* Redirects stored by this process, the latest first. */
+	struct obj_redirect_rec *mg_redirects;
+	struct obj_redirect_del *mg_deletions;
+	/*
+	 * Bumped when lower layers are removed, handles of migrated
+	 * objects then drop their cached layouts and extent maps.
+	 */
+	uint64_t mg_gen;
+};
+
+static struct obj_migrator obj_migrator = {
+	.mg_thread = MIO_BG_THREAD_INITIALIZER,
+};
+
+struct obj_redirect_write_args {
+	struct mio_obj *rwa_obj;
+	struct mio_obj *rwa_cobj;
+};
+
+#define drv_comp_obj_ops (mio_instance->m_driver->md_comp_obj_ops)
+
+static void obj_migrate_obj_close(struct mio_obj *obj)
+{
+	if (obj == NULL)
+		return;
+	mio_obj_close(obj);
+	mio_mem_free(obj);
+}
+
+static int obj_migrate_obj_open(const struct mio_obj_id *oid,
+				struct mio_obj **ret_obj)
+{
+	int rc;
+	struct mio_op op;
+	struct mio_obj *obj;
+
+	obj = mio_mem_alloc(sizeof *obj);
+	if (obj == NULL)
+		return -ENOMEM;
+
+	mio_op_init(&op);
+	rc = mio_obj_open(oid, obj, &op)? : mio_op_wait(&op);
+	mio_op_fini(&op);
+	if (rc < 0) {
+		mio_mem_free(obj);
+		return rc;
+	}
+	*ret_obj = obj;
+	return 0;
+}
+
+static void obj_migration_free(struct obj_migration *mig)
+{
+	obj_migrate_obj_close(mig->om_cobj);
+	mio_mem_free(mig);
+}
+
+/* Must be called with the migrator lock held. */
+static struct obj_migration *obj_migration_find(const struct mio_obj_id *oid)
+{
+	struct obj_migration *mig;
+
+	for (mig = obj_migrator.mg_migrations; mig != NULL; mig = mig->om_next)
+		if (!memcmp(mig->om_oid.moi_bytes, oid->moi_bytes,
+			    MIO_OBJ_ID_LEN))
+			return mig;
+	return NULL;
+}
+
+/* --------------------------------------------------------------- *
+ *                     Redirected IO                               *
+ * ----------------------------------------------------------------*/
+
+void mio_obj_redirect_check(struct mio_obj *obj)
+{
+	struct obj_redirect_rec *rec;
+
+	if (obj->mo_attrs.moa_redirected)
+		return;
+
+	pthread_mutex_lock(&obj_migrator.mg_thread.bt_lock);
+	for (rec = obj_migrator.mg_redirects;
+	     rec != NULL && rec->orr_seqno > obj->mo_sess_seqno;
+	     rec = rec->orr_next) {
+		if (memcmp(rec->orr_oid.moi_bytes, obj->mo_id.moi_bytes,
+			   MIO_OBJ_ID_LEN))
+			continue;
+		obj->mo_attrs.moa_redirected = true;
+		obj->mo_attrs.moa_redirect = rec->orr_redirect;
+		break;
+	}
+	pthread_mutex_unlock(&obj_migrator.mg_thread.bt_lock);
+}
+
+/**
+ * Returns the composite object serving the data of a migrated object,
+ * opening it on first use.
+ */
+static int obj_redirect_get(struct mio_obj *obj, struct mio_obj **ret_cobj)
+{
+	int rc = 0;
+	uint64_t gen;
+	struct mio_obj *cobj;
+
+	pthread_mutex_lock(&obj_migrator.mg_thread.bt_lock);
+	gen = obj_migrator.mg_gen;
+	pthread_mutex_unlock(&obj_migrator.mg_thread.bt_lock);
+
+	cobj = obj->mo_redirect_obj;
+	if (cobj == NULL) {
+		rc = obj_migrate_obj_open(&obj->mo_attrs.moa_redirect, &cobj);
+		if (rc < 0)
+			return rc;
+		obj->mo_redirect_obj = cobj;
+		obj->mo_attrs.moa_size = cobj->mo_attrs.moa_size;
+	} else if (obj->mo_redirect_gen != gen) {
+		cobj->mo_comp_layout_cached = false;
+		mio_composite_obj_map_invalidate(cobj);
+	}
+	obj->mo_redirect_gen = gen;
+	*ret_cobj = cobj;
+	return 0;
+}
+
+int mio_obj_redirect_readv(struct mio_obj *obj,
+			   const struct mio_iovec *iov, int iovcnt,
+			   struct mio_op *op)
+{
+	int rc;
+	struct mio_obj *cobj;
+
+	rc = obj_redirect_get(obj, &cobj);
+	if (rc < 0)
+		return rc;
+	return mio_comp_obj_readv(cobj, iov, iovcnt, op);
+}
+
+static int obj_redirect_write_fini(struct mio_driver_op *dop)
+{
+	struct obj_redirect_write_args *args;
+
+	args = (struct obj_redirect_write_args *)dop->mdo_op_args;
+	if (args->rwa_obj->mo_attrs.moa_size <
+	    args->rwa_cobj->mo_attrs.moa_size) {
+		args->rwa_obj->mo_attrs.moa_size =
+			args->rwa_cobj->mo_attrs.moa_size;
+		args->rwa_obj->mo_attrs_updated = true;
+	}
+	mio_mem_free(args);
+	return 0;
+}
+
+int mio_obj_redirect_writev(struct mio_obj *obj,
+			    const struct mio_iovec *iov, int iovcnt,
+			    struct mio_op *op)
+{
+	int rc;
+	struct mio_obj *cobj;
+	struct obj_redirect_write_args *args;
+
+	rc = obj_redirect_get(obj, &cobj);
+	if (rc < 0)
+		return rc;
+	args = mio_mem_alloc(sizeof *args);
+	if (args == NULL)
+		return -ENOMEM;
+	args->rwa_obj = obj;
+	args->rwa_cobj = cobj;
+
+	rc = mio_driver_op_add_fini(op, obj_redirect_write_fini, args);
+	if (rc < 0) {
+		mio_mem_free(args);
+		return rc;
+	}
+
+	return mio_comp_obj_writev(cobj, iov, iovcnt, op);
+}
+
+/**
+ * The pool of a migrated object is the pool of its top layer, where its
+ * data is written to.
+ */
+int mio_obj_redirect_pool_id(struct mio_obj *obj, struct mio_pool_id *pool_id)
+{
+	int rc;
+	struct mio_op op;
+	struct mio_obj *cobj;
+	struct mio_obj *lobj = NULL;
+	struct mio_comp_obj_layout layout;
+
+	rc = obj_redirect_get(obj, &cobj);
+	if (rc < 0)
+		return rc;
+
+	mio_memset(&layout, 0, sizeof layout);
+	mio_op_init(&op);
+	rc = mio_composite_obj_list_layers(cobj, &layout, &op)? :
+	     mio_op_wait(&op);
+	mio_op_fini(&op);
+	if (rc == 0 && layout.mlo_nr_layers == 0)
+		rc = -ENOENT;
+	rc = rc? :
+	     obj_migrate_obj_open(&layout.mlo_layers[0].mcol_oid, &lobj)? :
+	     mio_obj_pool_id(lobj, pool_id);
+	obj_migrate_obj_close(lobj);
+	mio_mem_free(layout.mlo_layers);
+	return rc;
+}
+
+void mio_obj_redirect_close(struct mio_obj *obj)
+{
+	struct mio_obj *cobj = obj->mo_redirect_obj;
+
+	if (cobj == NULL)
+		return;
+	/* Keep the size in the object's own record up to date. */
+	if (obj->mo_attrs.moa_size != cobj->mo_attrs.moa_size) {
+		obj->mo_attrs.moa_size = cobj->mo_attrs.moa_size;
+		obj->mo_attrs_updated = true;
+	}
+	obj_migrate_obj_close(cobj);
+	obj->mo_redirect_obj = NULL;
+}
+
+/* --------------------------------------------------------------- *
+ *                     Moving data                                 *
+ * ----------------------------------------------------------------*/
+
+/* Moves [off, off + len) into the move layer `mobj`. */
+static int obj_migrate_chunk_move(struct obj_migration *mig,
+				  struct mio_obj *mobj,
+				  off_t off, size_t len, char *buf)
+{
+	int rc;
+	struct mio_op op;
+	struct mio_iovec iov;
+	struct mio_obj *cobj = mig->om_cobj;
+
+	iov.miov_base = buf;
+	iov.miov_off = off;
+	iov.miov_len = len;
+
+	mio_op_init(&op);
+	rc = mio_obj_readv(cobj, &iov, 1, &op)? : mio_op_wait(&op);
+	mio_op_fini(&op);
+	if (rc < 0)
+		return rc;
+
+	mio_op_init(&op);
+	rc = mio_obj_op_init(&op, cobj, MIO_OBJ_WRITE)? :
+	     drv_comp_obj_ops->mcoo_writev_layer(cobj, mobj, &iov, 1, &op)? :
+	     mio_op_wait(&op);
+	mio_op_fini(&op);
+	return rc;
+}
+
+/**
+ * Lists the extents still served by a layer below the move layer. They
+ * are collected before any of them is moved, as moving changes the
+ * extent records being iterated over.
+ */
+static int obj_migrate_exts_get(struct obj_migration *mig,
+				const struct mio_comp_obj_layout *layout,
+				int *ret_nr_exts, struct mio_obj_ext **ret_exts)
+{
+	int rc;
+	int nr_exts = 0;
+	int max_nr_exts = 0;
+	struct mio_obj_id layer_id;
+	struct mio_obj_ext ext;
+	struct mio_obj_ext *exts = NULL;
+	struct mio_obj_ext *new_exts;
+	struct mio_comp_obj_ext_iter *iter;
+
+	rc = mio_composite_obj_ext_iter_init(mig->om_cobj, NULL, &iter);
+	if (rc < 0)
+		return rc;
+
+	while ((rc = mio_composite_obj_ext_iter_next(iter, &ext,
+						     &layer_id)) == 0) {
+		if (!memcmp(layer_id.moi_bytes,
+			    layout->mlo_layers[0].mcol_oid.moi_bytes,
+			    MIO_OBJ_ID_LEN) ||
+		    !memcmp(layer_id.moi_bytes,
+			    layout->mlo_layers[1].mcol_oid.moi_bytes,
+			    MIO_OBJ_ID_LEN))
+			continue;
+		if (nr_exts == max_nr_exts) {
+			max_nr_exts += OBJ_MIGRATE_EXTS_BATCH;
+			new_exts = mio_mem_alloc(max_nr_exts * sizeof *exts);
+			if (new_exts == NULL) {
+				rc = -ENOMEM;
+				break;
+			}
+			if (nr_exts != 0)
+				mio_mem_copy(new_exts, exts,
+					     nr_exts * sizeof *exts);
+			mio_mem_free(exts);
+			exts = new_exts;
+		}
+		exts[nr_exts++] = ext;
+	}
+	mio_composite_obj_ext_iter_fini(iter);
+
+	if (rc != -ENOENT) {
+		mio_mem_free(exts);
+		return rc;
+	}
+	*ret_nr_exts = nr_exts;
+	*ret_exts = exts;
+	return 0;
+}
+
+/**
+ * Frees the space taken by a lower layer: the original object is kept
+ * as it holds the attribute record, other layer objects are deleted.
+ */
+static int obj_migrate_layer_release(struct obj_migration *mig,
+				     const struct mio_obj_id *layer_id)
+{
+	int rc;
+	struct mio_op op;
+	struct mio_obj_ext ext;
+	struct mio_obj *lobj;
+
+	mio_op_init(&op);
+	if (memcmp(layer_id->moi_bytes, mig->om_oid.moi_bytes,
+		   MIO_OBJ_ID_LEN)) {
+		rc = mio_obj_delete(layer_id, &op)? :
+		     mio_op_wait(&op);
+		mio_op_fini(&op);
+		return rc;
+	}
+
+	rc = obj_migrate_obj_open(layer_id, &lobj);
+	if (rc < 0)
+		return rc;
+	ext.moe_off = 0;
+	ext.moe_size = mig->om_cobj->mo_attrs.moa_size;
+	if (lobj->mo_attrs.moa_size > ext.moe_size)
+		ext.moe_size = lobj->mo_attrs.moa_size;
+	rc = mio_obj_op_init(&op, mig->om_cobj, MIO_COMP_OBJ_DEL_EXTENTS)? :
+	     drv_comp_obj_ops->mcoo_free_layer_data(mig->om_cobj, lobj,
+						    1, &ext, &op)? :
+	     mio_op_wait(&op);
+	mio_op_fini(&op);
+	obj_migrate_obj_close(lobj);
+	return rc;
+}
+
+/* Removes the lower layers once all data is in the top layer. */
+static int obj_migrate_finish(struct obj_migration *mig,
+			      struct mio_comp_obj_layout *layout)
+{
+	int i;
+	int rc = 0;
+	struct mio_op op;
+
+	if (layout->mlo_nr_layers > 2) {
+		mio_op_init(&op);
+		rc = mio_composite_obj_del_layers(mig->om_cobj,
+						  layout->mlo_nr_layers - 2,
+						  layout->mlo_layers + 2,
+						  &op)? :
+		     mio_op_wait(&op);
+		mio_op_fini(&op);
+		if (rc < 0)
+			return rc;
+	}
+
+	pthread_mutex_lock(&obj_migrator.mg_thread.bt_lock);
+	obj_migrator.mg_gen++;
+	pthread_mutex_unlock(&obj_migrator.mg_thread.bt_lock);
+
+	for (i = 2; i < layout->mlo_nr_layers; i++) {
+		rc = obj_migrate_layer_release(mig,
+					       &layout->mlo_layers[i].mcol_oid);
+		if (rc < 0)
+			mio_log(MIO_WARN,
+				"Releasing migrated layer failed: %d\n", rc);
+	}
+	return 0;
+}
+
+/**
+ * A migration pass. Returns 0 once the object is fully migrated, -EAGAIN
+ * if data has been moved and the object is to be looked at again.
+ */
+static int obj_migrate_pass(struct obj_migration *mig)
+{
+	int i;
+	int rc;
+	int nr_exts = 0;
+	off_t off;
+	off_t end;
+	size_t len;
+	char *buf = NULL;
+	struct mio_op op;
+	struct mio_obj *mobj = NULL;
+	struct mio_obj_ext *exts = NULL;
+	struct mio_comp_obj_layout layout;
+
+	/* Writes made through other handles aren't in the cached map. */
+	mio_composite_obj_map_invalidate(mig->om_cobj);
+
+	mio_memset(&layout, 0, sizeof layout);
+	mio_op_init(&op);
+	rc = mio_composite_obj_list_layers(mig->om_cobj, &layout, &op)? :
+	     mio_op_wait(&op);
+	mio_op_fini(&op);
+	/* The top and move layers at least. */
+	if (rc == 0 && layout.mlo_nr_layers < 2)
+		rc = -ENOENT;
+	if (rc < 0)
+		goto exit;
+
+	rc = obj_migrate_exts_get(mig, &layout, &nr_exts, &exts);
+	if (rc < 0)
+		goto exit;
+	if (nr_exts == 0) {
+		rc = obj_migrate_finish(mig, &layout);
+		goto exit;
+	}
+
+	buf = mio_mem_alloc(OBJ_MIGRATE_CHUNK);
+	if (buf == NULL) {
+		rc = -ENOMEM;
+		goto exit;
+	}
+	rc = obj_migrate_obj_open(&layout.mlo_layers[1].mcol_oid, &mobj);
+	for (i = 0; i < nr_exts && rc == 0; i++) {
+		end = exts[i].moe_off + exts[i].moe_size;
+		for (off = exts[i].moe_off; off < end && rc == 0; off += len) {
+			len = end - off;
+			if (len > OBJ_MIGRATE_CHUNK)
+				len = OBJ_MIGRATE_CHUNK;
+			rc = obj_migrate_chunk_move(mig, mobj, off, len, buf);
+		}
+	}
+	/* The extents moved are now hidden by the move layer. */
+	if (rc == 0)
+		rc = -EAGAIN;
+
+exit:
+	obj_migrate_obj_close(mobj);
+	mio_mem_free(buf);
+	mio_mem_free(exts);
+	mio_mem_free(layout.mlo_layers);
+	return rc;
+}
+
+/* --------------------------------------------------------------- *
+ *                     Deleting migrated objects                   *
+ * ----------------------------------------------------------------*/
+
+static int obj_migrate_id_delete(const struct mio_obj_id *oid)
+{
+	int rc;
+	struct mio_op op;
+
+	mio_op_init(&op);
+	rc = mio_obj_delete(oid, &op)? : mio_op_wait(&op);
+	mio_op_fini(&op);
+	return rc;
+}
+
+/**
+ * Deletes the composite object of a deleted migrated object and its
+ * layers, but the original object which is deleted already.
+ */
+static int obj_redirect_delete(struct obj_redirect_del *del)
+{
+	int i;
+	int rc;
+	struct mio_op op;
+	struct mio_obj *cobj;
+	struct mio_obj_id *layer_id;
+	struct mio_comp_obj_layout layout;
+
+	rc = obj_migrate_obj_open(&del->ord_cobj_id, &cobj);
+	if (rc < 0)
+		return rc == -ENOENT? 0 : rc;
+
+	mio_memset(&layout, 0, sizeof layout);
+	mio_op_init(&op);
+	rc = mio_composite_obj_list_layers(cobj, &layout, &op)? :
+	     mio_op_wait(&op);
+	mio_op_fini(&op);
+	if (rc == 0 && layout.mlo_nr_layers != 0) {
+		mio_op_init(&op);
+		rc = mio_composite_obj_del_layers(cobj, layout.mlo_nr_layers,
+						  layout.mlo_layers, &op)? :
+		     mio_op_wait(&op);
+		mio_op_fini(&op);
+	}
+	obj_migrate_obj_close(cobj);
+	if (rc < 0)
+		goto exit;
+
+	for (i = 0; i < layout.mlo_nr_layers; i++) {
+		layer_id = &layout.mlo_layers[i].mcol_oid;
+		if (!memcmp(layer_id->moi_bytes, del->ord_oid.moi_bytes,
+			    MIO_OBJ_ID_LEN))
+			continue;
+		rc = obj_migrate_id_delete(layer_id);
+		if (rc < 0 && rc != -ENOENT)
+			mio_log(MIO_WARN,
+				"Deleting migrated layer failed: %d\n", rc);
+	}
+	rc = obj_migrate_id_delete(&del->ord_cobj_id);
+
+exit:
+	mio_mem_free(layout.mlo_layers);
+	return rc;
+}
+
+/**
+ * Must be called with the migrator lock held, by the migrator thread or
+ * once it is stopped. The migration of a deleted object is dropped
+ * before its composite object is deleted.
+ */
+static void obj_redirect_deletions_run()
+{
+	int rc;
+	struct obj_migration *mig;
+	struct obj_migration **prev;
+	struct obj_redirect_del *del;
+	struct mio_bg_thread *bt = &obj_migrator.mg_thread;
+
+	while (obj_migrator.mg_deletions != NULL) {
+		del = obj_migrator.mg_deletions;
+		obj_migrator.mg_deletions = del->ord_next;
+
+		for (prev = &obj_migrator.mg_migrations; *prev != NULL;
+		     prev = &(*prev)->om_next)
+			if (!memcmp((*prev)->om_oid.moi_bytes,
+				    del->ord_oid.moi_bytes, MIO_OBJ_ID_LEN))
+				break;
+		mig = *prev;
+		if (mig != NULL)
+			*prev = mig->om_next;
+
+		pthread_mutex_unlock(&bt->bt_lock);
+		if (mig != NULL)
+			obj_migration_free(mig);
+		rc = obj_redirect_delete(del);
+		if (rc < 0)
+			mio_log(MIO_WARN,
+				"Deleting migrated object failed: %d\n", rc);
+		mio_mem_free(del);
+		pthread_mutex_lock(&bt->bt_lock);
+	}
+}
+
+/**
+ * Migrations are run one pass at a time in turn. A migration stays in
+ * the list until its pass completes it, the thread sleeps when all
+ * migrations are busy or have failed in this round.
+ */
+static void obj_migrator_run()
+{
+	int rc;
+	bool progress;
+	struct obj_migration *mig;
+	struct obj_migration **prev;
+	struct mio_bg_thread *bt = &obj_migrator.mg_thread;
+
+	pthread_mutex_lock(&bt->bt_lock);
+	while (!bt->bt_stopping) {
+		obj_redirect_deletions_run();
+		progress = false;
+		prev = &obj_migrator.mg_migrations;
+		while (*prev != NULL && !bt->bt_stopping) {
+			mig = *prev;
+			pthread_mutex_unlock(&bt->bt_lock);
+			rc = obj_migrate_pass(mig);
+			if (rc < 0 && rc != -EAGAIN)
+				mio_log(MIO_WARN,
+					"Migrating object failed: %d\n", rc);
+			pthread_mutex_lock(&bt->bt_lock);
+
+			/* Only this thread removes migrations. */
+			if (rc == -EAGAIN)
+				progress = true;
+			if (rc < 0) {
+				prev = &mig->om_next;
+				continue;
+			}
+			*prev = mig->om_next;
+			pthread_mutex_unlock(&bt->bt_lock);
+			obj_migration_free(mig);
+			pthread_mutex_lock(&bt->bt_lock);
+		}
+		if (!progress && obj_migrator.mg_deletions == NULL)
+			mio_bg_thread_wait(bt, OBJ_MIGRATE_RETRY_INTERVAL *
+					       1000000ULL);
+	}
+	pthread_mutex_unlock(&bt->bt_lock);
+}
+
+/* Must be called with the migrator lock held. */
+static int obj_migrator_start()
+{
+	int rc;
+
+	rc = mio_bg_thread_start(&obj_migrator.mg_thread, obj_migrator_run);
+	if (rc < 0)
+		mio_log(MIO_ERROR, "Starting object migrator failed: %d\n", rc);
+	return rc;
+}
+
+/**
+ * Called by the driver once the object of a migrated object is deleted.
+ * The composite object is deleted by the migrator thread, or when the
+ * instance is finalised if the thread can't be started.
+ */
+void mio_obj_redirect_deleted(const struct mio_obj_id *oid,
+			      const struct mio_obj_id *cobj_id)
+{
+	struct obj_redirect_rec *rec;
+	struct obj_redirect_rec **prev;
+	struct obj_redirect_del *del;
+
+	del = mio_mem_alloc(sizeof *del);
+	if (del == NULL) {
+		mio_log(MIO_WARN, "Deleting migrated object failed: %d\n",
+			-ENOMEM);
+		return;
+	}
+	del->ord_oid = *oid;
+	del->ord_cobj_id = *cobj_id;
+
+	pthread_mutex_lock(&obj_migrator.mg_thread.bt_lock);
+	for (prev = &obj_migrator.mg_redirects; *prev != NULL;
+	     prev = &(*prev)->orr_next) {
+		rec = *prev;
+		if (memcmp(rec->orr_oid.moi_bytes, oid->moi_bytes,
+			   MIO_OBJ_ID_LEN))
+			continue;
+		*prev = rec->orr_next;
+		mio_mem_free(rec);
+		break;
+	}
+	del->ord_next = obj_migrator.mg_deletions;
+	obj_migrator.mg_deletions = del;
+	obj_migrator_start();
+	pthread_cond_broadcast(&obj_migrator.mg_thread.bt_cond);
+	pthread_mutex_unlock(&obj_migrator.mg_thread.bt_lock);
+}
+
+void mio_obj_migrate_sys_fini()
+{
+	struct obj_migration *mig;
+	struct obj_migration *migs;
+	struct obj_redirect_rec *rec;
+
+	mio_bg_thread_stop(&obj_migrator.mg_thread);
+
+	/*
+	 * Unfinished migrations resume when the object is migrated again.
+	 * Closing their objects takes the migrator lock.
+	 */
+	pthread_mutex_lock(&obj_migrator.mg_thread.bt_lock);
+	obj_redirect_deletions_run();
+	migs = obj_migrator.mg_migrations;
+	obj_migrator.mg_migrations = NULL;
+	while (obj_migrator.mg_redirects != NULL) {
+		rec = obj_migrator.mg_redirects;
+		obj_migrator.mg_redirects = rec->orr_next;
+		mio_mem_free(rec);
+	}
+	pthread_mutex_unlock(&obj_migrator.mg_thread.bt_lock);
+
+	while (migs != NULL) {
+		mig = migs;
+		migs = mig->om_next;
+		obj_migration_free(mig);
+	}
+}
+
+/* --------------------------------------------------------------- *
+ *                     Starting a migration                        *
+ * ----------------------------------------------------------------*/
+
+/**
+ * Makes an object id for the composite object or a layer from the
+ * migrated object's id and a sequence number.
+ */
+static void obj_migrate_id_make(const struct mio_obj_id *oid, uint64_t seq,
+				struct mio_obj_id *ret_id)
+{
+	uint64_t hash[2];
+	uint8_t buf[MIO_OBJ_ID_LEN + sizeof seq];
+
+	mio_mem_copy(buf, (void *)oid->moi_bytes, MIO_OBJ_ID_LEN);
+	mio_mem_copy(buf + MIO_OBJ_ID_LEN, &seq, sizeof seq);
+	hash[0] = mio_hash_fnv1a(buf, sizeof buf);
+	hash[1] = mio_hash_fnv1a(hash, sizeof hash[0]);
+	mio_mem_copy(ret_id->moi_bytes, hash, MIO_OBJ_ID_LEN);
+}
+
+static void obj_migrate_obj_delete(struct mio_obj *obj)
+{
+	struct mio_op op;
+	struct mio_obj_id oid = obj->mo_id;
+
+	obj_migrate_obj_close(obj);
+	mio_op_init(&op);
+	if (mio_obj_delete(&oid, &op) == 0)
+		mio_op_wait(&op);
+	mio_op_fini(&op);
+}
+
+/**
+ * Creates an object with a newly made id, trying other ids if the one
+ * made is taken. The object is made ready to be a layer and left open.
+ */
+static int obj_migrate_obj_create(const struct mio_obj_id *oid,
+				  const struct mio_pool_id *pool_id,
+				  struct mio_obj **ret_obj)
+{
+	int i;
+	int rc = -EEXIST;
+	uint64_t seq;
+	struct mio_op op;
+	struct mio_obj_id new_id;
+	struct mio_obj *obj;
+
+	obj = mio_mem_alloc(sizeof *obj);
+	if (obj == NULL)
+		return -ENOMEM;
+
+	seq = mio_now();
+	for (i = 0; i < OBJ_MIGRATE_ID_NR_TRIES && rc == -EEXIST; i++) {
+		obj_migrate_id_make(oid, seq + i, &new_id);
+		mio_op_init(&op);
+		rc = mio_obj_create(&new_id, pool_id, NULL, obj, &op)? :
+		     mio_op_wait(&op);
+		mio_op_fini(&op);
+	}
+	if (rc < 0) {
+		mio_mem_free(obj);
+		return rc;
+	}
+	rc = mio_comp_obj_layer_prepare(obj);
+	if (rc < 0) {
+		obj_migrate_obj_delete(obj);
+		return rc;
+	}
+	*ret_obj = obj;
+	return 0;
+}
+
+/**
+ * Pushes a new top layer and move layer in the target pool onto the
+ * composite object, unless its top layer is in that pool already (an
+ * earlier migration which hasn't completed).
+ */
+static int obj_migrate_layer_push(struct mio_obj *cobj,
+				  const struct mio_pool_id *pool_id)
+{
+	int rc;
+	bool same_pool = false;
+	struct mio_op op;
+	struct mio_obj *lobj = NULL;
+	struct mio_obj *tobj = NULL;
+	struct mio_obj *mobj = NULL;
+	struct mio_obj_id ids[2];
+	struct mio_pool_id top_pool_id;
+	struct mio_comp_obj_layout layout;
+
+	mio_memset(&layout, 0, sizeof layout);
+	mio_op_init(&op);
+	rc = mio_composite_obj_list_layers(cobj, &layout, &op)? :
+	     mio_op_wait(&op);
+	mio_op_fini(&op);
+	if (rc < 0)
+		goto exit;
+
+	if (layout.mlo_nr_layers != 0) {
+		rc = obj_migrate_obj_open(&layout.mlo_layers[0].mcol_oid,
+					  &lobj)? :
+		     mio_obj_pool_id(lobj, &top_pool_id);
+		obj_migrate_obj_close(lobj);
+		if (rc < 0)
+			goto exit;
+		same_pool = mio_obj_pool_id_cmp(&top_pool_id,
+						(struct mio_pool_id *)pool_id);
+	}
+	if (same_pool)
+		goto exit;
+
+	rc = obj_migrate_obj_create(&cobj->mo_id, pool_id, &tobj)? :
+	     obj_migrate_obj_create(&cobj->mo_id, pool_id, &mobj);
+	if (rc < 0)
+		goto error;
+
+	ids[0] = tobj->mo_id;
+	ids[1] = mobj->mo_id;
+	rc = mio_comp_obj_layers_push(cobj, 2, ids, &layout);
+	if (rc < 0)
+		goto error;
+	obj_migrate_obj_close(tobj);
+	obj_migrate_obj_close(mobj);
+	goto exit;
+
+error:
+	if (tobj != NULL)
+		obj_migrate_obj_delete(tobj);
+	if (mobj != NULL)
+		obj_migrate_obj_delete(mobj);
+exit:
+	mio_mem_free(layout.mlo_layers);
+	return rc;
+}
+
+/**
+ * Turns the object into a redirect to a new composite object whose
+ * only layer is the object itself. The redirect is stored last, until
+ * then the object is left as it was.
+ */
+static int obj_migrate_redirect(struct mio_obj *obj, struct mio_obj **ret_cobj)
+{
+	int rc;
+	struct mio_op op;
+	struct mio_obj *cobj;
+	struct mio_obj_ext ext;
+	struct mio_comp_obj_layer layer;
+	struct obj_redirect_rec *rec;
+
+	rec = mio_mem_alloc(sizeof *rec);
+	if (rec == NULL)
+		return -ENOMEM;
+	/* The object becomes the composite object's layer. */
+	rc = mio_comp_obj_layer_prepare(obj)? :
+	     obj_migrate_obj_create(&obj->mo_id, NULL, &cobj);
+	if (rc < 0) {
+		mio_mem_free(rec);
+		return rc;
+	}
+
+	layer.mcol_oid = obj->mo_id;
+	layer.mcol_priority = 0;
+	ext.moe_off = 0;
+	ext.moe_size = obj->mo_attrs.moa_size;
+	mio_op_init(&op);
+	rc = mio_composite_obj_create(&cobj->mo_id, cobj, &op)? :
+	     mio_op_wait(&op);
+	mio_op_fini(&op);
+	if (rc == 0) {
+		mio_op_init(&op);
+		rc = mio_composite_obj_add_layers(cobj, 1, &layer, &op)? :
+		     mio_op_wait(&op);
+		mio_op_fini(&op);
+	}
+	if (rc == 0 && ext.moe_size != 0) {
+		mio_op_init(&op);
+		rc = mio_composite_obj_add_extents(cobj, &layer.mcol_oid,
+						   1, &ext, &op)? :
+		     mio_op_wait(&op);
+		mio_op_fini(&op);
+	}
+	if (rc < 0)
+		goto error;
+	cobj->mo_attrs.moa_size = obj->mo_attrs.moa_size;
+	cobj->mo_attrs_updated = true;
+
+	obj->mo_attrs.moa_redirected = true;
+	obj->mo_attrs.moa_redirect = cobj->mo_id;
+	rc = mio_obj_attrs_store(obj);
+	if (rc < 0) {
+		obj->mo_attrs.moa_redirected = false;
+		goto error;
+	}
+
+	/*
+	 * Handles opened from now on load the redirect stored. The sequence
+	 * number is taken with the migrator lock held to keep the list in
+	 * order.
+	 */
+	rec->orr_oid = obj->mo_id;
+	rec->orr_redirect = cobj->mo_id;
+	pthread_mutex_lock(&obj_migrator.mg_thread.bt_lock);
+	pthread_mutex_lock(&mio_obj_session_seqno_lock);
+	rec->orr_seqno = mio_obj_session_seqno;
+	pthread_mutex_unlock(&mio_obj_session_seqno_lock);
+	rec->orr_next = obj_migrator.mg_redirects;
+	obj_migrator.mg_redirects = rec;
+	pthread_mutex_unlock(&obj_migrator.mg_thread.bt_lock);
+
+	*ret_cobj = cobj;
+	return 0;
+
+error:
+	obj_migrate_obj_delete(cobj);
+	mio_mem_free(rec);
+	return rc;
+}
+
+int mio_obj_migrate(const struct mio_obj_id *oid,
+		    const struct mio_pool_id *pool_id)
+{
+	int rc;
+	struct mio_obj *obj;
+	struct mio_obj *cobj = NULL;
+	struct obj_migration *mig;
+
+	rc = mio_instance_check();
+	if (rc < 0)
+		return rc;
+	if (oid == NULL || pool_id == NULL)
+		return -EINVAL;
+	if (drv_comp_obj_ops == NULL ||
+	    drv_comp_obj_ops->mcoo_writev_layer == NULL ||
+	    drv_comp_obj_ops->mcoo_free_layer_data == NULL)
+		return -EOPNOTSUPP;
+
+	pthread_mutex_lock(&obj_migrator.mg_thread.bt_lock);
+	mig = obj_migration_find(oid);
+	pthread_mutex_unlock(&obj_migrator.mg_thread.bt_lock);
+	if (mig != NULL)
+		return -EBUSY;
+
+	rc = obj_migrate_obj_open(oid, &obj);
+	if (rc < 0)
+		return rc;
+	if (mio_comp_obj_is_composite(obj))
+		rc = -EINVAL;
+	else if (obj->mo_attrs.moa_redirected)
+		rc = obj_migrate_obj_open(&obj->mo_attrs.moa_redirect, &cobj);
+	else
+		rc = obj_migrate_redirect(obj, &cobj);
+	obj_migrate_obj_close(obj);
+	if (rc < 0)
+		goto error;
+	rc = obj_migrate_layer_push(cobj, pool_id);
+	if (rc < 0)
+		goto error;
+
+	mig = mio_mem_alloc(sizeof *mig);
+	if (mig == NULL) {
+		rc = -ENOMEM;
+		goto error;
+	}
+	mig->om_oid = *oid;
+	mig->om_cobj = cobj;
+
+	pthread_mutex_lock(&obj_migrator.mg_thread.bt_lock);
+	rc = obj_migration_find(oid) != NULL? -EBUSY : obj_migrator_start();
+	if (rc == 0) {
+		mig->om_next = obj_migrator.mg_migrations;
+		obj_migrator.mg_migrations = mig;
+		pthread_cond_broadcast(&obj_migrator.mg_thread.bt_cond);
+	}
+	pthread_mutex_unlock(&obj_migrator.mg_thread.bt_lock);
+	if (rc < 0) {
+		mio_mem_free(mig);
+		goto error;
+	}
+	return 0;
+
+error:
+	mio_log(MIO_ERROR, "Starting migration failed: %d\n", rc);
+	obj_migrate_obj_close(cobj);
+	return rc;
+}
+
+/*
+ *  Local variables:
+ *  c-indentation-style: "K&R"
+ *  c-basic-offset: 8
+ *  tab-width: 8
+ *  fill-column: 80
+ *  scroll-step: 1
+ *  End:
+ */
+/*
+ * vim: tabstop=8 shiftwidth=8 noexpandtab textwidth=80 nowrap
+ *
+ */
@@ -0,0 +1,505 @@
+/* -*- C -*- */
+/*
+ * Copyright: (c) 2020 - 2021 Seagate Technology LLC and/or its its Affiliates,
+ * All Rights Reserved
+ *
+ * This software is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ */
+
+#include <errno.h>
+#include <assert.h>
+#include <string.h>
+#include <pthread.h>
+
+#include "logger.h"
+#include "utils.h"
+#include "mio.h"
+#include "mio_internal.h"
+#include "mio_telemetry.h"
+
+/**
+ * Object expiry index and reaper.
+ *
+ * An object's MIO_HINT_OBJ_LIFETIME hint is the time it expires. Every
+ * object with the hint has a record in the expiry key-value set
+ * `mio_obj_expiry_kvs`, added when the object is created with the hint
+ * or when the hint is set, moved when the hint changes and removed when
+ * the object is deleted by mio_obj_delete() or mio_objs_delete(). The
+ * key is the expiry time (big-endian, so records are ordered by it)
+ * followed by the object id.
+ *
+ * A record can outlive its object or the object's lifetime: the record
+ * of a creation which failed after being launched, or one a failed hint
+ * update or deletion didn't move or remove. So the index is only a list
+ * of candidates, the reaper opens them and keeps to the lifetime stored
+ * in the object's attributes.
+ *
+ * When MIO_OBJ_REAPER is set in the configuration, a thread started by
+ * mio_init() walks the index from the earliest record every interval
+ * and deletes the objects which have expired, OBJ_REAPER_BATCH at a
+ * time. A batch is opened by one mio_objs_open() op, the objects whose
+ * stored lifetime is the record's are deleted by one mio_objs_delete()
+ * op, which removes the data, the attributes and the index records of
+ * all of them together, and the index records of the objects already
+ * gone or with another lifetime are then deleted by one op. The reaper deletes at most
+ * MIO_OBJ_REAPER_RATE objects per second.
+ *
+ * Each pass is reported as a telemetry record "mio-obj-reaper"
+ * {nr_expired, nr_deleted, nr_failed}.
+ */
+
+enum {
+	/* In milliseconds. */
+	OBJ_REAPER_DEFAULT_INTERVAL = 60000,
+	/* Objects per second. */
+	OBJ_REAPER_DEFAULT_RATE = 1000,
+	OBJ_REAPER_BATCH = 256,
+};
+
+struct obj_expiry_key {
+	/* Seconds since the Epoch, big-endian. */
+	uint64_t oek_expiry;
+	struct mio_obj_id oek_oid;
+} __attribute__((packed));
+
+struct obj_reaper {
+	struct mio_bg_thread or_thread;
+
+	/* In nano-seconds. */
+	uint64_t or_interval;
+	uint64_t or_rate;
+
+	/* Only used by the reaper thread. */
+	uint64_t or_nr_expired;
+	uint64_t or_nr_deleted;
+	uint64_t or_nr_failed;
+};
+
+static struct obj_reaper obj_reaper = {
+	.or_thread = MIO_BG_THREAD_INITIALIZER,
+};
+
+static void obj_expiry_key_set(struct obj_expiry_key *key,
+			       const struct mio_obj_id *oid, uint64_t expiry)
+{
+	key->oek_expiry = mio_byteorder_cpu_to_be64(expiry);
+	key->oek_oid = *oid;
+}
+
+static int obj_expiry_kvs_exec(int opcode, int nr, struct obj_expiry_key *keys)
+{
+	int i;
+	int rc;
+	int32_t *rcs;
+	struct mio_op op;
+	struct mio_kv_pair *kvps;
+
+	rcs = mio_mem_alloc(nr * sizeof *rcs);
+	kvps = mio_mem_alloc(nr * sizeof *kvps);
+	if (rcs == NULL || kvps == NULL) {
+		rc = -ENOMEM;
+		goto exit;
+	}
+	for (i = 0; i < nr; i++) {
+		kvps[i].mkp_key = keys + i;
+		kvps[i].mkp_klen = sizeof *keys;
+		/* The value isn't used, the expiry time keeps it non-empty. */
+		kvps[i].mkp_val = &keys[i].oek_expiry;
+		kvps[i].mkp_vlen = sizeof keys[i].oek_expiry;
+	}
+
+	mio_op_init(&op);
+	if (opcode == MIO_KVS_PUT)
+		rc = mio_kvs_pair_put(&mio_obj_expiry_kvs.mk_id, nr,
+				      kvps, rcs, &op);
+	else
+		rc = mio_kvs_pair_del(&mio_obj_expiry_kvs.mk_id, nr,
+				      kvps, rcs, &op);
+	rc = rc? : mio_op_wait(&op);
+	mio_op_fini(&op);
+	for (i = 0; i < nr && rc == 0; i++)
+		if (rcs[i] != 0 && !(opcode == MIO_KVS_DEL &&
+				     rcs[i] == -ENOENT))
+			rc = rcs[i];
+
+exit:
+	mio_mem_free(rcs);
+	mio_mem_free(kvps);
+	return rc;
+}
+
+int mio_obj_expiry_add(int nr_objs, const struct mio_obj_id *oids,
+		       uint64_t expiry)
+{
+	int i;
+	int rc;
+	struct obj_expiry_key *keys;
+
+	if (expiry == MIO_HINT_VALUE_NULL)
+		return 0;
+
+	keys = mio_mem_alloc(nr_objs * sizeof *keys);
+	if (keys == NULL)
+		return -ENOMEM;
+	for (i = 0; i < nr_objs; i++)
+		obj_expiry_key_set(keys + i, oids + i, expiry);
+	rc = obj_expiry_kvs_exec(MIO_KVS_PUT, nr_objs, keys);
+	mio_mem_free(keys);
+	return rc;
+}
+
+int mio_obj_expiry_del(int nr_objs, const struct mio_obj_id *oids,
+		       uint64_t expiry)
+{
+	int i;
+	int rc;
+	struct obj_expiry_key *keys;
+
+	if (expiry == MIO_HINT_VALUE_NULL)
+		return 0;
+
+	keys = mio_mem_alloc(nr_objs * sizeof *keys);
+	if (keys == NULL)
+		return -ENOMEM;
+	for (i = 0; i < nr_objs; i++)
+		obj_expiry_key_set(keys + i, oids + i, expiry);
+	rc = obj_expiry_kvs_exec(MIO_KVS_DEL, nr_objs, keys);
+	mio_mem_free(keys);
+	return rc;
+}
+
+int mio_obj_expiry_update(const struct mio_obj_id *oid,
+			  uint64_t old_expiry, uint64_t new_expiry)
+{
+	int rc = 0;
+
+	if (old_expiry == new_expiry)
+		return 0;
+
+	rc = mio_obj_expiry_add(1, oid, new_expiry)? :
+	     mio_obj_expiry_del(1, oid, old_expiry);
+	return rc;
+}
+
+struct obj_expiry_del_args {
+	struct obj_expiry_key *eda_keys;
+	struct mio_kv_pair *eda_kvps;
+	int32_t *eda_rcs;
+};
+
+static void obj_expiry_del_args_free(struct obj_expiry_del_args *args)
+{
+	mio_mem_free(args->eda_keys);
+	mio_mem_free(args->eda_kvps);
+	mio_mem_free(args->eda_rcs);
+	mio_mem_free(args);
+}
+
+static int obj_expiry_del_fini(struct mio_driver_op *dop)
+{
+	obj_expiry_del_args_free(dop->mdo_op_args);
+	return 0;
+}
+
+int mio_obj_expiry_del_launch(int nr_objs, const struct mio_obj_id *oids,
+			      const uint64_t *expiries, struct mio_op *op)
+{
+	int i;
+	int rc;
+	struct obj_expiry_del_args *args;
+
+	args = mio_mem_alloc(sizeof *args);
+	if (args == NULL)
+		return -ENOMEM;
+	args->eda_keys = mio_mem_alloc(nr_objs * sizeof *args->eda_keys);
+	args->eda_kvps = mio_mem_alloc(nr_objs * sizeof *args->eda_kvps);
+	args->eda_rcs = mio_mem_alloc(nr_objs * sizeof *args->eda_rcs);
+	if (args->eda_keys == NULL || args->eda_kvps == NULL ||
+	    args->eda_rcs == NULL) {
+		rc = -ENOMEM;
+		goto error;
+	}
+	for (i = 0; i < nr_objs; i++) {
+		obj_expiry_key_set(args->eda_keys + i, oids + i, expiries[i]);
+		args->eda_kvps[i].mkp_key = args->eda_keys + i;
+		args->eda_kvps[i].mkp_klen = sizeof *args->eda_keys;
+	}
+
+	/* The arguments are released with the op. */
+	rc = mio_driver_op_add_fini(op, obj_expiry_del_fini, args);
+	if (rc < 0)
+		goto error;
+	return mio_instance->m_driver->md_kvs_ops->mko_del(
+		&mio_obj_expiry_kvs.mk_id, nr_objs, args->eda_kvps,
+		args->eda_rcs, op);
+
+error:
+	obj_expiry_del_args_free(args);
+	return rc;
+}
+
+static bool obj_reaper_stopping()
+{
+	return mio_bg_thread_stopping(&obj_reaper.or_thread);
+}
+
+/* Waits for `ns` nano-seconds or until the reaper is stopped. */
+static void obj_reaper_wait(uint64_t ns)
+{
+	pthread_mutex_lock(&obj_reaper.or_thread.bt_lock);
+	mio_bg_thread_wait(&obj_reaper.or_thread, ns);
+	pthread_mutex_unlock(&obj_reaper.or_thread.bt_lock);
+}
+
+/**
+ * Opens a batch of expired objects to check their stored lifetime.
+ * `keep` is set for the records to keep, of objects which couldn't be
+ * opened. Moves the records of objects to delete to the front of
+ * `keys` and returns how many there are, the others are stale.
+ */
+static int obj_reaper_check(int nr, struct obj_expiry_key *keys, bool *keep)
+{
+	int i;
+	int rc;
+	int nr_expired = 0;
+	uint64_t lifetime;
+	int32_t rcs[OBJ_REAPER_BATCH];
+	struct mio_op op;
+	struct mio_obj_id oids[OBJ_REAPER_BATCH];
+	struct obj_expiry_key key;
+	struct mio_obj *objs;
+
+	objs = mio_mem_alloc(nr * sizeof *objs);
+	if (objs == NULL)
+		return -ENOMEM;
+	for (i = 0; i < nr; i++)
+		oids[i] = keys[i].oek_oid;
+	mio_memset(rcs, 0, sizeof rcs);
+
+	mio_op_init(&op);
+	rc = mio_objs_open(nr, oids, objs, rcs, &op)? :
+	     mio_op_wait(&op);
+	mio_op_fini(&op);
+	if (rc < 0) {
+		mio_mem_free(objs);
+		return rc;
+	}
+
+	for (i = 0; i < nr; i++) {
+		keep[i] = rcs[i] != 0 && rcs[i] != -ENOENT;
+		if (rcs[i] != 0)
+			continue;
+		if (mio_hint_lookup(&objs[i].mo_hints, MIO_HINT_OBJ_LIFETIME,
+				    &lifetime) == 0 &&
+		    lifetime == mio_byteorder_be64_to_cpu(keys[i].oek_expiry)) {
+			key = keys[nr_expired];
+			keys[nr_expired] = keys[i];
+			keys[i] = key;
+			keep[i] = keep[nr_expired];
+			keep[nr_expired++] = false;
+		}
+		mio_obj_close(objs + i);
+	}
+	mio_mem_free(objs);
+	return nr_expired;
+}
+
+/**
+ * Deletes a batch of expired objects, then the index records of those
+ * already gone and the stale ones. Records of objects which couldn't be
+ * checked or deleted are kept and retried in the next pass.
+ */
+static void obj_reaper_delete(int nr, struct obj_expiry_key *keys)
+{
+	int i;
+	int rc;
+	int nr_expired;
+	int nr_gone = 0;
+	bool keep[OBJ_REAPER_BATCH];
+	int32_t rcs[OBJ_REAPER_BATCH];
+	struct mio_op op;
+	struct mio_obj_id oids[OBJ_REAPER_BATCH];
+
+	nr_expired = obj_reaper_check(nr, keys, keep);
+	if (nr_expired < 0) {
+		mio_log(MIO_WARN, "Checking expired objects failed: %d\n",
+			nr_expired);
+		obj_reaper.or_nr_failed += nr;
+		return;
+	}
+
+	for (i = 0; i < nr_expired; i++)
+		oids[i] = keys[i].oek_oid;
+	mio_memset(rcs, 0, sizeof rcs);
+	if (nr_expired != 0) {
+		mio_op_init(&op);
+		rc = mio_objs_delete(nr_expired, oids, rcs, &op)? :
+		     mio_op_wait(&op);
+		mio_op_fini(&op);
+		if (rc < 0) {
+			mio_log(MIO_WARN, "Reaping objects failed: %d\n", rc);
+			for (i = 0; i < nr_expired; i++)
+				rcs[i] = rc;
+		}
+	}
+
+	for (i = 0; i < nr; i++) {
+		if (keep[i] ||
+		    (i < nr_expired && rcs[i] != 0 && rcs[i] != -ENOENT)) {
+			obj_reaper.or_nr_failed++;
+			continue;
+		}
+		/* The record went with the object. */
+		if (i < nr_expired && rcs[i] == 0) {
+			obj_reaper.or_nr_deleted++;
+			continue;
+		}
+		keys[nr_gone++] = keys[i];
+	}
+	if (nr_gone == 0)
+		return;
+	rc = obj_expiry_kvs_exec(MIO_KVS_DEL, nr_gone, keys);
+	if (rc < 0)
+		mio_log(MIO_WARN, "Deleting expiry records failed: %d\n", rc);
+}
+
+/**
+ * Walks the expiry index from the earliest record up to the first one
+ * which hasn't expired yet, OBJ_REAPER_BATCH records at a time.
+ */
+static void obj_reaper_pass()
+{
+	int i;
+	int rc;
+	int nr;
+	bool first = true;
+	bool done = false;
+	void *start = NULL;
+	size_t start_len = 0;
+	uint64_t now;
+	uint64_t batch_start;
+	uint64_t batch_time;
+	int32_t rcs[OBJ_REAPER_BATCH];
+	struct mio_op op;
+	struct mio_kv_pair kvps[OBJ_REAPER_BATCH];
+	struct obj_expiry_key keys[OBJ_REAPER_BATCH];
+
+	obj_reaper.or_nr_expired = 0;
+	obj_reaper.or_nr_deleted = 0;
+	obj_reaper.or_nr_failed = 0;
+	now = mio_now() / 1000000000ULL;
+	do {
+		batch_start = mio_now();
+		mio_memset(kvps, 0, sizeof kvps);
+		mio_memset(rcs, 0, sizeof rcs);
+		kvps[0].mkp_key = start;
+		kvps[0].mkp_klen = start_len;
+		mio_op_init(&op);
+		rc = mio_kvs_pair_next(&mio_obj_expiry_kvs.mk_id,
+				       OBJ_REAPER_BATCH, kvps, !first,
+				       rcs, &op)? :
+		     mio_op_wait(&op);
+		mio_op_fini(&op);
+		mio_mem_free(start);
+		start = NULL;
+		if (rc < 0) {
+			mio_log(MIO_WARN, "Reaper scan failed: %d\n", rc);
+			break;
+		}
+		first = false;
+
+		nr = 0;
+		for (i = 0; i < OBJ_REAPER_BATCH && rcs[i] == 0 &&
+			    kvps[i].mkp_key != NULL && !done; i++) {
+			if (kvps[i].mkp_klen != sizeof *keys)
+				continue;
+			mio_mem_copy(keys + nr, kvps[i].mkp_key, sizeof *keys);
+			if (mio_byteorder_be64_to_cpu(keys[nr].oek_expiry) >
+			    now)
+				done = true;
+			else
+				nr++;
+		}
+		if (i < OBJ_REAPER_BATCH)
+			done = true;
+
+		/* The last key returned is where the next batch starts. */
+		if (!done) {
+			start = kvps[i - 1].mkp_key;
+			start_len = kvps[i - 1].mkp_klen;
+			kvps[i - 1].mkp_key = NULL;
+		}
+		for (i = 0; i < OBJ_REAPER_BATCH; i++) {
+			mio_mem_free(kvps[i].mkp_key);
+			mio_mem_free(kvps[i].mkp_val);
+		}
+
+		if (nr != 0 && !obj_reaper_stopping()) {
+			obj_reaper.or_nr_expired += nr;
+			obj_reaper_delete(nr, keys);
+			/* Keep to the rate. */
+			batch_time = nr * 1000000000ULL / obj_reaper.or_rate;
+			if (mio_now() - batch_start < batch_time)
+				obj_reaper_wait(batch_time -
+						(mio_now() - batch_start));
+		}
+	} while (!done && !obj_reaper_stopping());
+
+	mio_mem_free(start);
+	mio_telemetry_array_advertise_noprefix(
+		"mio-obj-reaper", MIO_TM_TYPE_ARRAY_UINT64, 3,
+		obj_reaper.or_nr_expired, obj_reaper.or_nr_deleted,
+		obj_reaper.or_nr_failed);
+}
+
+static void obj_reaper_run()
+{
+	while (!obj_reaper_stopping()) {
+		obj_reaper_pass();
+		obj_reaper_wait(obj_reaper.or_interval);
+	}
+}
+
+int mio_obj_reaper_sys_init()
+{
+	int rc;
+	uint64_t interval;
+
+	if (!mio_instance->m_obj_reaper)
+		return 0;
+	if (mio_instance->m_driver->md_obj_ops->moo_objs_open == NULL ||
+	    mio_instance->m_driver->md_obj_ops->moo_objs_delete == NULL)
+		return -EOPNOTSUPP;
+
+	interval = mio_instance->m_obj_reaper_interval?:
+		   OBJ_REAPER_DEFAULT_INTERVAL;
+	obj_reaper.or_interval = interval * 1000000ULL;
+	obj_reaper.or_rate = mio_instance->m_obj_reaper_rate?:
+			     OBJ_REAPER_DEFAULT_RATE;
+
+	rc = mio_bg_thread_start(&obj_reaper.or_thread, obj_reaper_run);
+	if (rc < 0)
+		mio_log(MIO_ERROR, "Starting reaper thread failed: %d\n", rc);
+	return rc;
+}
+
+void mio_obj_reaper_sys_fini()
+{
+	mio_bg_thread_stop(&obj_reaper.or_thread);
+}
+
+/*
+ *  Local variables:
+ *  c-indentation-style: "K&R"
+ *  c-basic-offset: 8
+ *  tab-width: 8
+ *  fill-column: 80
+ *  scroll-step: 1
+ *  End:
+ */
+/*
+ * vim: tabstop=8 shiftwidth=8 noexpandtab textwidth=80 nowrap
+ *
+ */
@@ -0,0 +1,426 @@
+/* -*- C -*- */
+/*
+ * Copyright: (c) 2020 - 2021 Seagate Technology LLC and/or its its Affiliates,
+ * All Rights Reserved
+ *
+ * This software is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ */
+
+#include <errno.h>
+#include <assert.h>
+#include <string.h>
+#include <pthread.h>
+
+#include "logger.h"
+#include "utils.h"
+#include "mio.h"
+#include "mio_internal.h"
+#include "mio_telemetry.h"
+
+/**
+ * Background tiering.
+ *
+ * When MIO_OBJ_TIERING is set in the configuration, a thread started by
+ * mio_init() keeps objects in the pool their hotness asks for, the job
+ * examples/mio_hsm.c does by hand.
+ *
+ * Only objects opted in with the persistent hint MIO_HINT_OBJ_AUTO_TIERING
+ * are moved. Every scan interval the thread walks the attribute
+ * key-value set(s) and decodes each record. Objects not opted in,
+ * composite objects and objects which have never been accessed are
+ * skipped there. The remaining objects are opened to compare the pool
+ * they are in with the pool mio_obj_hotness_to_pool_id() picks for
+ * their current hotness. Objects in the wrong pool are queued and the
+ * queue then replaces the one of the previous scan.
+ *
+ * Queued objects are moved with mio_obj_migrate(), subject to a budget
+ * of bytes per second for each pair of (from, to) pools. Each pair has a
+ * token bucket refilled at the budget rate and holding at most one
+ * second of budget. A migration is started when the bucket of its pair
+ * isn't in debt and takes the object's size from it, so objects larger
+ * than the budget still move, the pair then waits until the debt is
+ * paid off. The budget bounds the average rate at which data is handed
+ * to the migrator, not the rate of each migration.
+ *
+ * Each scan is reported as a telemetry record "mio-obj-tiering-scan"
+ * {nr_scanned, nr_queued, nr_started}, nr_started being the number of
+ * migrations started since the previous scan, and each migration as a
+ * record "mio-obj-tiering-migrate" {from pool index, to pool index, size}.
+ */
+
+enum {
+	/* In milliseconds. */
+	OBJ_TIERING_DEFAULT_SCAN_INTERVAL = 60000,
+	OBJ_TIERING_TICK = 1000,
+	/* Bytes per second for each pair of pools. */
+	OBJ_TIERING_DEFAULT_BANDWIDTH = 64 * 1024 * 1024,
+	OBJ_TIERING_SCAN_BATCH = 64,
+	OBJ_TIERING_QUEUE_BATCH = 256,
+};
+
+struct obj_tiering_cand {
+	struct mio_obj_id otc_oid;
+	int otc_from;
+	int otc_to;
+	uint64_t otc_size;
+};
+
+struct obj_tiering_bucket {
+	/* In bytes, negative when in debt. */
+	int64_t otb_tokens;
+	/* When the bucket was last refilled, in nano-seconds. */
+	uint64_t otb_time;
+};
+
+struct obj_tierd {
+	struct mio_bg_thread td_thread;
+
+	/* In nano-seconds. */
+	uint64_t td_interval;
+	uint64_t td_bandwidth;
+
+	/* Only used by the tiering thread. */
+	int td_nr_pools;
+	struct obj_tiering_bucket *td_buckets;
+	int td_nr_cands;
+	int td_max_nr_cands;
+	int td_next_cand;
+	struct obj_tiering_cand *td_cands;
+	/* Migrations started since the last scan. */
+	uint64_t td_nr_started;
+};
+
+static struct obj_tierd obj_tierd = {
+	.td_thread = MIO_BG_THREAD_INITIALIZER,
+};
+
+static int obj_tiering_pool_idx(struct mio_pool_id *pool_id)
+{
+	int i;
+
+	for (i = 0; i < obj_tierd.td_nr_pools; i++)
+		if (mio_obj_pool_id_cmp(&mio_pools.mps_pools[i].mp_id, pool_id))
+			return i;
+	return -ENOENT;
+}
+
+static int obj_tiering_cand_add(struct obj_tiering_cand *cand)
+{
+	int max_nr;
+	struct obj_tiering_cand *cands;
+
+	if (obj_tierd.td_nr_cands == obj_tierd.td_max_nr_cands) {
+		max_nr = obj_tierd.td_max_nr_cands + OBJ_TIERING_QUEUE_BATCH;
+		cands = mio_mem_alloc(max_nr * sizeof *cands);
+		if (cands == NULL)
+			return -ENOMEM;
+		if (obj_tierd.td_nr_cands != 0)
+			mio_mem_copy(cands, obj_tierd.td_cands,
+				     obj_tierd.td_nr_cands * sizeof *cands);
+		mio_mem_free(obj_tierd.td_cands);
+		obj_tierd.td_cands = cands;
+		obj_tierd.td_max_nr_cands = max_nr;
+	}
+	obj_tierd.td_cands[obj_tierd.td_nr_cands++] = *cand;
+	return 0;
+}
+
+/**
+ * Checks if the object whose attribute record is `val` is in the pool
+ * its hotness asks for. Returns 1 and fills `cand` if it isn't, 0 if it
+ * is or it is not to be tiered. The object is only opened, to find its
+ * pool, if it is to be tiered.
+ */
+static int obj_tiering_check(const struct mio_obj_id *oid,
+			     const void *val, size_t vlen,
+			     struct obj_tiering_cand *cand)
+{
+	int rc;
+	uint64_t hotness;
+	uint64_t opted_in = 0;
+	struct mio_op op;
+	struct mio_obj obj;
+	struct mio_obj_stats *stats;
+	struct mio_pool_id pool_id;
+	struct mio_pool_id new_pool_id;
+	struct mio_obj_ops *obj_ops = mio_instance->m_driver->md_obj_ops;
+
+	mio_memset(&obj, 0, sizeof obj);
+	obj.mo_id = *oid;
+	rc = obj_ops->moo_attrs_decode(val, vlen, &obj);
+	if (rc < 0)
+		return rc;
+
+	mio_hint_map_get(&obj.mo_hints.mh_map, MIO_HINT_OBJ_AUTO_TIERING,
+			 &opted_in);
+	stats = &obj.mo_attrs.moa_stats;
+	if (opted_in == 0 || obj.mo_attrs.moa_composite ||
+	    stats->mos_rcount + stats->mos_wcount == 0)
+		return 0;
+	rc = mio_obj_hint_get(&obj, MIO_HINT_OBJ_HOT_INDEX, &hotness);
+	if (rc < 0)
+		return rc;
+	new_pool_id = mio_obj_hotness_to_pool_id(hotness);
+	cand->otc_to = obj_tiering_pool_idx(&new_pool_id);
+	if (cand->otc_to < 0)
+		return 0;
+
+	mio_memset(&obj, 0, sizeof obj);
+	mio_op_init(&op);
+	rc = mio_obj_open(oid, &obj, &op)? : mio_op_wait(&op);
+	mio_op_fini(&op);
+	if (rc < 0)
+		return rc;
+
+	rc = mio_obj_pool_id(&obj, &pool_id);
+	if (rc < 0 || mio_obj_pool_id_cmp(&pool_id, &new_pool_id))
+		goto exit;
+
+	cand->otc_oid = *oid;
+	cand->otc_from = obj_tiering_pool_idx(&pool_id);
+	cand->otc_size = obj.mo_attrs.moa_size;
+	/* Objects in pools not configured are left alone. */
+	if (cand->otc_from >= 0)
+		rc = 1;
+
+exit:
+	mio_obj_close(&obj);
+	return rc;
+}
+
+static bool obj_tiering_stopping()
+{
+	return mio_bg_thread_stopping(&obj_tierd.td_thread);
+}
+
+/**
+ * Scans one attribute key-value set, OBJ_TIERING_SCAN_BATCH records at
+ * a time, starting each batch from the last key of the previous one.
+ */
+static int obj_tiering_kvs_scan(struct mio_kvs *kvs, int *nr_scanned)
+{
+	int i;
+	int rc;
+	int ret;
+	bool first = true;
+	void *start = NULL;
+	size_t start_len = 0;
+	int32_t rcs[OBJ_TIERING_SCAN_BATCH];
+	struct mio_op op;
+	struct mio_obj_id oid;
+	struct mio_kv_pair kvps[OBJ_TIERING_SCAN_BATCH];
+	struct obj_tiering_cand cand;
+	struct mio_obj_ops *obj_ops = mio_instance->m_driver->md_obj_ops;
+
+	do {
+		mio_memset(kvps, 0, sizeof kvps);
+		mio_memset(rcs, 0, sizeof rcs);
+		kvps[0].mkp_key = start;
+		kvps[0].mkp_klen = start_len;
+		mio_op_init(&op);
+		rc = mio_kvs_pair_next(&kvs->mk_id, OBJ_TIERING_SCAN_BATCH,
+				       kvps, !first, rcs, &op)? :
+		     mio_op_wait(&op);
+		mio_op_fini(&op);
+		mio_mem_free(start);
+		start = NULL;
+		if (rc < 0)
+			break;
+		first = false;
+
+		for (i = 0; i < OBJ_TIERING_SCAN_BATCH && rcs[i] == 0 &&
+			    kvps[i].mkp_key != NULL; i++) {
+			if (obj_ops->moo_attrs_key_decode(kvps[i].mkp_key,
+							  kvps[i].mkp_klen,
+							  &oid) < 0 ||
+			    obj_tiering_stopping())
+				continue;
+			(*nr_scanned)++;
+			ret = obj_tiering_check(&oid, kvps[i].mkp_val,
+						kvps[i].mkp_vlen, &cand);
+			if (ret == 1)
+				ret = obj_tiering_cand_add(&cand);
+			if (ret < 0 && ret != -ENOENT)
+				mio_log(MIO_DEBUG,
+					"Tiering check failed: %d\n", ret);
+		}
+
+		/* The last key returned is where the next batch starts. */
+		if (i == OBJ_TIERING_SCAN_BATCH) {
+			start = kvps[i - 1].mkp_key;
+			start_len = kvps[i - 1].mkp_klen;
+			kvps[i - 1].mkp_key = NULL;
+		}
+		for (i = 0; i < OBJ_TIERING_SCAN_BATCH; i++) {
+			mio_mem_free(kvps[i].mkp_key);
+			mio_mem_free(kvps[i].mkp_val);
+		}
+	} while (start != NULL && !obj_tiering_stopping());
+
+	mio_mem_free(start);
+	return rc;
+}
+
+static void obj_tiering_scan()
+{
+	int i;
+	int rc;
+	int nr_scanned = 0;
+	uint64_t nr_queued;
+
+	obj_tierd.td_nr_cands = 0;
+	obj_tierd.td_next_cand = 0;
+
+	/* Records stored before sharding was on are in the main set. */
+	rc = obj_tiering_kvs_scan(&mio_obj_attrs_kvs, &nr_scanned);
+	for (i = 0; i < mio_obj_attrs_kvs_nr_shards && rc == 0; i++)
+		rc = obj_tiering_kvs_scan(mio_obj_attrs_kvs_shards + i,
+					  &nr_scanned);
+	if (rc < 0)
+		mio_log(MIO_WARN, "Tiering scan failed: %d\n", rc);
+
+	nr_queued = obj_tierd.td_nr_cands;
+	mio_telemetry_array_advertise_noprefix(
+		"mio-obj-tiering-scan", MIO_TM_TYPE_ARRAY_UINT64,
+		3, (uint64_t)nr_scanned, nr_queued, obj_tierd.td_nr_started);
+	obj_tierd.td_nr_started = 0;
+}
+
+static struct obj_tiering_bucket *obj_tiering_bucket(int from, int to,
+						     uint64_t now)
+{
+	uint64_t elapsed;
+	struct obj_tiering_bucket *bucket;
+
+	bucket = obj_tierd.td_buckets + from * obj_tierd.td_nr_pools + to;
+	elapsed = now - bucket->otb_time;
+	/* A bucket holds at most one second of budget. */
+	if (elapsed > 1000000000ULL)
+		elapsed = 1000000000ULL;
+	bucket->otb_tokens += obj_tierd.td_bandwidth * elapsed /
+			      1000000000ULL;
+	if (bucket->otb_tokens > (int64_t)obj_tierd.td_bandwidth)
+		bucket->otb_tokens = obj_tierd.td_bandwidth;
+	bucket->otb_time = now;
+	return bucket;
+}
+
+/**
+ * Starts migrations for queued objects, in queue order, as long as the
+ * budget allows. An object whose pair of pools is out of budget holds
+ * the queue back so that the queue order is kept.
+ */
+static void obj_tiering_dispatch()
+{
+	int rc;
+	uint64_t now;
+	struct obj_tiering_cand *cand;
+	struct obj_tiering_bucket *bucket;
+
+	now = mio_now();
+	while (obj_tierd.td_next_cand < obj_tierd.td_nr_cands &&
+	       !obj_tiering_stopping()) {
+		cand = obj_tierd.td_cands + obj_tierd.td_next_cand;
+		bucket = obj_tiering_bucket(cand->otc_from, cand->otc_to, now);
+		if (bucket->otb_tokens < 0)
+			break;
+
+		rc = mio_obj_migrate(&cand->otc_oid,
+				     &mio_pools.mps_pools[cand->otc_to].mp_id);
+		if (rc == 0) {
+			bucket->otb_tokens -= cand->otc_size;
+			obj_tierd.td_nr_started++;
+			mio_telemetry_array_advertise_noprefix(
+				"mio-obj-tiering-migrate",
+				MIO_TM_TYPE_ARRAY_UINT64, 3,
+				(uint64_t)cand->otc_from,
+				(uint64_t)cand->otc_to, cand->otc_size);
+		} else if (rc != -EBUSY)
+			mio_log(MIO_WARN, "Tiering migration failed: %d\n", rc);
+		obj_tierd.td_next_cand++;
+	}
+}
+
+static void obj_tiering_run()
+{
+	uint64_t next_scan = 0;
+	struct mio_bg_thread *bt = &obj_tierd.td_thread;
+
+	pthread_mutex_lock(&bt->bt_lock);
+	while (!bt->bt_stopping) {
+		pthread_mutex_unlock(&bt->bt_lock);
+		if (mio_now() >= next_scan) {
+			obj_tiering_scan();
+			next_scan = mio_now() + obj_tierd.td_interval;
+		}
+		obj_tiering_dispatch();
+		pthread_mutex_lock(&bt->bt_lock);
+		mio_bg_thread_wait(bt, OBJ_TIERING_TICK * 1000000ULL);
+	}
+	pthread_mutex_unlock(&bt->bt_lock);
+}
+
+int mio_obj_tiering_sys_init()
+{
+	int rc;
+	int nr_pools = mio_pools.mps_nr_pools;
+	uint64_t interval;
+
+	if (!mio_instance->m_obj_tiering)
+		return 0;
+	if (mio_instance->m_driver->md_obj_ops->moo_attrs_key_decode == NULL ||
+	    mio_instance->m_driver->md_obj_ops->moo_attrs_decode == NULL)
+		return -EOPNOTSUPP;
+	if (nr_pools < 2) {
+		mio_log(MIO_WARN, "Tiering needs at least 2 pools!\n");
+		return 0;
+	}
+
+	obj_tierd.td_buckets = mio_mem_alloc(nr_pools * nr_pools *
+					     sizeof *obj_tierd.td_buckets);
+	if (obj_tierd.td_buckets == NULL)
+		return -ENOMEM;
+	obj_tierd.td_nr_pools = nr_pools;
+	interval = mio_instance->m_obj_tiering_scan_interval?:
+		   OBJ_TIERING_DEFAULT_SCAN_INTERVAL;
+	obj_tierd.td_interval = interval * 1000000ULL;
+	obj_tierd.td_bandwidth = mio_instance->m_obj_tiering_bandwidth?:
+				 OBJ_TIERING_DEFAULT_BANDWIDTH;
+
+	rc = mio_bg_thread_start(&obj_tierd.td_thread, obj_tiering_run);
+	if (rc < 0) {
+		mio_log(MIO_ERROR, "Starting tiering thread failed: %d\n", rc);
+		mio_mem_free(obj_tierd.td_buckets);
+		obj_tierd.td_buckets = NULL;
+	}
+	return rc;
+}
+
+void mio_obj_tiering_sys_fini()
+{
+	mio_bg_thread_stop(&obj_tierd.td_thread);
+
+	mio_mem_free(obj_tierd.td_buckets);
+	mio_mem_free(obj_tierd.td_cands);
+	obj_tierd.td_buckets = NULL;
+	obj_tierd.td_cands = NULL;
+	obj_tierd.td_nr_cands = 0;
+	obj_tierd.td_max_nr_cands = 0;
+	obj_tierd.td_next_cand = 0;
+}
+
+/*
+ *  Local variables:
+ *  c-indentation-style: "K&R"
+ *  c-basic-offset: 8
+ *  tab-width: 8
+ *  fill-column: 80
+ *  scroll-step: 1
+ *  End:
+ */
+/*
+ * vim: tabstop=8 shiftwidth=8 noexpandtab textwidth=80 nowrap
+ *
+ */
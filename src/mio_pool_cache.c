@@ -0,0 +1,413 @@
+/* -*- C -*- */
+/*
+ * Copyright: (c) 2020 - 2021 Seagate Technology LLC and/or its its Affiliates,
+ * All Rights Reserved
+ *
+ * This software is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ */
+
+#include <errno.h>
+#include <assert.h>
+#include <string.h>
+#include <pthread.h>
+
+#include "logger.h"
+#include "utils.h"
+#include "mio.h"
+#include "mio_internal.h"
+#include "mio_telemetry.h"
+
+/**
+ * Pool state cache.
+ *
+ * The cache keeps the descriptor, capacity and free space of each
+ * configured pool. It is filled by mio_init() and refreshed by a
+ * background thread every MIO_POOL_STATE_REFRESH_INTERVAL ms, pool
+ * queries (mio_pool_get(), mio_pool_get_all(), mio_pool_borrow() and
+ * mio_pool_freespace()) are answered from it without calling into the
+ * driver.
+ *
+ * A descriptor is immutable once published. It is only recomputed by
+ * the driver (mpo_get()) when the pool's version, as told by the
+ * driver's optional mpo_version() op, has changed, or on every refresh
+ * if the driver can't tell. A recomputed descriptor that differs from
+ * the published one replaces it, the old one is retired but not freed
+ * until mio_fini(), so that pointers handed out by mio_pool_borrow()
+ * stay valid. An identical one is dropped, so descriptors are only
+ * retired when the pool really changes, which is rare.
+ *
+ * Capacity and free space come from the driver's optional
+ * mpo_freespace() op. Pools whose driver can't tell are taken as never
+ * full.
+ *
+ * Object placement uses the cache to avoid full pools: when the pool
+ * chosen by hints has used more than the high-water mark
+ * (MIO_POOL_HIGH_WATERMARK percent of its capacity), the object goes to
+ * the next pool below it in the pool ranking that is under the mark,
+ * or failing that the nearest one above. If all pools are over the mark
+ * the chosen pool is kept. Each spill is reported as a telemetry record
+ * "mio-pool-spill" {from pool index, to pool index, percentage of the
+ * capacity used in the `from` pool, high-water mark}.
+ */
+
+enum {
+	/* In milliseconds. */
+	POOL_CACHE_DEFAULT_REFRESH_INTERVAL = 10000,
+	/* In percentage of pool capacity. */
+	POOL_CACHE_DEFAULT_HIGH_WATERMARK = 90,
+};
+
+struct pool_desc {
+	struct mio_pool pd_pool;
+	struct pool_desc *pd_next;
+};
+
+struct pool_state {
+	/* The published descriptor, read with atomic loads. */
+	struct pool_desc *ps_desc;
+	bool ps_has_version;
+	struct mio_pool_id ps_version;
+
+	/* Set if the driver reports capacity and free space. */
+	bool ps_has_space;
+	size_t ps_capacity;
+	size_t ps_freespace;
+};
+
+struct pool_cache {
+	pthread_mutex_t pc_lock;
+	struct mio_bg_thread pc_thread;
+
+	/* In nano-seconds. */
+	uint64_t pc_interval;
+	int pc_high_watermark;
+
+	int pc_nr_pools;
+	struct pool_state *pc_states;
+	/* Replaced descriptors, freed by mio_pool_cache_fini(). */
+	struct pool_desc *pc_retired;
+};
+
+static struct pool_cache pool_cache = {
+	.pc_lock = PTHREAD_MUTEX_INITIALIZER,
+	.pc_thread = MIO_BG_THREAD_INITIALIZER,
+};
+
+#define drv_pool_ops (mio_instance->m_driver->md_pool_ops)
+
+/*
+ * The pool set is fixed by the configuration and ordered the same as
+ * mio_pools, so pools are looked up there without taking the lock.
+ */
+static int pool_cache_idx(const struct mio_pool_id *pool_id)
+{
+	int i;
+	struct mio_pool_id *id;
+
+	for (i = 0; i < pool_cache.pc_nr_pools; i++) {
+		id = &mio_pools.mps_pools[i].mp_id;
+		if (id->mpi_hi == pool_id->mpi_hi &&
+		    id->mpi_lo == pool_id->mpi_lo)
+			return i;
+	}
+	return -ENOENT;
+}
+
+/**
+ * Recomputes the descriptor of pool `idx` if its version has changed.
+ * The driver is called without the cache lock held.
+ */
+static int pool_cache_desc_refresh(int idx)
+{
+	int rc;
+	bool has_version = false;
+	struct mio_pool_id version = { 0, 0 };
+	struct pool_desc *desc;
+	struct pool_state *state = pool_cache.pc_states + idx;
+	const struct mio_pool_id *pool_id = &mio_pools.mps_pools[idx].mp_id;
+
+	if (drv_pool_ops->mpo_version != NULL &&
+	    drv_pool_ops->mpo_version(pool_id, &version) == 0) {
+		has_version = true;
+		pthread_mutex_lock(&pool_cache.pc_lock);
+		rc = state->ps_has_version &&
+		     state->ps_version.mpi_hi == version.mpi_hi &&
+		     state->ps_version.mpi_lo == version.mpi_lo;
+		pthread_mutex_unlock(&pool_cache.pc_lock);
+		if (rc)
+			return 0;
+	}
+
+	desc = mio_mem_alloc(sizeof *desc);
+	if (desc == NULL)
+		return -ENOMEM;
+	mio_mem_copy(&desc->pd_pool, mio_pools.mps_pools + idx,
+		     sizeof desc->pd_pool);
+	rc = drv_pool_ops->mpo_get(pool_id, &desc->pd_pool);
+	if (rc < 0) {
+		mio_mem_free(desc);
+		return rc;
+	}
+
+	/*
+	 * Keep the published descriptor if nothing has changed, so that
+	 * a descriptor is only retired on a real change and the retired
+	 * list doesn't grow on every refresh of drivers without versions.
+	 */
+	pthread_mutex_lock(&pool_cache.pc_lock);
+	if (memcmp(&state->ps_desc->pd_pool, &desc->pd_pool,
+		   sizeof desc->pd_pool) == 0) {
+		mio_mem_free(desc);
+	} else {
+		state->ps_desc->pd_next = pool_cache.pc_retired;
+		pool_cache.pc_retired = state->ps_desc;
+		__atomic_store_n(&state->ps_desc, desc, __ATOMIC_RELEASE);
+	}
+	state->ps_has_version = has_version;
+	state->ps_version = version;
+	pthread_mutex_unlock(&pool_cache.pc_lock);
+	return 0;
+}
+
+static int pool_cache_refresh_one(int idx)
+{
+	int rc;
+	bool has_space = false;
+	size_t capacity = 0;
+	size_t freespace = 0;
+	struct pool_state *state = pool_cache.pc_states + idx;
+	const struct mio_pool_id *pool_id = &mio_pools.mps_pools[idx].mp_id;
+
+	rc = pool_cache_desc_refresh(idx);
+	if (drv_pool_ops->mpo_freespace != NULL &&
+	    drv_pool_ops->mpo_freespace(pool_id, &capacity, &freespace) == 0)
+		has_space = true;
+
+	pthread_mutex_lock(&pool_cache.pc_lock);
+	state->ps_has_space = has_space;
+	state->ps_capacity = capacity;
+	state->ps_freespace = freespace;
+	pthread_mutex_unlock(&pool_cache.pc_lock);
+	return rc;
+}
+
+static void pool_cache_refresh()
+{
+	int i;
+	int rc;
+
+	for (i = 0; i < pool_cache.pc_nr_pools; i++) {
+		rc = pool_cache_refresh_one(i);
+		if (rc < 0)
+			mio_log(MIO_WARN,
+				"Refreshing state of pool %s failed: %d\n",
+				mio_pools.mps_pools[i].mp_name, rc);
+	}
+}
+
+const struct mio_pool *mio_pool_cache_borrow(const struct mio_pool_id *pool_id)
+{
+	int idx;
+	struct pool_desc *desc;
+
+	idx = pool_cache_idx(pool_id);
+	if (idx < 0)
+		return NULL;
+	desc = __atomic_load_n(&pool_cache.pc_states[idx].ps_desc,
+			       __ATOMIC_ACQUIRE);
+	return &desc->pd_pool;
+}
+
+int mio_pool_cache_get(const struct mio_pool_id *pool_id,
+		       struct mio_pool *pool)
+{
+	const struct mio_pool *cached;
+
+	cached = mio_pool_cache_borrow(pool_id);
+	if (cached == NULL)
+		return -EINVAL;
+	*pool = *cached;
+	return 0;
+}
+
+int mio_pool_cache_freespace(const struct mio_pool_id *pool_id,
+			     size_t *freespace)
+{
+	int rc;
+	int idx;
+	struct pool_state *state;
+
+	idx = pool_cache_idx(pool_id);
+	pthread_mutex_lock(&pool_cache.pc_lock);
+	if (idx < 0)
+		rc = -EINVAL;
+	else {
+		state = pool_cache.pc_states + idx;
+		rc = state->ps_has_space? 0 : -EOPNOTSUPP;
+		*freespace = state->ps_freespace;
+	}
+	pthread_mutex_unlock(&pool_cache.pc_lock);
+	return rc;
+}
+
+/* Must be called with the cache lock held. */
+static int pool_cache_used_pct(int idx)
+{
+	struct pool_state *state = pool_cache.pc_states + idx;
+
+	if (!state->ps_has_space || state->ps_capacity == 0)
+		return 0;
+	if (state->ps_freespace >= state->ps_capacity)
+		return 0;
+	return (state->ps_capacity - state->ps_freespace) * 100 /
+	       state->ps_capacity;
+}
+
+/* Must be called with the cache lock held. */
+static bool pool_cache_is_full(int idx)
+{
+	return pool_cache_used_pct(idx) >= pool_cache.pc_high_watermark;
+}
+
+int mio_pool_cache_spill(int pool_idx)
+{
+	int i;
+	int to = -1;
+	uint64_t used_pct;
+	uint64_t hwm;
+
+	pthread_mutex_lock(&pool_cache.pc_lock);
+	if (pool_idx < 0 || pool_idx >= pool_cache.pc_nr_pools ||
+	    !pool_cache_is_full(pool_idx)) {
+		pthread_mutex_unlock(&pool_cache.pc_lock);
+		return pool_idx;
+	}
+
+	/* Pools are ranked from the highest performance to the lowest. */
+	for (i = pool_idx + 1; i < pool_cache.pc_nr_pools && to < 0; i++)
+		if (!pool_cache_is_full(i))
+			to = i;
+	for (i = pool_idx - 1; i >= 0 && to < 0; i--)
+		if (!pool_cache_is_full(i))
+			to = i;
+	used_pct = pool_cache_used_pct(pool_idx);
+	hwm = pool_cache.pc_high_watermark;
+	pthread_mutex_unlock(&pool_cache.pc_lock);
+
+	if (to < 0) {
+		mio_log(MIO_WARN, "All pools are over the high-water mark!\n");
+		return pool_idx;
+	}
+
+	mio_log(MIO_INFO, "Pool %s is %"PRIu64"%% full, spilling to %s\n",
+		mio_pools.mps_pools[pool_idx].mp_name, used_pct,
+		mio_pools.mps_pools[to].mp_name);
+	mio_telemetry_array_advertise_noprefix(
+		"mio-pool-spill", MIO_TM_TYPE_ARRAY_UINT64, 4,
+		(uint64_t)pool_idx, (uint64_t)to, used_pct, hwm);
+	return to;
+}
+
+static void pool_cache_refresher_run()
+{
+	struct mio_bg_thread *bt = &pool_cache.pc_thread;
+
+	pthread_mutex_lock(&bt->bt_lock);
+	while (!bt->bt_stopping) {
+		mio_bg_thread_wait(bt, pool_cache.pc_interval);
+		if (bt->bt_stopping)
+			break;
+		pthread_mutex_unlock(&bt->bt_lock);
+		pool_cache_refresh();
+		pthread_mutex_lock(&bt->bt_lock);
+	}
+	pthread_mutex_unlock(&bt->bt_lock);
+}
+
+int mio_pool_cache_init()
+{
+	int i;
+	int rc;
+	int nr_pools = mio_pools.mps_nr_pools;
+	uint64_t interval;
+	struct pool_state *states;
+
+	if (nr_pools == 0)
+		return 0;
+	if (mio_instance->m_pool_high_watermark < 0 ||
+	    mio_instance->m_pool_high_watermark > 100)
+		return -EINVAL;
+
+	/* Until refreshed, descriptors are as configured. */
+	states = mio_mem_alloc(nr_pools * sizeof *states);
+	if (states == NULL)
+		return -ENOMEM;
+	for (i = 0; i < nr_pools; i++) {
+		states[i].ps_desc = mio_mem_alloc(sizeof *states[i].ps_desc);
+		if (states[i].ps_desc == NULL) {
+			while (--i >= 0)
+				mio_mem_free(states[i].ps_desc);
+			mio_mem_free(states);
+			return -ENOMEM;
+		}
+		mio_mem_copy(&states[i].ps_desc->pd_pool,
+			     mio_pools.mps_pools + i,
+			     sizeof states[i].ps_desc->pd_pool);
+	}
+
+	pthread_mutex_lock(&pool_cache.pc_lock);
+	pool_cache.pc_states = states;
+	pool_cache.pc_nr_pools = nr_pools;
+	interval = mio_instance->m_pool_state_refresh_interval?:
+		   POOL_CACHE_DEFAULT_REFRESH_INTERVAL;
+	pool_cache.pc_interval = interval * 1000000ULL;
+	pool_cache.pc_high_watermark = mio_instance->m_pool_high_watermark?:
+				       POOL_CACHE_DEFAULT_HIGH_WATERMARK;
+	pthread_mutex_unlock(&pool_cache.pc_lock);
+
+	/* Queries are answered from the cache from now on. */
+	pool_cache_refresh();
+
+	rc = mio_bg_thread_start(&pool_cache.pc_thread,
+				 pool_cache_refresher_run);
+	if (rc < 0)
+		mio_log(MIO_ERROR, "Starting pool refresher failed: %d\n", rc);
+	return rc;
+}
+
+void mio_pool_cache_fini()
+{
+	int i;
+	struct pool_desc *desc;
+
+	mio_bg_thread_stop(&pool_cache.pc_thread);
+
+	pthread_mutex_lock(&pool_cache.pc_lock);
+	for (i = 0; i < pool_cache.pc_nr_pools; i++)
+		mio_mem_free(pool_cache.pc_states[i].ps_desc);
+	while (pool_cache.pc_retired != NULL) {
+		desc = pool_cache.pc_retired;
+		pool_cache.pc_retired = desc->pd_next;
+		mio_mem_free(desc);
+	}
+	mio_mem_free(pool_cache.pc_states);
+	pool_cache.pc_states = NULL;
+	pool_cache.pc_nr_pools = 0;
+	pthread_mutex_unlock(&pool_cache.pc_lock);
+}
+
+/*
+ *  Local variables:
+ *  c-indentation-style: "K&R"
+ *  c-basic-offset: 8
+ *  tab-width: 8
+ *  fill-column: 80
+ *  scroll-step: 1
+ *  End:
+ */
+/*
+ * vim: tabstop=8 shiftwidth=8 noexpandtab textwidth=80 nowrap
+ *
+ */
@@ -0,0 +1,253 @@
+/* -*- C -*- */
+/*
+ * Copyright: (c) 2020 - 2021 Seagate Technology LLC and/or its its Affiliates,
+ * All Rights Reserved
+ *
+ * This software is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ */
+
+#include <errno.h>
+#include <assert.h>
+#include <string.h>
+#include <pthread.h>
+
+#include "logger.h"
+#include "utils.h"
+#include "mio.h"
+#include "mio_internal.h"
+
+/**
+ * System hints.
+ *
+ * System hints of type MIO_HINT_PERSISTENT are shared by all clients:
+ * mio_sys_hint_set() stores them in the system hint key-value set
+ * `mio_sys_hints_kvs` (created by the driver) before updating the
+ * in-memory map. Each record is keyed by the hint's name, which keeps
+ * records valid when hints are added, and holds the value as a
+ * big-endian uint64_t.
+ *
+ * mio_init() loads the stored hints and a background thread reloads
+ * them every MIO_SYS_HINTS_REFRESH_INTERVAL ms, so a hint set by one
+ * client is seen by others within the interval. mio_sys_hint_get() only
+ * reads the in-memory map, which is guarded by a read-write lock.
+ * Session system hints stay local to the process.
+ */
+
+enum {
+	/* In milliseconds. */
+	SYS_HINTS_DEFAULT_REFRESH_INTERVAL = 60000,
+};
+
+struct sys_hints_refresher {
+	struct mio_bg_thread shr_thread;
+
+	/* In nano-seconds. */
+	uint64_t shr_interval;
+};
+
+static struct sys_hints_refresher sys_hints_refresher = {
+	.shr_thread = MIO_BG_THREAD_INITIALIZER,
+};
+
+struct mio_hints mio_sys_hints;
+static pthread_rwlock_t sys_hints_lock = PTHREAD_RWLOCK_INITIALIZER;
+
+static bool sys_hint_is_persistent(int hint_key)
+{
+	return mio_hint_type(MIO_HINT_SCOPE_SYS, hint_key) ==
+	       MIO_HINT_PERSISTENT;
+}
+
+static void sys_hint_key_set(struct mio_kv_pair *kvp, int hint_key)
+{
+	char *name;
+
+	name = mio_hint_name(MIO_HINT_SCOPE_SYS, hint_key);
+	kvp->mkp_key = name;
+	kvp->mkp_klen = strlen(name);
+}
+
+static int sys_hint_store(int hint_key, uint64_t hint_value)
+{
+	int rc;
+	int32_t rcs[1] = {0};
+	uint64_t value;
+	struct mio_op op;
+	struct mio_kv_pair kvp;
+
+	value = mio_byteorder_cpu_to_be64(hint_value);
+	sys_hint_key_set(&kvp, hint_key);
+	kvp.mkp_val = &value;
+	kvp.mkp_vlen = sizeof value;
+
+	mio_op_init(&op);
+	rc = mio_kvs_pair_put(&mio_sys_hints_kvs.mk_id, 1, &kvp, rcs, &op)? :
+	     mio_op_wait(&op);
+	mio_op_fini(&op);
+	return rc? : rcs[0];
+}
+
+/**
+ * Loads all persistent system hints from the system hint key-value set.
+ * Hints which haven't been stored keep their in-memory value.
+ */
+static int sys_hints_load()
+{
+	int i;
+	int rc;
+	int nr_keys = 0;
+	int keys[MIO_HINT_SYS_KEY_NUM];
+	int32_t rcs[MIO_HINT_SYS_KEY_NUM];
+	uint64_t value;
+	struct mio_op op;
+	struct mio_kv_pair kvps[MIO_HINT_SYS_KEY_NUM];
+
+	mio_memset(kvps, 0, sizeof kvps);
+	mio_memset(rcs, 0, sizeof rcs);
+	for (i = 0; i < MIO_HINT_SYS_KEY_NUM; i++) {
+		if (!sys_hint_is_persistent(i))
+			continue;
+		keys[nr_keys] = i;
+		sys_hint_key_set(kvps + nr_keys, i);
+		nr_keys++;
+	}
+	if (nr_keys == 0)
+		return 0;
+
+	mio_op_init(&op);
+	rc = mio_kvs_pair_get(&mio_sys_hints_kvs.mk_id, nr_keys,
+			      kvps, rcs, &op)? :
+	     mio_op_wait(&op);
+	mio_op_fini(&op);
+	if (rc < 0)
+		return rc;
+
+	pthread_rwlock_wrlock(&sys_hints_lock);
+	for (i = 0; i < nr_keys; i++) {
+		if (rcs[i] != 0 || kvps[i].mkp_vlen != sizeof value)
+			continue;
+		mio_mem_copy(&value, kvps[i].mkp_val, sizeof value);
+		mio_hint_map_set(&mio_sys_hints.mh_map, keys[i],
+				 mio_byteorder_be64_to_cpu(value));
+	}
+	pthread_rwlock_unlock(&sys_hints_lock);
+
+	for (i = 0; i < nr_keys; i++)
+		mio_mem_free(kvps[i].mkp_val);
+	return 0;
+}
+
+int mio_sys_hint_set(int hint_key, uint64_t hint_value)
+{
+	int rc;
+
+	if (mio_hint_name(MIO_HINT_SCOPE_SYS, hint_key) == NULL)
+		return -EINVAL;
+
+	if (sys_hint_is_persistent(hint_key)) {
+		rc = sys_hint_store(hint_key, hint_value);
+		if (rc < 0) {
+			mio_log(MIO_ERROR,
+				"Storing system hint failed! error = %d\n", rc);
+			return rc;
+		}
+	}
+
+	pthread_rwlock_wrlock(&sys_hints_lock);
+	rc = mio_hint_add(&mio_sys_hints, hint_key, hint_value);
+	pthread_rwlock_unlock(&sys_hints_lock);
+	if (rc < 0) {
+		mio_log(MIO_ERROR,
+			"Set system hint failed! error = %d\n", rc);
+		return rc;
+	}
+
+	return 0;
+}
+
+int mio_sys_hint_get(int hint_key, uint64_t *hint_value)
+{
+	int rc;
+
+	pthread_rwlock_rdlock(&sys_hints_lock);
+	rc = mio_hint_lookup(&mio_sys_hints, hint_key, hint_value);
+	pthread_rwlock_unlock(&sys_hints_lock);
+	return rc;
+}
+
+static void sys_hints_refresher_run()
+{
+	int rc;
+	struct mio_bg_thread *bt = &sys_hints_refresher.shr_thread;
+
+	pthread_mutex_lock(&bt->bt_lock);
+	while (!bt->bt_stopping) {
+		mio_bg_thread_wait(bt, sys_hints_refresher.shr_interval);
+		if (bt->bt_stopping)
+			break;
+		pthread_mutex_unlock(&bt->bt_lock);
+		rc = sys_hints_load();
+		if (rc < 0)
+			mio_log(MIO_WARN,
+				"Reloading system hints failed: %d\n", rc);
+		pthread_mutex_lock(&bt->bt_lock);
+	}
+	pthread_mutex_unlock(&bt->bt_lock);
+}
+
+int mio_sys_hints_init()
+{
+	int rc;
+	uint64_t interval;
+
+	rc = mio_hints_init(&mio_sys_hints);
+	if (rc < 0)
+		return rc;
+
+	rc = sys_hints_load();
+	if (rc < 0) {
+		mio_log(MIO_ERROR, "Loading system hints failed: %d\n", rc);
+		goto error;
+	}
+
+	interval = mio_instance->m_sys_hints_refresh_interval?:
+		   SYS_HINTS_DEFAULT_REFRESH_INTERVAL;
+	sys_hints_refresher.shr_interval = interval * 1000000ULL;
+	rc = mio_bg_thread_start(&sys_hints_refresher.shr_thread,
+				 sys_hints_refresher_run);
+	if (rc < 0) {
+		mio_log(MIO_ERROR,
+			"Starting system hint refresher failed: %d\n", rc);
+		goto error;
+	}
+	return 0;
+
+error:
+	mio_hints_fini(&mio_sys_hints);
+	return rc;
+}
+
+void mio_sys_hints_fini()
+{
+	mio_bg_thread_stop(&sys_hints_refresher.shr_thread);
+
+	pthread_rwlock_wrlock(&sys_hints_lock);
+	mio_hints_fini(&mio_sys_hints);
+	pthread_rwlock_unlock(&sys_hints_lock);
+}
+
+/*
+ *  Local variables:
+ *  c-indentation-style: "K&R"
+ *  c-basic-offset: 8
+ *  tab-width: 8
+ *  fill-column: 80
+ *  scroll-step: 1
+ *  End:
+ */
+/*
+ * vim: tabstop=8 shiftwidth=8 noexpandtab textwidth=80 nowrap
+ *
+ */
@@ -8,6 +8,7 @@
  * file, You can obtain one at http://mozilla.org/MPL/2.0/.
  */
 
+#include <errno.h>
 #include <stdlib.h>
 #include <string.h>
 #include <stddef.h> 
@@ -67,6 +68,53 @@ uint64_t mio_time_nanoseconds(uint64_t time_in_nanosecs)
 	return time_in_nanosecs % TIME_ONE_SECOND;
 }
 
+/* 64-bit FNV-1a hash. */
+uint64_t mio_hash_fnv1a(const void *buf, size_t len)
+{
+	size_t i;
+	uint64_t hash = 0xcbf29ce484222325ULL;
+	const uint8_t *p = buf;
+
+	for (i = 0; i < len; i++) {
+		hash ^= p[i];
+		hash *= 0x100000001b3ULL;
+	}
+	return hash;
+}
+
+/*
+ * Unsigned LEB128: 7 bits per byte, least significant group first, the
+ * top bit set on all bytes but the last.
+ */
+int mio_varint_encode(uint64_t value, void *buf)
+{
+	int len = 0;
+	uint8_t *p = buf;
+
+	while (value >= 0x80) {
+		p[len++] = (value & 0x7f) | 0x80;
+		value >>= 7;
+	}
+	p[len++] = value;
+	return len;
+}
+
+int mio_varint_decode(const void *buf, size_t buf_len, uint64_t *value)
+{
+	size_t i;
+	uint64_t v = 0;
+	const uint8_t *p = buf;
+
+	for (i = 0; i < buf_len && i < MIO_VARINT_MAX_LEN; i++) {
+		v |= (uint64_t)(p[i] & 0x7f) << (7 * i);
+		if (!(p[i] & 0x80)) {
+			*value = v;
+			return i + 1;
+		}
+	}
+	return -EIO;
+}
+
 uint64_t mio_byteorder_cpu_to_be64(uint64_t cpu_64bits)
 {
         return __cpu_to_be64(cpu_64bits);
@@ -19,6 +19,20 @@ uint64_t mio_now();
 uint64_t mio_time_seconds(uint64_t time_in_nanosecs);
 uint64_t mio_time_nanoseconds(uint64_t time_in_nanosecs);
 
+uint64_t mio_hash_fnv1a(const void *buf, size_t len);
+
+/**
+ * Variable-length encoding of unsigned integers. mio_varint_encode()
+ * returns the number of bytes written (at most MIO_VARINT_MAX_LEN) and
+ * mio_varint_decode() the number of bytes read, or -EIO if `buf` doesn't
+ * start with a complete varint.
+ */
+enum {
+	MIO_VARINT_MAX_LEN = 10
+};
+int mio_varint_encode(uint64_t value, void *buf);
+int mio_varint_decode(const void *buf, size_t buf_len, uint64_t *value);
+
 uint64_t mio_byteorder_cpu_to_be64(uint64_t cpu_64bits);
 uint64_t mio_byteorder_be64_to_cpu(uint64_t big_endian_64bits);
 uint16_t mio_byteorder_cpu_to_le16(uint16_t cpu_16bits);
@@ -50,6 +50,85 @@ kvs_create_query_delete_test()
 	return 0
 }
 
+kvs_count_check()
+{
+	local kid=$1
+	local yaml=$2
+	local st_key=$3
+	local nkeys=$4
+	local expected=$5
+	local clog=$MIO_SANDBOX_DIR/kvs_count.log
+
+	kvs_count_range "$kid" "$yaml" "$st_key" "$nkeys" "$clog" &>> "$MIO_TEST_LOG"
+	if [ $? -ne "0" ]
+	then
+		return 1
+	fi
+
+	if [ "$(cat $clog)" != "$expected" ]
+	then
+		echo "Found $(cat $clog) pairs in range, $expected expected."
+		return 1
+	fi
+
+	return 0
+}
+
+kvs_del_range_test()
+{
+	local kid="7:12345679"
+	local st_key=10000
+	local nkeys=8000
+	local yaml=$MIO_TESTS_DIR/mio_config.yaml
+
+	kvs_create "$kid" "$yaml" &>> "$MIO_TEST_LOG"
+	if [ $? -ne "0" ]
+	then
+		return 1
+	fi
+
+	# Keys 10000 to 17999, all of 5 digits so that they sort as numbers.
+	kvs_insert_pairs "$kid" "$yaml" "$st_key" "$nkeys" /dev/null &>> "$MIO_TEST_LOG"
+	if [ $? -ne "0" ]
+	then
+		kvs_delete "$kid" "$yaml" &>> "$MIO_TEST_LOG"
+		return 1
+	fi
+
+	kvs_count_check "$kid" "$yaml" "$st_key" "$nkeys" 8000 &>> "$MIO_TEST_LOG"
+	if [ $? -ne "0" ]
+	then
+		kvs_delete "$kid" "$yaml" &>> "$MIO_TEST_LOG"
+		return 1
+	fi
+
+	# Delete keys 11000 to 16999, several NEXT pages.
+	kvs_del_range "$kid" "$yaml" 11000 6000 &>> "$MIO_TEST_LOG"
+	if [ $? -ne "0" ]
+	then
+		kvs_delete "$kid" "$yaml" &>> "$MIO_TEST_LOG"
+		return 1
+	fi
+
+	kvs_count_check "$kid" "$yaml" "$st_key" "$nkeys" 2000 &>> "$MIO_TEST_LOG" &&
+	kvs_count_check "$kid" "$yaml" 11000 6000 0 &>> "$MIO_TEST_LOG" &&
+	kvs_count_check "$kid" "$yaml" 10000 1000 1000 &>> "$MIO_TEST_LOG" &&
+	kvs_count_check "$kid" "$yaml" 17000 1000 1000 &>> "$MIO_TEST_LOG"
+	if [ $? -ne "0" ]
+	then
+		kvs_delete "$kid" "$yaml" &>> "$MIO_TEST_LOG"
+		return 1
+	fi
+
+	kvs_delete "$kid" "$yaml" &>> "$MIO_TEST_LOG"
+	if [ $? -ne "0" ]
+	then
+		return 1
+	fi
+
+	return 0
+}
+
 mio_kvs_tests()
 {
 	kvs_create_query_delete_test "$1"
@@ -60,5 +139,13 @@ mio_kvs_tests()
 		printf "\tkvs_create_query_delete_test:  passed\n"
 	fi
 
+	kvs_del_range_test
+	if [ $? -ne "0" ]; then
+		printf "\tkvs_del_range_test:  failed\n"
+		return 1
+	else
+		printf "\tkvs_del_range_test:  passed\n"
+	fi
+
 	return 0
 }
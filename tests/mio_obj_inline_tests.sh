@@ -0,0 +1,124 @@
+#!/usr/bin/env bash
+
+# Keep the data of objects smaller than 4KB in the attribute index.
+obj_inline_yaml()
+{
+	local yaml=$1
+
+	sed -r -e 's/^(\s*)# (MOTR_INLINE_DATA_THRESHOLD):.*/\1\2: 4096/' \
+	       "$MIO_TESTS_DIR"/mio_config.yaml > "$yaml"
+}
+
+obj_inline_test()
+{
+	local oid="1:12349201"
+	local yaml=$MIO_SANDBOX_DIR/mio_config_inline.yaml
+	local mio_inline=$MIO_UTILS_DIR/mio_obj_inline
+
+	obj_inline_yaml "$yaml"
+
+	test_eval "$mio_inline -o $oid -y $yaml \
+		   &>> $MIO_TEST_LOG" &>> "$MIO_TEST_LOG"
+	if [ $? -ne "0" ]
+	then
+		return 1
+	fi
+
+	return 0
+}
+
+# Objects below, across and above the threshold, written and read by
+# separate processes.
+obj_inline_io_test()
+{
+	local yaml=$MIO_SANDBOX_DIR/mio_config_inline.yaml
+
+	obj_inline_yaml "$yaml"
+
+	for io_size in 1024 3072
+	do
+		for io_count in 1 2 4
+		do
+			obj_write_read_cmp $io_size $io_count 0 $yaml \
+				&>> $MIO_TEST_LOG
+			if [ $? -ne "0" ]
+			then
+				return 1
+			fi
+		done
+	done
+
+	return 0
+}
+
+# An inline object has no store entity until it is migrated, which has to
+# give it one first.
+obj_inline_migrate_test()
+{
+	local oid="1:12349202"
+	local io_size=1024
+	local io_count=2
+	local yaml=$MIO_SANDBOX_DIR/mio_config_inline.yaml
+	local input=$MIO_SANDBOX_DIR/inline.in
+	local mio_migrate=$MIO_UTILS_DIR/mio_obj_migrate
+	local pool_id=
+
+	obj_inline_yaml "$yaml"
+	pool_id="$(sed -r '/^(\s*#|$)/d;' "$yaml" | awk '/MOTR_POOL_ID/{print $NF; exit}')"
+
+	dd_file $io_size $io_count $input &>> $MIO_TEST_LOG
+	if [ $? -ne 0 ]; then
+		return 1
+	fi
+
+	obj_write $io_size $io_count $oid $yaml 0 $input &>> $MIO_TEST_LOG
+	if [ $? -ne 0 ]; then
+		obj_cleanup $oid $yaml
+		return 1
+	fi
+
+	test_eval "$mio_migrate -o $oid -p $pool_id -y $yaml \
+		   &>> $MIO_TEST_LOG" &>> "$MIO_TEST_LOG"
+	if [ $? -ne 0 ]; then
+		obj_cleanup $oid $yaml
+		return 1
+	fi
+
+	obj_migrate_read_cmp $oid $io_size $io_count $yaml $input
+	if [ $? -ne 0 ]; then
+		obj_cleanup $oid $yaml
+		return 1
+	fi
+
+	obj_cleanup $oid $yaml &>> $MIO_TEST_LOG
+	return $?
+}
+
+mio_obj_inline_tests()
+{
+	obj_inline_test
+	if [ $? -ne "0" ]; then
+		printf "\tobj_inline_test:  failed\n"
+		return 1
+	else
+		printf "\tobj_inline_test:  passed\n"
+	fi
+
+	obj_inline_io_test
+	if [ $? -ne "0" ]; then
+		printf "\tobj_inline_io_test:  failed\n"
+		return 1
+	else
+		printf "\tobj_inline_io_test:  passed\n"
+	fi
+
+	obj_inline_migrate_test
+	if [ $? -ne "0" ]; then
+		printf "\tobj_inline_migrate_test:  failed\n"
+		return 1
+	else
+		printf "\tobj_inline_migrate_test:  passed\n"
+	fi
+
+	return 0
+}
@@ -0,0 +1,115 @@
+#!/usr/bin/env bash
+
+obj_migrate_read_cmp()
+{
+	local oid=$1
+	local io_size=$2
+	local io_count=$3
+	local yaml=$4
+	local input=$5
+	local output=$MIO_SANDBOX_DIR/migrate.out
+
+	rm -f $output
+	obj_read $io_size $io_count $oid $yaml 0 $output &>> $MIO_TEST_LOG
+	if [ $? -ne 0 ]; then
+		return 1
+	fi
+
+	if ! cmp $input $output
+	then
+		echo -n "Failed: data written and data read from the migrated "
+		echo    "object are not same."
+		return 1
+	fi
+
+	return 0
+}
+
+obj_migrate_test()
+{
+	local oid="1:12349001"
+	local io_size=$((64 * 1024))
+	local io_count=80
+	local yaml=$MIO_TESTS_DIR/mio_config.yaml
+	local input=$MIO_SANDBOX_DIR/migrate.in
+	local input2=$MIO_SANDBOX_DIR/migrate2.in
+	local mio_migrate=$MIO_UTILS_DIR/mio_obj_migrate
+	local pool_ids=
+
+	pool_ids="$(sed -r '/^(\s*#|$)/d;' "$yaml" | awk '/MOTR_POOL_ID/{print $NF}')"
+
+	dd_file $io_size $io_count $input &>> $MIO_TEST_LOG
+	if [ $? -ne 0 ]; then
+		return 1
+	fi
+
+	obj_write $io_size $io_count $oid $yaml 0 $input &>> $MIO_TEST_LOG
+	if [ $? -ne 0 ]; then
+		obj_cleanup $oid $yaml
+		return 1
+	fi
+
+	# Migrate the object through every pool, the data must stay the
+	# same whichever pool it is in and whatever layers serve it.
+	for pool_id in $pool_ids;
+	do
+		test_eval "$mio_migrate -o $oid -p $pool_id -y $yaml \
+			   &>> $MIO_TEST_LOG" &>> "$MIO_TEST_LOG"
+		if [ $? -ne 0 ]; then
+			obj_cleanup $oid $yaml
+			return 1
+		fi
+
+		obj_migrate_read_cmp $oid $io_size $io_count $yaml $input
+		if [ $? -ne 0 ]; then
+			obj_cleanup $oid $yaml
+			return 1
+		fi
+	done
+
+	# Writes go to the composite object once migrated.
+	dd_file $io_size $io_count $input2 &>> $MIO_TEST_LOG
+	if [ $? -ne 0 ]; then
+		obj_cleanup $oid $yaml
+		return 1
+	fi
+
+	obj_write $io_size $io_count $oid $yaml 0 $input2 &>> $MIO_TEST_LOG
+	if [ $? -ne 0 ]; then
+		obj_cleanup $oid $yaml
+		return 1
+	fi
+
+	obj_migrate_read_cmp $oid $io_size $io_count $yaml $input2
+	if [ $? -ne 0 ]; then
+		obj_cleanup $oid $yaml
+		return 1
+	fi
+
+	obj_cleanup $oid $yaml &>> $MIO_TEST_LOG
+	if [ $? -ne 0 ]; then
+		return 1
+	fi
+
+	# The id is free again once the migrated object is deleted.
+	obj_create $oid $yaml &>> $MIO_TEST_LOG
+	if [ $? -ne 0 ]; then
+		return 1
+	fi
+
+	obj_cleanup $oid $yaml &>> $MIO_TEST_LOG
+	return $?
+}
+
+mio_obj_migrate_tests()
+{
+	obj_migrate_test
+	if [ $? -ne "0" ]; then
+		printf "\tobj_migrate_test:  failed\n"
+		return 1
+	else
+		printf "\tobj_migrate_test:  passed\n"
+	fi
+
+	return 0
+}
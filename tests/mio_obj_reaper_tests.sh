@@ -0,0 +1,43 @@
+#!/usr/bin/env bash
+
+obj_reaper_test()
+{
+	local oid="1:12349101"
+	local yaml=$MIO_SANDBOX_DIR/mio_config_reaper.yaml
+	local mio_reaper=$MIO_UTILS_DIR/mio_obj_reaper
+
+	# Run the reaper every second.
+	sed -r -e 's/^(\s*)# (MIO_OBJ_REAPER):.*/\1\2: 1/' \
+	       -e 's/^(\s*)# (MIO_OBJ_REAPER_INTERVAL):.*/\1\2: 1000/' \
+	       "$MIO_TESTS_DIR"/mio_config.yaml > "$yaml"
+
+	test_eval "$mio_reaper -o $oid -y $yaml \
+		   &>> $MIO_TEST_LOG" &>> "$MIO_TEST_LOG"
+	if [ $? -ne "0" ]
+	then
+		return 1
+	fi
+
+	# The expired object is gone for good, its id can be taken again.
+	obj_create "$oid" "$yaml" &>> "$MIO_TEST_LOG"
+	if [ $? -ne "0" ]
+	then
+		return 1
+	fi
+
+	obj_delete "$oid" "$yaml" &>> "$MIO_TEST_LOG"
+	return $?
+}
+
+mio_obj_reaper_tests()
+{
+	obj_reaper_test
+	if [ $? -ne "0" ]; then
+		printf "\tobj_reaper_test:  failed\n"
+		return 1
+	else
+		printf "\tobj_reaper_test:  passed\n"
+	fi
+
+	return 0
+}
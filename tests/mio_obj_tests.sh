@@ -25,6 +25,25 @@ obj_create_delete_test()
 	return 0
 }
 
+# Objects created, opened and deleted in bulk, along with a missing and
+# a bad one.
+obj_bulk_test()
+{
+	local nr_objs=$1
+	local oid="1:12348101"
+	local yaml=$MIO_TESTS_DIR/mio_config.yaml
+	local mio_bulk=$MIO_UTILS_DIR/mio_objs_bulk
+
+	test_eval "$mio_bulk -o $oid -n $nr_objs -y $yaml \
+		   &>> $MIO_TEST_LOG" &>> "$MIO_TEST_LOG"
+	if [ $? -ne "0" ]
+	then
+		return 1
+	fi
+
+	return 0
+}
+
 mio_obj_tests()
 {
 	obj_create_delete_test "$1"
@@ -35,5 +54,13 @@ mio_obj_tests()
 		printf "\tio_create_delete_test:  passed\n"
 	fi
 
+	obj_bulk_test "$1"
+	if [ $? -ne "0" ]; then
+		printf "\tobj_bulk_test:  failed\n"
+		return 1
+	else
+		printf "\tobj_bulk_test:  passed\n"
+	fi
+
 	return 0
 }
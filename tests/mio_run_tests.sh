@@ -22,9 +22,15 @@ MIO_NR_TEST_OBJS=1
 . "$MIO_TESTS_DIR"/mio_comp_obj_tests.sh
 . "$MIO_TESTS_DIR"/mio_pool_tests.sh
 . "$MIO_TESTS_DIR"/mio_obj_hint_tests.sh
+. "$MIO_TESTS_DIR"/mio_obj_migrate_tests.sh
+. "$MIO_TESTS_DIR"/mio_obj_reaper_tests.sh
+. "$MIO_TESTS_DIR"/mio_obj_inline_tests.sh
 
 # Define a test array: (test, test description)
 declare -A mio_test_descs
+mio_test_descs[mio_obj_inline_tests]="Inline object data tests"
+mio_test_descs[mio_obj_reaper_tests]="Object reaper tests"
+mio_test_descs[mio_obj_migrate_tests]="Object migration tests"
 mio_test_descs[mio_obj_hint_tests]="Object hint tests"
 mio_test_descs[mio_pool_tests]="Pool tests"
 mio_test_descs[mio_kvs_tests]="Key/value set (KVS) tests"
@@ -33,6 +39,9 @@ mio_test_descs[mio_obj_io_tests]="Object IO tests"
 mio_test_descs[mio_obj_tests]="Object creation and deletion tests"
 
 declare -A mio_test_params
+mio_test_params[mio_obj_inline_tests]=
+mio_test_params[mio_obj_reaper_tests]=
+mio_test_params[mio_obj_migrate_tests]=
 mio_test_params[mio_obj_hint_tests]="${MIO_NR_TEST_OBJS}"
 mio_test_params[mio_pool_tests]=
 mio_test_params[mio_kvs_tests]=
@@ -45,7 +54,10 @@ mio_all_tests="mio_obj_tests \
 	      mio_comp_obj_tests \
 	      mio_kvs_tests \
 	      mio_pool_tests \
-	      mio_obj_hint_tests"
+	      mio_obj_hint_tests \
+	      mio_obj_migrate_tests \
+	      mio_obj_reaper_tests \
+	      mio_obj_inline_tests"
 
 mio_run_test()
 {
@@ -220,3 +220,38 @@ kvs_del_pairs()
 
 	return 0
 }
+
+kvs_del_range()
+{
+	local kid=$1
+	local yaml=$2
+	local st_key=$3
+	local nkeys=$4
+	local kvs_del_range=$MIO_UTILS_DIR/mio_kvs_del_range
+
+	test_eval "$kvs_del_range -k $kid -y $yaml -s $st_key -n $nkeys"
+	if [ $? -ne 0 ]; then
+		echo "Failed to delete pairs in range from key-value set $kid."
+		return 1
+	fi
+
+	return 0
+}
+
+kvs_count_range()
+{
+	local kid=$1
+	local yaml=$2
+	local st_key=$3
+	local nkeys=$4
+	local output=$5
+	local kvs_count_range=$MIO_UTILS_DIR/mio_kvs_count_range
+
+	test_eval "$kvs_count_range -k $kid -y $yaml -s $st_key -n $nkeys -l $output"
+	if [ $? -ne 0 ]; then
+		echo "Failed to count pairs in range of key-value set $kid."
+		return 1
+	fi
+
+	return 0
+}